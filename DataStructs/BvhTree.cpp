@@ -0,0 +1,509 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// BvhTree.cpp
+//
+//   A bounding volume hierarchy with four children per node.  See BvhTree.h.
+
+#include <assert.h>
+#include <math.h>
+
+// C++ STL headers
+#include <algorithm>
+#include <chrono>
+
+#include "BvhTree.h"
+
+// Center of the box along one axis
+static inline double Centroid( const AABB& box, int axis )
+{
+	return 0.5*(box.GetBoxMin()[axis]+box.GetBoxMax()[axis]);
+}
+
+// Bin of a centroid, for the bins that divide the axis from minOnAxis, scale bins per unit.
+static inline int SplitBin( double centroid, double minOnAxis, double scale )
+{
+	int bin = (int)((centroid-minOnAxis)*scale);
+	return Min( bin, BvhTree::NumSplitBins-1 );
+}
+
+// Float values rounded down and up, so the float boxes enclose the double boxes.
+static inline float RoundDown( double x )
+{
+	float f = (float)x;
+	return ( (double)f>x ) ? nextafterf( f, -FLT_MAX ) : f;
+}
+
+static inline float RoundUp( double x )
+{
+	float f = (float)x;
+	return ( (double)f<x ) ? nextafterf( f, FLT_MAX ) : f;
+}
+
+// The ray in float, for BvhNode::IntersectBoxes.  slack allows for the rounding of startPos.
+static void SetFloatRay( const VectorR3& startPos, const VectorR3& dir,
+						 float rayStart[3], float dirInv[3], float slack[3] )
+{
+	const double start[3] = { startPos.x, startPos.y, startPos.z };
+	const double direction[3] = { dir.x, dir.y, dir.z };
+	for ( int axis=0; axis<3; axis++ ) {
+		rayStart[axis] = (float)start[axis];
+		double inv = ( direction[axis]!=0.0 ) ? 1.0/direction[axis] : 1.0e30;
+		ClampRange( &inv, -1.0e30, 1.0e30 );
+		dirInv[axis] = (float)inv;
+		slack[axis] = RoundUp( fabs( (start[axis]-(double)rayStart[axis])*inv ) );
+	}
+}
+
+// Destructor
+BvhTree::~BvhTree()
+{
+	delete[] Nodes;
+	delete[] LeafObjectList;
+}
+
+
+/***********************************************************************************************
+ * Tree traversal functions.
+ ***********************************************************************************************/
+
+// Traverse: Same arguments and return value as KdTree::Traverse.
+//   Returns "true" if traversal aborted by the callback function returning "true"
+//	 The stack holds children of nodes, numbered NodeWidth*(node index)+(child number),
+//	 with the distances at which the ray enters and exits their boxes.
+bool BvhTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& dir, double seekDistance, bool obeySeekDistance )
+{
+	if ( NumNodes==0 ) {
+		return false;
+	}
+
+	// The box tests are done in float.
+	float rayStart[3];
+	float dirInv[3];
+	float slack[3];
+	SetFloatRay( startPos, dir, rayStart, dirInv, slack );
+
+	KdTraverseStack localStack;
+	KdTraverseStack& traverseStack = GetTraverseStack( data, localStack );
+	KdTraverseStats& stats = StatsFor( data );
+
+	bool stopDistanceActive = obeySeekDistance;
+	double stopDistance = seekDistance;
+	long currentNodeIndex = 0;			// The node whose children are tested next, or -1
+	while ( true ) {
+
+		if ( currentNodeIndex>=0 ) {
+			stats.NodesTraversed++;
+			const BvhNode& node = Nodes[currentNodeIndex];
+			float entryDist[NodeWidth];
+			float exitDist[NodeWidth];
+			node.IntersectBoxes( rayStart, dirInv, slack, entryDist, exitDist );
+
+			// Sort the children hit by decreasing entry distance, and push them
+			//	 in that order so the nearest is popped first.
+			int order[NodeWidth];
+			int numHit = 0;
+			for ( int k=0; k<NodeWidth; k++ ) {
+				if ( node.ChildIsEmpty(k) || entryDist[k]>exitDist[k]
+						|| (stopDistanceActive && entryDist[k]>stopDistance) )
+				{
+					continue;
+				}
+				int pos = numHit++;
+				for ( ; pos>0 && entryDist[order[pos-1]]<entryDist[k]; pos-- ) {
+					order[pos] = order[pos-1];
+				}
+				order[pos] = k;
+			}
+			for ( int i=0; i<numHit; i++ ) {
+				int k = order[i];
+				traverseStack.Push().Set( currentNodeIndex*NodeWidth+k, entryDist[k], exitDist[k] );
+			}
+		}
+
+		if ( traverseStack.IsEmpty() ) {
+			return stopDistanceActive;
+		}
+		Kd_TraverseNodeData& topNode = traverseStack.Pop();
+		currentNodeIndex = -1;
+		if ( stopDistanceActive && topNode.GetMinDist()>stopDistance ) {
+			continue;
+		}
+		const BvhNode& parent = Nodes[topNode.GetNodeNumber()/NodeWidth];
+		int childNum = (int)(topNode.GetNodeNumber()%NodeWidth);
+		if ( parent.ChildIsNode( childNum ) ) {
+			currentNodeIndex = parent.Child[childNum];
+			continue;
+		}
+
+		// Handle leaf nodes by invoking the callback function
+		stats.LeavesTraversed++;
+		int numObjects = parent.NumObjects[childNum];
+		long* objectIdPtr = LeafObjectList + parent.Child[childNum];
+		stats.ObjectsInLeaves += numObjects;
+		double newStopDist;
+		if ( data->UseListCallback ) {
+			// Pass whole list of objects back to the user
+			if ( (*((PotentialObjectsListCallback*)data->CallbackFunction))( data, numObjects, objectIdPtr, &newStopDist ) ) {
+				stopDistanceActive = true;
+				stopDistance = newStopDist;
+			}
+		}
+		else {
+			// Pass the objects back to the user one at a time
+			for ( ; numObjects>0; numObjects-- ) {
+				if ( (*((PotentialObjectCallback*)data->CallbackFunction))( data, *objectIdPtr, &newStopDist ) ) {
+					stopDistanceActive = true;
+					stopDistance = newStopDist;
+				}
+				objectIdPtr++;
+			}
+		}
+	}
+}
+
+// TraverseAnyHit: Occlusion query.
+//   Returns "true" if the callback function found an object blocking the ray
+//	 The stack holds the indices of nodes whose children still need testing.
+bool BvhTree::TraverseAnyHit( KdData *data, const VectorR3& startPos, const VectorR3& dir, double maxDistance )
+{
+	if ( NumNodes==0 ) {
+		return false;
+	}
+
+	float rayStart[3];
+	float dirInv[3];
+	float slack[3];
+	SetFloatRay( startPos, dir, rayStart, dirInv, slack );
+
+	KdTraverseStack localStack;
+	KdTraverseStack& traverseStack = GetTraverseStack( data, localStack );
+
+	KdTraverseStats& stats = StatsFor( data );
+
+	PotentialOccluderCallback* callback = (PotentialOccluderCallback*)data->CallbackFunction;
+	long currentNodeIndex = 0;
+	while ( true ) {
+		stats.NodesTraversed++;
+		const BvhNode& node = Nodes[currentNodeIndex];
+		float entryDist[NodeWidth];
+		float exitDist[NodeWidth];
+		node.IntersectBoxes( rayStart, dirInv, slack, entryDist, exitDist );
+
+		for ( int k=0; k<NodeWidth; k++ ) {
+			if ( node.ChildIsEmpty(k) || entryDist[k]>exitDist[k] || entryDist[k]>maxDistance ) {
+				continue;
+			}
+			if ( node.ChildIsNode(k) ) {
+				traverseStack.Push().Set( node.Child[k], entryDist[k], exitDist[k] );
+				continue;
+			}
+			stats.LeavesTraversed++;
+			int numObjects = node.NumObjects[k];
+			const long* objectIdPtr = LeafObjectList + node.Child[k];
+			stats.ObjectsInLeaves += numObjects;
+			for ( ; numObjects>0; numObjects-- ) {
+				if ( (*callback)( data, *objectIdPtr ) ) {
+					return true;
+				}
+				objectIdPtr++;
+			}
+		}
+
+		if ( traverseStack.IsEmpty() ) {
+			return false;
+		}
+		currentNodeIndex = traverseStack.Pop().GetNodeNumber();
+	}
+}
+
+KdTraverseStack& BvhTree::GetTraverseStack( KdData *data, KdTraverseStack& localStack )
+{
+	KdTraverseStack* stackPtr = data->TraverseStack;
+	if ( stackPtr==0 || stackPtr->GetCapacity()<GetStackSize() ) {
+		localStack.SetCapacity( GetStackSize() );
+		StatsFor( data ).StackAllocations++;
+		stackPtr = &localStack;
+	}
+	stackPtr->Reset();
+	return *stackPtr;
+}
+
+
+/***********************************************************************************************
+ * Tree building functions.
+ ***********************************************************************************************/
+void BvhTree::BuildTree( long numObjects, ExtentFunction* extentFunc )
+{
+	assert ( !Built );
+	auto startTime = std::chrono::steady_clock::now();
+	Built = true;
+	NumObjects = numObjects;
+	if ( numObjects>0 ) {
+		ObjectAABBs = new AABB[numObjects];
+		LeafObjectList = new long[numObjects];
+		BuildNodes = new Array<BvhBuildNode>;
+		for ( long i=0; i<numObjects; i++ ) {
+			(*extentFunc)( i, ObjectAABBs[i] );
+			LeafObjectList[i] = i;
+		}
+
+		long rootIdx = BuildBinarySubTree( 0, numObjects );
+
+		// Each node takes the place of at least one split node of the binary tree
+		//	 (unless the root is a leaf), and the binary tree has one less split
+		//	 node than leaves.
+		long numSplitNodes = (BuildNodes->SizeUsed()-1)/2;
+		Nodes = new BvhNode[Max(numSplitNodes,1L)];
+		MakeWideSubTree( rootIdx, 0 );
+		assert ( NumNodes<=Max(numSplitNodes,1L) );
+
+		delete[] ObjectAABBs;
+		ObjectAABBs = 0;
+		delete BuildNodes;
+		BuildNodes = 0;
+	}
+	auto endTime = std::chrono::steady_clock::now();
+	BuildSeconds = std::chrono::duration<double>(endTime-startTime).count();
+}
+
+// Builds the binary tree for the objects LeafObjectList[firstObject], ...
+//	 Reorders those entries of LeafObjectList so each leaf's objects are
+//	 consecutive.  Returns the index of the new node in BuildNodes.
+long BvhTree::BuildBinarySubTree( long firstObject, long numObjects )
+{
+	long nodeIdx = BuildNodes->SizeUsed();
+	BuildNodes->Touch( nodeIdx );
+
+	AABB box = ObjectAABBs[LeafObjectList[firstObject]];
+	VectorR3 centroid;
+	centroid.Set( Centroid(box,0), Centroid(box,1), Centroid(box,2) );
+	AABB centroidBox( centroid, centroid );
+	for ( long i=1; i<numObjects; i++ ) {
+		const AABB& objectBox = ObjectAABBs[LeafObjectList[firstObject+i]];
+		box.EnlargeToEnclose( objectBox );
+		centroid.Set( Centroid(objectBox,0), Centroid(objectBox,1), Centroid(objectBox,2) );
+		centroidBox.EnlargeToEnclose( AABB( centroid, centroid ) );
+	}
+	BvhBuildNode& node = (*BuildNodes)[nodeIdx];
+	node.Box = box;
+	node.LeftChildIdx = -1;
+	node.RightChildIdx = -1;
+	node.FirstObject = firstObject;
+	node.NumObjects = numObjects;
+	if ( numObjects==1 ) {
+		return nodeIdx;
+	}
+
+	int splitAxis, splitBin;
+	double splitCost;
+	long numLeft;
+	if ( CalcBestSplit( node, centroidBox, &splitAxis, &splitBin, &splitCost ) ) {
+		if ( numObjects<=MaxLeafObjects && splitCost>=ObjectCost*(double)numObjects ) {
+			return nodeIdx;
+		}
+		numLeft = PartitionObjects( firstObject, numObjects, centroidBox, splitAxis, splitBin );
+	}
+	else {
+		// All the centroids are at the same place
+		if ( numObjects<=MaxLeafObjects ) {
+			return nodeIdx;
+		}
+		numLeft = numObjects/2;
+	}
+
+	// BuildNodes may be reallocated by the recursive calls, so node is not used after here.
+	long leftIdx = BuildBinarySubTree( firstObject, numLeft );
+	long rightIdx = BuildBinarySubTree( firstObject+numLeft, numObjects-numLeft );
+	(*BuildNodes)[nodeIdx].LeftChildIdx = leftIdx;
+	(*BuildNodes)[nodeIdx].RightChildIdx = rightIdx;
+	return nodeIdx;
+}
+
+// Finds the split of the node's objects with the least SAH cost.  The objects
+//	 are put in NumSplitBins bins along each axis by their centroids, and the
+//	 splits between the bins are tried.  The cost is one (for the node) plus
+//	 ObjectCost times the number of objects on each side, weighted by the
+//	 probability a ray that meets the node meets that side's box.
+// Returns false if the centroids are all at the same place.
+bool BvhTree::CalcBestSplit( const BvhBuildNode& node, const AABB& centroidBox,
+							 int* splitAxis, int* splitBin, double* splitCost ) const
+{
+	double nodeArea = node.Box.SurfaceArea();
+	double areaInv = ( nodeArea>0.0 ) ? 1.0/nodeArea : 1.0;
+	bool foundSplit = false;
+	for ( int axis=0; axis<3; axis++ ) {
+		double minOnAxis = centroidBox.GetBoxMin()[axis];
+		double axisLength = centroidBox.GetBoxMax()[axis] - minOnAxis;
+		if ( axisLength<=0.0 ) {
+			continue;
+		}
+		double scale = (double)NumSplitBins/axisLength;
+
+		long binCount[NumSplitBins];
+		AABB binBox[NumSplitBins];
+		for ( int bin=0; bin<NumSplitBins; bin++ ) {
+			binCount[bin] = 0;
+		}
+		for ( long i=0; i<node.NumObjects; i++ ) {
+			const AABB& objectBox = ObjectAABBs[LeafObjectList[node.FirstObject+i]];
+			int bin = SplitBin( Centroid(objectBox,axis), minOnAxis, scale );
+			if ( binCount[bin]==0 ) {
+				binBox[bin] = objectBox;
+			}
+			else {
+				binBox[bin].EnlargeToEnclose( objectBox );
+			}
+			binCount[bin]++;
+		}
+
+		// Area and number of objects of bins bin, bin+1, ...
+		double rightArea[NumSplitBins];
+		long rightCount[NumSplitBins];
+		AABB sideBox;
+		long sideCount = 0;
+		for ( int bin=NumSplitBins-1; bin>0; bin-- ) {
+			if ( binCount[bin]>0 ) {
+				if ( sideCount==0 ) {
+					sideBox = binBox[bin];
+				}
+				else {
+					sideBox.EnlargeToEnclose( binBox[bin] );
+				}
+				sideCount += binCount[bin];
+			}
+			rightArea[bin] = ( sideCount>0 ) ? sideBox.SurfaceArea() : 0.0;
+			rightCount[bin] = sideCount;
+		}
+
+		// Try the split after each bin
+		sideCount = 0;
+		for ( int bin=0; bin<NumSplitBins-1; bin++ ) {
+			if ( binCount[bin]>0 ) {
+				if ( sideCount==0 ) {
+					sideBox = binBox[bin];
+				}
+				else {
+					sideBox.EnlargeToEnclose( binBox[bin] );
+				}
+				sideCount += binCount[bin];
+			}
+			if ( sideCount==0 || rightCount[bin+1]==0 ) {
+				continue;
+			}
+			double cost = 1.0 + ObjectCost*areaInv*( sideBox.SurfaceArea()*(double)sideCount
+													 + rightArea[bin+1]*(double)rightCount[bin+1] );
+			if ( !foundSplit || cost<*splitCost ) {
+				foundSplit = true;
+				*splitAxis = axis;
+				*splitBin = bin;
+				*splitCost = cost;
+			}
+		}
+	}
+	return foundSplit;
+}
+
+// Moves the objects whose centroids are in bins 0, ..., splitBin to the front.
+//	 Returns the number of them.
+long BvhTree::PartitionObjects( long firstObject, long numObjects, const AABB& centroidBox,
+								int splitAxis, int splitBin )
+{
+	double minOnAxis = centroidBox.GetBoxMin()[splitAxis];
+	double scale = (double)NumSplitBins/(centroidBox.GetBoxMax()[splitAxis] - minOnAxis);
+	const AABB* objectAABBs = ObjectAABBs;
+	long* firstRight = std::partition( LeafObjectList+firstObject, LeafObjectList+firstObject+numObjects,
+		[=]( long objectNum ) {
+			return SplitBin( Centroid(objectAABBs[objectNum],splitAxis), minOnAxis, scale )<=splitBin;
+		} );
+	long numLeft = (long)(firstRight-(LeafObjectList+firstObject));
+	assert ( 0<numLeft && numLeft<numObjects );
+	return numLeft;
+}
+
+// Makes the node for the binary subtree with root buildNodeIdx, and the nodes
+//	 below it.  The children of the node are found by replacing the child with the
+//	 largest box by its two children until there are NodeWidth of them, or they
+//	 are all leaves.  Returns the index of the new node.
+long BvhTree::MakeWideSubTree( long buildNodeIdx, long depth )
+{
+	long nodeIdx = NumNodes++;
+	UpdateMax( depth, MaxDepth );
+
+	long children[NodeWidth];
+	int numChildren;
+	const BvhBuildNode& buildNode = (*BuildNodes)[buildNodeIdx];
+	if ( buildNode.IsLeaf() ) {
+		children[0] = buildNodeIdx;		// Only happens for the root
+		numChildren = 1;
+	}
+	else {
+		children[0] = buildNode.LeftChildIdx;
+		children[1] = buildNode.RightChildIdx;
+		numChildren = 2;
+	}
+	while ( numChildren<NodeWidth ) {
+		int largest = -1;
+		double largestArea = 0.0;
+		for ( int k=0; k<numChildren; k++ ) {
+			const BvhBuildNode& child = (*BuildNodes)[children[k]];
+			double area = child.Box.SurfaceArea();
+			if ( !child.IsLeaf() && ( largest<0 || area>largestArea ) ) {
+				largest = k;
+				largestArea = area;
+			}
+		}
+		if ( largest<0 ) {
+			break;
+		}
+		const BvhBuildNode& opened = (*BuildNodes)[children[largest]];
+		children[largest] = opened.LeftChildIdx;
+		children[numChildren++] = opened.RightChildIdx;
+	}
+
+	BvhNode& node = Nodes[nodeIdx];
+	for ( int k=0; k<NodeWidth; k++ ) {
+		if ( k>=numChildren ) {
+			for ( int axis=0; axis<3; axis++ ) {
+				node.BoxMin[axis][k] = node.BoxMax[axis][k] = 0.0f;
+			}
+			node.Child[k] = 0;
+			node.NumObjects[k] = -1;
+			continue;
+		}
+		const BvhBuildNode& child = (*BuildNodes)[children[k]];
+		for ( int axis=0; axis<3; axis++ ) {
+			node.BoxMin[axis][k] = RoundDown( child.Box.GetBoxMin()[axis] );
+			node.BoxMax[axis][k] = RoundUp( child.Box.GetBoxMax()[axis] );
+		}
+		if ( child.IsLeaf() ) {
+			// The list is sorted by objectNums, as for the kd-tree.
+			NumLeaves++;
+			node.Child[k] = (int)child.FirstObject;
+			node.NumObjects[k] = (int)child.NumObjects;
+			std::sort( LeafObjectList+child.FirstObject, LeafObjectList+child.FirstObject+child.NumObjects );
+		}
+		else {
+			node.NumObjects[k] = 0;
+			node.Child[k] = (int)MakeWideSubTree( children[k], depth+1 );
+		}
+	}
+	return nodeIdx;
+}
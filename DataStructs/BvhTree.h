@@ -0,0 +1,265 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// BvhTree.h
+//
+//   A bounding volume hierarchy which holds 3D objects of generic type and
+//	 supports ray tracing.  It is an alternative to KdTree: it is built with
+//	 the same ExtentFunction callback, and it is traversed with the same
+//	 KdData and PotentialObjectCallback (or PotentialObjectsListCallback).
+//
+//	 Every object is in exactly one leaf, so a ray never meets an object
+//	 twice.  The tree is built as a binary tree by binned surface area
+//	 heuristic (SAH) splitting, and is then collapsed into nodes with four
+//	 children.  A node stores the boxes of its four children as arrays of
+//	 floats, one array for each face, so the four boxes are tested together.
+
+#ifndef BVHTREE_H
+#define BVHTREE_H
+
+#include <float.h>
+
+// The box tests use SSE when it is available.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=1)
+#define BVH_USE_SSE 1
+#include <xmmintrin.h>
+#else
+#define BVH_USE_SSE 0
+#endif
+
+#include "KdTree.h"
+
+class BvhTree;
+class BvhNode;			// A node of the tree, with four children.
+class BvhBuildNode;		// A node of the binary tree made while building.
+
+// ************************************************************************************
+// BvhTree																			  *
+// ************************************************************************************
+class BvhTree
+{
+public:
+	BvhTree();
+	~BvhTree();
+
+	// ****** Tree traversal routines ******
+
+	// Traverse: Same arguments and return value as KdTree::Traverse.
+	//	 The leaves are visited in the order the ray enters their boxes, and
+	//	 a stop distance returned by the callback function skips all boxes
+	//	 entered beyond it.
+	//	 Uses data->TraverseStack if it is set and large enough (see GetStackSize()).
+	//	 Otherwise allocates a stack for this traversal.
+	bool Traverse( KdData *data, const VectorR3& startPos, const VectorR3& dir, double seekDistance = 0.0, bool useSeekDistance = false );
+
+	// TraverseAnyHit: Same arguments and return value as KdTree::TraverseAnyHit.
+	//	 The children of a node are not sorted, and a leaf is tested as soon
+	//	 as the ray is found to hit its box.
+	bool TraverseAnyHit( KdData *data, const VectorR3& startPos, const VectorR3& dir, double maxDistance );
+
+	// ******** Accessors ****************
+	bool IsBuilt() const { return Built; }
+	long GetNumNodes() const { return NumNodes; }
+	long GetNumLeaves() const { return NumLeaves; }
+	long GetNumLeafEntries() const { return NumObjects; }		// Each object is in one leaf
+	long GetMemoryBytes() const;	// Memory used by the nodes and the leaves' object lists
+
+	// Depth of the deepest node (the root has depth zero).  A KdTraverseStack
+	//	 with capacity GetStackSize() never overflows.
+	long GetMaxDepth() const { return MaxDepth; }
+	long GetStackSize() const { return (NodeWidth-1)*MaxDepth+NodeWidth; }
+
+	// Traversals count their work as for a KdTree (see KdTraverseStats).
+	void ResetStats() { TreeStats.Reset(); }
+	void Stats_Add( const KdTraverseStats& stats ) { TreeStats.Add( stats ); }
+	void Stats_GetAll( long* numNodes, long* numNonEmptyLeaves, long* numObjsInLeaves ) const;
+	long Stats_GetStackAllocations() const { return TreeStats.StackAllocations; }
+
+	// ****** Tree building routines *******
+
+	// Set the assumed cost for intersecting a single object, in units of
+	//	 the cost of testing the boxes of one node.  Defaults to 2.0.
+	void SetObjectCost( double cost ) { ObjectCost = cost; }
+	// Leaves are split if they hold more than this many objects.  Defaults to 8.
+	void SetMaxLeafObjects( long maxObjects ) { MaxLeafObjects = maxObjects; }
+
+	// Can call BuildTree at most once.
+	void BuildTree( long numObjects, ExtentFunction* extentFunc );
+	double GetBuildSeconds() const { return BuildSeconds; }		// Time taken by BuildTree
+
+	const static int NodeWidth = 4;		// Number of children of a node
+	const static int NumSplitBins = 16;	// Bins used on each axis to choose the splits
+
+	long NumObjects;	// Number of objects stored in the tree
+
+private:
+	bool Built;
+	BvhNode* Nodes;				// Nodes[0] is the root
+	long NumNodes;
+	long NumLeaves;
+	long* LeafObjectList;		// The object lists of all leaves, one after another
+	long MaxDepth;
+	double BuildSeconds;
+
+	double ObjectCost;
+	long MaxLeafObjects;
+
+	// Traversal statistics, of the traversals whose KdData has no Stats
+	KdTraverseStats TreeStats;
+	KdTraverseStats& StatsFor( const KdData* data ) { return data->Stats ? *data->Stats : TreeStats; }
+
+	// Temporary data used only while building the tree.
+	AABB* ObjectAABBs;				// Bounding box of each object
+	Array<BvhBuildNode>* BuildNodes;	// The binary tree
+
+	// Returns data->TraverseStack, or localStack if that is too small.
+	KdTraverseStack& GetTraverseStack( KdData *data, KdTraverseStack& localStack );
+
+	// Routines used for building the tree
+	long BuildBinarySubTree( long firstObject, long numObjects );
+	bool CalcBestSplit( const BvhBuildNode& node, const AABB& centroidBox,
+						int* splitAxis, int* splitBin, double* splitCost ) const;
+	long PartitionObjects( long firstObject, long numObjects, const AABB& centroidBox,
+						   int splitAxis, int splitBin );
+	long MakeWideSubTree( long buildNodeIdx, long depth );
+
+	BvhTree( const BvhTree& );				// Not copyable
+	BvhTree& operator=( const BvhTree& );
+};
+
+// ************************************************************************************
+// BvhNode																			  *
+//	  Node with four children.  The child boxes are in float, rounded outward.	  *
+//	  A child is empty, a leaf or another node.									  *
+// ************************************************************************************
+
+class BvhNode {
+	friend class BvhTree;
+
+public:
+	bool ChildIsEmpty( int k ) const { return (NumObjects[k]<0); }
+	bool ChildIsLeaf( int k ) const { return (NumObjects[k]>0); }
+	bool ChildIsNode( int k ) const { return (NumObjects[k]==0); }
+
+	// Sets the entry and exit distances of the ray for each child's box.  The
+	//	 ray misses the box if the entry distance is larger than the exit distance.
+	void IntersectBoxes( const float rayStart[3], const float dirInv[3], const float slack[3],
+						 float entryDist[BvhTree::NodeWidth], float exitDist[BvhTree::NodeWidth] ) const;
+
+private:
+	float BoxMin[3][BvhTree::NodeWidth];	// BoxMin[axis][child]
+	float BoxMax[3][BvhTree::NodeWidth];
+	int Child[BvhTree::NodeWidth];			// Index of a node, or the position in LeafObjectList of a leaf
+	int NumObjects[BvhTree::NodeWidth];		// Zero for a node, -1 if empty.  Otherwise, the objects in a leaf.
+};
+
+// ************************************************************************************
+// BvhBuildNode																		  *
+//	  Node of the binary tree made while building.  Used only for that purpose.	  *
+// ************************************************************************************
+
+class BvhBuildNode {
+	friend class BvhTree;
+
+public:
+	bool IsLeaf() const { return (LeftChildIdx==-1); }
+
+private:
+	AABB Box;				// Encloses the boxes of all the node's objects
+	long LeftChildIdx;		// Equals -1 for a leaf
+	long RightChildIdx;
+	long FirstObject;		// The objects are LeafObjectList[FirstObject], ...
+	long NumObjects;
+};
+
+// **********************************************************
+// BvhTree and BvhNode - inlined member functions
+// **********************************************************
+
+inline BvhTree::BvhTree()
+{
+	NumObjects = 0;
+	Built = false;
+	Nodes = 0;
+	NumNodes = 0;
+	NumLeaves = 0;
+	LeafObjectList = 0;
+	MaxDepth = 0;
+	BuildSeconds = 0.0;
+	ObjectCost = 2.0;
+	MaxLeafObjects = 8;
+	ObjectAABBs = 0;
+	BuildNodes = 0;
+	ResetStats();
+}
+
+inline long BvhTree::GetMemoryBytes() const
+{
+	return NumNodes*(long)sizeof(BvhNode) + NumObjects*(long)sizeof(long);
+}
+
+inline void BvhTree::Stats_GetAll( long* numNodes, long* numNonEmptyLeaves, long* numObjsInLeaves ) const
+{
+	*numNodes = TreeStats.NodesTraversed;
+	*numNonEmptyLeaves = TreeStats.LeavesTraversed;
+	*numObjsInLeaves = TreeStats.ObjectsInLeaves;
+}
+
+// The slab test.  With SSE, the four children are done at once.  slack
+//	 widens the slabs, to allow for the rounding of the ray's start position
+//	 to float, and the distances are widened to allow for the rounding of
+//	 the products.
+inline void BvhNode::IntersectBoxes( const float rayStart[3], const float dirInv[3], const float slack[3],
+									 float entryDist[BvhTree::NodeWidth], float exitDist[BvhTree::NodeWidth] ) const
+{
+	const float roundOff = 4.0f*FLT_EPSILON;
+#if BVH_USE_SSE
+	__m128 entry = _mm_setzero_ps();
+	__m128 exit = _mm_set1_ps( FLT_MAX );
+	for ( int axis=0; axis<3; axis++ ) {
+		__m128 start = _mm_set1_ps( rayStart[axis] );
+		__m128 inv = _mm_set1_ps( dirInv[axis] );
+		__m128 axisSlack = _mm_set1_ps( slack[axis] );
+		__m128 t0 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( BoxMin[axis] ), start ), inv );
+		__m128 t1 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( BoxMax[axis] ), start ), inv );
+		entry = _mm_max_ps( entry, _mm_sub_ps( _mm_min_ps( t0, t1 ), axisSlack ) );
+		exit = _mm_min_ps( exit, _mm_add_ps( _mm_max_ps( t0, t1 ), axisSlack ) );
+	}
+	__m128 round = _mm_set1_ps( roundOff );
+	__m128 absExit = _mm_andnot_ps( _mm_set1_ps( -0.0f ), exit );
+	_mm_storeu_ps( entryDist, _mm_sub_ps( entry, _mm_mul_ps( entry, round ) ) );
+	_mm_storeu_ps( exitDist, _mm_add_ps( exit, _mm_mul_ps( absExit, round ) ) );
+#else
+	for ( int k=0; k<BvhTree::NodeWidth; k++ ) {
+		float entry = 0.0f;
+		float exit = FLT_MAX;
+		for ( int axis=0; axis<3; axis++ ) {
+			float t0 = (BoxMin[axis][k]-rayStart[axis])*dirInv[axis];
+			float t1 = (BoxMax[axis][k]-rayStart[axis])*dirInv[axis];
+			entry = Max( entry, Min( t0, t1 ) - slack[axis] );
+			exit = Min( exit, Max( t0, t1 ) + slack[axis] );
+		}
+		entryDist[k] = entry - entry*roundOff;
+		exitDist[k] = exit + (exit<0.0f ? -exit : exit)*roundOff;
+	}
+#endif
+}
+
+#endif // BVHTREE_H
@@ -32,39 +32,44 @@
 #include <assert.h>
 #include <stdio.h>
 
+// C++ STL headers
+#include <chrono>
+#include <thread>
+#include <vector>
+
 #include "KdTree.h"
 #include "DoubleRecurse.h"
 
-// Destructor
-KdTree::~KdTree()
+const int KdTree::MaxPacketRays;		// Defined here, since it is passed by reference
+
+// Calls task(0), ..., task(numTasks-1).  If inParallel, each task after the
+//	 first runs on its own thread.  Used while building the tree.
+template<class Task> static void RunBuildTasks( int numTasks, bool inParallel, Task task )
 {
-	if ( TreeSize()==0 ) {
+	if ( !inParallel ) {
+		for ( int i=0; i<numTasks; i++ ) {
+			task( i );
+		}
 		return;
 	}
-	// Traverse the tree and delete object lists in each non-empty leaf node
-	Stack<long> IdxStack;
-	long currentNodeIndex = RootIndex();			// The current node in the traversal
-	while ( true ) {
-		KdTreeNode* currentNode = &TreeNodes[currentNodeIndex];
-		if ( currentNode->IsLeaf() ){
-			delete[] currentNode->Data.Leaf.ObjectList;
-		}
-		else {
-			if ( !currentNode->LeftChildEmpty() ) {
-				IdxStack.Push( currentNode->Data.Split.LeftChildIdx );
-			}
-			if ( !currentNode->RightChildEmpty() ) {
-				currentNodeIndex = currentNode->Data.Split.RightChildIdx;
-				continue;
-			}
-		}
-		if ( IdxStack.IsEmpty() ) {
-			break;
-		}
-		currentNodeIndex = IdxStack.Pop();
+	std::vector<std::thread> threads;
+	for ( int i=1; i<numTasks; i++ ) {
+		threads.push_back( std::thread( task, i ) );
+	}
+	task( 0 );
+	for ( size_t i=0; i<threads.size(); i++ ) {
+		threads[i].join();
 	}
 }
 
+// Destructor
+KdTree::~KdTree()
+{
+	// The leaves' object lists all point into LeafObjectList
+	delete[] CompactNodes;
+	delete[] LeafObjectList;
+}
+
 
 /***********************************************************************************************
  * Tree traversal functions.
@@ -75,6 +80,33 @@ KdTree::~KdTree()
 //	 dir - direction of the ray.
 //   Returns "true" if traversal aborted by the callback function returning "true"
 bool KdTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& dir, double seekDistance, bool obeySeekDistance )
+{
+	if ( UseCompactNodes ) {
+		return TraverseNodes<false>( CompactNodes, data, startPos, dir, seekDistance, obeySeekDistance );
+	}
+	else {
+		return TraverseNodes<false>( TreeNodes.GetFirstEntryPtr(), data, startPos, dir, seekDistance, obeySeekDistance );
+	}
+}
+
+// TraverseAnyHit: Occlusion query.
+//   Returns "true" if the callback function found an object blocking the ray
+bool KdTree::TraverseAnyHit( KdData *data, const VectorR3& startPos, const VectorR3& dir, double maxDistance )
+{
+	if ( UseCompactNodes ) {
+		return TraverseNodes<true>( CompactNodes, data, startPos, dir, maxDistance, true );
+	}
+	else {
+		return TraverseNodes<true>( TreeNodes.GetFirstEntryPtr(), data, startPos, dir, maxDistance, true );
+	}
+}
+
+// The traversal, for either form of the tree nodes.
+//	 With AnyHit, the callback is a PotentialOccluderCallback, and the
+//	 traversal stops at the first object it reports.
+template<bool AnyHit, class NodeT> bool KdTree::TraverseNodes( const NodeT* nodes, KdData *data, 
+												  const VectorR3& startPos, const VectorR3& dir, 
+												  double seekDistance, bool obeySeekDistance )
 {
 	double entryDist, exitDist;
 	int entryFaceId, exitFaceId;
@@ -106,7 +138,7 @@ bool KdTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& d
 
 	long currentNodeIndex = RootIndex();			// The current node in the traversal
 	assert ( currentNodeIndex != -1 ) ;				// The tree should not be empty
-    KdTreeNode* currentNode = &TreeNodes[currentNodeIndex];
+	const NodeT* currentNode = nodes+currentNodeIndex;
 	double minDistance = Max(0.0, entryDist);					
 	double maxDistance = exitDist;
 	bool hitParallel = false;
@@ -120,19 +152,27 @@ bool KdTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& d
 		maxDistance = seekDistance;
 	}
 	assert ( minDistance<=maxDistance );
-	Stack<Kd_TraverseNodeData> traverseStack;
+	KdTraverseStats& stats = StatsFor( data );
+	KdTraverseStack* stackPtr = data->TraverseStack;
+	KdTraverseStack localStack;
+	if ( stackPtr==0 || stackPtr->GetCapacity()<=MaxDepth ) {
+		localStack.SetCapacity( MaxDepth+1 );
+		stats.StackAllocations++;
+		stackPtr = &localStack;
+	}
+	KdTraverseStack& traverseStack = *stackPtr;
 	traverseStack.Reset();
 
 	while ( true ) {
 		
 		if ( ! currentNode->IsLeaf() ) {
-			Stats_NodeTraversed();
+			stats.NodesTraversed++;
 			// Handle non-leaf nodes
 			//		These do not contain primitive objects.
 			int thisSign;
 			double thisDirInv;
 			double thisStartPt;
-			switch ( currentNode->NodeType ) 
+			switch ( currentNode->SplitAxis() ) 
 			{
 			case KD_SPLIT_X:
 				thisSign = signDirX;
@@ -162,12 +202,12 @@ bool KdTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& d
 					currentNodeIndex = currentNode->RightChildIndex();
 				}
 				else if ( thisSplitVal>thisStartPt ) {
-					currentNodeIndex = currentNode->LeftChildIndex();
+					currentNodeIndex = LeftChild( *currentNode, currentNodeIndex );
 				}
 				else {
 					// Exactly hit the splitting plane (not so good!)
-					int leftIdx = currentNode->LeftChildIndex();
-					int rightIdx = currentNode->RightChildIndex();
+					long leftIdx = LeftChild( *currentNode, currentNodeIndex );
+					long rightIdx = currentNode->RightChildIndex();
 					if ( leftIdx == -1 ) {
 						currentNodeIndex = rightIdx;
 					}
@@ -175,8 +215,7 @@ bool KdTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& d
 						currentNodeIndex = leftIdx;
 					}
 					else {
-						traverseStack.Push();
-						traverseStack.Top().Set( rightIdx, minDistance, maxDistance );
+						traverseStack.Push().Set( rightIdx, minDistance, maxDistance );
 						currentNodeIndex = leftIdx;
 						hitParallel = true;
 						UpdateMax(maxDistance,parallelHitMax);
@@ -185,12 +224,12 @@ bool KdTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& d
 			}
 			else {
 				if ( thisSign>0 ) {
-					nearNodeIdx = currentNode->LeftChildIndex();
+					nearNodeIdx = LeftChild( *currentNode, currentNodeIndex );
 					farNodeIdx = currentNode->RightChildIndex();
 				}
 				else {
 					nearNodeIdx = currentNode->RightChildIndex();
-					farNodeIdx = currentNode->LeftChildIndex();
+					farNodeIdx = LeftChild( *currentNode, currentNodeIndex );
 				}
 				double splitDistance = (currentNode->SplitValue()-thisStartPt)*thisDirInv;
 				if ( splitDistance<minDistance ) {
@@ -208,8 +247,7 @@ bool KdTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& d
 				else {
 					// Push the far node -- if it exists
 					if ( farNodeIdx != -1 ) {
-						traverseStack.Push();
-						traverseStack.Top().Set( farNodeIdx, splitDistance, maxDistance );
+						traverseStack.Push().Set( farNodeIdx, splitDistance, maxDistance );
 					}
 					// Near node is the new current node
 					maxDistance = splitDistance;
@@ -217,7 +255,7 @@ bool KdTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& d
 				}
 			}
 			if ( currentNodeIndex != -1 ) {
-				currentNode = &TreeNodes[currentNodeIndex];
+				currentNode = nodes+currentNodeIndex;
 				continue;
 			}
 			// If we reach here, we are at an empty leaf and can fall through.
@@ -226,16 +264,27 @@ bool KdTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& d
 
 		else {
 			// Handle leaf nodes by invoking the callback function
-			Stats_LeafTraversed();
-			if ( data->UseListCallback ) {
+			stats.LeavesTraversed++;
+			if ( AnyHit ) {
+				int i = currentNode->GetNumObjects();
+				stats.ObjectsInLeaves += i;
+				const long* objectIdPtr = LeafObjects( *currentNode );
+				for ( ; i>0; i-- ) {
+					if ( (*((PotentialOccluderCallback*)data->CallbackFunction))( data, *objectIdPtr ) ) {
+						return true;
+					}
+					objectIdPtr++;
+				}
+			}
+			else if ( data->UseListCallback ) {
 				// Pass whole list of objects back to the user
 				bool stopFlag;
 				double newStopDist;
-				Stats_ObjectsInLeaves( currentNode->Data.Leaf.NumObjects );
+				stats.ObjectsInLeaves += currentNode->GetNumObjects();
 				stopFlag = (*((PotentialObjectsListCallback*)data->CallbackFunction))(
 										data,
-										currentNode->Data.Leaf.NumObjects, 
-										currentNode->Data.Leaf.ObjectList, 
+										currentNode->GetNumObjects(), 
+										LeafObjects( *currentNode ), 
 										&newStopDist );
 				if ( stopFlag ) {
 					stopDistanceActive = true;
@@ -245,9 +294,9 @@ bool KdTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& d
 			else {
 				// Pass the objects back to the user one at a time
 				double newStopDist;
-				int i = currentNode->Data.Leaf.NumObjects;
-				Stats_ObjectsInLeaves( i );
-				long* objectIdPtr = currentNode->Data.Leaf.ObjectList;
+				int i = currentNode->GetNumObjects();
+				stats.ObjectsInLeaves += i;
+				const long* objectIdPtr = LeafObjects( *currentNode );
 				for ( ; i>0; i-- ) {
 					if ( (*((PotentialObjectCallback*)data->CallbackFunction))(
 												data, *objectIdPtr, &newStopDist )  )  
@@ -262,19 +311,19 @@ bool KdTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& d
 
 		// Get to this point if done with a leaf node (possibly empty, possibly not).
 		if ( traverseStack.IsEmpty() ) {
-			return stopDistanceActive;
+			return ( !AnyHit && stopDistanceActive );
 		}
 		else {
 			Kd_TraverseNodeData& topNode = traverseStack.Pop();
 			minDistance = topNode.GetMinDist();
-			if ( stopDistanceActive && minDistance>stopDistance ) {
+			if ( !AnyHit && stopDistanceActive && minDistance>stopDistance ) {
 				if ( !hitParallel || minDistance>=parallelHitMax ) {
 					// Exit loop.  Fully done.
 					return true;
 				}
 			}
 			currentNodeIndex = topNode.GetNodeNumber();
-			currentNode = &TreeNodes[currentNodeIndex];
+			currentNode = nodes+currentNodeIndex;
 			maxDistance = topNode.GetMaxDist(); 
 		}
 
@@ -283,16 +332,312 @@ bool KdTree::Traverse( KdData *data, const VectorR3& startPos, const VectorR3& d
 }
 
 
+/***********************************************************************************************
+ * Packet traversal.
+ ***********************************************************************************************/
+
+static inline int NumRaysInMask( unsigned int mask )
+{
+	mask = mask - ((mask>>1) & 0x55555555);
+	mask = (mask & 0x33333333) + ((mask>>2) & 0x33333333);
+	mask = (mask + (mask>>4)) & 0x0F0F0F0F;
+	return (int)((mask*0x01010101)>>24);
+}
+
+unsigned int KdTree::TraversePacket( KdData** rays, int numRays, KdPacketStack& stack )
+{
+	return TraversePacketRays<false>( rays, numRays, 0, stack );
+}
+
+unsigned int KdTree::TraversePacketAnyHit( KdData** rays, int numRays, const double* maxDistances,
+										   KdPacketStack& stack )
+{
+	return TraversePacketRays<true>( rays, numRays, maxDistances, stack );
+}
+
+// Splits the rays into the packet, whose directions have the signs of the
+//	 first ray's direction, and the rays to be traversed one at a time.
+template<bool AnyHit> unsigned int KdTree::TraversePacketRays( KdData** rays, int numRays,
+												  const double* maxDistances, KdPacketStack& stack )
+{
+	assert( 0<numRays && numRays<=MaxPacketRays );
+	KdMailbox* mailbox = rays[0]->Mailbox;
+	const VectorR3& firstDir = rays[0]->kdTraverseDir;
+	int signDirX = Sign(firstDir.x);
+	int signDirY = Sign(firstDir.y);
+	int signDirZ = Sign(firstDir.z);
+	unsigned int packetMask = 0;
+	if ( signDirX!=0 && signDirY!=0 && signDirZ!=0 ) {
+		for ( int k=0; k<numRays; k++ ) {
+			const VectorR3& dir = rays[k]->kdTraverseDir;
+			if ( Sign(dir.x)==signDirX && Sign(dir.y)==signDirY && Sign(dir.z)==signDirZ ) {
+				packetMask |= (1u<<k);
+			}
+		}
+	}
+	if ( NumRaysInMask(packetMask)<2 ) {
+		packetMask = 0;
+	}
+
+	unsigned int hitMask = 0;
+	for ( int k=0; k<numRays; k++ ) {
+		if ( packetMask & (1u<<k) ) {
+			continue;
+		}
+		assert( rays[k]->Mailbox==mailbox );
+		if ( mailbox ) {
+			mailbox->NewRay();
+		}
+		bool hit = AnyHit 
+					? TraverseAnyHit( rays[k], rays[k]->kdStartPos, rays[k]->kdTraverseDir, maxDistances[k] )
+					: Traverse( rays[k], rays[k]->kdStartPos, rays[k]->kdTraverseDir );
+		if ( hit ) {
+			hitMask |= (1u<<k);
+		}
+	}
+	if ( packetMask==0 ) {
+		return hitMask;
+	}
+
+	if ( mailbox ) {
+		mailbox->NewPacket();
+	}
+	if ( stack.GetCapacity()<=MaxDepth ) {
+		stack.SetCapacity( MaxDepth+1 );
+	}
+	StatsFor( rays[0] ).PacketRays += NumRaysInMask( packetMask );
+	if ( UseCompactNodes ) {
+		hitMask |= TraversePacketNodes<AnyHit>( CompactNodes, rays, numRays, packetMask, maxDistances, stack );
+	}
+	else {
+		hitMask |= TraversePacketNodes<AnyHit>( TreeNodes.GetFirstEntryPtr(), rays, numRays, packetMask, 
+												maxDistances, stack );
+	}
+	return hitMask;
+}
+
+// The traversal of the rays in packetMask, for either form of the tree nodes.
+//	 Each ray has its own entry and exit distances, computed exactly as in
+//	 TraverseNodes.  The rays share the near and far child of each node, since 
+//	 their directions have the same signs, so each ray meets its leaves in the 
+//	 same order as when it is traversed alone.
+template<bool AnyHit, class NodeT> unsigned int KdTree::TraversePacketNodes( const NodeT* nodes, 
+												  KdData** rays, int numRays, unsigned int packetMask, 
+												  const double* maxDistances, KdPacketStack& stack )
+{
+	double startPos[3][MaxPacketRays];
+	double dirInv[3][MaxPacketRays];
+	double minDistance[MaxPacketRays];
+	double maxDistance[MaxPacketRays];
+	double stopDistance[MaxPacketRays];
+	unsigned int stopDistanceActive = 0;	// For AnyHit, the rays found to be blocked
+	KdMailbox* mailbox = rays[0]->Mailbox;
+	KdTraverseStats& stats = StatsFor( rays[0] );
+
+	const VectorR3& firstDir = rays[0]->kdTraverseDir;
+	int signDir[3] = { Sign(firstDir.x), Sign(firstDir.y), Sign(firstDir.z) };
+	// The loops over the rays at each node have no branches and may include
+	//	 rays outside packetMask, so those are given the values of a ray inside it.
+	int firstInPacket = 0;
+	while ( !(packetMask & (1u<<firstInPacket)) ) {
+		firstInPacket++;
+	}
+	for ( int k=0; k<numRays; k++ ) {
+		bool inPacket = ( (packetMask & (1u<<k))!=0 );
+		const VectorR3& start = rays[inPacket ? k : firstInPacket]->kdStartPos;
+		const VectorR3& dir = rays[inPacket ? k : firstInPacket]->kdTraverseDir;
+		VectorR3 inv( 1.0/dir.x, 1.0/dir.y, 1.0/dir.z );
+		startPos[0][k] = start.x;
+		startPos[1][k] = start.y;
+		startPos[2][k] = start.z;
+		dirInv[0][k] = inv.x;
+		dirInv[1][k] = inv.y;
+		dirInv[2][k] = inv.z;
+		minDistance[k] = maxDistance[k] = 0.0;
+		if ( !inPacket ) {
+			continue;
+		}
+		double entryDist, exitDist;
+		int entryFaceId, exitFaceId;
+		bool intersectsAABB = BoundingBox.RayEntryExit( start, signDir[0], signDir[1], signDir[2], inv,
+														&entryDist, &entryFaceId, &exitDist, &exitFaceId );
+		if ( !intersectsAABB || exitDist<0.0 ) {
+			packetMask &= ~(1u<<k);
+			continue;
+		}
+		minDistance[k] = Max(0.0, entryDist);
+		maxDistance[k] = exitDist;
+		if ( AnyHit && maxDistance[k]>maxDistances[k] ) {
+			if ( maxDistances[k]<minDistance[k] ) {
+				packetMask &= ~(1u<<k);
+				continue;
+			}
+			maxDistance[k] = maxDistances[k];
+		}
+	}
+
+	stack.Reset();
+	long currentNodeIndex = RootIndex();
+	unsigned int activeMask = packetMask;		// The rays traversing the current node
+	while ( activeMask!=0 ) {
+		const NodeT* currentNode = nodes+currentNodeIndex;
+		int numActive = NumRaysInMask( activeMask );
+		stats.PacketSteps++;
+		stats.PacketRaySteps += numActive;
+		// The loops over the rays run only from the first to the last active ray,
+		//	 so once the packet has diverged to a single ray it is traversed alone.
+		int kFirst = 0;
+		while ( !(activeMask & (1u<<kFirst)) ) {
+			kFirst++;
+		}
+		int kEnd = numRays;
+		while ( !(activeMask & (1u<<(kEnd-1))) ) {
+			kEnd--;
+		}
+		if ( ! currentNode->IsLeaf() ) {
+			stats.NodesTraversed += numActive;
+			int axis = currentNode->SplitAxis();
+			double splitValue = currentNode->SplitValue();
+			long nearNodeIdx;
+			long farNodeIdx;
+			if ( signDir[axis]>0 ) {
+				nearNodeIdx = LeftChild( *currentNode, currentNodeIndex );
+				farNodeIdx = currentNode->RightChildIndex();
+			}
+			else {
+				nearNodeIdx = currentNode->RightChildIndex();
+				farNodeIdx = LeftChild( *currentNode, currentNodeIndex );
+			}
+			const double* thisStartPt = startPos[axis];
+			const double* thisDirInv = dirInv[axis];
+			double splitDistance[MaxPacketRays];
+			unsigned int nearMask = 0;			// The rays with splitDistance>=minDistance
+			unsigned int farMask = 0;			// The rays with splitDistance<=maxDistance
+			for ( int k=kFirst; k<kEnd; k++ ) {
+				double t = (splitValue-thisStartPt[k])*thisDirInv[k];
+				splitDistance[k] = t;
+				nearMask |= (unsigned int)( !(t<minDistance[k]) ) << k;
+				farMask |= (unsigned int)( !(t>maxDistance[k]) ) << k;
+			}
+			nearMask = ( nearNodeIdx==-1 ) ? 0 : (nearMask & activeMask);
+			farMask = ( farNodeIdx==-1 ) ? 0 : (farMask & activeMask);
+			if ( nearMask!=0 ) {
+				if ( farMask!=0 ) {
+					// Push the far node, for the rays that reach it
+					Kd_TraversePacketData& farNode = stack.Push();
+					farNode.NodeNumber = farNodeIdx;
+					farNode.RayMask = farMask;
+					for ( int k=kFirst; k<kEnd; k++ ) {
+						double t = splitDistance[k];
+						farNode.MinDistance[k] = (t<minDistance[k]) ? minDistance[k] : t;
+						farNode.MaxDistance[k] = maxDistance[k];
+					}
+				}
+				// Rays in nearMask and farMask now end at the split plane.
+				//	 The others are done with this node or do not change.
+				for ( int k=kFirst; k<kEnd; k++ ) {
+					double t = splitDistance[k];
+					maxDistance[k] = (t>maxDistance[k]) ? maxDistance[k] : t;
+				}
+				activeMask = nearMask;
+				currentNodeIndex = nearNodeIdx;
+				continue;
+			}
+			if ( farMask!=0 ) {
+				for ( int k=kFirst; k<kEnd; k++ ) {
+					double t = splitDistance[k];
+					minDistance[k] = (t<minDistance[k]) ? minDistance[k] : t;
+				}
+				activeMask = farMask;
+				currentNodeIndex = farNodeIdx;
+				continue;
+			}
+			// No ray goes on: get the next node from the stack.
+		}
+
+		else {
+			// Handle leaf nodes by invoking the callback function for each active ray
+			int numObjects = currentNode->GetNumObjects();
+			const long* leafObjects = LeafObjects( *currentNode );
+			stats.LeavesTraversed += numActive;
+			stats.ObjectsInLeaves += numObjects*numActive;
+			for ( int k=kFirst; k<kEnd; k++ ) {
+				if ( !(activeMask & (1u<<k)) ) {
+					continue;
+				}
+				KdData* data = rays[k];
+				if ( mailbox ) {
+					mailbox->SelectRay( k );
+				}
+				if ( AnyHit ) {
+					for ( int i=0; i<numObjects; i++ ) {
+						if ( (*((PotentialOccluderCallback*)data->CallbackFunction))( data, leafObjects[i] ) ) {
+							stopDistanceActive |= (1u<<k);
+							packetMask &= ~(1u<<k);			// This ray is done
+							break;
+						}
+					}
+				}
+				else if ( data->UseListCallback ) {
+					double newStopDist;
+					if ( (*((PotentialObjectsListCallback*)data->CallbackFunction))(
+										data, numObjects, LeafObjects( *currentNode ), &newStopDist ) ) 
+					{
+						stopDistanceActive |= (1u<<k);
+						stopDistance[k] = newStopDist;
+					}
+				}
+				else {
+					double newStopDist;
+					for ( int i=0; i<numObjects; i++ ) {
+						if ( (*((PotentialObjectCallback*)data->CallbackFunction))( data, leafObjects[i], &newStopDist ) ) {
+							stopDistanceActive |= (1u<<k);
+							stopDistance[k] = newStopDist;
+						}
+					}
+				}
+			}
+		}
+
+		// Done with a node.  Get the next node from the stack that some ray still needs.
+		activeMask = 0;
+		while ( activeMask==0 && !stack.IsEmpty() ) {
+			Kd_TraversePacketData& topNode = stack.Pop();
+			activeMask = topNode.RayMask & packetMask;
+			for ( int k=0; k<numRays; k++ ) {
+				if ( activeMask & (1u<<k) ) {
+					minDistance[k] = topNode.MinDistance[k];
+					maxDistance[k] = topNode.MaxDistance[k];
+					if ( !AnyHit && (stopDistanceActive & (1u<<k)) && minDistance[k]>stopDistance[k] ) {
+						// This ray is fully done
+						packetMask &= ~(1u<<k);
+						activeMask &= ~(1u<<k);
+					}
+				}
+			}
+			currentNodeIndex = topNode.NodeNumber;
+		}
+	}
+	return stopDistanceActive;
+}
+
 /***********************************************************************************************
  * Tree building functions.
  ***********************************************************************************************/
 void KdTree::BuildTree(long numObjects, ExtentFunction* extentFunc, ExtentInBoxFunction* extentInBoxFunc )
 {
 	assert (TreeSize() == 0);
+	auto startTime = std::chrono::steady_clock::now();
 	NumObjects = numObjects;
 	ExtentFunc = extentFunc;
 	ExtentInBoxFunc = extentInBoxFunc;
 
+	BuildThreadsUsed = BuildThreads;
+	if ( BuildThreadsUsed<=0 ) {
+		BuildThreadsUsed = Max( 1, (int)std::thread::hardware_concurrency() );
+	}
+	bool inParallel = ( BuildThreadsUsed>1 && numObjects>=MinObjectsForBuildTask );
+
 	// Get total cost of all objects
 	if ( UseConstantCost ) {
 		TotalObjectCosts = ObjectConstantCost*NumObjects;
@@ -310,11 +655,14 @@ void KdTree::BuildTree(long numObjects, ExtentFunction* extentFunc, ExtentInBoxF
 
 	// Calculate all initial extents
 	long i;
-	AABB* ObjectAabbPtr = ObjectAABBs;
-	for (i=0; i<numObjects; i++ ) {
-		(*ExtentFunc)( i, *ObjectAabbPtr );
-		ObjectAabbPtr++;
-	}
+	AABB* ObjectAabbPtr;
+	int numExtentTasks = inParallel ? BuildThreadsUsed : 1;
+	RunBuildTasks( numExtentTasks, inParallel, [this,numObjects,numExtentTasks]( int task ) {
+		long last = (numObjects*(task+1))/numExtentTasks;
+		for ( long j=(numObjects*task)/numExtentTasks; j<last; j++ ) {
+			(*ExtentFunc)( j, ObjectAABBs[j] );
+		}
+	} );
 
 	// Pick the overall BoundingBox to enclose all the individual bounding boxes.
 	BoundingBox = *ObjectAABBs;
@@ -348,19 +696,119 @@ void KdTree::BuildTree(long numObjects, ExtentFunction* extentFunc, ExtentInBoxF
 	// Need this for memory management of ExtentTriple lists
 	long spaceAvailable = 2*(ExtentTripleStorageMultiplier-1)*NumObjects;
 
-	// Sort the triples
-	XextentList.Sort();
-	YextentList.Sort();
-	ZextentList.Sort();
+	// Sort the triples.  (Unless the root uses binned splitting.)
+	if ( !UseBinnedSplit( numObjects ) ) {
+		ExtentTripleArrayInfo* extentLists[3] = { &XextentList, &YextentList, &ZextentList };
+		RunBuildTasks( 3, inParallel, [&extentLists]( int axis ) { extentLists[axis]->Sort(); } );
+	}
+
+	// Subtrees are built in parallel down to the level where there is about
+	//	 one subtree per thread, and one level further for load balance.
+	int parallelDepth = 0;
+	if ( inParallel ) {
+		while ( (1<<parallelDepth)<BuildThreadsUsed ) {
+			parallelDepth++;
+		}
+		parallelDepth++;
+	}
 		
 	// Recursively build the entire tree!
 	KdTreeNode& RootNode = TreeNodes[RootIndex()];
 	RootNode.ParentIdx = -1;				// No parent, it is the root node
-	BuildSubTree ( RootIndex(), BoundingBox, TotalObjectCosts, XextentList, YextentList, ZextentList, spaceAvailable );
+	BuildSubTree ( RootIndex(), BoundingBox, TotalObjectCosts, XextentList, YextentList, ZextentList, 
+				   spaceAvailable, parallelDepth );
 
 	delete[] ObjectAABBs;
 	delete[] ET_Lists;
 	delete[] LeftRightStatus;
+
+	CalcMaxDepth();
+	MakeCompactTree();
+
+	auto endTime = std::chrono::steady_clock::now();
+	BuildSeconds = std::chrono::duration<double>(endTime - startTime).count();
+}
+
+// Find the depth of the deepest leaf.  This bounds the size of the traversal stack.
+void KdTree::CalcMaxDepth()
+{
+	MaxDepth = 0;
+	Stack<long> nodeStack;
+	Stack<long> depthStack;
+	nodeStack.Push( RootIndex() );
+	depthStack.Push( 0 );
+	while ( !nodeStack.IsEmpty() ) {
+		const KdTreeNode& node = TreeNodes[nodeStack.Pop()];
+		long depth = depthStack.Pop();
+		UpdateMax( depth, MaxDepth );
+		if ( !node.IsLeaf() ) {
+			if ( !node.LeftChildEmpty() ) {
+				nodeStack.Push( node.LeftChildIndex() );
+				depthStack.Push( depth+1 );
+			}
+			if ( !node.RightChildEmpty() ) {
+				nodeStack.Push( node.RightChildIndex() );
+				depthStack.Push( depth+1 );
+			}
+		}
+	}
+}
+
+// Make the compact nodes and the single list of leaf objects.
+//	 The leaves of TreeNodes are changed to use the single list.
+void KdTree::MakeCompactTree()
+{
+	long numNodes = TreeSize();
+	NumLeafEntries = 0;
+	for ( long i=0; i<numNodes; i++ ) {
+		const KdTreeNode& node = TreeNodes[i];
+		if ( node.IsLeaf() ) {
+			NumLeafEntries += node.GetNumObjects();
+		}
+	}
+	assert ( numNodes < (1L<<29) && NumLeafEntries < (1L<<32) );	// Fit in the node's bit fields
+
+	CompactNodes = new KdCompactNode[numNodes];
+	LeafObjectList = new long[Max(NumLeafEntries,1L)];
+	if ( !CompactNodes || !LeafObjectList ) {
+		MemoryError();
+	}
+	long nextNode = 0;
+	long nextLeafEntry = 0;
+	MakeCompactSubTree( RootIndex(), &nextNode, &nextLeafEntry );
+	assert ( nextNode==numNodes && nextLeafEntry==NumLeafEntries );
+}
+
+// Put the subtree at TreeNodes[nodeIndex] into CompactNodes, starting at *nextNode.
+void KdTree::MakeCompactSubTree( long nodeIndex, long* nextNode, long* nextLeafEntry )
+{
+	KdTreeNode& node = TreeNodes[nodeIndex];
+	KdCompactNode& compact = CompactNodes[(*nextNode)++];
+	if ( node.IsLeaf() ) {
+		long numObjects = node.GetNumObjects();
+		long* objectList = LeafObjectList + *nextLeafEntry;
+		for ( long i=0; i<numObjects; i++ ) {
+			objectList[i] = node.Data.Leaf.ObjectList[i];
+		}
+		delete[] node.Data.Leaf.ObjectList;
+		node.Data.Leaf.ObjectList = objectList;
+		compact.Value.FirstObject = (unsigned int)(*nextLeafEntry);
+		compact.Flags = ((unsigned int)numObjects<<2) | KD_LEAF;
+		*nextLeafEntry += numObjects;
+		return;
+	}
+	compact.Value.Split = (float)node.SplitValue();
+	compact.Flags = (unsigned int)node.SplitAxis();
+	if ( node.LeftChildEmpty() ) {
+		compact.Flags |= KdCompactNode::LeftEmptyBit;
+	}
+	else {
+		MakeCompactSubTree( node.LeftChildIndex(), nextNode, nextLeafEntry );	// Left child is next
+	}
+	if ( !node.RightChildEmpty() ) {
+		compact.Flags |= (unsigned int)(*nextNode)<<3;
+		MakeCompactSubTree( node.RightChildIndex(), nextNode, nextLeafEntry );
+	}
 }
 
 // Recursively build a subtree.
@@ -370,12 +818,17 @@ void KdTree::BuildTree(long numObjects, ExtentFunction* extentFunc, ExtentInBoxF
 // spaceAvailable gives the amount of room for growth of the ExtentTripleLists.
 void KdTree::BuildSubTree( long baseIndex, AABB& aabb, double totalObjectCost,
 					ExtentTripleArrayInfo& xExtents, ExtentTripleArrayInfo& yExtents, 
-					ExtentTripleArrayInfo& zExtents, long spaceAvailable )
+					ExtentTripleArrayInfo& zExtents, long spaceAvailable, int parallelDepth )
 {
 
 	VectorR3 deltaAABB = aabb.GetBoxMax();
 	deltaAABB -= aabb.GetBoxMin();
 
+	// Large nodes near the root split their work between threads
+	bool inParallel = ( parallelDepth>0 && xExtents.NumObjects()>=MinObjectsForBuildTask );
+	bool binned = UseBinnedSplit( xExtents.NumObjects() );	// If so, the triples are not sorted
+	int numTasks = inParallel ? Max( 1<<(parallelDepth-1), 2 ) : 1;
+
 	// Step 1.
 	// Try all three axes to find the best split decision
 	KD_SplittingAxis splitAxisID;	// 0-2 for axis x,y,z OR 3 for no split
@@ -389,7 +842,7 @@ void KdTree::BuildSubTree( long baseIndex, AABB& aabb, double totalObjectCost,
 	CalcBestSplit( aabb, deltaAABB, totalObjectCost, xExtents, yExtents, zExtents,
 					&splitAxisID, &splitValue, 
 					&numTriplesToLeft, &numObjectsToLeft, &numObjectsToRight, 
-					&costObjectsToLeft, &costObjectsToRight );
+					&costObjectsToLeft, &costObjectsToRight, inParallel );
 	switch ( splitAxisID ) {
 		case KD_LEAF:
 			{
@@ -447,7 +900,7 @@ void KdTree::BuildSubTree( long baseIndex, AABB& aabb, double totalObjectCost,
 			childAabb.SetNewAxisMax( splitAxisID, splitValue );
 		}
 		BuildSubTree( childIndex, childAabb, totalObjectCost,
-						xExtents, yExtents, zExtents, spaceAvailable );
+						xExtents, yExtents, zExtents, spaceAvailable, parallelDepth );
 		return;
 	}
 	
@@ -456,19 +909,47 @@ void KdTree::BuildSubTree( long baseIndex, AABB& aabb, double totalObjectCost,
 	// Decide which objects go left and right - Store info in LeftRightStatus[]
 	ExtentTriple* etPtr = splitExtentList->TripleArray;
 	long i;
-	for ( i=0; i<numTriplesToLeft; i++, etPtr++ ) {
-		// It is on the left, don't know if on right yet, so set as not.
-		LeftRightStatus[ etPtr->ObjectID ] = 1;			// Set first bit, reset second bit
-	}
 	long n = splitExtentList->NumTriples();
-	for ( ; i<n; i++, etPtr++ ) {
-		if ( etPtr->ExtentType == ExtentTriple::TT_MAX ) {
-			// On right side.  Maybe on left side too.
-			LeftRightStatus[ etPtr->ObjectID ] |= 2;		// Set second bit
+	if ( binned ) {
+		// The triples are not sorted, so compare each one to the split value.
+		//	 As in CountSplitSides, objects go left if min<splitValue, and right if max>splitValue.
+		ExtentTriple* firstTriple = etPtr;
+		for ( i=0; i<n; i++, etPtr++ ) {
+			LeftRightStatus[ etPtr->ObjectID ] = 0;
 		}
-		else {
-			// On right side only
-			LeftRightStatus[ etPtr->ObjectID ] = 2;			// Set second bit, reset first bit
+		etPtr = firstTriple;
+		for ( i=0; i<n; i++, etPtr++ ) {
+			switch ( etPtr->ExtentType ) {
+			case ExtentTriple::TT_MIN:
+				if ( etPtr->ExtentValue<splitValue ) {
+					LeftRightStatus[ etPtr->ObjectID ] |= 1;
+				}
+				break;
+			case ExtentTriple::TT_MAX:
+				if ( etPtr->ExtentValue>splitValue ) {
+					LeftRightStatus[ etPtr->ObjectID ] |= 2;
+				}
+				break;
+			case ExtentTriple::TT_FLAT:
+				LeftRightStatus[ etPtr->ObjectID ] = ( etPtr->ExtentValue<=splitValue ) ? 1 : 2;
+				break;
+			}
+		}
+	}
+	else {
+		for ( i=0; i<numTriplesToLeft; i++, etPtr++ ) {
+			// It is on the left, don't know if on right yet, so set as not.
+			LeftRightStatus[ etPtr->ObjectID ] = 1;			// Set first bit, reset second bit
+		}
+		for ( ; i<n; i++, etPtr++ ) {
+			if ( etPtr->ExtentType == ExtentTriple::TT_MAX ) {
+				// On right side.  Maybe on left side too.
+				LeftRightStatus[ etPtr->ObjectID ] |= 2;		// Set second bit
+			}
+			else {
+				// On right side only
+				LeftRightStatus[ etPtr->ObjectID ] = 2;			// Set second bit, reset first bit
+			}
 		}
 	}
 
@@ -538,11 +1019,13 @@ void KdTree::BuildSubTree( long baseIndex, AABB& aabb, double totalObjectCost,
 	ExtentTripleArrayInfo newYextents( yExtents.EndOfArray, 0, 0 );
 	ExtentTripleArrayInfo newZextents( zExtents.EndOfArray, 0, 0 );
 	// Create the AABB's for the smaller subtree
-	MakeAabbsForSubtree( leftRightFlag, xExtents, *smallerChildAabb );
+	MakeAabbsForSubtree( leftRightFlag, xExtents, *smallerChildAabb, numTasks );
 	// Copy the extent triples for the smaller subtree
-	CopyTriplesForSubtree( leftRightFlag, 0, xExtents, newXextents ); 
-	CopyTriplesForSubtree( leftRightFlag, 1, yExtents, newYextents ); 
-	CopyTriplesForSubtree( leftRightFlag, 2, zExtents, newZextents ); 
+	ExtentTripleArrayInfo* fromLists[3] = { &xExtents, &yExtents, &zExtents };
+	ExtentTripleArrayInfo* toLists[3] = { &newXextents, &newYextents, &newZextents };
+	RunBuildTasks( 3, inParallel, [&]( int axis ) {
+		CopyTriplesForSubtree( leftRightFlag, axis, *fromLists[axis], *toLists[axis] ); 
+	} );
 	// Recalculate total cost if necessary, i.e., if some objects go missing
 	if ( newXextents.NumObjects()!=smallerNumObjects ) {
 		smallerTotalCost = CalcTotalCosts( newXextents );
@@ -551,11 +1034,11 @@ void KdTree::BuildSubTree( long baseIndex, AABB& aabb, double totalObjectCost,
 	// Step 8.
 	leftRightFlag = 3-leftRightFlag;
 	// Create the AABB's for the larger subtree
-	MakeAabbsForSubtree( leftRightFlag, xExtents, *largerChildAabb );
+	MakeAabbsForSubtree( leftRightFlag, xExtents, *largerChildAabb, numTasks );
 	// Copy the extent triples for the larger subtree
-	CopyTriplesForSubtree( leftRightFlag, 0, xExtents, xExtents ); 
-	CopyTriplesForSubtree( leftRightFlag, 1, yExtents, yExtents ); 
-	CopyTriplesForSubtree( leftRightFlag, 2, zExtents, zExtents ); 
+	RunBuildTasks( 3, inParallel, [&]( int axis ) {
+		CopyTriplesForSubtree( leftRightFlag, axis, *fromLists[axis], *fromLists[axis] ); 
+	} );
 	leftRightFlag = 3-leftRightFlag;		// Reset to smaller subtree again
 	// Recalculate total cost if necessary, i.e., if some objects go missing
 	if ( xExtents.NumObjects()!=largerNumObjects ) {
@@ -564,20 +1047,171 @@ void KdTree::BuildSubTree( long baseIndex, AABB& aabb, double totalObjectCost,
 
 	// Step 9.
 	// Invoke BuildSubTree recursively for the two subtrees
+	if ( inParallel && newXextents.NumObjects()>=MinObjectsForBuildTask ) {
+		BuildSubTreesInParallel( smallerChildIdx, *smallerChildAabb, smallerTotalCost,
+								 newXextents, newYextents, newZextents,
+								 largerChildIdx, *largerChildAabb, largerTotalCost,
+								 xExtents, yExtents, zExtents, spaceAvailable, parallelDepth-1 );
+		return;
+	}
 	BuildSubTree(smallerChildIdx, *smallerChildAabb, smallerTotalCost,
-					newXextents, newYextents, newZextents, newSpaceAvailable);
+					newXextents, newYextents, newZextents, newSpaceAvailable, parallelDepth );
 	BuildSubTree(largerChildIdx, *largerChildAabb, largerTotalCost,
-					xExtents, yExtents, zExtents, spaceAvailable );
+					xExtents, yExtents, zExtents, spaceAvailable, parallelDepth );
+
+}
+
+
+// Build the two subtrees at once.  The smaller subtree is built on a new
+//	 thread, in a separate KdTree.  Its nodes are then moved into this tree
+//	 so that every node has the index it gets from the sequential build: the
+//	 smaller subtree's nodes come before the larger's.
+void KdTree::BuildSubTreesInParallel( long smallerChildIdx, AABB& smallerAabb, double smallerTotalCost,
+					ExtentTripleArrayInfo& smallerXextents, ExtentTripleArrayInfo& smallerYextents, 
+					ExtentTripleArrayInfo& smallerZextents,
+					long largerChildIdx, AABB& largerAabb, double largerTotalCost,
+					ExtentTripleArrayInfo& xExtents, ExtentTripleArrayInfo& yExtents, 
+					ExtentTripleArrayInfo& zExtents, long spaceAvailable, int parallelDepth )
+{
+	// The smaller subtree's triples are copied out now, as the larger 
+	//	 subtree reuses the space they are in.
+	KdTree subTree;
+	const ExtentTripleArrayInfo* fromExtents[3] = { &smallerXextents, &smallerYextents, &smallerZextents };
+	ExtentTripleArrayInfo subXextents, subYextents, subZextents;
+	ExtentTripleArrayInfo* subExtents[3] = { &subXextents, &subYextents, &subZextents };
+	long subSpaceAvailable;
+	subTree.StartSubTreeBuild( *this, fromExtents, subExtents, &subSpaceAvailable );
+
+	long firstNewIdx = TreeSize();
+	std::thread subTreeThread( [&]() {
+		subTree.BuildSubTree( subTree.RootIndex(), smallerAabb, smallerTotalCost,
+							  subXextents, subYextents, subZextents, subSpaceAvailable, parallelDepth );
+	} );
+	BuildSubTree( largerChildIdx, largerAabb, largerTotalCost,
+				  xExtents, yExtents, zExtents, spaceAvailable, parallelDepth );
+	subTreeThread.join();
+
+	subTree.EndSubTreeBuild();
+	MoveSubTreeNodes( subTree, smallerChildIdx, largerChildIdx, firstNewIdx );
+}
+
+// Copy the settings used for building the tree.
+void KdTree::CopyBuildSettings( const KdTree& from )
+{
+	NumObjects = from.NumObjects;
+	TotalObjectCosts = from.TotalObjectCosts;
+	SplitAlgorithm = from.SplitAlgorithm;
+	NumSplitBins = from.NumSplitBins;
+	MaxExactSplitObjects = from.MaxExactSplitObjects;
+	StoppingCostPerRay = from.StoppingCostPerRay;
+	UseConstantCost = from.UseConstantCost;
+	ObjectConstantCost = from.ObjectConstantCost;
+	UserCostFunction = from.UserCostFunction;
+	ExtentFunc = from.ExtentFunc;
+	ExtentInBoxFunc = from.ExtentInBoxFunc;
+	BoundingBoxSurfaceArea = from.BoundingBoxSurfaceArea;
+	BuildThreadsUsed = from.BuildThreadsUsed;
+}
+
+// Set up this KdTree to build a subtree of the parent's tree.  The subtree's
+//	 root is node 0.  Its triples are copied into new storage, with space to 
+//	 grow in the same proportion as for a whole tree.
+void KdTree::StartSubTreeBuild( const KdTree& parent, const ExtentTripleArrayInfo* fromExtents[3],
+								ExtentTripleArrayInfo* newExtents[3], long* spaceAvailable )
+{
+	CopyBuildSettings( parent );
+	ObjectAABBs = new AABB[NumObjects];
+	LeftRightStatus = new unsigned char[NumObjects];
+	long numInSubTree = fromExtents[0]->NumObjects();
+	long axisStorage = (2*ExtentTripleStorageMultiplier)*numInSubTree;
+	ET_Lists = new ExtentTriple[3*axisStorage];
+	if ( !ObjectAABBs || !LeftRightStatus || !ET_Lists ) {
+		MemoryError();
+	}
+	for ( int axis=0; axis<3; axis++ ) {
+		const ExtentTripleArrayInfo& from = *fromExtents[axis];
+		ExtentTriple* toArray = ET_Lists + axis*axisStorage;
+		long n = from.NumTriples();
+		for ( long i=0; i<n; i++ ) {
+			toArray[i] = from.TripleArray[i];
+		}
+		newExtents[axis]->Init( toArray, from.NumMaxMins, from.NumFlats );
+	}
+	*spaceAvailable = 2*(ExtentTripleStorageMultiplier-1)*numInSubTree;
 
+	long rootIdx = NextIndex();
+	TreeNodes[rootIdx].ParentIdx = -1;
 }
 
+void KdTree::EndSubTreeBuild()
+{
+	delete[] ObjectAABBs;
+	delete[] ET_Lists;
+	delete[] LeftRightStatus;
+}
+
+// Move the nodes of a subtree built by another KdTree into this tree.  Its root
+//	 becomes node subTreeRootIdx, and its other nodes are inserted at firstNewIdx.
+//	 The nodes from firstNewIdx on (the subtree at largerRootIdx) move up to make
+//	 room.  The leaves' object lists now belong to this tree.
+void KdTree::MoveSubTreeNodes( const KdTree& subTree, long subTreeRootIdx, long largerRootIdx, long firstNewIdx )
+{
+	long shift = subTree.TreeSize()-1;				// Number of nodes inserted
+	long oldSize = TreeSize();
+	for ( long i=0; i<shift; i++ ) {
+		NextIndex();
+	}
+
+	// Move up the nodes from firstNewIdx on, and renumber the references to them.
+	//	 These come from the moved nodes and from the root of their subtree.
+	auto renumber = [firstNewIdx,shift]( KdTreeNode& node ) {
+		if ( node.ParentIdx>=firstNewIdx ) {
+			node.ParentIdx += shift;
+		}
+		if ( !node.IsLeaf() ) {
+			if ( node.Data.Split.LeftChildIdx>=firstNewIdx ) {
+				node.Data.Split.LeftChildIdx += shift;
+			}
+			if ( node.Data.Split.RightChildIdx>=firstNewIdx ) {
+				node.Data.Split.RightChildIdx += shift;
+			}
+		}
+	};
+	for ( long i=oldSize-1; i>=firstNewIdx; i-- ) {
+		TreeNodes[i+shift] = TreeNodes[i];
+		renumber( TreeNodes[i+shift] );
+	}
+	renumber( TreeNodes[largerRootIdx] );
+
+	// Copy in the subtree's nodes.  Node k>0 of the subtree goes to firstNewIdx+k-1.
+	for ( long k=0; k<=shift; k++ ) {
+		const KdTreeNode& fromNode = subTree.TreeNodes[k];
+		KdTreeNode& toNode = TreeNodes[ (k==0) ? subTreeRootIdx : firstNewIdx+k-1 ];
+		long parentIdx = toNode.ParentIdx;			// Already set for the root
+		toNode = fromNode;
+		if ( k!=0 ) {
+			parentIdx = (fromNode.ParentIdx==0) ? subTreeRootIdx : firstNewIdx+fromNode.ParentIdx-1;
+		}
+		toNode.ParentIdx = parentIdx;
+		if ( !toNode.IsLeaf() ) {
+			long& leftIdx = toNode.Data.Split.LeftChildIdx;
+			long& rightIdx = toNode.Data.Split.RightChildIdx;
+			if ( leftIdx!=-1 ) {
+				leftIdx += firstNewIdx-1;
+			}
+			if ( rightIdx!=-1 ) {
+				rightIdx += firstNewIdx-1;
+			}
+		}
+	}
+}
 
 void KdTree::CalcBestSplit( const AABB& aabb, const VectorR3& deltaBox, double totalObjectCost, 
 					const ExtentTripleArrayInfo& xExtents, const ExtentTripleArrayInfo& yExtents, 
 					const ExtentTripleArrayInfo& zExtents,
 					KD_SplittingAxis* splitAxisID, double* splitValue, 
 					long* numTriplesToLeft, long* numObjectsToLeft, long* numObjectsToRight, 
-					double* costObjectsToLeft, double* costObjectsToRight )
+					double* costObjectsToLeft, double* costObjectsToRight, bool inParallel )
 {
 	assert( xExtents.NumObjects() == yExtents.NumObjects() );
 	assert( yExtents.NumObjects() == zExtents.NumObjects() );
@@ -591,6 +1225,69 @@ void KdTree::CalcBestSplit( const AABB& aabb, const VectorR3& deltaBox, double t
 		return;						// There is no way to improve enough to bother.
 	}
 
+	if ( UseBinnedSplit( xExtents.NumObjects() ) ) {
+		// Binned splitting: try each axis in turn, then count the objects
+		//	 on each side of the best plane.  numTriplesToLeft is only
+		//	 used to tell if the left side is empty.
+		const ExtentTripleArrayInfo* extents[3] = { &xExtents, &yExtents, &zExtents };
+		double bestCost = totalObjectCost;
+		for ( int axis=0; axis<3; axis++ ) {
+			int secondAxis = (axis==0) ? 1 : 0;
+			int thirdAxis = (axis==2) ? 1 : 2;
+			if ( CalcBestSplitBinned( totalObjectCost, costToBeat, *extents[axis], 
+									  aabb.GetBoxMin()[axis], aabb.GetBoxMax()[axis],
+									  deltaBox[secondAxis], deltaBox[thirdAxis],
+									  &bestCost, splitValue ) )
+			{
+				*splitAxisID = (KD_SplittingAxis)axis;
+				costToBeat = bestCost;
+			}
+		}
+		if ( *splitAxisID!=KD_LEAF ) {
+			CountSplitSides( *extents[*splitAxisID], *splitValue, numObjectsToLeft, numObjectsToRight,
+							 costObjectsToLeft, costObjectsToRight );
+			*numTriplesToLeft = *numObjectsToLeft;
+		}
+		return;
+	}
+
+	if ( inParallel && ( SplitAlgorithm==MacDonaldBooth || SplitAlgorithm==MacDonaldBoothModifiedCoefs ) ) {
+		// The MacDonald-Booth cost of a split does not depend on the cost to beat,
+		//	 so the three axes can be searched at once, and the results combined
+		//	 as the search of the axes in turn would.  Each axis has its own
+		//	 KdTree to hold the CF_ values.  (The double recurse costs depend 
+		//	 slightly on the cost to beat, so those axes are searched in turn.)
+		const ExtentTripleArrayInfo* extents[3] = { &xExtents, &yExtents, &zExtents };
+		KdTree axisTrees[3];
+		bool found[3];
+		double axisCost[3], axisSplitValue[3], axisCostLeft[3], axisCostRight[3];
+		long axisTriplesLeft[3], axisObjectsLeft[3], axisObjectsRight[3];
+		RunBuildTasks( 3, true, [&]( int axis ) {
+			int secondAxis = (axis==0) ? 1 : 0;
+			int thirdAxis = (axis==2) ? 1 : 2;
+			axisTrees[axis].CopyBuildSettings( *this );
+			found[axis] = axisTrees[axis].CalcBestSplit( totalObjectCost, costToBeat, *extents[axis], 
+								aabb.GetBoxMin()[axis], aabb.GetBoxMax()[axis], 
+								deltaBox[secondAxis], deltaBox[thirdAxis],
+								axisCost+axis, axisSplitValue+axis, 
+								axisTriplesLeft+axis, axisObjectsLeft+axis, axisObjectsRight+axis,
+								axisCostLeft+axis, axisCostRight+axis );
+		} );
+		for ( int axis=0; axis<3; axis++ ) {
+			if ( found[axis] && axisCost[axis]<costToBeat ) {
+				*splitAxisID = (KD_SplittingAxis)axis;
+				costToBeat = axisCost[axis];
+				*splitValue = axisSplitValue[axis];
+				*numTriplesToLeft = axisTriplesLeft[axis];
+				*numObjectsToLeft = axisObjectsLeft[axis];
+				*numObjectsToRight = axisObjectsRight[axis];
+				*costObjectsToLeft = axisCostLeft[axis];
+				*costObjectsToRight = axisCostRight[axis];
+			}
+		}
+		return;
+	}
+
 	// Try each of the three axes in turn.
 	double bestCostSoFar = totalObjectCost; 
 	if ( CalcBestSplit( totalObjectCost, costToBeat, xExtents, 
@@ -708,6 +1405,109 @@ bool KdTree::CalcBestSplit( double totalObjectCosts, double costToBeat,
 	return foundBetter;
 }
 
+// Binned search for the best split on one axis.  The triples need not be
+//	 sorted.  The split cost is evaluated at the boundaries between NumSplitBins
+//	 equal bins, counting an object as on the left if its min (or flat) is in a
+//	 lower bin, and on the right unless its max (or flat) is in a lower bin.
+// Returns true if a new better split is found on the axis.
+bool KdTree::CalcBestSplitBinned( double totalObjectCosts, double costToBeat, 
+						const ExtentTripleArrayInfo& extents, 
+						double minOnAxis, double maxOnAxis, 
+						double secondAxisLen, double thirdAxisLen,
+						double* retNewBestCost, double* retSplitValue )
+{
+	if ( minOnAxis>=maxOnAxis ) {
+		return false;		// We do not support splitting a zero length axis.
+	}
+
+	InitSplitCostFunction( minOnAxis, maxOnAxis, secondAxisLen, thirdAxisLen,
+							costToBeat, totalObjectCosts );
+
+	// Cost of the objects starting (min or flat) and ending (max or flat) in each bin.
+	double startCosts[MaxSplitBins];
+	double endCosts[MaxSplitBins];
+	for ( int b=0; b<NumSplitBins; b++ ) {
+		startCosts[b] = endCosts[b] = 0.0;
+	}
+	double binScale = NumSplitBins/(maxOnAxis-minOnAxis);
+	ExtentTriple* etPtr = extents.TripleArray;
+	long n = extents.NumTriples();
+	for ( long i=0; i<n; i++, etPtr++ ) {
+		int bin = (int)((etPtr->ExtentValue-minOnAxis)*binScale);
+		ClampRange( &bin, 0, NumSplitBins-1 );
+		double cost = ObjectCost( etPtr->ObjectID );
+		if ( etPtr->ExtentType!=ExtentTriple::TT_MAX ) {
+			startCosts[bin] += cost;
+		}
+		if ( etPtr->ExtentType!=ExtentTriple::TT_MIN ) {
+			endCosts[bin] += cost;
+		}
+	}
+
+	bool foundBetter = false;
+	double bestCost = costToBeat;
+	double costLeft = 0.0;
+	double costRight = totalObjectCosts;
+	double binWidth = (maxOnAxis-minOnAxis)/NumSplitBins;
+	for ( int b=1; b<NumSplitBins; b++ ) {
+		costLeft += startCosts[b-1];
+		costRight -= endCosts[b-1];
+		// Keep the sums in range despite roundoff
+		double thisCostLeft = Min( costLeft, totalObjectCosts );
+		double thisCostRight = Max( costRight, 0.0 );
+		double thisSplitValue = minOnAxis + b*binWidth;
+		if ( CalcSplitCost( thisSplitValue, thisCostLeft, thisCostRight, &bestCost ) ) {
+			foundBetter = true;
+			*retNewBestCost = bestCost;
+			*retSplitValue = thisSplitValue;
+		}
+	}
+	return foundBetter;
+}
+
+// Count the objects, and their costs, on each side of a split plane.  Objects
+//	 with min<splitValue are on the left, and those with max>splitValue are on
+//	 the right.  Flats are on the left if they are at splitValue.
+void KdTree::CountSplitSides( const ExtentTripleArrayInfo& extents, double splitValue,
+							  long* numObjectsToLeft, long* numObjectsToRight,
+							  double* costObjectsToLeft, double* costObjectsToRight )
+{
+	*numObjectsToLeft = *numObjectsToRight = 0;
+	*costObjectsToLeft = *costObjectsToRight = 0.0;
+	ExtentTriple* etPtr = extents.TripleArray;
+	long n = extents.NumTriples();
+	for ( long i=0; i<n; i++, etPtr++ ) {
+		bool toLeft;
+		switch ( etPtr->ExtentType ) {
+		case ExtentTriple::TT_MIN:
+			if ( !(etPtr->ExtentValue<splitValue) ) {
+				continue;
+			}
+			toLeft = true;
+			break;
+		case ExtentTriple::TT_MAX:
+			if ( !(etPtr->ExtentValue>splitValue) ) {
+				continue;
+			}
+			toLeft = false;
+			break;
+		case ExtentTriple::TT_FLAT:
+		default:
+			toLeft = ( etPtr->ExtentValue<=splitValue );
+			break;
+		}
+		double cost = ObjectCost( etPtr->ObjectID );
+		if ( toLeft ) {
+			(*numObjectsToLeft)++;
+			(*costObjectsToLeft) += cost;
+		}
+		else {
+			(*numObjectsToRight)++;
+			(*costObjectsToRight) += cost;
+		}
+	}
+}
+
 void KdTree::UpdateLeftRightCosts( const ExtentTriple& et, long* numObjectsLeft, long* numObjectsRight, 
 							   double *costLeft, double *costRight )
 {
@@ -739,32 +1539,37 @@ void KdTree::UpdateLeftRightCosts( const ExtentTriple& et, long* numObjectsLeft,
 
 
 // Create the Aabb's for one of the subtrees
+//	 Each object is handled at only one of its triples, so the triples are
+//	 split between numTasks threads.
 void KdTree::MakeAabbsForSubtree( unsigned char leftRightFlag, const ExtentTripleArrayInfo& theExtents,
-									const AABB& theAabb )
+									const AABB& theAabb, int numTasks )
 {
-	ExtentTriple* etPtr = theExtents.TripleArray;
-	long i;
 	long n = theExtents.NumTriples();
-	for ( i=0; i<n; i++, etPtr++ ) {
-		long objectID = etPtr->ObjectID;
-		if ( (LeftRightStatus[ objectID ] & leftRightFlag) != 0 ) {
-			// Don't bother if a Max on the left, or a Min on the right.
-			//		In these cases, the extent will be computed anyway
-			if ( !((etPtr->ExtentType==(ExtentTriple::TT_MIN) && leftRightFlag==2)
-				|| (etPtr->ExtentType==(ExtentTriple::TT_MAX) && leftRightFlag==1)) )
-			{
-				assert ( 0<=objectID && objectID<NumObjects );
-				bool stillIn = (*ExtentInBoxFunc)( objectID, theAabb, ObjectAABBs[objectID] );
-				bool flatX = ObjectAABBs[objectID].IsFlatX();
-				bool flatY = ObjectAABBs[objectID].IsFlatY();
-				bool flatZ = ObjectAABBs[objectID].IsFlatZ();
-				if ( !stillIn ||(flatX&&flatY) || (flatY&&flatZ) || (flatX&&flatZ) ) {
-					// Remove from being in this subtree (bitwise OR with complement of leftRightFlag)
-					LeftRightStatus[objectID] &= ~leftRightFlag;
+	RunBuildTasks( numTasks, numTasks>1, [&]( int task ) {
+		long last = (n*(task+1))/numTasks;
+		long i = (n*task)/numTasks;
+		ExtentTriple* etPtr = theExtents.TripleArray + i;
+		for ( ; i<last; i++, etPtr++ ) {
+			long objectID = etPtr->ObjectID;
+			if ( (LeftRightStatus[ objectID ] & leftRightFlag) != 0 ) {
+				// Don't bother if a Max on the left, or a Min on the right.
+				//		In these cases, the extent will be computed anyway
+				if ( !((etPtr->ExtentType==(ExtentTriple::TT_MIN) && leftRightFlag==2)
+					|| (etPtr->ExtentType==(ExtentTriple::TT_MAX) && leftRightFlag==1)) )
+				{
+					assert ( 0<=objectID && objectID<NumObjects );
+					bool stillIn = (*ExtentInBoxFunc)( objectID, theAabb, ObjectAABBs[objectID] );
+					bool flatX = ObjectAABBs[objectID].IsFlatX();
+					bool flatY = ObjectAABBs[objectID].IsFlatY();
+					bool flatZ = ObjectAABBs[objectID].IsFlatZ();
+					if ( !stillIn ||(flatX&&flatY) || (flatY&&flatZ) || (flatX&&flatZ) ) {
+						// Remove from being in this subtree (bitwise OR with complement of leftRightFlag)
+						LeftRightStatus[objectID] &= ~leftRightFlag;
+					}
 				}
 			}
 		}
-	}
+	} );
 }
 
 
@@ -836,8 +1641,10 @@ void KdTree::CopyTriplesForSubtree( unsigned char leftRightFlag, int axisNumber,
 	assert ( (iM&0x01) == 0 );
 	toExtents.SetNumbers( iM>>1, iF );
 	
-	// Now sort the new array of triples
-	toExtents.Sort();
+	// Now sort the new array of triples.  Not needed if binned splitting is used for it.
+	if ( !UseBinnedSplit( toExtents.NumObjects() ) ) {
+		toExtents.Sort();
+	}
 }
 
 double KdTree::CalcTotalCosts( const ExtentTripleArrayInfo& extents ) const
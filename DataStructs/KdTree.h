@@ -44,8 +44,14 @@ class RayTraceStats;	// Statistics for KdTree traversal
 class KdData;
 class KdTree;			// kd-tree.
 class KdTreeNode;		// A single node in the kd-tree.
+class KdCompactNode;	// A single node in the compact form of the kd-tree used for traversal.
 
 class Kd_TraverseNodeData;			// Holds information on a single node needing traversal.
+class KdTraverseStack;				// Stack of nodes needing traversal, reused from ray to ray.
+class Kd_TraversePacketData;		// A node needing traversal by some of the rays of a packet.
+class KdPacketStack;				// Stack of nodes needing traversal by a packet of rays.
+class KdMailbox;					// Records the objects already tested against the current ray.
+class KdTraverseStats;				// Counts the work done by traversals.
 
 // Next classes used only for creating tree
 class ExtentTriple;				// A extent triples: a single max, min, or flat value
@@ -69,6 +75,9 @@ typedef bool PotentialObjectCallback( KdData *data, long objectNum, double* retS
 //	  The list is static, so the pointer may be saved for later use.
 //	  Return code is "true" if the returned stop distance is relevant
 typedef bool PotentialObjectsListCallback( KdData *data, int numberOfObjects, long* objectNums, double* retStopDistance );
+//    Gives an object in a leaf node, for an occlusion query (see TraverseAnyHit).
+//	  Return code is "true" if the object blocks the ray: the traversal then stops at once.
+typedef bool PotentialOccluderCallback( KdData *data, long objectNum );
 
 enum KD_SplittingAxis {
 	KD_SPLIT_X = 0,
@@ -77,6 +86,28 @@ enum KD_SplittingAxis {
 	KD_LEAF = 3
 };
 
+// ************************************************************************************
+// KdTraverseStats counts the work done by traversals of a KdTree or a BvhTree.
+//	 A traversal adds to the counters of its KdData's Stats, if it has one,
+//	 and otherwise to the tree's own.  Threads that traverse a tree at the
+//	 same time each need their own KdTraverseStats: they are added to the
+//	 tree's with Stats_Add once the threads are done.
+// ************************************************************************************
+class KdTraverseStats {
+public:
+	KdTraverseStats() { Reset(); }
+	void Reset();
+	void Add( const KdTraverseStats& other );
+
+	long NodesTraversed;
+	long LeavesTraversed;		// Non-empty leaves
+	long ObjectsInLeaves;
+	long StackAllocations;		// Traversals that had to allocate their own stack
+	long PacketRays;			// Rays traversed in packets (kd-tree only)
+	long PacketSteps;			// Nodes and leaves visited by the packets
+	long PacketRaySteps;		// The same, counted once for each active ray
+};
+
 // ************************************************************************************
 // KdTree																			  *
 // ************************************************************************************
@@ -98,16 +129,56 @@ public:
 	//	 startPos - beginning of the ray.
 	//	 dir - direction of the ray.
 	//   Returns "true" if traversal aborted by the callback function returning "true"
+	//	 Uses data->TraverseStack if it is set and large enough (see GetMaxDepth()).
+	//	 Otherwise allocates a stack for this traversal.
 	bool Traverse( KdData *data, const VectorR3& startPos, const VectorR3& dir, double seekDistance = 0.0, bool useSeekDistance = false );
 
+	// TraverseAnyHit: Occlusion query for the segment from startPos to distance
+	//	 maxDistance along dir.  data->CallbackFunction is a PotentialOccluderCallback*.
+	//	 Returns "true" as soon as the callback returns "true" for an object.
+	//	 There are no stop distances to track, and the rest of the leaf is skipped.
+	bool TraverseAnyHit( KdData *data, const VectorR3& startPos, const VectorR3& dir, double maxDistance );
+
+	// TraversePacket: Traverses up to MaxPacketRays rays together, with one stack
+	//	 and a mask of the rays that are still active at each node.  Ray k starts
+	//	 at rays[k]->kdStartPos, in direction rays[k]->kdTraverseDir, and the
+	//	 callback is called with rays[k] for the objects Traverse would give it,
+	//	 in the same order: each ray gets the same result as from Traverse.
+	//	 The callback and the mailbox are those of rays[0].  The mailbox is
+	//	 started here (NewPacket() or NewRay()), not by the caller.
+	//	 Rays whose direction is not of the same signs as rays[0]'s, with no zero
+	//	 components, are traversed one at a time, as is a packet of one ray.
+	//	 Returns a mask, with bit k set if Traverse would have returned "true" for ray k.
+	//	 The stack is enlarged if it cannot hold GetMaxDepth()+1 nodes.
+	unsigned int TraversePacket( KdData** rays, int numRays, KdPacketStack& stack );
+	// TraversePacketAnyHit: Occlusion queries for a packet of rays, as TraverseAnyHit.
+	//	 Ray k is the segment of length maxDistances[k].  Bit k of the returned mask
+	//	 is set if the callback found an object blocking ray k.
+	unsigned int TraversePacketAnyHit( KdData** rays, int numRays, const double* maxDistances,
+									   KdPacketStack& stack );
+	const static int MaxPacketRays = 16;
+
+	// Traverse uses the compact nodes (the default), or the nodes made by the
+	//	 tree building.  The second is slower, and is kept for comparisons.
+	void SetCompactTraversal( bool useCompact ) { UseCompactNodes = useCompact; }
+	bool UsesCompactTraversal() const { return UseCompactNodes; }
+
 	// ******** Accessors ****************
 	const KdTreeNode& GetNode( long i ) const;
+	long GetNumNodes() const { return TreeSize(); }
+	long GetNumLeafEntries() const { return NumLeafEntries; }	// Total length of the leaves' object lists
 
-	void ResetStats();
-	void Stats_ObjectsInLeaves( long objNum = 1 );
-	void Stats_NodeTraversed();
-	void Stats_LeafTraversed();
+	// Depth of the deepest leaf (the root has depth zero).  A KdTraverseStack
+	//	 with capacity GetMaxDepth()+1 never overflows.
+	long GetMaxDepth() const { return MaxDepth; }
+
+	void ResetStats() { TreeStats.Reset(); }
+	void Stats_Add( const KdTraverseStats& stats ) { TreeStats.Add( stats ); }
 	void Stats_GetAll( long* numNodes, long* numNonEmptyLeaves, long* numObjsInLeaves ) const;
+	long Stats_GetStackAllocations() const { return TreeStats.StackAllocations; }
+	// Rays traversed in packets, the node and leaf steps of the packets, and 
+	//	 the steps the rays would have taken one at a time.
+	void Stats_GetPacketData( long* numPacketRays, long* numPacketSteps, long* numRaySteps ) const;
 
 public:
 	// ****** Tree building routines *******
@@ -128,6 +199,16 @@ public:
 	void SetMacdonaldBoothSplitting( bool useModifiedCoefs = false );	
 	void SetDoubleRecurseSplitting( bool useModifiedCoefs = false );
 
+	// Set how the split planes are found.  By default, every node sweeps its
+	//	 sorted extents and evaluates the split cost at every extent.
+	// With binned splitting, nodes with more than maxExactObjects objects
+	//	 evaluate the split cost only at the numBins-1 planes that divide each
+	//	 axis into equal bins, and their extents are not sorted.  Smaller nodes,
+	//	 near the leaves, use the exact sweep.  Either cost function can be used.
+	void SetBinnedSplitting( int numBins = 32, long maxExactObjects = 1024 );
+	void SetExactSplitting();		// The default
+	const static int MaxSplitBins = 256;
+
 	// Set the stopping criterion
 	//   numAccesses means the benefit required to justify adding a new tree node.
 	//		The "benefit" is measured in terms of time savings, the time saved is
@@ -139,8 +220,16 @@ public:
 	//  Default values are 1,000,000 and 4.0.
 	void SetStoppingCriterion( long numRays, double numAccesses );
 
+	// Set the number of threads used by BuildTree.  Zero (the default) means
+	//	 one per hardware thread.  The tree is the same for every number of threads.
+	//	 With more than one thread, the extent callback functions are called
+	//	 from several threads at once.
+	void SetBuildThreads( int numThreads ) { BuildThreads = numThreads; }
+
 	// Can call BuildTree at most once.
 	void BuildTree( long numObject, ExtentFunction* extentFunc, ExtentInBoxFunction* extentInBoxFunc );
+	double GetBuildSeconds() const { return BuildSeconds; }		// Time taken by BuildTree
+	int GetBuildThreadsUsed() const { return BuildThreadsUsed; }
 
 	const static int ExtentTripleStorageMultiplier  = 4;	// m/(1-m) where m is the overlapping fraction expected
 
@@ -155,11 +244,33 @@ private:
 	long NextIndex();		// Preallocate the next entry ahead of time.
 
 	AABB BoundingBox;			// An AABB that encloses the entire tree
-
-	// Traversal statistics
-	long Stats_NumberKdNodesTraversed;
-	long Stats_NumberKdLeavesTraversed;
-	long Stats_NumberKdObjectsInLeaves;
+	long MaxDepth;				// Depth of the deepest leaf
+	void CalcMaxDepth();
+
+	// The compact form of the tree, made from TreeNodes at the end of BuildTree.
+	KdCompactNode* CompactNodes;	// Same nodes as TreeNodes, in depth first order
+	long* LeafObjectList;			// The object lists of all leaves, one after another
+	long NumLeafEntries;			// Length of LeafObjectList
+	bool UseCompactNodes;
+	void MakeCompactTree();
+	void MakeCompactSubTree( long nodeIndex, long* nextNode, long* nextLeafEntry );
+
+	template<bool AnyHit, class NodeT> bool TraverseNodes( const NodeT* nodes, KdData *data, 
+											   const VectorR3& startPos, const VectorR3& dir, 
+											   double seekDistance, bool obeySeekDistance );
+	template<bool AnyHit> unsigned int TraversePacketRays( KdData** rays, int numRays,
+											   const double* maxDistances, KdPacketStack& stack );
+	template<bool AnyHit, class NodeT> unsigned int TraversePacketNodes( const NodeT* nodes,
+											   KdData** rays, int numRays, unsigned int packetMask,
+											   const double* maxDistances, KdPacketStack& stack );
+	static long LeftChild( const KdTreeNode& node, long nodeIndex );
+	static long LeftChild( const KdCompactNode& node, long nodeIndex );
+	static long* LeafObjects( const KdTreeNode& node );
+	long* LeafObjects( const KdCompactNode& node ) const;
+
+	// Traversal statistics, of the traversals whose KdData has no Stats
+	KdTraverseStats TreeStats;
+	KdTraverseStats& StatsFor( const KdData* data );
 
 	// Following items are used only while building the tree.
 	enum SplitAlgorithmType {
@@ -171,6 +282,16 @@ private:
 
 	SplitAlgorithmType SplitAlgorithm;	// Which split cost function to use.
 
+	int NumSplitBins;					// Zero for exact splitting
+	long MaxExactSplitObjects;			// Nodes with more objects than this use bins
+	bool UseBinnedSplit( long numObjects ) const { return ( NumSplitBins>0 && numObjects>MaxExactSplitObjects ); }
+
+	int BuildThreads;					// Number of threads requested, zero for one per hardware thread
+	int BuildThreadsUsed;
+	double BuildSeconds;
+	// Only nodes with at least this many objects are split up between threads.
+	const static long MinObjectsForBuildTask = 4096;
+
 	double StoppingCostPerRay;				// Improved cost/ray needed to justify adding tree node
 
 	bool UseConstantCost;
@@ -187,15 +308,26 @@ private:
 	unsigned char* LeftRightStatus;		// Info on whether objects go left or right in split.
 
 	// Routines used for building the tree
+	//	 parallelDepth is the number of levels further down the tree at which 
+	//	 the subtrees can be built on separate threads.
 	void BuildSubTree( long baseIndex, AABB& aabb, double totalObjectCost,
 					ExtentTripleArrayInfo& xExtents, ExtentTripleArrayInfo& yExtents, 
-					ExtentTripleArrayInfo& zExtents, long spaceAvailable );
+					ExtentTripleArrayInfo& zExtents, long spaceAvailable, int parallelDepth );
 	void CalcBestSplit( const AABB& aabb, const VectorR3& deltaAABB, double totalObjectCost, 
 					const ExtentTripleArrayInfo& xExtents, const ExtentTripleArrayInfo& yExtents, 
 					const ExtentTripleArrayInfo& zExtents,
 					KD_SplittingAxis* splitAxisID, double* splitValue, 
 					long* numTriplesToLeft, long* numObjectsToLeft, long* numObjectsToRight, 
-					double* costObjectsToLeft, double* costObjectsToRight );
+					double* costObjectsToLeft, double* costObjectsToRight, bool inParallel );
+	bool CalcBestSplitBinned( double totalObjectCost, double costToBeat, 
+						const ExtentTripleArrayInfo& extents, 
+						double minOnAxis, double maxOnAxis, 
+						double secondAxisLen, double thirdAxisLen,
+						double* newBestCost, double* splitValue );
+	void CountSplitSides( const ExtentTripleArrayInfo& extents, double splitValue,
+						long* numObjectsToLeft, long* numObjectsToRight,
+						double* costObjectsToLeft, double* costObjectsToRight );
+	double ObjectCost( long objectNum ) const;
 	bool CalcBestSplit( double totalObjectCost, double costToBeat, 
 						const ExtentTripleArrayInfo& extents, 
 						double minOnAxis, double maxOnAxis, 
@@ -204,7 +336,7 @@ private:
 						long* numTriplesToLeft, long* numObjectsToLeft, long* numObjectsToRight,
 						double* costObjectsToLeft, double* costObjectsToRight );
 	void MakeAabbsForSubtree( unsigned char leftRightFlag, const ExtentTripleArrayInfo& theExtents,
-								const AABB& theAabb );
+								const AABB& theAabb, int numTasks );
 	void CopyTriplesForSubtree( unsigned char leftRightFlag, int axisNumber,
 										ExtentTripleArrayInfo& fromExtents, 
 										ExtentTripleArrayInfo& toExtents ); 
@@ -212,6 +344,21 @@ private:
 							   double *costLeft, double *costRight );
 	double CalcTotalCosts( const ExtentTripleArrayInfo& extents ) const;
 
+	// Routines for building two subtrees on separate threads.  The smaller 
+	//	 subtree is built in a separate KdTree with its own copies of the 
+	//	 temporary data, and its nodes are then moved into this tree.
+	void BuildSubTreesInParallel( long smallerChildIdx, AABB& smallerAabb, double smallerTotalCost,
+					ExtentTripleArrayInfo& smallerXextents, ExtentTripleArrayInfo& smallerYextents, 
+					ExtentTripleArrayInfo& smallerZextents,
+					long largerChildIdx, AABB& largerAabb, double largerTotalCost,
+					ExtentTripleArrayInfo& xExtents, ExtentTripleArrayInfo& yExtents, 
+					ExtentTripleArrayInfo& zExtents, long spaceAvailable, int parallelDepth );
+	void CopyBuildSettings( const KdTree& from );
+	void StartSubTreeBuild( const KdTree& parent, const ExtentTripleArrayInfo* fromExtents[3],
+							ExtentTripleArrayInfo* newExtents[3], long* spaceAvailable );
+	void EndSubTreeBuild();
+	void MoveSubTreeNodes( const KdTree& subTree, long subTreeRootIdx, long largerRootIdx, long firstNewIdx );
+
 	// Routines and data used for split-cost-functions.  
 	// Only needed while building a kd-Tree.
 	//  CF = cost function.  
@@ -250,7 +397,7 @@ private:
 class KdData {
 public:
 	KdData() 
-	: isectEpsilon(1.0e-6), bestObject(-1), bestHitDistance(DBL_MAX) {}
+	: isectEpsilon(1.0e-6), bestObject(-1), bestHitDistance(DBL_MAX), TraverseStack(0), Mailbox(0), Stats(0) {}
 	bool kdTraverseFeeler;
 	double isectEpsilon;
 	long bestObject;
@@ -266,6 +413,9 @@ public:
 	// Traversal helper data
 	bool UseListCallback;		// True for the "List" callback traversal
 	void* CallbackFunction;		// Either PotentialObjectCallback* or PotentialObjectsListCallback*
+	KdTraverseStack* TraverseStack;	// Stack for KdTree::Traverse.  Null to allocate one per traversal.
+	KdMailbox* Mailbox;			// Used by the callback functions to skip objects already tested.  Null for none.
+	KdTraverseStats* Stats;		// Counts the traversals.  Null to count them in the tree (see KdTraverseStats).
 };
 
 // ************************************************************************************
@@ -317,6 +467,46 @@ private:
 
 };
 
+// ************************************************************************************
+// KdCompactNode																	  *
+//	  8 byte node used for traversal.  The nodes are in depth first order, so the	  *
+//	  left child of a split node, if not empty, is the next node.  A leaf holds	  *
+//	  the position of its objects in the tree's LeafObjectList.					  *
+// ************************************************************************************
+
+class KdCompactNode {
+public:
+	friend class KdTree;
+
+	bool IsLeaf() const { return ((Flags&AxisMask)==KD_LEAF); }
+	KD_SplittingAxis GetNodeType() const { return (KD_SplittingAxis)(Flags&AxisMask); }
+	int SplitAxis() const { assert(!IsLeaf()); return (int)(Flags&AxisMask); }
+	long GetNumObjects() const { assert(IsLeaf()); return (long)(Flags>>2); }
+
+	double SplitValue() const { return Value.Split; }
+
+	// Index of the left child, or -1 if it is empty.  nodeIndex is the index of this node.
+	long LeftChildIndex( long nodeIndex ) const { return (Flags&LeftEmptyBit) ? -1 : nodeIndex+1; }
+	// Index of the right child, or -1 if it is empty.
+	long RightChildIndex() const { return (Flags<8) ? -1 : (long)(Flags>>3); }
+
+private:
+	enum {
+		AxisMask = 3,
+		LeftEmptyBit = 4
+	};
+
+	union {
+		float Split;				// Split value, for split nodes
+		unsigned int FirstObject;	// Position in LeafObjectList, for leaves
+	} Value;
+	// Bits 0-1: the KD_SplittingAxis value.
+	//	 Split nodes: bit 2 is set if the left child is empty.  Bits 3-31 are the 
+	//		index of the right child, or zero if it is empty.
+	//	 Leaves: Bits 2-31 are the number of objects.
+	unsigned int Flags;
+};
+
 // *******************************************************************
 // Kd_TraverseNodeData												 *
 //		Holds information on a node needing traversal				 *
@@ -340,6 +530,183 @@ private:
 	double MaxDistance;			// Maximum distance along ray to search (exit distance)
 };
 
+// *******************************************************************
+// KdTraverseStack													 *
+//		Fixed size stack of nodes needing traversal.  A render		 *
+//		thread allocates one and uses it for all its rays, so		 *
+//		traversal does no memory allocation.						 *
+// *******************************************************************
+
+class KdTraverseStack {
+public:
+	KdTraverseStack() : Capacity(0), SizeUsed(0), Entries(0) {}
+	KdTraverseStack( long capacity ) : Capacity(0), SizeUsed(0), Entries(0) { SetCapacity(capacity); }
+	~KdTraverseStack() { delete[] Entries; }
+
+	void SetCapacity( long capacity );			// Reallocates and empties the stack
+	long GetCapacity() const { return Capacity; }
+
+	void Reset() { SizeUsed = 0; }
+	bool IsEmpty() const { return (SizeUsed==0); }
+	Kd_TraverseNodeData& Push() { assert(SizeUsed<Capacity); return Entries[SizeUsed++]; }
+	Kd_TraverseNodeData& Pop() { assert(SizeUsed>0); return Entries[--SizeUsed]; }
+
+private:
+	long Capacity;
+	long SizeUsed;
+	Kd_TraverseNodeData* Entries;
+
+	KdTraverseStack( const KdTraverseStack& );				// Not copyable
+	KdTraverseStack& operator=( const KdTraverseStack& );
+};
+
+inline void KdTraverseStack::SetCapacity( long capacity )
+{
+	delete[] Entries;
+	Entries = new Kd_TraverseNodeData[capacity];
+	Capacity = capacity;
+	SizeUsed = 0;
+}
+
+// *******************************************************************
+// Kd_TraversePacketData											 *
+//		A node needing traversal by the rays of a packet in			 *
+//		RayMask, with the entry and exit distance of each ray.		 *
+// *******************************************************************
+
+class Kd_TraversePacketData {
+	friend class KdTree;
+
+private:
+	long NodeNumber;
+	unsigned int RayMask;
+	double MinDistance[KdTree::MaxPacketRays];
+	double MaxDistance[KdTree::MaxPacketRays];
+};
+
+// *******************************************************************
+// KdPacketStack													 *
+//		Fixed size stack of nodes needing traversal, for			 *
+//		KdTree::TraversePacket.  Reused from packet to packet.		 *
+// *******************************************************************
+
+class KdPacketStack {
+public:
+	KdPacketStack() : Capacity(0), SizeUsed(0), Entries(0) {}
+	KdPacketStack( long capacity ) : Capacity(0), SizeUsed(0), Entries(0) { SetCapacity(capacity); }
+	~KdPacketStack() { delete[] Entries; }
+
+	void SetCapacity( long capacity );			// Reallocates and empties the stack
+	long GetCapacity() const { return Capacity; }
+
+	void Reset() { SizeUsed = 0; }
+	bool IsEmpty() const { return (SizeUsed==0); }
+	Kd_TraversePacketData& Push() { assert(SizeUsed<Capacity); return Entries[SizeUsed++]; }
+	Kd_TraversePacketData& Pop() { assert(SizeUsed>0); return Entries[--SizeUsed]; }
+
+private:
+	long Capacity;
+	long SizeUsed;
+	Kd_TraversePacketData* Entries;
+
+	KdPacketStack( const KdPacketStack& );				// Not copyable
+	KdPacketStack& operator=( const KdPacketStack& );
+};
+
+inline void KdPacketStack::SetCapacity( long capacity )
+{
+	delete[] Entries;
+	Entries = new Kd_TraversePacketData[capacity];
+	Capacity = capacity;
+	SizeUsed = 0;
+}
+
+// ************************************************************************************
+// KdMailbox																		  *
+//	  An object that straddles a split plane is in several leaves, so a ray		  *
+//	  can meet it more than once.  The mailbox stamps each object with the		  *
+//	  number of the last ray tested against it, so the repeated tests can be	  *
+//	  skipped.  Each thread needs its own mailbox.								  *
+//	  For a packet of rays, the stamp is the packet's number, with a mask of	  *
+//	  the rays of the packet tested against the object.							  *
+// ************************************************************************************
+class KdMailbox {
+public:
+	KdMailbox() : NumObjects(0), CurrentRay(0), CurrentRayBit(1), RayStamps(0), NumberSkipped(0) {}
+	KdMailbox( long numObjects ) : NumObjects(0), CurrentRay(0), CurrentRayBit(1), RayStamps(0), NumberSkipped(0) 
+		{ SetNumObjects(numObjects); }
+	~KdMailbox() { delete[] RayStamps; }
+
+	void SetNumObjects( long numObjects );		// Reallocates and clears the mailbox
+
+	// Starts a new ray: no object has been tested against it yet.
+	void NewRay();
+	// Starts a new packet of rays (see KdTree::TraversePacket), and selects its ray 0.
+	void NewPacket() { NewRay(); }
+	// Selects ray k of the packet: AlreadyTested() is then for that ray.
+	void SelectRay( int k ) { CurrentRayBit = (1u<<k); }
+	// Returns true if the object was already tested against the current ray.
+	//	 Otherwise, records that it has now been tested and returns false.
+	bool AlreadyTested( long objectNum );
+
+	long GetNumberSkipped() const { return NumberSkipped; }	// Tests skipped since the last reset
+	void ResetNumberSkipped() { NumberSkipped = 0; }
+
+private:
+	struct Stamp {
+		unsigned int Ray;			// The last ray, or packet, tested against the object
+		unsigned int RayBits;		// The rays of that packet tested against the object
+	};
+	long NumObjects;
+	unsigned int CurrentRay;
+	unsigned int CurrentRayBit;
+	Stamp* RayStamps;
+	long NumberSkipped;
+
+	KdMailbox( const KdMailbox& );				// Not copyable
+	KdMailbox& operator=( const KdMailbox& );
+};
+
+inline void KdMailbox::SetNumObjects( long numObjects )
+{
+	delete[] RayStamps;
+	RayStamps = new Stamp[numObjects];
+	NumObjects = numObjects;
+	for ( long i=0; i<numObjects; i++ ) {
+		RayStamps[i].Ray = 0;
+		RayStamps[i].RayBits = 0;
+	}
+	CurrentRay = 0;
+}
+
+inline void KdMailbox::NewRay()
+{
+	CurrentRay++;
+	CurrentRayBit = 1;
+	if ( CurrentRay==0 ) {
+		// The ray numbers wrapped around: clear the old stamps.
+		SetNumObjects( NumObjects );
+		CurrentRay = 1;
+	}
+}
+
+inline bool KdMailbox::AlreadyTested( long objectNum )
+{
+	assert( objectNum>=0 && objectNum<NumObjects );
+	Stamp& stamp = RayStamps[objectNum];
+	if ( stamp.Ray==CurrentRay ) {
+		if ( stamp.RayBits & CurrentRayBit ) {
+			NumberSkipped++;
+			return true;
+		}
+		stamp.RayBits |= CurrentRayBit;
+		return false;
+	}
+	stamp.Ray = CurrentRay;
+	stamp.RayBits = CurrentRayBit;
+	return false;
+}
+
 inline Kd_TraverseNodeData::Kd_TraverseNodeData( long nodeNum, double minDist, double maxDist )
 {
 	Set ( nodeNum, minDist, maxDist );
@@ -531,7 +898,16 @@ inline long ExtentTripleArrayInfo::AddToEnd ( double min, double max, long objec
 
 inline KdTree::KdTree()
 {
+	MaxDepth = 0;
+	CompactNodes = 0;
+	LeafObjectList = 0;
+	NumLeafEntries = 0;
+	UseCompactNodes = true;
+	BuildThreads = 0;
+	BuildThreadsUsed = 0;
+	BuildSeconds = 0.0;
 	SplitAlgorithm = MacDonaldBooth;
+	SetExactSplitting();
 	SetObjectCost ( DefaultObjectCost() );
 	SetStoppingCriterion( 1000000, 4.0 );
 
@@ -540,7 +916,16 @@ inline KdTree::KdTree()
 
 inline KdTree::KdTree( long numObjects, ExtentFunction* extentFunc, ExtentInBoxFunction* extentInBoxFunc )
 {
+	MaxDepth = 0;
+	CompactNodes = 0;
+	LeafObjectList = 0;
+	NumLeafEntries = 0;
+	UseCompactNodes = true;
+	BuildThreads = 0;
+	BuildThreadsUsed = 0;
+	BuildSeconds = 0.0;
 	SplitAlgorithm = MacDonaldBooth;
+	SetExactSplitting();
 	SetObjectCost ( DefaultObjectCost() );
 	SetStoppingCriterion( 1000000, 4.0 );
 	BuildTree( numObjects, extentFunc, extentInBoxFunc );
@@ -575,6 +960,23 @@ inline void KdTree::SetMacdonaldBoothSplitting( bool useModifiedCoefs )
 	SplitAlgorithm = useModifiedCoefs ? MacDonaldBoothModifiedCoefs : MacDonaldBooth;
 }
 
+inline void KdTree::SetBinnedSplitting( int numBins, long maxExactObjects )
+{
+	assert ( 2<=numBins && numBins<=MaxSplitBins );
+	NumSplitBins = numBins;
+	MaxExactSplitObjects = maxExactObjects;
+}
+
+inline void KdTree::SetExactSplitting()
+{
+	NumSplitBins = 0;
+}
+
+inline double KdTree::ObjectCost( long objectNum ) const
+{
+	return UseConstantCost ? ObjectConstantCost : (*UserCostFunction)(objectNum);
+}
+
 // Set to use Buss Double-Recurse splitting criterion.
 // Argument == true to change the coefficients
 inline void KdTree::SetDoubleRecurseSplitting( bool useModifiedCoefs )
@@ -582,34 +984,45 @@ inline void KdTree::SetDoubleRecurseSplitting( bool useModifiedCoefs )
 	SplitAlgorithm = useModifiedCoefs ? DoubleRecurseModifiedCoefs : DoubleRecurseGS;
 }
 
-inline void KdTree::ResetStats() 
+inline void KdTraverseStats::Reset()
 {
-	// Traversal statistics
-	Stats_NumberKdNodesTraversed = 0;
-	Stats_NumberKdLeavesTraversed = 0;
-	Stats_NumberKdObjectsInLeaves = 0;
+	NodesTraversed = 0;
+	LeavesTraversed = 0;
+	ObjectsInLeaves = 0;
+	StackAllocations = 0;
+	PacketRays = 0;
+	PacketSteps = 0;
+	PacketRaySteps = 0;
 }
 
-inline void KdTree::Stats_ObjectsInLeaves( long objNum ) 
+inline void KdTraverseStats::Add( const KdTraverseStats& other )
 {
-	Stats_NumberKdObjectsInLeaves += objNum;
+	NodesTraversed += other.NodesTraversed;
+	LeavesTraversed += other.LeavesTraversed;
+	ObjectsInLeaves += other.ObjectsInLeaves;
+	StackAllocations += other.StackAllocations;
+	PacketRays += other.PacketRays;
+	PacketSteps += other.PacketSteps;
+	PacketRaySteps += other.PacketRaySteps;
 }
 
-inline void KdTree::Stats_NodeTraversed( ) 
+inline KdTraverseStats& KdTree::StatsFor( const KdData* data )
 {
-	Stats_NumberKdNodesTraversed++;
+	return data->Stats ? *data->Stats : TreeStats;
 }
 
-inline void KdTree::Stats_LeafTraversed( ) 
+inline void KdTree::Stats_GetAll( long* numNodes, long* numNonEmptyLeaves, long* numObjsInLeaves ) const
 {
-	Stats_NumberKdLeavesTraversed++;
+	*numNodes = TreeStats.NodesTraversed;
+	*numNonEmptyLeaves = TreeStats.LeavesTraversed;
+	*numObjsInLeaves = TreeStats.ObjectsInLeaves;
 }
 
-inline void KdTree::Stats_GetAll( long* numNodes, long* numNonEmptyLeaves, long* numObjsInLeaves ) const
+inline void KdTree::Stats_GetPacketData( long* numPacketRays, long* numPacketSteps, long* numRaySteps ) const
 {
-	*numNodes = Stats_NumberKdNodesTraversed;
-	*numNonEmptyLeaves = Stats_NumberKdLeavesTraversed;
-	*numObjsInLeaves = Stats_NumberKdObjectsInLeaves;
+	*numPacketRays = TreeStats.PacketRays;
+	*numPacketSteps = TreeStats.PacketSteps;
+	*numRaySteps = TreeStats.PacketRaySteps;
 }
 
 inline const KdTreeNode& KdTree::GetNode( long i ) const 
@@ -617,6 +1030,26 @@ inline const KdTreeNode& KdTree::GetNode( long i ) const
 	return TreeNodes[i]; 
 }
 
+inline long KdTree::LeftChild( const KdTreeNode& node, long nodeIndex )
+{
+	return node.LeftChildIndex();
+}
+
+inline long KdTree::LeftChild( const KdCompactNode& node, long nodeIndex )
+{
+	return node.LeftChildIndex( nodeIndex );
+}
+
+inline long* KdTree::LeafObjects( const KdTreeNode& node )
+{
+	return node.Data.Leaf.ObjectList;
+}
+
+inline long* KdTree::LeafObjects( const KdCompactNode& node ) const
+{
+	return LeafObjectList + node.Value.FirstObject;
+}
+
 // Allocate the next entry for the KdTree 
 //  Call this to pre-allocate to avoid having the Array for the KdTree
 //		automatically re-sized at a bad time.
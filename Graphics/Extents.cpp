@@ -49,7 +49,9 @@
 //  If returns false, the extentsMin/Max values are not set.
 // **********************************************************************
 
-static VectorR3 VertArray[60];
+// Scratch space for the clipped polygons.  One per thread, since the kd-tree
+//	 build calls these routines from several threads at once.
+static thread_local VectorR3 VertArray[60];
 
 
 bool CalcExtentsInBox( const ViewableParallelogram& parallelogram,
@@ -403,11 +405,20 @@ bool CalcExtentsInBox( const ViewableTriangle& tri,
 						   const VectorR3& boxBoundMin, const VectorR3& boxBoundMax,
 						   VectorR3* extentsMin, VectorR3* extentsMax )
 {
-	VertArray[0] = tri.GetVertexA();
-	VertArray[1] = tri.GetVertexB();
-	VertArray[2] = tri.GetVertexC();
+	return CalcExtentsInBox( tri.GetVertexA(), tri.GetVertexB(), tri.GetVertexC(), tri.GetNormal(),
+							 boxBoundMin, boxBoundMax, extentsMin, extentsMax );
+}
+
+bool CalcExtentsInBox( const VectorR3& vertA, const VectorR3& vertB, const VectorR3& vertC,
+						   const VectorR3& normal,
+						   const VectorR3& boxBoundMin, const VectorR3& boxBoundMax,
+						   VectorR3* extentsMin, VectorR3* extentsMax )
+{
+	VertArray[0] = vertA;
+	VertArray[1] = vertB;
+	VertArray[2] = vertC;
 
-	int numClippedVerts = ClipConvexPolygonAgainstBoundingBox( 3, VertArray, tri.GetNormal(),
+	int numClippedVerts = ClipConvexPolygonAgainstBoundingBox( 3, VertArray, normal,
 														boxBoundMin, boxBoundMax );
 	if ( numClippedVerts == 0 ) {
 		return false;
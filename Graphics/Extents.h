@@ -68,6 +68,12 @@ bool CalcExtentsInBox( const ViewableTriangle& tri,
 						   const VectorR3& boxBoundMin, const VectorR3& boxBoundMax,
 						   VectorR3* extentsMin, VectorR3* extentsMax );
 
+// Triangle given by its vertices and unit normal (e.g., a triangle of a ViewableTriangleMesh)
+bool CalcExtentsInBox( const VectorR3& vertA, const VectorR3& vertB, const VectorR3& vertC,
+						   const VectorR3& normal,
+						   const VectorR3& boxBoundMin, const VectorR3& boxBoundMax,
+						   VectorR3* extentsMin, VectorR3* extentsMax );
+
 // **********************************************************************
 // CalcSolidExtentsInBox. Consider the intersection of a solid geometric 
 //		object with the bounding box defined by boundBoxMax/Min.
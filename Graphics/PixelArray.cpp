@@ -23,6 +23,22 @@
 #include "PixelArray.h"
 #include "RgbImage.h"
 
+#ifndef PIXELARRAY_DONT_USE_OPENGL
+// If you do not have GLUT installed, you can use the basic GL routines instead.
+//   For this, include windows.h and GL/gl.h, instead of GL/glut.h
+//#include <windows.h>
+//#include <GL/gl.h>	// Basic OpenGL includes
+// Including stdlib.h and disabling the atexit_hack seem to work everywhere.
+//	Eventually there should be a new version of glut.h that doesn't need this.
+#include <stdlib.h>
+#define GLUT_DISABLE_ATEXIT_HACK
+#ifdef __APPLE__
+#include <GLUT/glut.h>	// Mac GLUT OpenGL includes
+#else
+#include <GL/glut.h>	// GLUT OpenGL includes
+#endif
+#endif  // PIXELARRAY_DONT_USE_OPENGL
+
 // SetSize(width, height) resizes the pixel data info.
 // If necessary, it allocates new block of memory.
 // Returns true if new memory has been allocated.
@@ -44,6 +60,8 @@ bool PixelArray::SetSize( int width, int height ) {
 	return retValue;
 }
 
+#ifndef PIXELARRAY_DONT_USE_OPENGL
+
 // Set the size to the size of the viewport.
 void PixelArray::ResetSize() {
 	GLint got[4];		// i,j, width, height
@@ -93,6 +111,8 @@ void PixelArray::ClampAndDrawFloats()
 	DrawFloats();
 }
 
+#endif  // PIXELARRAY_DONT_USE_OPENGL
+
 // Dumps the PixelArray data into an RgbImage object.
 //   The RgbImage data (for now at least) must match the
 //	 size of the PixelArray dimensions.
@@ -22,20 +22,9 @@
 #ifndef PIXELARRAY_H
 #define PIXELARRAY_H
 
-// If you do not have GLUT installed, you can use the basic GL routines instead.
-//   For this, include windows.h and GL/gl.h, instead of GL/glut.h
-//#include <windows.h>
-//#include <GL/gl.h>	// Basic OpenGL includes
-// Including stdlib.h and disabling the atexit_hack seem to work everywhere.
-//	Eventually there should be a new version of glut.h that doesn't need this.
-#include <stdlib.h>
-#define GLUT_DISABLE_ATEXIT_HACK
-#ifdef __APPLE__
-#include <GLUT/glut.h>	// Mac GLUT OpenGL includes
-#else
-#include <GL/glut.h>	// GLUT OpenGL includes
-#endif
-
+// Define PIXELARRAY_DONT_USE_OPENGL to turn off the routines that use OpenGL.
+//   (The OpenGL headers are only included by PixelArray.cpp.)
+// #define PIXELARRAY_DONT_USE_OPENGL
 
 #include "../VrMath/LinearR3.h"
 #include "../VrMath/LinearR4.h"
@@ -49,7 +38,9 @@ public:
 	PixelArray( int width, int height );
 	~PixelArray();
 
+#ifndef PIXELARRAY_DONT_USE_OPENGL
 	void ResetSize();
+#endif
 	bool SetSize( int width, int height );
 
 	// Set a single pixel color  -- i indexes left to right, j top to bottom
@@ -58,6 +49,7 @@ public:
 	void SetPixel( int i, int j, const VectorR4 color );
 	void SetPixel( int i, int j, const VectorR3 color );
 
+#ifndef PIXELARRAY_DONT_USE_OPENGL
 	// Draw into the OpenGL draw buffer
 	// Any of the three methods could be used, but ClampAndDrawFloats
 	//	works best at circumventing bugs in graphics board drivers.
@@ -65,6 +57,7 @@ public:
 	void ClampAndDrawFloats();
 	void DrawFloats() const;
 	void DrawViaRgbImage() const;
+#endif
 
 	// Write out to a RgbImage  or to a BITMAP (.bmp) file.
 	void Dump( RgbImage& image ) const;
@@ -88,12 +81,14 @@ protected:
 
 };
 
+#ifndef PIXELARRAY_DONT_USE_OPENGL
 inline PixelArray::PixelArray() 
 { 
 	ColorValues = 0;
 	Allocated = 0;
 	ResetSize(); 
 }
+#endif
 inline PixelArray::PixelArray( int width, int height )
 {
 	ColorValues = 0;
@@ -35,6 +35,20 @@ void ViewableBase::CalcAABB( AABB& retAABB ) const
 	CalcBoundingPlanes( dirVec, &theMin.z, &theMax.z );
 }
 
+bool ViewableBase::FindIntersectionDistance( const VectorR3& viewPos, const VectorR3& viewDir, 
+											double maxDistance, double *intersectDistance ) const
+{
+	VisiblePoint hitPoint;
+	return FindIntersectionNT( viewPos, viewDir, maxDistance, intersectDistance, hitPoint );
+}
+
+bool ViewableBase::IntersectsSegment( const VectorR3& viewPos, const VectorR3& viewDir, 
+									 double maxDistance ) const
+{
+	double hitDistance;
+	return FindIntersectionDistance( viewPos, viewDir, maxDistance, &hitDistance );
+}
+
 bool ViewableBase::CalcExtentsInBox( const AABB& aabb, AABB& retAABB ) const
 {
 	CalcAABB( retAABB );
@@ -48,6 +48,24 @@ public:
 		const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance,
 		double *intersectDistance, VisiblePoint& returnedPoint ) const;
 
+	// Intersection in two phases.  FindIntersectionDistance is the cheap first
+	//	 phase: it returns the same hit and distance as FindIntersection, but fills
+	//	 in no VisiblePoint.  The default calls FindIntersectionNT.
+	//	 CalcVisiblePoint is the second phase, run only for the closest hit:
+	//	 it fills in the VisiblePoint (and applies the texture map) for a hit
+	//	 that FindIntersectionDistance found at hitDistance along the same ray.
+	virtual bool FindIntersectionDistance( const VectorR3& viewPos, const VectorR3& viewDir, 
+										   double maxDistance, double *intersectDistance ) const;
+	bool CalcVisiblePoint( const VectorR3& viewPos, const VectorR3& viewDir, 
+						   double hitDistance, VisiblePoint& returnedPoint ) const;
+
+	// Returns true if the ray hits the object at distance less than maxDistance.
+	//	 viewDir must be a unit vector.  Used for occlusion (shadow feeler) tests:
+	//	 no VisiblePoint is filled in and no texture map is applied.
+	//	 The default calls FindIntersectionDistance.
+	virtual bool IntersectsSegment( const VectorR3& viewPos, const VectorR3& viewDir, 
+									double maxDistance ) const;
+
 	// Sets front and back texture maps.
 	// Subclasses of ViewablePoint will have more routines.
 	void TextureMap( const TextureMapBase* texture );	// Front & back
@@ -96,7 +114,8 @@ public:
 			Viewable_Parallelogram,
 			Viewable_Sphere,
 			Viewable_Torus,
-			Viewable_Triangle };
+			Viewable_Triangle,
+			Viewable_TriangleMesh };
 	virtual ViewableType GetViewableType() const = 0;
 
 	virtual ~ViewableBase() {}
@@ -106,6 +125,9 @@ protected:
 	const TextureMapBase* TextureFront;		// Front texture map
 	const TextureMapBase* TextureBack;		// Back Texture map
 
+	// Sets the object of the visible point, and invokes the texture map (if any)
+	void ApplyTextureMap( VisiblePoint& returnedPoint, const VectorR3& viewDir ) const;
+
 	// The "NT" version is the one that does all the work of finding
 	//		the intersection point, and computing u,v coordinates.
 	//	The "NT" version does not call the texture map: this is left for
@@ -155,16 +177,31 @@ inline bool ViewableBase::FindIntersection (
 	found = FindIntersectionNT(viewPos, viewDir, 
 								maxDistance, intersectDistance, returnedPoint);
 	if ( found ) {
-		returnedPoint.SetObject( this );
-		// Invoke the texture map (if any)
-		const TextureMapBase* texmap = returnedPoint.IsFrontFacing() ? TextureFront : TextureBack;
-		if ( texmap ) {
-			texmap->ApplyTexture( returnedPoint, viewDir );
-		}
+		ApplyTextureMap( returnedPoint, viewDir );
 	}
 	return found;
 }
 
+inline void ViewableBase::ApplyTextureMap( VisiblePoint& returnedPoint, const VectorR3& viewDir ) const
+{
+	returnedPoint.SetObject( this );
+	// Invoke the texture map (if any)
+	const TextureMapBase* texmap = returnedPoint.IsFrontFacing() ? TextureFront : TextureBack;
+	if ( texmap ) {
+		texmap->ApplyTexture( returnedPoint, viewDir );
+	}
+}
+
+// The hit is the closest one, so FindIntersection finds it again when
+//	 maxDistance is just beyond it.
+inline bool ViewableBase::CalcVisiblePoint( const VectorR3& viewPos, const VectorR3& viewDir, 
+											double hitDistance, VisiblePoint& returnedPoint ) const
+{
+	double intersectDistance;
+	return FindIntersection( viewPos, viewDir, hitDistance+1.0e-9*(1.0+hitDistance), 
+							 &intersectDistance, returnedPoint );
+}
+
 
 // NOW THEY ARE PURELY VIRTUAL
 // Eventually these routine should be purely virtual, but first I have to implement
@@ -28,6 +28,51 @@
 bool ViewableEllipsoid::FindIntersectionNT ( 
 		const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance,
 		double *intersectDistance, VisiblePoint& returnedPoint ) const
+{
+	int hitType = CalcHitDistance( viewPos, viewDir, maxDistance, intersectDistance );
+	if ( hitType==0 ) {
+		return false;
+	}
+	if ( hitType==1 ) {
+		// Found an intersection from outside.
+		returnedPoint.SetFrontFace();
+		returnedPoint.SetMaterial( *OuterMaterial );
+	}
+	else {
+		// Found an intersection from inside.
+		returnedPoint.SetBackFace();
+		returnedPoint.SetMaterial( *InnerMaterial );
+	}
+
+	// Calculate intersection position
+	VectorR3 v=viewDir;
+	v *= (*intersectDistance);
+	v += viewPos;
+	returnedPoint.SetPosition( v );	// Intersection Position
+
+	v -= Center;	// Now v is the relative position
+	double vdotuA = v^AxisA;		
+	double vdotuB = v^AxisB;
+	double vdotuC = v^AxisC;
+	v = vdotuA*AxisA + vdotuB*AxisB + vdotuC*AxisC;
+	v.Normalize();
+	returnedPoint.SetNormal( v );
+
+	// Calculate u-v coordinates
+	ViewableSphere::CalcUV( vdotuB, vdotuC, vdotuA, uvProjectionType,
+							&returnedPoint.GetUV() );
+	returnedPoint.SetFaceNumber( 0 );
+	return true;
+}
+
+bool ViewableEllipsoid::FindIntersectionDistance( const VectorR3& viewPos, const VectorR3& viewDir, 
+												  double maxDistance, double *intersectDistance ) const
+{
+	return ( CalcHitDistance( viewPos, viewDir, maxDistance, intersectDistance )!=0 );
+}
+
+int ViewableEllipsoid::CalcHitDistance( const VectorR3& viewPos, const VectorR3& viewDir, 
+										double maxDistance, double *intersectDistance ) const
 {
 	VectorR3 v = viewPos;
 	v -= Center;
@@ -41,7 +86,7 @@ bool ViewableEllipsoid::FindIntersectionNT (
 	double C = Square(pdotuA) + Square(pdotuB) + Square(pdotuC) - 1.0;
 	double B = ( pdotuA*udotuA + pdotuB*udotuB + pdotuC*udotuC );
 	if ( C>0.0 && B>=0.0 ) {
-		return false;			// Pointing away from the ellipsoid
+		return 0;			// Pointing away from the ellipsoid
 	}
 
 	B += B;		// Double B to get final factor of 2.
@@ -50,46 +95,22 @@ bool ViewableEllipsoid::FindIntersectionNT (
 	double alpha1, alpha2;
 	int numRoots = QuadraticSolveRealSafe( A, B, C, &alpha1, &alpha2 );
 	if ( numRoots==0 ) {
-		return false;
+		return 0;
 	}
 	if ( alpha1>0.0 ) {
 		if ( alpha1>=maxDistance ) {
-			return false;				// Too far away
+			return 0;				// Too far away
 		}
-		// Found an intersection from outside.
-		returnedPoint.SetFrontFace();
-		returnedPoint.SetMaterial( *OuterMaterial );
 		*intersectDistance = alpha1;
+		return 1;
 	}
 	else if ( numRoots==2 && alpha2>0.0 && alpha2<maxDistance ) {
-		// Found an intersection from inside.
-		returnedPoint.SetBackFace();
-		returnedPoint.SetMaterial( *InnerMaterial );
 		*intersectDistance = alpha2;
+		return 2;
 	}
 	else {
-		return false;	// Both intersections behind us (should never get here)
+		return 0;	// Both intersections behind us (should never get here)
 	}
-
-	// Calculate intersection position
-	v=viewDir;
-	v *= (*intersectDistance);
-	v += viewPos;
-	returnedPoint.SetPosition( v );	// Intersection Position
-
-	v -= Center;	// Now v is the relative position
-	double vdotuA = v^AxisA;		
-	double vdotuB = v^AxisB;
-	double vdotuC = v^AxisC;
-	v = vdotuA*AxisA + vdotuB*AxisB + vdotuC*AxisC;
-	v.Normalize();
-	returnedPoint.SetNormal( v );
-
-	// Calculate u-v coordinates
-	ViewableSphere::CalcUV( vdotuB, vdotuC, vdotuA, uvProjectionType,
-							&returnedPoint.GetUV() );
-	returnedPoint.SetFaceNumber( 0 );
-	return true;
 }
 
 void ViewableEllipsoid::CalcBoundingPlanes( const VectorR3& u, double *minDot, double *maxDot ) const
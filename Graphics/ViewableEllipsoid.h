@@ -40,6 +40,8 @@ public:
 	virtual bool FindIntersectionNT ( 
 		const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance,
 		double *intersectDistance, VisiblePoint& returnedPoint ) const;
+	bool FindIntersectionDistance( const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance, 
+								   double *intersectDistance ) const;
 	void CalcBoundingPlanes( const VectorR3& u, double *minDot, double *maxDot ) const;
 	bool CalcPartials( const VisiblePoint& visPoint, 
 					   VectorR3& retPartialU, VectorR3& retPartialV ) const;
@@ -103,6 +105,11 @@ public:
 
 protected:
 
+	// Distance to the hit, if any.  Returns 0 for no hit, 1 for a hit from
+	//	 outside and 2 for a hit from inside.
+	int CalcHitDistance( const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance, 
+						 double *intersectDistance ) const;
+
 	VectorR3 Center;
 
 	VectorR3 AxisA;		// Axes are orthogonal and have 
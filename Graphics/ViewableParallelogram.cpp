@@ -116,6 +116,37 @@ bool ViewableParallelogram::FindIntersectionNT (
 	return true;
 }
 
+// Same tests as FindIntersectionNT, without setting the visible point.
+bool ViewableParallelogram::FindIntersectionDistance( const VectorR3& viewPos, const VectorR3& viewDir, 
+													  double maxDistance, double *intersectDistance ) const
+{
+	assert( IsWellFormed() );
+	double mdotn = (viewDir^Normal);
+	double planarDist = (viewPos^Normal)-PlaneCoef;
+
+	if ( mdotn<=0.0 ) {
+		if ( planarDist<=0 || planarDist >= -maxDistance*mdotn ) {
+			return false;
+		}
+	}
+	else {
+		if ( BackFaceCulled() || planarDist>=0 || -planarDist >= maxDistance*mdotn ) {
+			return false;
+		}
+	}
+
+	*intersectDistance = -planarDist/mdotn;
+	VectorR3 v(viewDir);
+	v *= *intersectDistance;
+	v += viewPos;				// Point of view line intersecting plane
+	double dotABnormal = v^NormalAB;
+	if ( dotABnormal<CoefAB || dotABnormal>CoefCD ) {
+		return false;
+	}
+	double dotBCnormal = v^NormalBC;
+	return ( dotBCnormal>=CoefBC && dotBCnormal<=CoefDA );
+}
+
 bool ViewableParallelogram::CalcPartials( const VisiblePoint& visPoint, 
 									 VectorR3& retPartialU, VectorR3& retPartialV ) const
 {
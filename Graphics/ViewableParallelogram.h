@@ -55,6 +55,8 @@ public:
 	virtual bool FindIntersectionNT ( 
 		const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance,
 		double *intersectDistance, VisiblePoint& returnedPoint ) const;
+	bool FindIntersectionDistance( const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance, 
+								   double *intersectDistance ) const;
 	void CalcBoundingPlanes( const VectorR3& u, double *minDot, double *maxDot ) const;
 	bool CalcExtentsInBox( const AABB& boundingAABB, AABB& retAABB ) const;
 	bool CalcPartials( const VisiblePoint& visPoint, 
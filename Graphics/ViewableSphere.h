@@ -39,6 +39,8 @@ public:
 	virtual bool FindIntersectionNT ( 
 		const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance,
 		double *intersectDistance, VisiblePoint& returnedPoint ) const;
+	bool FindIntersectionDistance( const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance, 
+								   double *intersectDistance ) const;
 	void CalcBoundingPlanes( const VectorR3& u, double *minDot, double *maxDot ) const;
 	bool CalcExtentsInBox( const AABB& boundingAABB, AABB& retAABB ) const;
 	bool CalcPartials( const VisiblePoint& visPoint, 
@@ -221,5 +223,11 @@ inline bool ViewableSphere::QuickIntersectTest(
 							   intersectDistance, Center, RadiusSq );
 }
 
+inline bool ViewableSphere::FindIntersectionDistance( const VectorR3& viewPos, const VectorR3& viewDir, 
+													  double maxDistance, double *intersectDistance ) const
+{
+	return QuickIntersectTest( viewPos, viewDir, maxDistance, intersectDistance, Center, RadiusSq );
+}
+
 
 #endif // VIEWABLESPHERE_H
@@ -26,10 +26,17 @@
 //		help with intersections with rays.
 void ViewableTriangle::PreCalcInfo()
 {
-	VectorR3 EdgeAB = VertexB - VertexA;
-	VectorR3 EdgeBC = VertexC - VertexB;
-	VectorR3 EdgeCA = VertexA - VertexC;
+	CalcTriangleInfo( VertexA, VertexB, VertexC, &Normal, &PlaneCoef, &Ubeta, &Ugamma );
+}
+
+void ViewableTriangle::CalcTriangleInfo( const VectorR3& vertexA, const VectorR3& vertexB, const VectorR3& vertexC,
+										 VectorR3* normal, double* planeCoef, VectorR3* ubeta, VectorR3* ugamma )
+{
+	VectorR3 EdgeAB = vertexB - vertexA;
+	VectorR3 EdgeBC = vertexC - vertexB;
+	VectorR3 EdgeCA = vertexA - vertexC;
 
+	VectorR3& Normal = *normal;
 	if ( (EdgeAB^EdgeBC) < (EdgeBC^EdgeCA) ) {
 		Normal = EdgeAB*EdgeBC;
 	}
@@ -41,7 +48,7 @@ void ViewableTriangle::PreCalcInfo()
 		Normal /= mag;		// Unit vector to triangle's plane
 	}
 	
-	PlaneCoef = (Normal^VertexA);	// Same coef for all three vertices.
+	*planeCoef = (Normal^vertexA);	// Same coef for all three vertices.
 
 	double A = EdgeAB.NormSq();
 	double B = (EdgeAB^EdgeCA);
@@ -50,9 +57,11 @@ void ViewableTriangle::PreCalcInfo()
 	A *= Dinv;
 	B *= Dinv;
 	C *= Dinv;
+	VectorR3& Ubeta = *ubeta;
 	Ubeta = EdgeAB;
 	Ubeta *= C;
 	Ubeta.AddScaled( EdgeCA, -B );
+	VectorR3& Ugamma = *ugamma;
 	Ugamma = EdgeCA;
 	Ugamma *= -A;
 	Ugamma.AddScaled( EdgeAB, B );
@@ -71,40 +80,17 @@ bool ViewableTriangle::FindIntersectionNT (
 		double *intersectDistance, VisiblePoint& returnedPoint ) const
 {
 	assert( IsWellFormed() );
-	double mdotn = (viewDir^Normal);
-	double planarDist = (viewPos^Normal)-PlaneCoef;
-
-	// hit distance = -planarDist/mdotn
-	bool frontFace = (mdotn<=0.0);
-	if ( frontFace ) {
-		if ( planarDist<=0 || planarDist >= -maxDistance*mdotn ) {
-			return false;
-		}
-	}
-	else {
-		if ( BackFaceCulled() || planarDist>=0 || -planarDist >= maxDistance*mdotn ) {
-			return false;
-		}
+	bool frontFace;
+	double vCoord, wCoord;
+	if ( !IntersectTriangle( viewPos, viewDir, maxDistance, VertexA, Normal, PlaneCoef, Ubeta, Ugamma,
+							 BackFaceCulled(), intersectDistance, &vCoord, &wCoord, &frontFace ) ) {
+		return false;
 	}
 
-	*intersectDistance = -planarDist/mdotn;
 	VectorR3 q;		
 	q = viewDir;
 	q *= *intersectDistance;
 	q += viewPos;						// Point of view line intersecting plane
-
-	// Compute barycentric coordinates
-	VectorR3 v(q);
-	v -= VertexA;
-	double vCoord = (v^Ubeta);
-	if ( vCoord<0.0 ) {
-		return false;
-	}
-	double wCoord = (v^Ugamma);
-	if ( wCoord<0.0 || vCoord+wCoord>1.0 ) {
-		return false;
-	}
-
 	returnedPoint.SetPosition( q );		// Set point of intersection
 	returnedPoint.SetUV( vCoord, wCoord );
 
@@ -123,6 +109,17 @@ bool ViewableTriangle::FindIntersectionNT (
 	return true;
 }
 
+// Same tests as FindIntersectionNT, without setting the visible point.
+bool ViewableTriangle::FindIntersectionDistance( const VectorR3& viewPos, const VectorR3& viewDir, 
+												 double maxDistance, double *intersectDistance ) const
+{
+	assert( IsWellFormed() );
+	bool frontFace;
+	double vCoord, wCoord;
+	return IntersectTriangle( viewPos, viewDir, maxDistance, VertexA, Normal, PlaneCoef, Ubeta, Ugamma,
+							  BackFaceCulled(), intersectDistance, &vCoord, &wCoord, &frontFace );
+}
+
 void ViewableTriangle::CalcBoundingPlanes( const VectorR3& u, double *minDot, double *maxDot ) const
 {
 	double mind = (u^VertexA);
@@ -52,6 +52,8 @@ public:
 	virtual bool FindIntersectionNT ( 
 		const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance,
 		double *intersectDistance, VisiblePoint& returnedPoint ) const;
+	bool FindIntersectionDistance( const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance, 
+								   double *intersectDistance ) const;
 	void CalcBoundingPlanes( const VectorR3& u, double *minDot, double *maxDot ) const;
 	bool CalcExtentsInBox( const AABB& boundingAABB, AABB& retAABB ) const;
 	bool CalcPartials( const VisiblePoint& visPoint, 
@@ -66,6 +68,17 @@ public:
 	void GetVertices( VectorR3* vertA, VectorR3* vertB, VectorR3* vertC ) const;
 	const VectorR3& GetNormal() const { return Normal; }
 
+	// The precalculated data of the triangle with the given vertices.
+	static void CalcTriangleInfo( const VectorR3& vertexA, const VectorR3& vertexB, const VectorR3& vertexC,
+								  VectorR3* normal, double* planeCoef, VectorR3* ubeta, VectorR3* ugamma );
+	// The ray-triangle test, for the precalculated data.  Shared with ViewableTriangleMesh.
+	//	 If the ray hits at distance less than maxDistance, returns true and sets the
+	//	 distance, the barycentric coordinates and whether the front face was hit.
+	static bool IntersectTriangle( const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance,
+								   const VectorR3& vertexA, const VectorR3& normal, double planeCoef,
+								   const VectorR3& ubeta, const VectorR3& ugamma, bool backFaceCulled,
+								   double *intersectDistance, double* vCoord, double* wCoord, bool* frontFace );
+
 protected:
 	VectorR3 VertexA;
 	VectorR3 VertexB;
@@ -148,4 +161,41 @@ inline void ViewableTriangle::GetVertices(
 	*vertC = VertexC;
 }
 
+inline bool ViewableTriangle::IntersectTriangle( const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance,
+						const VectorR3& vertexA, const VectorR3& normal, double planeCoef,
+						const VectorR3& ubeta, const VectorR3& ugamma, bool backFaceCulled,
+						double *intersectDistance, double* vCoord, double* wCoord, bool* frontFace )
+{
+	double mdotn = (viewDir^normal);
+	double planarDist = (viewPos^normal)-planeCoef;
+
+	// hit distance = -planarDist/mdotn
+	*frontFace = (mdotn<=0.0);
+	if ( *frontFace ) {
+		if ( planarDist<=0 || planarDist >= -maxDistance*mdotn ) {
+			return false;
+		}
+	}
+	else {
+		if ( backFaceCulled || planarDist>=0 || -planarDist >= maxDistance*mdotn ) {
+			return false;
+		}
+	}
+
+	*intersectDistance = -planarDist/mdotn;
+	VectorR3 v;		
+	v = viewDir;
+	v *= *intersectDistance;
+	v += viewPos;						// Point of view line intersecting plane
+
+	// Compute barycentric coordinates
+	v -= vertexA;
+	*vCoord = (v^ubeta);
+	if ( *vCoord<0.0 ) {
+		return false;
+	}
+	*wCoord = (v^ugamma);
+	return !( *wCoord<0.0 || *vCoord+*wCoord>1.0 );
+}
+
 #endif // VIEWABLETRIANGLE_H
@@ -0,0 +1,212 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+#include <float.h>
+
+#include "ViewableTriangleMesh.h"
+#include "Extents.h"
+#include "../VrMath/Aabb.h"
+
+ViewableTriangleMesh::~ViewableTriangleMesh()
+{
+	delete[] Vertices;
+	delete[] VertexIndices;
+	delete[] TriangleData;
+	delete BuildVertices;
+	delete BuildIndices;
+}
+
+long ViewableTriangleMesh::AddVertex( const VectorR3& vertex )
+{
+	assert( !IsFinished() );
+	BuildVertices->Push( vertex );
+	return NumVertices++;
+}
+
+bool ViewableTriangleMesh::AddTriangle( long vertA, long vertB, long vertC )
+{
+	assert( !IsFinished() );
+	assert( 0<=vertA && vertA<NumVertices && 0<=vertB && vertB<NumVertices && 0<=vertC && vertC<NumVertices );
+	VectorR3 normal, ubeta, ugamma;
+	double planeCoef;
+	ViewableTriangle::CalcTriangleInfo( (*BuildVertices)[vertA], (*BuildVertices)[vertB], (*BuildVertices)[vertC],
+										&normal, &planeCoef, &ubeta, &ugamma );
+	if ( normal.NormSq()==0.0 ) {
+		return false;			// Degenerate triangle
+	}
+	BuildIndices->Push( (int)vertA );
+	BuildIndices->Push( (int)vertB );
+	BuildIndices->Push( (int)vertC );
+	NumTriangles++;
+	return true;
+}
+
+// The vertices and indices are copied to arrays of exactly the right size,
+//	 and the build arrays are freed.
+void ViewableTriangleMesh::FinishMesh()
+{
+	assert( !IsFinished() );
+	Vertices = new VectorR3[NumVertices];
+	for ( long i=0; i<NumVertices; i++ ) {
+		Vertices[i] = (*BuildVertices)[i];
+	}
+	VertexIndices = new int[3*NumTriangles];
+	for ( long i=0; i<3*NumTriangles; i++ ) {
+		VertexIndices[i] = (*BuildIndices)[i];
+	}
+	delete BuildVertices;
+	delete BuildIndices;
+	BuildVertices = 0;
+	BuildIndices = 0;
+
+	TriangleData = new double[NumTriangleData*NumTriangles];
+	for ( long tri=0; tri<NumTriangles; tri++ ) {
+		double* data = TriangleData + tri*NumTriangleData;
+		VectorR3 normal, ubeta, ugamma;
+		ViewableTriangle::CalcTriangleInfo( GetVertexA(tri), GetVertexB(tri), GetVertexC(tri),
+											&normal, data+PlaneCoef, &ubeta, &ugamma );
+		data[NormalX] = normal.x;
+		data[NormalY] = normal.y;
+		data[NormalZ] = normal.z;
+		data[UbetaX] = ubeta.x;
+		data[UbetaY] = ubeta.y;
+		data[UbetaZ] = ubeta.z;
+		data[UgammaX] = ugamma.x;
+		data[UgammaY] = ugamma.y;
+		data[UgammaZ] = ugamma.z;
+	}
+}
+
+// Same as ViewableTriangle::FindIntersectionNT, for triangle number tri.
+bool ViewableTriangleMesh::FindTriangleIntersectionNT( long tri,
+								const VectorR3& viewPos, const VectorR3& viewDir,
+								double maxDistance, double *intersectDistance,
+								VisiblePoint& returnedPoint ) const
+{
+	assert( IsFinished() && 0<=tri && tri<NumTriangles );
+	bool frontFace;
+	double vCoord, wCoord;
+	VectorR3 normal = GetNormal(tri);
+	if ( !ViewableTriangle::IntersectTriangle( viewPos, viewDir, maxDistance, GetVertexA(tri), normal,
+							GetTriangleData(PlaneCoef,tri),
+							VectorR3( GetTriangleData(UbetaX,tri), GetTriangleData(UbetaY,tri), GetTriangleData(UbetaZ,tri) ),
+							VectorR3( GetTriangleData(UgammaX,tri), GetTriangleData(UgammaY,tri), GetTriangleData(UgammaZ,tri) ),
+							BackFaceCulled(), intersectDistance, &vCoord, &wCoord, &frontFace ) ) {
+		return false;
+	}
+
+	VectorR3 q;
+	q = viewDir;
+	q *= *intersectDistance;
+	q += viewPos;						// Point of view line intersecting plane
+	returnedPoint.SetPosition( q );		// Set point of intersection
+	returnedPoint.SetUV( vCoord, wCoord );
+
+	if ( frontFace ) {
+		returnedPoint.SetMaterial( *FrontMat );
+		returnedPoint.SetFrontFace();
+	}
+	else {
+		returnedPoint.SetMaterial( *BackMat );
+		returnedPoint.SetBackFace();
+	}
+	returnedPoint.SetNormal( normal );
+	returnedPoint.SetFaceNumber( 0 );
+	returnedPoint.SetTriangleNumber( tri );
+
+	return true;
+}
+
+void ViewableTriangleMesh::CalcTriangleAABB( long tri, AABB& retAABB ) const
+{
+	const VectorR3& vA = GetVertexA(tri);
+	const VectorR3& vB = GetVertexB(tri);
+	const VectorR3& vC = GetVertexC(tri);
+	VectorR3& theMin = retAABB.GetBoxMin();
+	VectorR3& theMax = retAABB.GetBoxMax();
+	theMin.Set( Min(vA.x,Min(vB.x,vC.x)), Min(vA.y,Min(vB.y,vC.y)), Min(vA.z,Min(vB.z,vC.z)) );
+	theMax.Set( Max(vA.x,Max(vB.x,vC.x)), Max(vA.y,Max(vB.y,vC.y)), Max(vA.z,Max(vB.z,vC.z)) );
+}
+
+bool ViewableTriangleMesh::CalcTriangleExtentsInBox( long tri, const AABB& boundingAABB, AABB& retAABB ) const
+{
+	return ( ::CalcExtentsInBox( GetVertexA(tri), GetVertexB(tri), GetVertexC(tri), GetNormal(tri),
+								 boundingAABB.GetBoxMin(), boundingAABB.GetBoxMax(),
+								 &(retAABB.GetBoxMin()), &(retAABB.GetBoxMax()) ) );
+}
+
+// Tests every triangle.  Ray tracing uses the kd-tree or BVH instead,
+//	 which hold the triangles separately.
+bool ViewableTriangleMesh::FindIntersectionNT(
+		const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance,
+		double *intersectDistance, VisiblePoint& returnedPoint ) const
+{
+	long bestTri = -1;
+	double bestDistance = maxDistance;
+	for ( long tri=0; tri<NumTriangles; tri++ ) {
+		double hitDistance;
+		if ( FindTriangleIntersectionDistance( tri, viewPos, viewDir, bestDistance, &hitDistance ) ) {
+			bestDistance = hitDistance;
+			bestTri = tri;
+		}
+	}
+	if ( bestTri<0 ) {
+		return false;
+	}
+	return FindTriangleIntersectionNT( bestTri, viewPos, viewDir, maxDistance, intersectDistance, returnedPoint );
+}
+
+bool ViewableTriangleMesh::FindIntersectionDistance( const VectorR3& viewPos, const VectorR3& viewDir,
+													 double maxDistance, double *intersectDistance ) const
+{
+	bool found = false;
+	for ( long tri=0; tri<NumTriangles; tri++ ) {
+		if ( FindTriangleIntersectionDistance( tri, viewPos, viewDir, maxDistance, intersectDistance ) ) {
+			maxDistance = *intersectDistance;
+			found = true;
+		}
+	}
+	return found;
+}
+
+void ViewableTriangleMesh::CalcBoundingPlanes( const VectorR3& u, double *minDot, double *maxDot ) const
+{
+	assert( IsFinished() );
+	double mind = DBL_MAX;
+	double maxd = -DBL_MAX;
+	for ( long i=0; i<NumVertices; i++ ) {
+		double t = (u^Vertices[i]);
+		mind = Min( mind, t );
+		maxd = Max( maxd, t );
+	}
+	*minDot = mind;
+	*maxDot = maxd;
+}
+
+bool ViewableTriangleMesh::CalcPartials( const VisiblePoint& visPoint,
+										 VectorR3& retPartialU, VectorR3& retPartialV ) const
+{
+	long tri = visPoint.GetTriangleNumber();
+	retPartialU = GetVertexB(tri);
+	retPartialU -= GetVertexA(tri);
+	retPartialV = GetVertexC(tri);
+	retPartialV -= GetVertexA(tri);
+	return true;			// Not a singularity point (degenerate triangles are not added)
+}
@@ -0,0 +1,202 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// ViewableTriangleMesh.h
+//
+//   A set of triangles that share one array of vertices, one pair of
+//	 materials and one pair of texture maps.
+//
+//	 Each triangle is three indices into the vertex array.  The data used by
+//	 the ray-triangle test (the same as a ViewableTriangle's) is precomputed
+//	 and stored in one array, so the triangles take
+//	 much less memory than ViewableTriangles and are tested without virtual calls.
+//
+//	 SceneDescription makes each triangle of a mesh a separate primitive, so
+//	 the kd-tree and the BVH hold the triangles one by one: the routines that
+//	 take a triangle number are for this.  The ViewableBase routines treat the
+//	 mesh as a single object.
+
+#ifndef VIEWABLETRIANGLEMESH_H
+#define VIEWABLETRIANGLEMESH_H
+
+#include "ViewableBase.h"
+#include "ViewableTriangle.h"
+#include "Material.h"
+#include "../DataStructs/Array.h"
+
+class ViewableTriangleMesh : public ViewableBase {
+
+public:
+	ViewableTriangleMesh();
+	~ViewableTriangleMesh();
+
+	// ****** Building the mesh ******
+	long AddVertex( const VectorR3& vertex );		// Returns the index of the vertex
+	// Adds a triangle, with vertices in counter-clockwise order.
+	//	 Returns false, and adds nothing, if the triangle has zero area.
+	bool AddTriangle( long vertA, long vertB, long vertC );
+	// Call once all triangles are added: computes the data for the
+	//	 ray-triangle tests.  No more vertices or triangles may be added.
+	void FinishMesh();
+	bool IsFinished() const { return (BuildVertices==0); }
+
+	void SetMaterial( const MaterialBase* material );
+	void SetMaterialFront( const MaterialBase* frontmaterial );
+	void SetMaterialBack( const MaterialBase* backmaterial );
+	const MaterialBase* GetMaterialFront() const { return FrontMat; }
+	const MaterialBase* GetMaterialBack() const { return BackMat; }
+
+	bool IsTwoSided() const { return (BackMat!=0); }
+	bool BackFaceCulled() const { return (BackMat==0); }
+
+	long GetNumVertices() const { return NumVertices; }
+	long GetNumTriangles() const { return NumTriangles; }
+	const VectorR3& GetVertex( long i ) const { assert(IsFinished()); return Vertices[i]; }
+	const VectorR3& GetVertexA( long tri ) const { return GetVertex( VertexIndices[3*tri] ); }
+	const VectorR3& GetVertexB( long tri ) const { return GetVertex( VertexIndices[3*tri+1] ); }
+	const VectorR3& GetVertexC( long tri ) const { return GetVertex( VertexIndices[3*tri+2] ); }
+	VectorR3 GetNormal( long tri ) const;
+	long GetMemoryBytes() const;		// Memory used by the vertices and triangles
+
+	// The precomputed data of the triangles (see ViewableTriangle).
+	enum TriangleDataComponent {
+		NormalX = 0, NormalY = 1, NormalZ = 2,		// Unit normal to the plane of triangle
+		PlaneCoef = 3,								// Constant coef in def'n of the plane
+		UbetaX = 4, UbetaY = 5, UbetaZ = 6,			// Vector for finding beta coef
+		UgammaX = 7, UgammaY = 8, UgammaZ = 9,		// Vector for finding gamma coef
+		NumTriangleData = 10
+	};
+	double GetTriangleData( int component, long tri ) const { return TriangleData[tri*NumTriangleData+component]; }
+
+	// ****** Routines for a single triangle ******
+	// Same as FindIntersectionDistance and FindIntersection, for triangle number tri.
+	bool FindTriangleIntersectionDistance( long tri, const VectorR3& viewPos, const VectorR3& viewDir,
+										   double maxDistance, double *intersectDistance ) const;
+	bool FindTriangleIntersection( long tri, const VectorR3& viewPos, const VectorR3& viewDir,
+								   double maxDistance, double *intersectDistance,
+								   VisiblePoint& returnedPoint ) const;
+	void CalcTriangleAABB( long tri, AABB& retAABB ) const;
+	bool CalcTriangleExtentsInBox( long tri, const AABB& boundingAABB, AABB& retAABB ) const;
+
+	// ****** ViewableBase routines, for the whole mesh ******
+	// Returns the closest hit over all triangles.  The triangle number is
+	//	 returned in the visible point.
+	virtual bool FindIntersectionNT (
+		const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance,
+		double *intersectDistance, VisiblePoint& returnedPoint ) const;
+	bool FindIntersectionDistance( const VectorR3& viewPos, const VectorR3& viewDir, double maxDistance,
+								   double *intersectDistance ) const;
+	void CalcBoundingPlanes( const VectorR3& u, double *minDot, double *maxDot ) const;
+	bool CalcPartials( const VisiblePoint& visPoint,
+					   VectorR3& retPartialU, VectorR3& retPartialV ) const;
+	ViewableType GetViewableType() const { return Viewable_TriangleMesh; }
+
+protected:
+	const MaterialBase* FrontMat;
+	const MaterialBase* BackMat;	// Null point if not visible from back
+
+	long NumVertices;
+	long NumTriangles;
+	VectorR3* Vertices;
+	int* VertexIndices;			// Three vertices for each triangle
+
+	// NumTriangleData values for each triangle, kept together so a
+	//	 triangle's test reads two cache lines, not ten.
+	double* TriangleData;
+
+	// Used only while the mesh is being built
+	Array<VectorR3>* BuildVertices;
+	Array<int>* BuildIndices;
+
+	bool FindTriangleIntersectionNT( long tri, const VectorR3& viewPos, const VectorR3& viewDir,
+									 double maxDistance, double *intersectDistance,
+									 VisiblePoint& returnedPoint ) const;
+
+	ViewableTriangleMesh( const ViewableTriangleMesh& );			// Not copyable
+	ViewableTriangleMesh& operator=( const ViewableTriangleMesh& );
+};
+
+inline ViewableTriangleMesh::ViewableTriangleMesh()
+{
+	FrontMat = &Material::Default;
+	BackMat = &Material::Default;
+	NumVertices = 0;
+	NumTriangles = 0;
+	Vertices = 0;
+	VertexIndices = 0;
+	TriangleData = 0;
+	BuildVertices = new Array<VectorR3>;
+	BuildIndices = new Array<int>;
+}
+
+inline void ViewableTriangleMesh::SetMaterial(const MaterialBase* material )
+{
+	SetMaterialFront(material);
+	SetMaterialBack(material);
+}
+
+inline void ViewableTriangleMesh::SetMaterialFront(const MaterialBase* frontmaterial )
+{
+	FrontMat = frontmaterial;
+}
+
+inline void ViewableTriangleMesh::SetMaterialBack( const MaterialBase* backmaterial )
+{
+	BackMat = backmaterial;
+}
+
+inline VectorR3 ViewableTriangleMesh::GetNormal( long tri ) const
+{
+	return VectorR3( GetTriangleData(NormalX,tri), GetTriangleData(NormalY,tri), GetTriangleData(NormalZ,tri) );
+}
+
+inline long ViewableTriangleMesh::GetMemoryBytes() const
+{
+	return NumVertices*(long)sizeof(VectorR3)
+			+ NumTriangles*(3*(long)sizeof(int) + NumTriangleData*(long)sizeof(double));
+}
+
+inline bool ViewableTriangleMesh::FindTriangleIntersectionDistance( long tri,
+								const VectorR3& viewPos, const VectorR3& viewDir,
+								double maxDistance, double *intersectDistance ) const
+{
+	assert( IsFinished() && 0<=tri && tri<NumTriangles );
+	bool frontFace;
+	double vCoord, wCoord;
+	return ViewableTriangle::IntersectTriangle( viewPos, viewDir, maxDistance, GetVertexA(tri), GetNormal(tri),
+							GetTriangleData(PlaneCoef,tri),
+							VectorR3( GetTriangleData(UbetaX,tri), GetTriangleData(UbetaY,tri), GetTriangleData(UbetaZ,tri) ),
+							VectorR3( GetTriangleData(UgammaX,tri), GetTriangleData(UgammaY,tri), GetTriangleData(UgammaZ,tri) ),
+							BackFaceCulled(), intersectDistance, &vCoord, &wCoord, &frontFace );
+}
+
+inline bool ViewableTriangleMesh::FindTriangleIntersection( long tri,
+								const VectorR3& viewPos, const VectorR3& viewDir,
+								double maxDistance, double *intersectDistance,
+								VisiblePoint& returnedPoint ) const
+{
+	bool found = FindTriangleIntersectionNT( tri, viewPos, viewDir, maxDistance, intersectDistance, returnedPoint );
+	if ( found ) {
+		ApplyTextureMap( returnedPoint, viewDir );
+	}
+	return found;
+}
+
+#endif // VIEWABLETRIANGLEMESH_H
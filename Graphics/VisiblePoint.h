@@ -36,7 +36,7 @@ class VisiblePoint {
 	friend class ViewableBase;
 	
 public:
-	VisiblePoint() { FrontFace = true; MatNeedsFreeing = false; };
+	VisiblePoint() { FrontFace = true; MatNeedsFreeing = false; TriangleNumber = 0; };
 	VisiblePoint(const VisiblePoint &p);
 	~VisiblePoint();
 
@@ -74,6 +74,10 @@ public:
 	void SetObject( const ViewableBase *object ) { TheObject = object; }
 	const ViewableBase& GetObject() const { return *TheObject; }
 
+	// The triangle that was hit, when the object is a ViewableTriangleMesh.
+	void SetTriangleNumber( long triangleNumber ) { TriangleNumber = triangleNumber; }
+	long GetTriangleNumber() const { return TriangleNumber; }
+
 	void MakeMaterialMutable();	
 
 private:
@@ -83,6 +87,7 @@ private:
 	VectorR2 uvCoords;		// (u,v) coordinates for texture mapping & etc.
 	int FaceNumber;			// Index of face number (non-negative).
 	const ViewableBase* TheObject;		// The object from which the visible point came.
+	long TriangleNumber;	// Index of the triangle, if TheObject is a mesh.
 	bool FrontFace;			// Is it being viewed from the front side?
 	
 	bool MatNeedsFreeing;	// true if we are responsible for freeing the material.
@@ -109,6 +114,7 @@ inline VisiblePoint& VisiblePoint::operator=(const VisiblePoint& vp)
 	uvCoords = vp.uvCoords;
 	FaceNumber = vp.FaceNumber;
 	TheObject = vp.TheObject;
+	TriangleNumber = vp.TriangleNumber;
 	FrontFace = vp.FrontFace;
 
 	if ( MatNeedsFreeing ) {
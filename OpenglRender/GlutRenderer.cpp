@@ -31,6 +31,7 @@
 #include "../Graphics/ViewableSphere.h"
 #include "../Graphics/ViewableTorus.h"
 #include "../Graphics/ViewableTriangle.h"
+#include "../Graphics/ViewableTriangleMesh.h"
 #include "../RaytraceMgr/SceneDescription.h"
 
 GlutRenderer::GlutRenderer()
@@ -240,6 +241,9 @@ void GlutRenderer::RenderViewable( const ViewableBase& object )
 		case ViewableBase::Viewable_Triangle:
 			RenderViewableTriangle( (const ViewableTriangle&)object );
 			break;
+		case ViewableBase::Viewable_TriangleMesh:
+			RenderViewableTriangleMesh( (const ViewableTriangleMesh&)object );
+			break;
 		default:
 			assert(0);
 	}
@@ -643,6 +647,27 @@ void GlutRenderer::RenderViewableTriangle( const ViewableTriangle& object )
 	glEnd();
 }
 
+void GlutRenderer::RenderViewableTriangleMesh( const ViewableTriangleMesh& object )
+{
+	// Set material properties
+	SetFrontMaterial ( object.GetMaterialFront() );
+	SetBackMaterial( object.GetMaterialBack() );
+
+	// Draw triangles
+	double temp[3];
+	glBegin( GL_TRIANGLES );
+	for ( long i=0; i<object.GetNumTriangles(); i++ ) {
+		SetNormal( object.GetNormal(i) );
+		object.GetVertexA(i).Dump( temp );
+		glVertex3dv( temp );
+		object.GetVertexB(i).Dump( temp );
+		glVertex3dv( temp );
+		object.GetVertexC(i).Dump( temp );
+		glVertex3dv( temp );
+	}
+	glEnd();
+}
+
 void GlutRenderer::SetFrontMaterial( const MaterialBase* mat )
 {
 	if ( mat==0 ) {				// If no front material
@@ -45,6 +45,7 @@ class ViewableParallelogram;
 class ViewableSphere;
 class ViewableTorus;
 class ViewableTriangle;
+class ViewableTriangleMesh;
 class MaterialBase;
 class SceneDescription;
 
@@ -113,6 +114,7 @@ public:
 	void RenderViewableSphere( const ViewableSphere& object );
 	void RenderViewableTorus( const ViewableTorus& object );
 	void RenderViewableTriangle( const ViewableTriangle& object );
+	void RenderViewableTriangleMesh( const ViewableTriangleMesh& object );
 	
 private:
 	int MeshCount;
@@ -0,0 +1,297 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+#include <math.h>
+
+#include "LeafBatch.h"
+#include "../Graphics/ViewableTriangleMesh.h"
+#include "../Graphics/ViewableSphere.h"
+
+const char* LeafBatch::InstructionSet()
+{
+	return LEAFBATCH_USE_AVX ? "AVX" : ( LEAFBATCH_USE_SSE2 ? "SSE2" : "scalar" );
+}
+
+bool LeafBatch::AddTriangle( long objectNum, const ViewableTriangleMesh& mesh, long tri )
+{
+	int k = NumTriangles++;
+	TriangleObject[k] = objectNum;
+	TriangleCulled[k] = mesh.BackFaceCulled();
+	for ( int i=0; i<ViewableTriangleMesh::NumTriangleData; i++ ) {
+		TriangleData[i][k] = mesh.GetTriangleData( i, tri );
+	}
+	const VectorR3& vertexA = mesh.GetVertexA( tri );
+	TriangleData[TriVertexAX][k] = vertexA.x;
+	TriangleData[TriVertexAY][k] = vertexA.y;
+	TriangleData[TriVertexAZ][k] = vertexA.z;
+	return ( NumTriangles==BlockSize && TestTriangles() );
+}
+
+bool LeafBatch::AddSphere( long objectNum, const ViewableSphere& sphere )
+{
+	int k = NumSpheres++;
+	SphereObject[k] = objectNum;
+	const VectorR3& center = sphere.GetCenter();
+	SphereData[SphereCenterX][k] = center.x;
+	SphereData[SphereCenterY][k] = center.y;
+	SphereData[SphereCenterZ][k] = center.z;
+	SphereData[SphereRadiusSq][k] = sphere.GetRadiusSq();
+	return ( NumSpheres==BlockSize && TestSpheres() );
+}
+
+// The first part of ViewableTriangle::IntersectTriangle, for the block:
+//	 finds each triangle's hit distance and the triangles that are hit if
+//	 maxDistance is large enough.  The unused entries of a partly full
+//	 block are copies of the first entry.
+bool LeafBatch::TestTriangles()
+{
+	for ( int i=0; i<NumTriangleValues; i++ ) {
+		for ( int k=NumTriangles; k<BlockSize; k++ ) {
+			TriangleData[i][k] = TriangleData[i][0];
+		}
+	}
+	const double (*data)[BlockSize] = TriangleData;
+	double mdotnArray[BlockSize];
+	double planarDistArray[BlockSize];
+	double hitDistArray[BlockSize];
+	int hitBits = 0;			// Bit k is set if triangle k may be hit
+
+#if LEAFBATCH_USE_AVX
+	{
+		__m256d dirX = _mm256_set1_pd( ViewDir.x ), dirY = _mm256_set1_pd( ViewDir.y ), dirZ = _mm256_set1_pd( ViewDir.z );
+		__m256d posX = _mm256_set1_pd( ViewPos.x ), posY = _mm256_set1_pd( ViewPos.y ), posZ = _mm256_set1_pd( ViewPos.z );
+		__m256d zero = _mm256_setzero_pd();
+		__m256d normX = _mm256_loadu_pd( data[ViewableTriangleMesh::NormalX] );
+		__m256d normY = _mm256_loadu_pd( data[ViewableTriangleMesh::NormalY] );
+		__m256d normZ = _mm256_loadu_pd( data[ViewableTriangleMesh::NormalZ] );
+		__m256d mdotn = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( dirX, normX ), _mm256_mul_pd( dirY, normY ) ),
+									   _mm256_mul_pd( dirZ, normZ ) );
+		__m256d planarDist = _mm256_sub_pd( _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( posX, normX ), _mm256_mul_pd( posY, normY ) ),
+														   _mm256_mul_pd( posZ, normZ ) ),
+											_mm256_loadu_pd( data[ViewableTriangleMesh::PlaneCoef] ) );
+		// Front faces need !(planarDist<=0), back faces !(planarDist>=0)
+		__m256d frontFace = _mm256_cmp_pd( mdotn, zero, _CMP_LE_OQ );
+		__m256d sideOk = _mm256_or_pd( _mm256_and_pd( frontFace, _mm256_cmp_pd( planarDist, zero, _CMP_NLE_UQ ) ),
+									   _mm256_andnot_pd( frontFace, _mm256_cmp_pd( planarDist, zero, _CMP_NGE_UQ ) ) );
+		__m256d hitDist = _mm256_div_pd( _mm256_xor_pd( planarDist, _mm256_set1_pd( -0.0 ) ), mdotn );
+		__m256d vX = _mm256_sub_pd( _mm256_add_pd( _mm256_mul_pd( dirX, hitDist ), posX ), _mm256_loadu_pd( data[TriVertexAX] ) );
+		__m256d vY = _mm256_sub_pd( _mm256_add_pd( _mm256_mul_pd( dirY, hitDist ), posY ), _mm256_loadu_pd( data[TriVertexAY] ) );
+		__m256d vZ = _mm256_sub_pd( _mm256_add_pd( _mm256_mul_pd( dirZ, hitDist ), posZ ), _mm256_loadu_pd( data[TriVertexAZ] ) );
+		__m256d vCoord = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( vX, _mm256_loadu_pd( data[ViewableTriangleMesh::UbetaX] ) ),
+													   _mm256_mul_pd( vY, _mm256_loadu_pd( data[ViewableTriangleMesh::UbetaY] ) ) ),
+										_mm256_mul_pd( vZ, _mm256_loadu_pd( data[ViewableTriangleMesh::UbetaZ] ) ) );
+		__m256d wCoord = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( vX, _mm256_loadu_pd( data[ViewableTriangleMesh::UgammaX] ) ),
+													   _mm256_mul_pd( vY, _mm256_loadu_pd( data[ViewableTriangleMesh::UgammaY] ) ) ),
+										_mm256_mul_pd( vZ, _mm256_loadu_pd( data[ViewableTriangleMesh::UgammaZ] ) ) );
+		// Inside: !(vCoord<0) and !(wCoord<0) and !(vCoord+wCoord>1)
+		__m256d inside = _mm256_and_pd( _mm256_cmp_pd( vCoord, zero, _CMP_NLT_UQ ),
+										_mm256_and_pd( _mm256_cmp_pd( wCoord, zero, _CMP_NLT_UQ ),
+													   _mm256_cmp_pd( _mm256_add_pd( vCoord, wCoord ), _mm256_set1_pd( 1.0 ), _CMP_NGT_UQ ) ) );
+		hitBits = _mm256_movemask_pd( _mm256_and_pd( sideOk, inside ) );
+		_mm256_storeu_pd( mdotnArray, mdotn );
+		_mm256_storeu_pd( planarDistArray, planarDist );
+		_mm256_storeu_pd( hitDistArray, hitDist );
+	}
+#elif LEAFBATCH_USE_SSE2
+	__m128d dirX = _mm_set1_pd( ViewDir.x ), dirY = _mm_set1_pd( ViewDir.y ), dirZ = _mm_set1_pd( ViewDir.z );
+	__m128d posX = _mm_set1_pd( ViewPos.x ), posY = _mm_set1_pd( ViewPos.y ), posZ = _mm_set1_pd( ViewPos.z );
+	__m128d zero = _mm_setzero_pd();
+	for ( int h=0; h<BlockSize; h+=2 ) {
+		__m128d normX = _mm_loadu_pd( data[ViewableTriangleMesh::NormalX]+h );
+		__m128d normY = _mm_loadu_pd( data[ViewableTriangleMesh::NormalY]+h );
+		__m128d normZ = _mm_loadu_pd( data[ViewableTriangleMesh::NormalZ]+h );
+		__m128d mdotn = _mm_add_pd( _mm_add_pd( _mm_mul_pd( dirX, normX ), _mm_mul_pd( dirY, normY ) ),
+									_mm_mul_pd( dirZ, normZ ) );
+		__m128d planarDist = _mm_sub_pd( _mm_add_pd( _mm_add_pd( _mm_mul_pd( posX, normX ), _mm_mul_pd( posY, normY ) ),
+													 _mm_mul_pd( posZ, normZ ) ),
+										 _mm_loadu_pd( data[ViewableTriangleMesh::PlaneCoef]+h ) );
+		// Front faces need !(planarDist<=0), back faces !(planarDist>=0)
+		__m128d frontFace = _mm_cmple_pd( mdotn, zero );
+		__m128d sideOk = _mm_or_pd( _mm_and_pd( frontFace, _mm_cmpnle_pd( planarDist, zero ) ),
+									_mm_andnot_pd( frontFace, _mm_cmpnge_pd( planarDist, zero ) ) );
+		__m128d hitDist = _mm_div_pd( _mm_xor_pd( planarDist, _mm_set1_pd( -0.0 ) ), mdotn );
+		__m128d vX = _mm_sub_pd( _mm_add_pd( _mm_mul_pd( dirX, hitDist ), posX ), _mm_loadu_pd( data[TriVertexAX]+h ) );
+		__m128d vY = _mm_sub_pd( _mm_add_pd( _mm_mul_pd( dirY, hitDist ), posY ), _mm_loadu_pd( data[TriVertexAY]+h ) );
+		__m128d vZ = _mm_sub_pd( _mm_add_pd( _mm_mul_pd( dirZ, hitDist ), posZ ), _mm_loadu_pd( data[TriVertexAZ]+h ) );
+		__m128d vCoord = _mm_add_pd( _mm_add_pd( _mm_mul_pd( vX, _mm_loadu_pd( data[ViewableTriangleMesh::UbetaX]+h ) ),
+												 _mm_mul_pd( vY, _mm_loadu_pd( data[ViewableTriangleMesh::UbetaY]+h ) ) ),
+									 _mm_mul_pd( vZ, _mm_loadu_pd( data[ViewableTriangleMesh::UbetaZ]+h ) ) );
+		__m128d wCoord = _mm_add_pd( _mm_add_pd( _mm_mul_pd( vX, _mm_loadu_pd( data[ViewableTriangleMesh::UgammaX]+h ) ),
+												 _mm_mul_pd( vY, _mm_loadu_pd( data[ViewableTriangleMesh::UgammaY]+h ) ) ),
+									 _mm_mul_pd( vZ, _mm_loadu_pd( data[ViewableTriangleMesh::UgammaZ]+h ) ) );
+		// Inside: !(vCoord<0) and !(wCoord<0) and !(vCoord+wCoord>1)
+		__m128d inside = _mm_and_pd( _mm_cmpnlt_pd( vCoord, zero ),
+									 _mm_and_pd( _mm_cmpnlt_pd( wCoord, zero ),
+												 _mm_cmpngt_pd( _mm_add_pd( vCoord, wCoord ), _mm_set1_pd( 1.0 ) ) ) );
+		hitBits |= _mm_movemask_pd( _mm_and_pd( sideOk, inside ) ) << h;
+		_mm_storeu_pd( mdotnArray+h, mdotn );
+		_mm_storeu_pd( planarDistArray+h, planarDist );
+		_mm_storeu_pd( hitDistArray+h, hitDist );
+	}
+#else
+	for ( int k=0; k<BlockSize; k++ ) {
+		VectorR3 normal( data[ViewableTriangleMesh::NormalX][k], data[ViewableTriangleMesh::NormalY][k],
+						 data[ViewableTriangleMesh::NormalZ][k] );
+		double mdotn = (ViewDir^normal);
+		double planarDist = (ViewPos^normal)-data[ViewableTriangleMesh::PlaneCoef][k];
+		mdotnArray[k] = mdotn;
+		planarDistArray[k] = planarDist;
+		if ( (mdotn<=0.0) ? planarDist<=0.0 : planarDist>=0.0 ) {
+			continue;
+		}
+		double hitDist = -planarDist/mdotn;
+		hitDistArray[k] = hitDist;
+		VectorR3 v( ViewDir );
+		v *= hitDist;
+		v += ViewPos;
+		v -= VectorR3( data[TriVertexAX][k], data[TriVertexAY][k], data[TriVertexAZ][k] );
+		double vCoord = v.x*data[ViewableTriangleMesh::UbetaX][k] + v.y*data[ViewableTriangleMesh::UbetaY][k]
+							+ v.z*data[ViewableTriangleMesh::UbetaZ][k];
+		double wCoord = v.x*data[ViewableTriangleMesh::UgammaX][k] + v.y*data[ViewableTriangleMesh::UgammaY][k]
+							+ v.z*data[ViewableTriangleMesh::UgammaZ][k];
+		if ( !( vCoord<0.0 || wCoord<0.0 || vCoord+wCoord>1.0 ) ) {
+			hitBits |= (1<<k);
+		}
+	}
+#endif
+
+	// The tests against the closest hit, in order
+	bool found = false;
+	for ( int k=0; k<NumTriangles; k++ ) {
+		if ( (hitBits & (1<<k))==0 ) {
+			continue;
+		}
+		double maxDistance = *BestHitDistance;
+		double mdotn = mdotnArray[k];
+		double planarDist = planarDistArray[k];
+		if ( mdotn<=0.0 ) {
+			if ( planarDist >= -maxDistance*mdotn ) {
+				continue;
+			}
+		}
+		else {
+			if ( TriangleCulled[k] || -planarDist >= maxDistance*mdotn ) {
+				continue;
+			}
+		}
+		*BestHitDistance = hitDistArray[k];
+		*BestObject = TriangleObject[k];
+		found = true;
+	}
+	NumTriangles = 0;
+	return found;
+}
+
+// The first part of ViewableSphere::QuickIntersectTest, for the block:
+//	 finds the spheres whose surface the ray's line crosses.  The unused
+//	 entries of a partly full block are copies of the first entry.
+bool LeafBatch::TestSpheres()
+{
+	for ( int i=0; i<NumSphereValues; i++ ) {
+		for ( int k=NumSpheres; k<BlockSize; k++ ) {
+			SphereData[i][k] = SphereData[i][0];
+		}
+	}
+	const double (*data)[BlockSize] = SphereData;
+	double dArray[BlockSize];
+	double bSqArray[BlockSize];
+	double rootArray[BlockSize];
+	int hitBits = 0;			// Bit k is set if the line meets sphere k
+
+#if LEAFBATCH_USE_AVX
+	{
+		__m256d dirX = _mm256_set1_pd( ViewDir.x ), dirY = _mm256_set1_pd( ViewDir.y ), dirZ = _mm256_set1_pd( ViewDir.z );
+		__m256d toCenterX = _mm256_sub_pd( _mm256_loadu_pd( data[SphereCenterX] ), _mm256_set1_pd( ViewPos.x ) );
+		__m256d toCenterY = _mm256_sub_pd( _mm256_loadu_pd( data[SphereCenterY] ), _mm256_set1_pd( ViewPos.y ) );
+		__m256d toCenterZ = _mm256_sub_pd( _mm256_loadu_pd( data[SphereCenterZ] ), _mm256_set1_pd( ViewPos.z ) );
+		__m256d d = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( dirX, toCenterX ), _mm256_mul_pd( dirY, toCenterY ) ),
+								   _mm256_mul_pd( dirZ, toCenterZ ) );
+		__m256d vX = _mm256_sub_pd( _mm256_mul_pd( dirX, d ), toCenterX );
+		__m256d vY = _mm256_sub_pd( _mm256_mul_pd( dirY, d ), toCenterY );
+		__m256d vZ = _mm256_sub_pd( _mm256_mul_pd( dirZ, d ), toCenterZ );
+		__m256d aSq = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( vX, vX ), _mm256_mul_pd( vY, vY ) ), _mm256_mul_pd( vZ, vZ ) );
+		__m256d radiusSq = _mm256_loadu_pd( data[SphereRadiusSq] );
+		__m256d bSq = _mm256_sub_pd( radiusSq, aSq );
+		hitBits = _mm256_movemask_pd( _mm256_cmp_pd( aSq, radiusSq, _CMP_NGE_UQ ) );
+		_mm256_storeu_pd( dArray, d );
+		_mm256_storeu_pd( bSqArray, bSq );
+		_mm256_storeu_pd( rootArray, _mm256_sqrt_pd( bSq ) );
+	}
+#elif LEAFBATCH_USE_SSE2
+	__m128d dirX = _mm_set1_pd( ViewDir.x ), dirY = _mm_set1_pd( ViewDir.y ), dirZ = _mm_set1_pd( ViewDir.z );
+	for ( int h=0; h<BlockSize; h+=2 ) {
+		__m128d toCenterX = _mm_sub_pd( _mm_loadu_pd( data[SphereCenterX]+h ), _mm_set1_pd( ViewPos.x ) );
+		__m128d toCenterY = _mm_sub_pd( _mm_loadu_pd( data[SphereCenterY]+h ), _mm_set1_pd( ViewPos.y ) );
+		__m128d toCenterZ = _mm_sub_pd( _mm_loadu_pd( data[SphereCenterZ]+h ), _mm_set1_pd( ViewPos.z ) );
+		__m128d d = _mm_add_pd( _mm_add_pd( _mm_mul_pd( dirX, toCenterX ), _mm_mul_pd( dirY, toCenterY ) ),
+								_mm_mul_pd( dirZ, toCenterZ ) );
+		__m128d vX = _mm_sub_pd( _mm_mul_pd( dirX, d ), toCenterX );
+		__m128d vY = _mm_sub_pd( _mm_mul_pd( dirY, d ), toCenterY );
+		__m128d vZ = _mm_sub_pd( _mm_mul_pd( dirZ, d ), toCenterZ );
+		__m128d aSq = _mm_add_pd( _mm_add_pd( _mm_mul_pd( vX, vX ), _mm_mul_pd( vY, vY ) ), _mm_mul_pd( vZ, vZ ) );
+		__m128d radiusSq = _mm_loadu_pd( data[SphereRadiusSq]+h );
+		__m128d bSq = _mm_sub_pd( radiusSq, aSq );
+		hitBits |= _mm_movemask_pd( _mm_cmpnge_pd( aSq, radiusSq ) ) << h;
+		_mm_storeu_pd( dArray+h, d );
+		_mm_storeu_pd( bSqArray+h, bSq );
+		_mm_storeu_pd( rootArray+h, _mm_sqrt_pd( bSq ) );
+	}
+#else
+	for ( int k=0; k<BlockSize; k++ ) {
+		VectorR3 tocenter( data[SphereCenterX][k], data[SphereCenterY][k], data[SphereCenterZ][k] );
+		tocenter -= ViewPos;
+		double d = (ViewDir^tocenter);
+		VectorR3 v( ViewDir );
+		v *= d;
+		v -= tocenter;
+		double aSq = v.NormSq();
+		dArray[k] = d;
+		bSqArray[k] = data[SphereRadiusSq][k]-aSq;
+		if ( !(aSq >= data[SphereRadiusSq][k]) ) {
+			rootArray[k] = sqrt( bSqArray[k] );
+			hitBits |= (1<<k);
+		}
+	}
+#endif
+
+	// The tests against the closest hit, in order
+	bool found = false;
+	for ( int k=0; k<NumSpheres; k++ ) {
+		if ( (hitBits & (1<<k))==0 ) {
+			continue;
+		}
+		double maxDist = *BestHitDistance;
+		double D = dArray[k];
+		double BSq = bSqArray[k];
+		if ( D>0.0 && D*D>BSq && (D<maxDist || BSq>Square(D-maxDist) ) ) {
+			*BestHitDistance = D-rootArray[k];		// It hits the sphere as it enters.
+		}
+		else if ( (D>0.0 || D*D<BSq) && D<maxDist && BSq<Square(D-maxDist) ) {
+			*BestHitDistance = D+rootArray[k];		// It hits the sphere as it exits
+		}
+		else {
+			continue;
+		}
+		*BestObject = SphereObject[k];
+		found = true;
+	}
+	NumSpheres = 0;
+	return found;
+}
@@ -0,0 +1,124 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// LeafBatch.h
+//   Finds the closest hit of a ray among the objects of a kd-tree or BVH
+//	 leaf, testing four objects at a time.
+//
+//	 The triangles of meshes and the spheres are gathered into blocks of four,
+//	 with one array for each value, and a full block is tested at once with
+//	 AVX or SSE2 (or a scalar loop, if neither is available).  The arithmetic
+//	 is that of ViewableTriangle::IntersectTriangle and ViewableSphere::
+//	 QuickIntersectTest.  The tests that depend on the distance to the closest
+//	 hit are then made for each hit, in the order the objects were added,
+//	 so the same hit is found as when the objects are tested one at a time.
+
+#ifndef LEAFBATCH_H
+#define LEAFBATCH_H
+
+#if defined(__AVX__)
+#define LEAFBATCH_USE_AVX 1
+#include <immintrin.h>
+#else
+#define LEAFBATCH_USE_AVX 0
+#endif
+#if !LEAFBATCH_USE_AVX && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2))
+#define LEAFBATCH_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define LEAFBATCH_USE_SSE2 0
+#endif
+
+#include "../VrMath/LinearR3.h"
+
+class ViewableTriangleMesh;
+class ViewableSphere;
+
+class LeafBatch {
+public:
+	// The closest hit so far is at distance *bestHitDistance on object *bestObject.
+	//	 Both are updated whenever a closer hit is found.
+	LeafBatch( const VectorR3& viewPos, const VectorR3& viewDir, double* bestHitDistance, long* bestObject );
+
+	// Add an object to its block.  A block is tested as soon as it is full.
+	//	 Return true if a closer hit was found.
+	bool AddTriangle( long objectNum, const ViewableTriangleMesh& mesh, long tri );
+	bool AddSphere( long objectNum, const ViewableSphere& sphere );
+	// Test the objects in the blocks that are not full.  Call after the last object is added.
+	bool Flush();
+
+	const static int BlockSize = 4;
+
+	// Name of the instruction set used for the blocks
+	static const char* InstructionSet();
+
+private:
+	VectorR3 ViewPos;
+	VectorR3 ViewDir;
+	double* BestHitDistance;
+	long* BestObject;
+
+	// The triangles: the precomputed data of ViewableTriangleMesh,
+	//	 then vertex A.  TriangleData[value][k] for triangle k.
+	enum {
+		TriVertexAX = 10, TriVertexAY = 11, TriVertexAZ = 12,
+		NumTriangleValues = 13
+	};
+	int NumTriangles;
+	long TriangleObject[BlockSize];
+	bool TriangleCulled[BlockSize];			// True if the back face is culled
+	double TriangleData[NumTriangleValues][BlockSize];
+
+	// The spheres: center and radius squared
+	enum {
+		SphereCenterX = 0, SphereCenterY = 1, SphereCenterZ = 2, SphereRadiusSq = 3,
+		NumSphereValues = 4
+	};
+	int NumSpheres;
+	long SphereObject[BlockSize];
+	double SphereData[NumSphereValues][BlockSize];
+
+	bool TestTriangles();
+	bool TestSpheres();
+};
+
+inline LeafBatch::LeafBatch( const VectorR3& viewPos, const VectorR3& viewDir,
+							 double* bestHitDistance, long* bestObject )
+: ViewPos( viewPos ), ViewDir( viewDir )
+{
+	BestHitDistance = bestHitDistance;
+	BestObject = bestObject;
+	NumTriangles = 0;
+	NumSpheres = 0;
+}
+
+inline bool LeafBatch::Flush()
+{
+	bool found = false;
+	if ( NumTriangles>0 ) {
+		found = TestTriangles();
+	}
+	if ( NumSpheres>0 ) {
+		found = TestSpheres() || found;
+	}
+	return found;
+}
+
+#endif // LEAFBATCH_H
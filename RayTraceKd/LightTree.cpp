@@ -0,0 +1,163 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "LightTree.h"
+#include "../Graphics/Light.h"
+#include "../Graphics/DirectLight.h"
+#include "../RaytraceMgr/SceneDescription.h"
+
+void LightTree::Build( const SceneDescription& scene )
+{
+	Scene = &scene;
+	Nodes.Reset();
+	DirectionalLights.Reset();
+	Array<int> lightNums;
+	for ( int k=0; k<scene.NumLights(); k++ ) {
+		if ( scene.GetLight(k).IsDirectional() ) {
+			DirectionalLights.Push( k );
+		}
+		else {
+			lightNums.Push( k );
+		}
+	}
+	if ( lightNums.SizeUsed()>0 ) {
+		BuildNode( lightNums.GetFirstEntryPtr(), lightNums.SizeUsed() );
+	}
+}
+
+// Builds the subtree over the lights, splitting them in two halves across
+//	 the longest side of their box.  Returns the number of its root node.
+int LightTree::BuildNode( int* lightNums, int numLights )
+{
+	int nodeNum = Nodes.SizeUsed();
+	Node* node = Nodes.Push();
+	const VectorR3& firstPos = Scene->GetLight(lightNums[0]).GetPosition();
+	VectorR3 boxMin = firstPos;
+	VectorR3 boxMax = firstPos;
+	node->Power = 0.0;
+	node->AttenConstant = DBL_MAX;
+	node->AttenLinear = DBL_MAX;
+	node->AttenQuadratic = DBL_MAX;
+	for ( int i=0; i<numLights; i++ ) {
+		const Light& light = Scene->GetLight(lightNums[i]);
+		const VectorR3& pos = light.GetPosition();
+		boxMin.Set( Min(boxMin.x,pos.x), Min(boxMin.y,pos.y), Min(boxMin.z,pos.z) );
+		boxMax.Set( Max(boxMax.x,pos.x), Max(boxMax.y,pos.y), Max(boxMax.z,pos.z) );
+		node->Power = Max( node->Power, LightPower(light) );
+		bool atten = light.AttenuateActive();
+		node->AttenConstant = Min( node->AttenConstant, atten ? light.GetAttenuateConstant() : 1.0 );
+		node->AttenLinear = Min( node->AttenLinear, atten ? light.GetAttenuateLinear() : 0.0 );
+		node->AttenQuadratic = Min( node->AttenQuadratic, atten ? light.GetAttenuateQuadratic() : 0.0 );
+	}
+	node->Box.Set( boxMin, boxMax );
+	node->LightNum = -1;
+	node->RightChild = -1;
+	if ( numLights==1 ) {
+		node->LightNum = lightNums[0];
+		return nodeNum;
+	}
+
+	VectorR3 extent = boxMax-boxMin;
+	int axis = ( extent.x>=extent.y && extent.x>=extent.z ) ? 0 : ( extent.y>=extent.z ? 1 : 2 );
+	const SceneDescription* scene = Scene;
+	int half = numLights/2;
+	std::nth_element( lightNums, lightNums+half, lightNums+numLights,
+		[scene,axis]( int a, int b ) {
+			const VectorR3& posA = scene->GetLight(a).GetPosition();
+			const VectorR3& posB = scene->GetLight(b).GetPosition();
+			return ( axis==0 ? posA.x<posB.x : ( axis==1 ? posA.y<posB.y : posA.z<posB.z ) );
+		} );
+	BuildNode( lightNums, half );
+	int rightChild = BuildNode( lightNums+half, numLights-half );
+	Nodes[nodeNum].RightChild = rightChild;		// The node may have moved
+	return nodeNum;
+}
+
+void LightTree::GetLights( const VectorR3& position, double cutoff, Array<int>& lights ) const
+{
+	lights.Reset();
+	for ( long i=0; i<DirectionalLights.SizeUsed(); i++ ) {
+		lights.Push( DirectionalLights[i] );
+	}
+	if ( Nodes.SizeUsed()>0 ) {
+		int stack[64];				// The tree is balanced, so its depth is at most 32
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while ( stackSize>0 ) {
+			int nodeNum = stack[--stackSize];
+			const Node& node = Nodes[nodeNum];
+			if ( node.LightNum>=0 ) {
+				if ( MayLight( Scene->GetLight(node.LightNum), position, cutoff ) ) {
+					lights.Push( node.LightNum );
+				}
+			}
+			// The bound is computed differently from MaxLight(), so it is
+			//	 given some slack for roundoff.
+			else if ( NodeMaxLight( node, position )*(1.0+1.0e-9)>=cutoff ) {
+				stack[stackSize++] = node.RightChild;
+				stack[stackSize++] = nodeNum+1;
+			}
+		}
+	}
+	if ( lights.SizeUsed()>1 ) {
+		std::sort( lights.GetFirstEntryPtr(), lights.GetFirstEntryPtr()+lights.SizeUsed() );
+	}
+}
+
+double LightTree::MaxLight( const Light& light, const VectorR3& position )
+{
+	VectorR3 lightVector;
+	double lightAttenuate;
+	if ( CalcLightDirAndFactor( light, position, &lightVector, &lightAttenuate ) ) {
+		return LightPower( light )*lightAttenuate;
+	}
+	// Hidden from a spotlight
+	const VectorR3& ambient = light.GetColorAmbient();
+	return Max( ambient.x, Max( ambient.y, ambient.z ) )*lightAttenuate;
+}
+
+bool LightTree::MayLight( const Light& light, const VectorR3& position, double cutoff )
+{
+	return ( light.IsDirectional() || MaxLight( light, position )>=cutoff );
+}
+
+double LightTree::NodeMaxLight( const Node& node, const VectorR3& position )
+{
+	const VectorR3& boxMin = node.Box.GetBoxMin();
+	const VectorR3& boxMax = node.Box.GetBoxMax();
+	VectorR3 toBox( Max( 0.0, Max( boxMin.x-position.x, position.x-boxMax.x ) ),
+					Max( 0.0, Max( boxMin.y-position.y, position.y-boxMax.y ) ),
+					Max( 0.0, Max( boxMin.z-position.z, position.z-boxMax.z ) ) );
+	double distSq = toBox.NormSq();
+	double denom = node.AttenConstant + sqrt(distSq)*node.AttenLinear + distSq*node.AttenQuadratic;
+	return ( denom>0.0 ) ? node.Power/denom : DBL_MAX;
+}
+
+double LightTree::LightPower( const Light& light )
+{
+	VectorR3 color = light.GetColorAmbient();
+	color += light.GetColorDiffuse();
+	color += light.GetColorSpecular();
+	return Max( color.x, Max( color.y, color.z ) );
+}
@@ -0,0 +1,92 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// LightTree.h
+//   A bounding volume hierarchy over the positional lights of a scene,
+//	 used to skip the lights that cannot light a point by more than a
+//	 cutoff (see RenderOptions::LightCutoff).
+//
+//	 The light reaching a point from a light is at most its power, the
+//	 largest component of its ambient, diffuse and specular colors added
+//	 together, times its attenuation at the point.  A material whose
+//	 coefficients are at most one reflects no more than this.
+//
+//	 Each node bounds the positions of its lights, and holds the largest
+//	 power of its lights and the smallest of each of their attenuation
+//	 coefficients (a light without attenuation has coefficients 1, 0, 0).
+//	 The light from the node at a point is then at most
+//		Power / ( AttenConstant + d*AttenLinear + d*d*AttenQuadratic ),
+//	 where d is the distance from the point to the node's box, and the
+//	 node is skipped if this is below the cutoff.  A leaf holds one light,
+//	 whose light is found as by DirectIlluminate(): it includes the
+//	 spotlight factor, and outside a spotlight's cone only the ambient
+//	 light is left.
+//
+//	 Directional lights are never attenuated, so they are never skipped.
+
+#ifndef LIGHTTREE_H
+#define LIGHTTREE_H
+
+#include "../DataStructs/Array.h"
+#include "../VrMath/Aabb.h"
+
+class Light;
+class SceneDescription;
+
+class LightTree {
+public:
+	LightTree() {}
+
+	// Builds the tree over the lights of the scene
+	void Build( const SceneDescription& scene );
+
+	// Sets lights to the numbers of the scene's lights that may light
+	//	 position by at least cutoff, in increasing order.
+	void GetLights( const VectorR3& position, double cutoff, Array<int>& lights ) const;
+
+	// The most light that the light may shed on position (see above)
+	static double MaxLight( const Light& light, const VectorR3& position );
+	// Whether GetLights() returns the light
+	static bool MayLight( const Light& light, const VectorR3& position, double cutoff );
+
+	long GetNumNodes() const { return Nodes.SizeUsed(); }
+
+private:
+	class Node {
+	public:
+		AABB Box;				// Bounds the positions of the lights
+		double Power;			// The largest power of the lights
+		double AttenConstant;	// The smallest attenuation coefficients of the lights
+		double AttenLinear;
+		double AttenQuadratic;
+		int LightNum;			// The light of a leaf.  -1 for an inner node.
+		int RightChild;			// The left child of an inner node is the next node
+	};
+
+	Array<Node> Nodes;				// The root is node 0
+	Array<int> DirectionalLights;
+	const SceneDescription* Scene;
+
+	int BuildNode( int* lightNums, int numLights );
+	static double NodeMaxLight( const Node& node, const VectorR3& position );
+	static double LightPower( const Light& light );
+};
+
+#endif // LIGHTTREE_H
@@ -0,0 +1,237 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// RayTraceBatch.cpp
+//   Headless batch renderer.  Loads a scene named on the command line,
+//   ray traces it at the requested resolution and writes a .bmp file.
+//   Does not open a window and does not link with OpenGL or GLUT.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// C++ STL headers
+#include <chrono>
+
+#include "RayTraceRender.h"
+#include "LeafBatch.h"
+
+#include "../Graphics/PixelArray.h"
+#include "../Graphics/CameraView.h"
+#include "../RaytraceMgr/SceneDescription.h"
+
+static void PrintUsage( const char* progName )
+{
+	fprintf( stderr, "Usage: %s [options] [scene.nff | scene.obj]\n", progName );
+	fprintf( stderr, "  -w <width>       Image width in pixels (default 640).\n" );
+	fprintf( stderr, "  -h <height>      Image height in pixels (default 480).\n" );
+	fprintf( stderr, "  -s <samples>     Rays per pixel (default 16).\n" );
+	fprintf( stderr, "  -S <sampler>     Sampler: random, stratified, halton, sobol or cmj (default stratified).\n" );
+	fprintf( stderr, "  -A <threshold>   Adaptive sampling: refine each pixel until the standard error of its\n" );
+	fprintf( stderr, "                   color is below threshold, up to the -s rays per pixel (default off).\n" );
+	fprintf( stderr, "  -m <samples>     Adaptive sampling: rays per pixel in the first pass (default 4).\n" );
+	fprintf( stderr, "  -c <contrast>    Adaptive sampling: pixels that differ this much from a neighbour\n" );
+	fprintf( stderr, "                   after the first pass get extra rays (default 0.1).\n" );
+	fprintf( stderr, "  -g <0 or 1>      Progressive: trace one pixel in 8x8 first, then refine in passes,\n" );
+	fprintf( stderr, "                   reporting the time of each pass (default 0).\n" );
+	fprintf( stderr, "  -b <seconds>     Time budget: stop refining the image (the -A pass, and the -g passes\n" );
+	fprintf( stderr, "                   after the first full resolution one) at this time (default 0, for none).\n" );
+	fprintf( stderr, "  -M <file.bmp>    Write a map of the rays per pixel (white is the -s maximum).\n" );
+	fprintf( stderr, "  -d <depth>       Maximum ray trace depth (default 3).\n" );
+	fprintf( stderr, "  -R <threshold>   Stochastic ray tree: follow one of reflection and transmission,\n" );
+	fprintf( stderr, "                   with Russian roulette below threshold (default off).\n" );
+	fprintf( stderr, "  -F <0 or 1>      Split reflection and transmission by the Fresnel equations (default 0).\n" );
+	fprintf( stderr, "  -f <length>      Focal length (default 350).\n" );
+	fprintf( stderr, "  -a <aperture>    Width of the lens, 0 for a pinhole camera (default 0.2).\n" );
+	fprintf( stderr, "  -j <threads>     Number of render threads (default: one per hardware thread).\n" );
+	fprintf( stderr, "  -p <0 or 1>      Pin each render thread to its own CPU (default 0)%s.\n",
+				RenderThreadPool::CanPinThreads() ? "" : "; not supported here" );
+	fprintf( stderr, "  -t <size>        Threads render tiles of size x size pixels (default 16).\n" );
+	fprintf( stderr, "  -T <order>       Tile order: scanline, morton or hilbert (default hilbert).\n" );
+	fprintf( stderr, "  -B <accel>       Acceleration structure: kdtree or bvh (default kdtree).\n" );
+	fprintf( stderr, "  -L <0 or 1>      Test the triangles and spheres of each leaf together, with %s (default 1).\n",
+				LeafBatch::InstructionSet() );
+	fprintf( stderr, "  -P <rays>        Trace the camera rays of a pixel through the kd-tree in packets of\n" );
+	fprintf( stderr, "                   up to %d rays, with their shadow feelers (default 1, for none).\n",
+				KdTree::MaxPacketRays );
+	fprintf( stderr, "  -W <rays>        Trace the camera rays of each tile in batches of this many rays,\n" );
+	fprintf( stderr, "                   stage by stage (default 0, for none).\n" );
+	fprintf( stderr, "  -O <0 or 1>      With -W, sort the reflected and transmitted rays by direction and\n" );
+	fprintf( stderr, "                   origin before tracing them (default 0).\n" );
+	fprintf( stderr, "  -l <cutoff>      Light culling: shade each point only with the lights that may light it\n" );
+	fprintf( stderr, "                   by at least cutoff, found with a light tree (default 0, for none).\n" );
+	fprintf( stderr, "  -q <coef>        Give the positional lights the attenuation 1/(1+coef*d*d) at distance d\n" );
+	fprintf( stderr, "                   (default: as given by the scene; .nff lights are not attenuated).\n" );
+	fprintf( stderr, "  -n <frames>      Render the frame this many times (default 1).\n" );
+	fprintf( stderr, "  -o <file.bmp>    Output bitmap file (default raytrace.bmp).\n" );
+	fprintf( stderr, "With no scene file, the built-in scene of RayTraceSetup2.cpp is rendered.\n" );
+}
+
+// Start of the frame being rendered, for the times of the progressive passes
+static chrono::steady_clock::time_point FrameStart;
+
+static void ReportProgress( const PixelArray& pixels, int stride, long samplesPerPixel )
+{
+	double ms = chrono::duration<double,milli>( chrono::steady_clock::now() - FrameStart ).count();
+	fprintf( stdout, "  Progressive pass: 1/%d resolution, %ld samples per pixel.  Time: %0.1lf(ms)\n",
+				stride, samplesPerPixel, ms );
+}
+
+//**********************************************************
+// Main Routine
+//**********************************************************
+int main( int argc, char** argv )
+{
+	int width = 640;
+	int height = 480;
+	const char* outFile = "raytrace.bmp";
+	const char* sceneFile = 0;
+	const char* mapFile = 0;
+	int numFrames = 1;
+	double lightAttenuation = 0.0;
+	RenderOptions options;
+
+	for ( int i=1; i<argc; i++ ) {
+		const char* arg = argv[i];
+		if ( arg[0]=='-' && arg[1]!=0 && arg[2]==0 && i+1<argc ) {
+			const char* value = argv[++i];
+			switch ( arg[1] ) {
+			case 'w':	width = atoi(value);					break;
+			case 'h':	height = atoi(value);					break;
+			case 's':	options.SamplesPerPixel = atol(value);	break;
+			case 'A':
+				options.Adaptive = true;
+				options.AdaptiveThreshold = atof(value);
+				break;
+			case 'm':	options.AdaptiveMinSamples = atol(value);	break;
+			case 'c':	options.AdaptiveContrast = atof(value);		break;
+			case 'M':	mapFile = value;						break;
+			case 'g':	options.Progressive = ( atoi(value)!=0 );	break;
+			case 'b':	options.TimeBudget = atof(value);		break;
+			case 'd':	options.TraceDepth = atoi(value);		break;
+			case 'R':
+				options.StochasticRayTree = true;
+				options.RouletteThreshold = atof(value);
+				break;
+			case 'F':	options.FresnelRates = ( atoi(value)!=0 );	break;
+			case 'L':	options.LeafBatch = ( atoi(value)!=0 );	break;
+			case 'P':	options.PacketSize = atoi(value);		break;
+			case 'W':	options.WavefrontRays = atol(value);	break;
+			case 'O':	options.SortSecondaryRays = ( atoi(value)!=0 );	break;
+			case 'f':	options.FocalLength = atof(value);		break;
+			case 'a':	options.Aperture = atof(value);			break;
+			case 'j':	options.NumThreads = atoi(value);		break;
+			case 'p':	options.PinThreads = ( atoi(value)!=0 );	break;
+			case 't':	options.TileSize = atoi(value);			break;
+			case 'l':	options.LightCutoff = atof(value);		break;
+			case 'q':	lightAttenuation = atof(value);			break;
+			case 'n':	numFrames = atoi(value);				break;
+			case 'T':
+				if ( !TileScheduler::ParseOrder( value, &options.TileOrder ) ) {
+					PrintUsage( argv[0] );
+					return 1;
+				}
+				break;
+			case 'S':
+				if ( !Sampler::ParseType( value, &options.SamplePattern ) ) {
+					PrintUsage( argv[0] );
+					return 1;
+				}
+				break;
+			case 'B':
+				if ( !ParseAccelerator( value, &options.Accelerator ) ) {
+					PrintUsage( argv[0] );
+					return 1;
+				}
+				break;
+			case 'o':	outFile = value;						break;
+			default:
+				PrintUsage( argv[0] );
+				return 1;
+			}
+		}
+		else if ( arg[0]!='-' && sceneFile==0 ) {
+			sceneFile = arg;
+		}
+		else {
+			PrintUsage( argv[0] );
+			return 1;
+		}
+	}
+	if ( width<=0 || height<=0 || options.SamplesPerPixel<=0 || options.AdaptiveMinSamples<=0 || options.TraceDepth<=0
+			|| options.TileSize<=0 || numFrames<=0 || options.PacketSize<=0 || options.WavefrontRays<0 || options.TimeBudget<0.0
+			|| options.LightCutoff<0.0 || lightAttenuation<0.0 ) {
+		PrintUsage( argv[0] );
+		return 1;
+	}
+
+	if ( !LoadActiveScene( sceneFile ) ) {
+		fprintf( stderr, "Unable to load scene file %s.\n", sceneFile );
+		return 1;
+	}
+	if ( lightAttenuation>0.0 ) {
+		AttenuateSceneLights( lightAttenuation );
+	}
+
+	PixelArray pixels( width, height );
+	PixelArray sampleMap( width, height );
+	FitCameraToPixels( pixels );
+	const CameraView& theCV = ActiveScene->GetCameraView();
+
+	auto start = chrono::steady_clock::now();
+	myBuildKdTree();
+	auto built = chrono::steady_clock::now();
+
+	long buildMs = (long)chrono::duration_cast<chrono::milliseconds>(built - start).count();
+	fprintf( stdout, "KdTree build: %ld(ms)\n", buildMs );
+	if ( options.Accelerator==ACCEL_BVH ) {
+		myBuildBvh();		// Otherwise built by the first frame
+	}
+	RenderThreads.Start( options.GetNumThreads() );		// Kept for all the frames
+
+	// Later frames are scheduled using the tile costs measured in the earlier ones.
+	for ( int frame=0; frame<numFrames; frame++ ) {
+		auto frameStart = chrono::steady_clock::now();
+		FrameStart = frameStart;
+		RayTracePixels( pixels, theCV, options, mapFile ? &sampleMap : 0, ReportProgress );
+		auto frameEnd = chrono::steady_clock::now();
+
+		MyStats.PrintStats();
+		RenderTiles.PrintStats();
+		long traceMs = (long)chrono::duration_cast<chrono::milliseconds>(frameEnd - frameStart).count();
+		fprintf( stdout, "Raytrace frame %d (%dx%d) %s%ld %s samples -j%d%s  Time: %ld(ms)\n",
+					frame, width, height, options.Adaptive ? "adaptive, up to " : "",
+					options.SamplesPerPixel, Sampler::TypeName(options.SamplePattern),
+					options.GetNumThreads(), options.PinThreads ? " pinned" : "", traceMs );
+		if ( options.TimeBudget>0.0 ) {
+			fprintf( stdout, "  Time budget: %0.1lf(ms)\n", 1000.0*options.TimeBudget );
+		}
+	}
+
+	pixels.ClampAllValues();
+	pixels.DumpBmp( outFile );
+	fprintf( stdout, "Wrote %s.\n", outFile );
+	if ( mapFile ) {
+		sampleMap.DumpBmp( mapFile );
+		fprintf( stdout, "Wrote %s.\n", mapFile );
+	}
+
+	return 0;
+}
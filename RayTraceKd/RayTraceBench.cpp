@@ -0,0 +1,946 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// RayTraceBench.cpp
+//   Headless benchmarks for the ray tracer.  The first argument names
+//   the benchmark; the rest are options and a scene file, as for
+//   raytracebatch.out.
+//
+//   samplers:  Convergence of the samplers.  Renders a reference image
+//		with many samples per pixel, then reports the RMS error against
+//		the reference for each sampler at 1, 4, 16, ... samples per pixel.
+//   adaptive:  Adaptive sampling against a fixed number of samples per pixel.
+//		Reports the time, the rays per pixel and the RMS error against a
+//		reference image for each, so times can be compared at equal error.
+//   raytree:   The full ray tree against the stochastic ray tree (one branch
+//		per hit plus Russian roulette).  Reports the rays traced, the time
+//		and the RMS error against a full tree reference image.
+//   kdlayout:  Traversal of the compact kd-tree nodes against the nodes made
+//		by the tree building.  Reports the memory used by each, and the best
+//		times of several renders and of several traversals alone (camera
+//		rays traversed the length of the tree, with no intersection tests).
+//   kdbuild:   The kd-tree build modes: MacDonald-Booth and double recurse
+//		split costs, each with exact and binned splitting.  Reports the build
+//		time and the cost of tracing the camera rays with each tree.
+//   accel:     The kd-tree against the BVH.  Reports the build time, the
+//		memory, and the rays per second of camera rays alone (closest hit,
+//		no shading) and of full renders.
+//   packets:   The camera rays of each pixel traced through the kd-tree in
+//		packets of 1, 4, 8 and 16 rays.  Reports the best render time, the
+//		rays per traversal step and the steps saved per ray, and the RMS
+//		difference from the image traced one ray at a time.
+//   leafbatch: The objects of each kd-tree or BVH leaf tested one at a time
+//		and in blocks by a LeafBatch.  Reports the best render time of each
+//		and the RMS difference of the images.
+//   wavefront: Depth first ray tracing against wavefront batches of 256, 4096
+//		and 16384 camera rays, with the reflected and transmitted rays
+//		unsorted and sorted.  Reports the best render time, the rays per
+//		second and the RMS difference from the depth first image.
+//   threads:   New render threads for each frame against the persistent
+//		threads of RenderThreads, unpinned and pinned.  Reports the cost of
+//		an empty pass and the mean, fastest and slowest frame times.
+//   lights:    The light culling of RenderOptions::LightCutoff, with several
+//		cutoffs.  With no scene file, renders a generated .nff scene with a
+//		grid of many point lights over a plane of spheres.  The lights are
+//		given quadratic attenuation, which .nff files cannot give.  Reports
+//		the render time, the lights shaded per point and the RMS error
+//		against the image with every light.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+// C++ STL headers
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "RayTraceRender.h"
+#include "LeafBatch.h"
+
+#include "../Graphics/PixelArray.h"
+#include "../Graphics/CameraView.h"
+#include "../RaytraceMgr/SceneDescription.h"
+
+class BenchOptions {
+public:
+	BenchOptions();
+
+	int Width, Height;
+	long ReferenceSamples;		// Samples per pixel of the reference image
+	long MaxSamples;			// Largest number of samples per pixel that is tested
+	int NumFrames;				// Frames rendered in each mode by the threads benchmark
+	int NumLights;				// Lights of the scene generated by the lights benchmark
+	double LightAttenuation;	// Quadratic attenuation of the lights for the lights benchmark
+	const char* SceneFile;
+	RenderOptions Render;
+};
+
+inline BenchOptions::BenchOptions()
+{
+	Width = 160;
+	Height = 120;
+	ReferenceSamples = 1024;
+	MaxSamples = 256;
+	NumFrames = 20;
+	NumLights = 144;
+	LightAttenuation = 16.0;
+	SceneFile = 0;
+}
+
+static void PrintUsage( const char* progName )
+{
+	fprintf( stderr, "Usage: %s <benchmark> [options] [scene.nff | scene.obj]\n", progName );
+	fprintf( stderr, "Benchmarks:\n" );
+	fprintf( stderr, "  samplers         RMS error against a reference image, for each sampler and\n" );
+	fprintf( stderr, "                   1, 4, 16, ... samples per pixel.\n" );
+	fprintf( stderr, "  adaptive         Time and RMS error of adaptive sampling, with thresholds\n" );
+	fprintf( stderr, "                   0.04, 0.02, 0.01 and 0.005, and of 4, 16, ... samples per pixel.\n" );
+	fprintf( stderr, "  raytree          Rays, time and RMS error of the full and the stochastic ray tree\n" );
+	fprintf( stderr, "                   at 4, 16, ... samples per pixel.  Use -d to set the depth.\n" );
+	fprintf( stderr, "  kdlayout         Memory and render time of the compact kd-tree nodes and of the\n" );
+	fprintf( stderr, "                   nodes made by the tree building.  Use -s to set the samples.\n" );
+	fprintf( stderr, "  kdbuild          Build time and ray cost of the exact and binned kd-tree builds,\n" );
+	fprintf( stderr, "                   with each split cost function.  -j sets the build threads.\n" );
+	fprintf( stderr, "  accel            Build time, memory and rays per second of the kd-tree and the BVH.\n" );
+	fprintf( stderr, "  packets          Render time and traversal steps saved with the camera rays of a pixel\n" );
+	fprintf( stderr, "                   traced in packets of 1, 4, 8 and 16 rays.  Use -a to set the aperture.\n" );
+	fprintf( stderr, "  leafbatch        Render time with the objects of a leaf tested one at a time and\n" );
+	fprintf( stderr, "                   in blocks of %d (%s), with each accelerator.\n",
+				LeafBatch::BlockSize, LeafBatch::InstructionSet() );
+	fprintf( stderr, "  wavefront        Render time with the rays traced depth first and in wavefront\n" );
+	fprintf( stderr, "                   batches of 256, 4096 and 16384 camera rays, with the reflected and\n" );
+	fprintf( stderr, "                   transmitted rays unsorted and sorted.\n" );
+	fprintf( stderr, "  threads          Frame times with new render threads for each frame and with the\n" );
+	fprintf( stderr, "                   persistent threads, unpinned and pinned.  Use -n to set the frames.\n" );
+	fprintf( stderr, "  lights           Render time, lights shaded per point and RMS error of the light culling,\n" );
+	fprintf( stderr, "                   with cutoffs 0.001, 0.003, 0.01 and 0.03.  With no scene file, writes and\n" );
+	fprintf( stderr, "                   renders lights_<n>.nff, a grid of -l point lights over spheres.\n" );
+	fprintf( stderr, "Options:\n" );
+	fprintf( stderr, "  -w <width>       Image width in pixels (default 160).\n" );
+	fprintf( stderr, "  -h <height>      Image height in pixels (default 120).\n" );
+	fprintf( stderr, "  -r <samples>     Rays per pixel of the reference image (default 1024).\n" );
+	fprintf( stderr, "  -m <samples>     Largest number of rays per pixel tested (default 256).\n" );
+	fprintf( stderr, "  -s <samples>     Rays per pixel for the kdlayout, kdbuild, accel, packets, leafbatch\n" );
+	fprintf( stderr, "                   and wavefront benchmarks (default 16).\n" );
+	fprintf( stderr, "  -S <sampler>     Sampler for the adaptive benchmark (default stratified).\n" );
+	fprintf( stderr, "  -d <depth>       Maximum ray trace depth (default 3).\n" );
+	fprintf( stderr, "  -f <length>      Focal length (default 350).\n" );
+	fprintf( stderr, "  -a <aperture>    Width of the lens, 0 for a pinhole camera (default 0.2).\n" );
+	fprintf( stderr, "  -j <threads>     Number of render threads (default: one per hardware thread).\n" );
+	fprintf( stderr, "  -n <frames>      Frames rendered in each mode by the threads benchmark (default 20).\n" );
+	fprintf( stderr, "  -l <lights>      Lights of the scene generated by the lights benchmark (default 144).\n" );
+	fprintf( stderr, "  -q <coef>        The lights benchmark gives the lights the attenuation 1/(1+coef*d*d)\n" );
+	fprintf( stderr, "                   at distance d.  The generated lights are 1 apart (default 16).\n" );
+	fprintf( stderr, "With no scene file, the built-in scene of RayTraceSetup2.cpp is used.\n" );
+}
+
+// Returns false if the arguments are not valid.
+static bool ParseOptions( int argc, char** argv, BenchOptions& options )
+{
+	for ( int i=2; i<argc; i++ ) {
+		const char* arg = argv[i];
+		if ( arg[0]=='-' && arg[1]!=0 && arg[2]==0 && i+1<argc ) {
+			const char* value = argv[++i];
+			switch ( arg[1] ) {
+			case 'w':	options.Width = atoi(value);					break;
+			case 'h':	options.Height = atoi(value);					break;
+			case 'r':	options.ReferenceSamples = atol(value);			break;
+			case 'm':	options.MaxSamples = atol(value);				break;
+			case 's':	options.Render.SamplesPerPixel = atol(value);	break;
+			case 'S':
+				if ( !Sampler::ParseType( value, &options.Render.SamplePattern ) ) {
+					return false;
+				}
+				break;
+			case 'd':	options.Render.TraceDepth = atoi(value);		break;
+			case 'f':	options.Render.FocalLength = atof(value);		break;
+			case 'a':	options.Render.Aperture = atof(value);			break;
+			case 'j':	options.Render.NumThreads = atoi(value);		break;
+			case 'n':	options.NumFrames = atoi(value);				break;
+			case 'l':	options.NumLights = atoi(value);				break;
+			case 'q':	options.LightAttenuation = atof(value);			break;
+			default:
+				return false;
+			}
+		}
+		else if ( arg[0]!='-' && options.SceneFile==0 ) {
+			options.SceneFile = arg;
+		}
+		else {
+			return false;
+		}
+	}
+	return ( options.Width>0 && options.Height>0 && options.ReferenceSamples>0
+			 && options.MaxSamples>0 && options.Render.SamplesPerPixel>0 
+			 && options.Render.TraceDepth>0 && options.NumFrames>0
+			 && options.NumLights>0 && options.LightAttenuation>=0.0 );
+}
+
+// Root mean square difference of the clamped pixel values.
+static double RmsError( const PixelArray& image, const PixelArray& reference )
+{
+	double sumSq = 0.0;
+	for ( int j=0; j<image.GetHeight(); j++ ) {
+		for ( int i=0; i<image.GetWidth(); i++ ) {
+			const float* a = image.GetPixel( i, j );
+			const float* b = reference.GetPixel( i, j );
+			for ( int c=0; c<3; c++ ) {
+				double diff = (double)a[c]-(double)b[c];
+				sumSq += diff*diff;
+			}
+		}
+	}
+	return sqrt( sumSq/(3.0*image.GetWidth()*image.GetHeight()) );
+}
+
+// Renders the frame and clamps it.  Returns the time in milliseconds.
+static long RenderFrame( PixelArray& pixels, const RenderOptions& options )
+{
+	auto start = chrono::steady_clock::now();
+	RayTracePixels( pixels, ActiveScene->GetCameraView(), options );
+	auto end = chrono::steady_clock::now();
+	pixels.ClampAllValues();
+	return (long)chrono::duration_cast<chrono::milliseconds>(end - start).count();
+}
+
+// Renders the reference image.  It uses a different seed from the images
+//	 being tested, so its sample positions are independent of theirs.
+static void RenderReference( PixelArray& reference, const BenchOptions& options, const char* benchName )
+{
+	RenderOptions refOptions = options.Render;
+	refOptions.SamplesPerPixel = options.ReferenceSamples;
+	refOptions.SamplePattern = SAMPLER_SOBOL;
+	refOptions.SampleSeed = 1;
+	refOptions.Adaptive = false;
+	long refMs = RenderFrame( reference, refOptions );
+	fprintf( stdout, "%s: %s, %dx%d, depth %d, aperture %g.\n", benchName,
+				options.SceneFile ? options.SceneFile : "built-in scene",
+				options.Width, options.Height, options.Render.TraceDepth, options.Render.Aperture );
+	fprintf( stdout, "Reference: %ld %s samples per pixel, %ld(ms).\n",
+				refOptions.SamplesPerPixel, Sampler::TypeName(refOptions.SamplePattern), refMs );
+}
+
+static int BenchSamplers( const BenchOptions& options )
+{
+	PixelArray reference( options.Width, options.Height );
+	PixelArray pixels( options.Width, options.Height );
+	FitCameraToPixels( pixels );
+	myBuildKdTree();
+	RenderReference( reference, options, "Sampler convergence" );
+
+	fprintf( stdout, "RMS error:\n%8s", "spp" );
+	for ( int s=SAMPLER_RANDOM; s<=SAMPLER_CMJ; s++ ) {
+		fprintf( stdout, " %12s", Sampler::TypeName((SamplerType)s) );
+	}
+	fprintf( stdout, "\n" );
+
+	long totalMs[SAMPLER_CMJ+1] = { 0 };
+	for ( long spp=1; spp<=options.MaxSamples; spp*=4 ) {
+		fprintf( stdout, "%8ld", spp );
+		for ( int s=SAMPLER_RANDOM; s<=SAMPLER_CMJ; s++ ) {
+			RenderOptions testOptions = options.Render;
+			testOptions.SamplesPerPixel = spp;
+			testOptions.SamplePattern = (SamplerType)s;
+			testOptions.SampleSeed = 0;
+			totalMs[s] += RenderFrame( pixels, testOptions );
+			fprintf( stdout, " %12.6lf", RmsError( pixels, reference ) );
+			fflush( stdout );
+		}
+		fprintf( stdout, "\n" );
+	}
+	fprintf( stdout, "%8s", "ms" );
+	for ( int s=SAMPLER_RANDOM; s<=SAMPLER_CMJ; s++ ) {
+		fprintf( stdout, " %12ld", totalMs[s] );
+	}
+	fprintf( stdout, "\n" );
+	return 0;
+}
+
+// Mean of the values of the sample map, times the maximum rays per pixel.
+static double MeanSamples( const PixelArray& sampleMap, long maxSamples )
+{
+	double sum = 0.0;
+	for ( int j=0; j<sampleMap.GetHeight(); j++ ) {
+		for ( int i=0; i<sampleMap.GetWidth(); i++ ) {
+			sum += sampleMap.GetPixel( i, j )[0];
+		}
+	}
+	return sum*maxSamples/((double)sampleMap.GetWidth()*(double)sampleMap.GetHeight());
+}
+
+static int BenchAdaptive( const BenchOptions& options )
+{
+	PixelArray reference( options.Width, options.Height );
+	PixelArray pixels( options.Width, options.Height );
+	PixelArray sampleMap( options.Width, options.Height );
+	FitCameraToPixels( pixels );
+	myBuildKdTree();
+	RenderReference( reference, options, "Adaptive sampling" );
+
+	fprintf( stdout, "%-26s %12s %10s %12s\n", "Sampling", "rays/pixel", "ms", "RMS error" );
+	char label[64];
+	for ( long spp=4; spp<=options.MaxSamples; spp*=4 ) {
+		RenderOptions testOptions = options.Render;
+		testOptions.SamplesPerPixel = spp;
+		testOptions.Adaptive = false;
+		long ms = RenderFrame( pixels, testOptions );
+		sprintf( label, "fixed %ld %s", spp, Sampler::TypeName(testOptions.SamplePattern) );
+		fprintf( stdout, "%-26s %12.3lf %10ld %12.6lf\n", label, (double)spp, ms, RmsError( pixels, reference ) );
+		fflush( stdout );
+	}
+	const double thresholds[4] = { 0.04, 0.02, 0.01, 0.005 };
+	for ( int k=0; k<4; k++ ) {
+		RenderOptions testOptions = options.Render;
+		testOptions.SamplesPerPixel = options.MaxSamples;
+		testOptions.Adaptive = true;
+		testOptions.AdaptiveThreshold = thresholds[k];
+		auto start = chrono::steady_clock::now();
+		RayTracePixels( pixels, ActiveScene->GetCameraView(), testOptions, &sampleMap );
+		auto end = chrono::steady_clock::now();
+		pixels.ClampAllValues();
+		long ms = (long)chrono::duration_cast<chrono::milliseconds>(end - start).count();
+		sprintf( label, "adaptive %g, max %ld", thresholds[k], options.MaxSamples );
+		fprintf( stdout, "%-26s %12.3lf %10ld %12.6lf\n", label, MeanSamples( sampleMap, options.MaxSamples ),
+					ms, RmsError( pixels, reference ) );
+		fflush( stdout );
+	}
+	return 0;
+}
+
+static int BenchRayTree( const BenchOptions& options )
+{
+	PixelArray reference( options.Width, options.Height );
+	PixelArray pixels( options.Width, options.Height );
+	FitCameraToPixels( pixels );
+	myBuildKdTree();
+	RenderReference( reference, options, "Ray tree" );
+
+	fprintf( stdout, "%-24s %14s %14s %10s %12s\n", "Ray tree", "rays traced", "rays/pixel", "ms", "RMS error" );
+	char label[64];
+	double numPixels = (double)options.Width*(double)options.Height;
+	for ( long spp=4; spp<=options.MaxSamples; spp*=4 ) {
+		for ( int stochastic=0; stochastic<=1; stochastic++ ) {
+			RenderOptions testOptions = options.Render;
+			testOptions.SamplesPerPixel = spp;
+			testOptions.StochasticRayTree = ( stochastic!=0 );
+			long ms = RenderFrame( pixels, testOptions );
+			long numRays = MyStats.GetNumRaysTraced();
+			sprintf( label, "%s, %ld spp", stochastic ? "stochastic" : "full", spp );
+			fprintf( stdout, "%-24s %14ld %14.2lf %10ld %12.6lf\n", label, numRays, numRays/numPixels,
+						ms, RmsError( pixels, reference ) );
+			fflush( stdout );
+		}
+	}
+	return 0;
+}
+
+// Callback for the traversal benchmark: counts the objects and never stops the traversal.
+static long NumObjectsVisited;
+static bool CountObjectCallback( KdData* data, long objectNum, double* retStopDistance )
+{
+	NumObjectsVisited++;
+	return false;
+}
+
+// Callback that finds the closest hit, as SeekIntersectionKd does.
+static bool SeekHitCallback( KdData* data, long objectNum, double* retStopDistance )
+{
+	double hitDistance;
+	if ( !ActiveScene->PrimitiveIntersectionDistance( objectNum, data->kdStartPos, data->kdTraverseDir,
+								data->bestHitDistance, &hitDistance ) ) 
+	{
+		return false;
+	}
+	data->bestObject = objectNum;
+	data->bestHitDistance = hitDistance;
+	*retStopDistance = hitDistance;
+	return true;
+}
+
+// Size of a traversal stack that never overflows.
+static long TraverseStackSize( const KdTree& kdTree )
+{
+	return kdTree.GetMaxDepth()+1;
+}
+
+static long TraverseStackSize( const BvhTree& bvh )
+{
+	return bvh.GetStackSize();
+}
+
+// Traverses the kd-tree or BVH with samplesPerPixel camera rays per pixel.  
+//	 Returns the time in milliseconds.
+template<class TreeT> static long TraverseFrame( TreeT& tree, PotentialObjectCallback* callback, 
+												 int width, int height, long samplesPerPixel )
+{
+	const CameraView& view = ActiveScene->GetCameraView();
+	KdTraverseStack stack( TraverseStackSize( tree ) );
+	KdData data;
+	data.UseListCallback = false;
+	data.CallbackFunction = (void*)callback;
+	data.TraverseStack = &stack;
+	data.kdStartPos = view.GetPosition();
+	int gridSize = (int)ceil( sqrt( (double)samplesPerPixel ) );
+	NumObjectsVisited = 0;
+	VectorR3 dir;
+	auto start = chrono::steady_clock::now();
+	for ( int j=0; j<height; j++ ) {
+		for ( int i=0; i<width; i++ ) {
+			for ( long s=0; s<samplesPerPixel; s++ ) {
+				double u = ((double)(s%gridSize)+0.5)/gridSize;
+				double v = ((double)(s/gridSize)+0.5)/gridSize;
+				view.CalcPixelDirection( i+u, j+v, &dir );
+				data.kdTraverseDir = dir;
+				data.bestObject = -1;
+				data.bestHitDistance = DBL_MAX;
+				tree.Traverse( &data, view.GetPosition(), dir );
+			}
+		}
+	}
+	auto end = chrono::steady_clock::now();
+	return (long)chrono::duration_cast<chrono::milliseconds>(end - start).count();
+}
+
+static int BenchKdLayout( const BenchOptions& options )
+{
+	PixelArray pixels( options.Width, options.Height );
+	PixelArray compactPixels( options.Width, options.Height );
+	FitCameraToPixels( pixels );
+	myBuildKdTree();
+
+	long numNodes = ObjectKdTree.GetNumNodes();
+	long numLeafEntries = ObjectKdTree.GetNumLeafEntries();
+	fprintf( stdout, "Kd-tree layout: %s, %dx%d, %ld samples per pixel, depth %d.\n",
+				options.SceneFile ? options.SceneFile : "built-in scene",
+				options.Width, options.Height, options.Render.SamplesPerPixel, options.Render.TraceDepth );
+	fprintf( stdout, "%ld nodes, %ld leaf entries, maximum depth %ld.\n",
+				numNodes, numLeafEntries, ObjectKdTree.GetMaxDepth() );
+	fprintf( stdout, "%-10s %12s %14s %14s %12s\n", "Nodes", "bytes/node", "node bytes", "traverse ms", "render ms" );
+
+	const int numRepeats = 3;
+	long bestTraverseMs[2];
+	long bestRenderMs[2];
+	long numVisited[2];
+	for ( int compact=0; compact<=1; compact++ ) {
+		bestTraverseMs[compact] = bestRenderMs[compact] = -1;
+	}
+	// Alternate the two, so both see the same machine load.
+	for ( int k=0; k<numRepeats; k++ ) {
+		for ( int compact=0; compact<=1; compact++ ) {
+			ObjectKdTree.SetCompactTraversal( compact!=0 );
+			long ms = TraverseFrame( ObjectKdTree, CountObjectCallback, 
+									 options.Width, options.Height, options.Render.SamplesPerPixel );
+			numVisited[compact] = NumObjectsVisited;
+			if ( bestTraverseMs[compact]<0 || ms<bestTraverseMs[compact] ) {
+				bestTraverseMs[compact] = ms;
+			}
+			ms = RenderFrame( compact ? compactPixels : pixels, options.Render );
+			if ( bestRenderMs[compact]<0 || ms<bestRenderMs[compact] ) {
+				bestRenderMs[compact] = ms;
+			}
+		}
+	}
+	ObjectKdTree.SetCompactTraversal( true );
+
+	fprintf( stdout, "%-10s %12d %14ld %14ld %12ld\n", "build", (int)sizeof(KdTreeNode), 
+				numNodes*(long)sizeof(KdTreeNode), bestTraverseMs[0], bestRenderMs[0] );
+	fprintf( stdout, "%-10s %12d %14ld %14ld %12ld\n", "compact", (int)sizeof(KdCompactNode), 
+				numNodes*(long)sizeof(KdCompactNode), bestTraverseMs[1], bestRenderMs[1] );
+	fprintf( stdout, "Speedup: traversal, %.3lf.  Render, %.3lf.\n",
+				(double)bestTraverseMs[0]/(double)Max(bestTraverseMs[1],1L),
+				(double)bestRenderMs[0]/(double)Max(bestRenderMs[1],1L) );
+	fprintf( stdout, "Objects visited by the traversals: %ld and %ld.  RMS difference of the images, %.8lf.\n",
+				numVisited[0], numVisited[1], RmsError( compactPixels, pixels ) );
+	return 0;
+}
+
+static void BenchExtentFunc( long objNum, AABB& retBox )
+{
+	ActiveScene->CalcPrimitiveAABB( objNum, retBox );
+}
+
+static bool BenchExtentInBoxFunc( long objNum, const AABB& aabb, AABB& retBox )
+{
+	return ActiveScene->CalcPrimitiveExtentsInBox( objNum, aabb, retBox );
+}
+
+static int BenchKdBuild( const BenchOptions& options )
+{
+	FitCameraToPixels( PixelArray( options.Width, options.Height ) );
+	fprintf( stdout, "Kd-tree builds: %s, %ld objects.  Camera rays: %dx%d, %ld per pixel.\n",
+				options.SceneFile ? options.SceneFile : "built-in scene", ActiveScene->NumPrimitives(),
+				options.Width, options.Height, options.Render.SamplesPerPixel );
+	fprintf( stdout, "%-24s %9s %9s %10s %10s %10s %10s\n", 
+				"Build", "build s", "nodes", "trace ms", "nodes/ray", "leaves/ray", "objs/ray" );
+
+	const char* buildNames[4] = { "MacDonald-Booth", "double recurse", "binned MacDonald-Booth", "binned double recurse" };
+	double numRays = (double)options.Width*(double)options.Height*(double)options.Render.SamplesPerPixel;
+	for ( int k=0; k<4; k++ ) {
+		// The settings are those of myBuildKdTree, except for the split cost function.
+		KdTree* kdTree = new KdTree;
+		if ( k%2==0 ) {
+			kdTree->SetMacdonaldBoothSplitting();
+		}
+		else {
+			kdTree->SetDoubleRecurseSplitting( true );
+		}
+		if ( k>=2 ) {
+			kdTree->SetBinnedSplitting();
+		}
+		kdTree->SetObjectCost( 8.0 );
+		kdTree->SetBuildThreads( options.Render.NumThreads );
+		kdTree->BuildTree( ActiveScene->NumPrimitives(), BenchExtentFunc, BenchExtentInBoxFunc );
+
+		kdTree->ResetStats();
+		long ms = TraverseFrame( *kdTree, SeekHitCallback, 
+								 options.Width, options.Height, options.Render.SamplesPerPixel );
+		long numNodes, numLeaves, numObjects;
+		kdTree->Stats_GetAll( &numNodes, &numLeaves, &numObjects );
+		fprintf( stdout, "%-24s %9.3lf %9ld %10ld %10.3lf %10.3lf %10.3lf\n", buildNames[k],
+					kdTree->GetBuildSeconds(), kdTree->GetNumNodes(), ms,
+					numNodes/numRays, numLeaves/numRays, numObjects/numRays );
+		fflush( stdout );
+		delete kdTree;
+	}
+	return 0;
+}
+
+static int BenchAccel( const BenchOptions& options )
+{
+	PixelArray kdPixels( options.Width, options.Height );
+	PixelArray bvhPixels( options.Width, options.Height );
+	PixelArray* pixels[2] = { &kdPixels, &bvhPixels };		// Indexed by AcceleratorType
+	FitCameraToPixels( kdPixels );
+	myBuildKdTree();
+	myBuildBvh();
+
+	fprintf( stdout, "Accelerators: %s, %ld objects.  %dx%d, %ld samples per pixel, depth %d.\n",
+				options.SceneFile ? options.SceneFile : "built-in scene", ActiveScene->NumPrimitives(),
+				options.Width, options.Height, options.Render.SamplesPerPixel, options.Render.TraceDepth );
+	fprintf( stdout, "%-8s %9s %9s %10s %14s %14s %10s %10s\n", "", "build s", "nodes", "memory KB",
+				"camera Mray/s", "render Mray/s", "nodes/ray", "objs/ray" );
+
+	// Best of several camera ray traversals (closest hit only) and of several renders
+	const int numRepeats = 3;
+	double numCameraRays = (double)options.Width*(double)options.Height*(double)options.Render.SamplesPerPixel;
+	double bestCameraRate[2] = { 0.0, 0.0 };
+	double bestRenderRate[2] = { 0.0, 0.0 };
+	double nodesPerRay[2], objectsPerRay[2];
+	// Alternate the two, so both see the same machine load.
+	for ( int k=0; k<numRepeats; k++ ) {
+		for ( int accel=ACCEL_KDTREE; accel<=ACCEL_BVH; accel++ ) {
+			long ms = ( accel==ACCEL_BVH )
+						? TraverseFrame( ObjectBvh, SeekHitCallback, options.Width, options.Height, options.Render.SamplesPerPixel )
+						: TraverseFrame( ObjectKdTree, SeekHitCallback, options.Width, options.Height, options.Render.SamplesPerPixel );
+			UpdateMax( numCameraRays/(1000.0*(double)Max(ms,1L)), bestCameraRate[accel] );
+
+			RenderOptions renderOptions = options.Render;
+			renderOptions.Accelerator = (AcceleratorType)accel;
+			ms = RenderFrame( *pixels[accel], renderOptions );
+			double numRays = (double)MyStats.GetNumRaysTraced();
+			UpdateMax( numRays/(1000.0*(double)Max(ms,1L)), bestRenderRate[accel] );
+			long numNodes, numLeaves, numObjects;
+			if ( accel==ACCEL_BVH ) {
+				ObjectBvh.Stats_GetAll( &numNodes, &numLeaves, &numObjects );
+			}
+			else {
+				ObjectKdTree.Stats_GetAll( &numNodes, &numLeaves, &numObjects );
+			}
+			nodesPerRay[accel] = numNodes/numRays;
+			objectsPerRay[accel] = numObjects/numRays;
+		}
+	}
+
+	long kdBytes = ObjectKdTree.GetNumNodes()*(long)sizeof(KdCompactNode) + ObjectKdTree.GetNumLeafEntries()*(long)sizeof(long);
+	fprintf( stdout, "%-8s %9.3lf %9ld %10.1lf %14.3lf %14.3lf %10.3lf %10.3lf\n", "kdtree",
+				ObjectKdTree.GetBuildSeconds(), ObjectKdTree.GetNumNodes(), kdBytes/1024.0,
+				bestCameraRate[ACCEL_KDTREE], bestRenderRate[ACCEL_KDTREE], 
+				nodesPerRay[ACCEL_KDTREE], objectsPerRay[ACCEL_KDTREE] );
+	fprintf( stdout, "%-8s %9.3lf %9ld %10.1lf %14.3lf %14.3lf %10.3lf %10.3lf\n", "bvh",
+				ObjectBvh.GetBuildSeconds(), ObjectBvh.GetNumNodes(), ObjectBvh.GetMemoryBytes()/1024.0,
+				bestCameraRate[ACCEL_BVH], bestRenderRate[ACCEL_BVH], 
+				nodesPerRay[ACCEL_BVH], objectsPerRay[ACCEL_BVH] );
+	fprintf( stdout, "RMS difference of the images, %.8lf.\n", RmsError( bvhPixels, kdPixels ) );
+	return 0;
+}
+
+static int BenchPackets( const BenchOptions& options )
+{
+	const int numSizes = 4;
+	const int packetSizes[numSizes] = { 1, 4, 8, 16 };
+	PixelArray pixels( options.Width, options.Height );
+	PixelArray packetPixels( options.Width, options.Height );
+	FitCameraToPixels( pixels );
+	myBuildKdTree();
+
+	fprintf( stdout, "Packets: %s, %ld objects.  %dx%d, %ld samples per pixel, depth %d, aperture %lg.\n",
+				options.SceneFile ? options.SceneFile : "built-in scene", ActiveScene->NumPrimitives(),
+				options.Width, options.Height, options.Render.SamplesPerPixel, options.Render.TraceDepth,
+				options.Render.Aperture );
+	fprintf( stdout, "%-8s %10s %10s %14s %14s %14s %14s\n", "Rays", "render ms", "speedup", "rays in packet",
+				"active/step", "saved/ray", "RMS difference" );
+
+	const int numRepeats = 3;
+	long bestMs[numSizes];
+	long numPacketRays[numSizes], numPacketSteps[numSizes], numRaySteps[numSizes];
+	double rmsError[numSizes];
+	for ( int i=0; i<numSizes; i++ ) {
+		bestMs[i] = -1;
+	}
+	// Alternate the sizes, so all see the same machine load.
+	for ( int k=0; k<numRepeats; k++ ) {
+		for ( int i=0; i<numSizes; i++ ) {
+			RenderOptions renderOptions = options.Render;
+			renderOptions.Accelerator = ACCEL_KDTREE;
+			renderOptions.PacketSize = packetSizes[i];
+			long ms = RenderFrame( i==0 ? pixels : packetPixels, renderOptions );
+			if ( bestMs[i]<0 || ms<bestMs[i] ) {
+				bestMs[i] = ms;
+			}
+			ObjectKdTree.Stats_GetPacketData( &numPacketRays[i], &numPacketSteps[i], &numRaySteps[i] );
+			rmsError[i] = RmsError( packetPixels, pixels );
+		}
+	}
+
+	double numRays = (double)MyStats.GetNumRaysTraced();
+	for ( int i=0; i<numSizes; i++ ) {
+		fprintf( stdout, "%-8d %10ld %10.3lf %14.3lf %14.3lf %14.3lf %14.8lf\n", packetSizes[i], bestMs[i],
+					(double)bestMs[0]/(double)Max(bestMs[i],1L), (double)numPacketRays[i]/numRays,
+					(double)numRaySteps[i]/(double)Max(numPacketSteps[i],1L),
+					(double)(numRaySteps[i]-numPacketSteps[i])/(double)Max(numPacketRays[i],1L),
+					i==0 ? 0.0 : rmsError[i] );
+	}
+	return 0;
+}
+
+static int BenchWavefront( const BenchOptions& options )
+{
+	// Depth first, then each batch size without and with the secondary rays sorted
+	const int numModes = 7;
+	const long batchRays[numModes] = { 0, 256, 256, 4096, 4096, 16384, 16384 };
+	const bool sortRays[numModes] = { false, false, true, false, true, false, true };
+	PixelArray pixels( options.Width, options.Height );
+	PixelArray wavefrontPixels( options.Width, options.Height );
+	FitCameraToPixels( pixels );
+	myBuildKdTree();
+
+	fprintf( stdout, "Wavefront: %s, %ld objects.  %dx%d, %ld samples per pixel, depth %d, aperture %lg.\n",
+				options.SceneFile ? options.SceneFile : "built-in scene", ActiveScene->NumPrimitives(),
+				options.Width, options.Height, options.Render.SamplesPerPixel, options.Render.TraceDepth,
+				options.Render.Aperture );
+	fprintf( stdout, "%-8s %-8s %10s %10s %10s %14s\n", "Batch", "Sorted", "render ms", "Mray/s", "speedup", "RMS difference" );
+
+	const int numRepeats = 3;
+	long bestMs[numModes];
+	double rmsError[numModes];
+	for ( int i=0; i<numModes; i++ ) {
+		bestMs[i] = -1;
+	}
+	// Alternate the modes, so all see the same machine load.
+	for ( int k=0; k<numRepeats; k++ ) {
+		for ( int i=0; i<numModes; i++ ) {
+			RenderOptions renderOptions = options.Render;
+			renderOptions.WavefrontRays = batchRays[i];
+			renderOptions.SortSecondaryRays = sortRays[i];
+			long ms = RenderFrame( i==0 ? pixels : wavefrontPixels, renderOptions );
+			if ( bestMs[i]<0 || ms<bestMs[i] ) {
+				bestMs[i] = ms;
+			}
+			rmsError[i] = RmsError( wavefrontPixels, pixels );
+		}
+	}
+
+	double numRays = (double)MyStats.GetNumRaysTraced();
+	for ( int i=0; i<numModes; i++ ) {
+		fprintf( stdout, "%-8ld %-8s %10ld %10.3lf %10.3lf %14.8lf\n", batchRays[i], sortRays[i] ? "yes" : "no", 
+					bestMs[i], numRays/(1000.0*(double)Max(bestMs[i],1L)),
+					(double)bestMs[0]/(double)Max(bestMs[i],1L), i==0 ? 0.0 : rmsError[i] );
+	}
+	return 0;
+}
+
+static int BenchLeafBatch( const BenchOptions& options )
+{
+	PixelArray pixels( options.Width, options.Height );
+	PixelArray batchPixels( options.Width, options.Height );
+	FitCameraToPixels( pixels );
+	myBuildKdTree();
+	myBuildBvh();
+
+	fprintf( stdout, "Leaf batches: %s, %ld objects.  %dx%d, %ld samples per pixel, depth %d.\n",
+				options.SceneFile ? options.SceneFile : "built-in scene", ActiveScene->NumPrimitives(),
+				options.Width, options.Height, options.Render.SamplesPerPixel, options.Render.TraceDepth );
+	fprintf( stdout, "Blocks of %d, with %s.\n", LeafBatch::BlockSize, LeafBatch::InstructionSet() );
+	fprintf( stdout, "%-8s %14s %14s %10s %14s\n", "", "one at a time", "leaf batch", "speedup", "RMS difference" );
+
+	const int numRepeats = 3;
+	for ( int accel=ACCEL_KDTREE; accel<=ACCEL_BVH; accel++ ) {
+		long bestMs[2] = { -1, -1 };
+		// Alternate the two, so both see the same machine load.
+		for ( int k=0; k<numRepeats; k++ ) {
+			for ( int batch=0; batch<=1; batch++ ) {
+				RenderOptions renderOptions = options.Render;
+				renderOptions.Accelerator = (AcceleratorType)accel;
+				renderOptions.LeafBatch = (batch!=0);
+				long ms = RenderFrame( batch ? batchPixels : pixels, renderOptions );
+				if ( bestMs[batch]<0 || ms<bestMs[batch] ) {
+					bestMs[batch] = ms;
+				}
+			}
+		}
+		fprintf( stdout, "%-8s %14ld %14ld %10.3lf %14.8lf\n", accel==ACCEL_BVH ? "bvh" : "kdtree",
+					bestMs[0], bestMs[1], (double)bestMs[0]/(double)Max(bestMs[1],1L),
+					RmsError( batchPixels, pixels ) );
+	}
+	return 0;
+}
+
+static double MicrosecondsSince( chrono::steady_clock::time_point start )
+{
+	return chrono::duration<double,micro>( chrono::steady_clock::now() - start ).count();
+}
+
+static int BenchThreads( const BenchOptions& options )
+{
+	const int numModes = 3;
+	const char* modeNames[numModes] = { "new", "pool", "pinned" };
+	const bool persistent[numModes] = { false, true, true };
+	const bool pinned[numModes] = { false, false, true };
+	PixelArray pixels( options.Width, options.Height );
+	FitCameraToPixels( pixels );
+	myBuildKdTree();
+	int numThreads = options.Render.GetNumThreads();
+
+	fprintf( stdout, "Threads: %s, %ld objects.  %dx%d, %ld samples per pixel, depth %d, %d threads, %d frames.\n",
+				options.SceneFile ? options.SceneFile : "built-in scene", ActiveScene->NumPrimitives(),
+				options.Width, options.Height, options.Render.SamplesPerPixel, options.Render.TraceDepth,
+				numThreads, options.NumFrames );
+	if ( !RenderThreadPool::CanPinThreads() ) {
+		fprintf( stdout, "Threads cannot be pinned here: \"pinned\" is the same as \"pool\".\n" );
+	}
+
+	// The cost of a pass that does no work: starting and joining the threads,
+	//	 or waking the pool's threads and waiting for them.
+	const int numEmptyPasses = 1000;
+	double emptyPassUs[numModes];
+	for ( int i=0; i<numModes; i++ ) {
+		auto start = chrono::steady_clock::now();
+		for ( int k=0; k<numEmptyPasses; k++ ) {
+			if ( persistent[i] ) {
+				RenderThreads.Run( numThreads, pinned[i], [](int t) {} );
+			}
+			else {
+				vector<thread> threads;
+				for ( int t=0; t<numThreads; t++ ) {
+					threads.push_back( thread( [](int t) {}, t ) );
+				}
+				for ( thread& t : threads ) {
+					t.join();
+				}
+			}
+		}
+		emptyPassUs[i] = MicrosecondsSince( start )/numEmptyPasses;
+	}
+
+	// Alternate the modes, so all see the same machine load.  The first
+	//	 frame only warms up the caches.
+	double sumMs[numModes], minMs[numModes], maxMs[numModes];
+	for ( int i=0; i<numModes; i++ ) {
+		sumMs[i] = maxMs[i] = 0.0;
+		minMs[i] = DBL_MAX;
+	}
+	RenderFrame( pixels, options.Render );
+	for ( int k=0; k<options.NumFrames; k++ ) {
+		for ( int i=0; i<numModes; i++ ) {
+			RenderOptions renderOptions = options.Render;
+			renderOptions.PersistentThreads = persistent[i];
+			renderOptions.PinThreads = pinned[i];
+			auto start = chrono::steady_clock::now();
+			RayTracePixels( pixels, ActiveScene->GetCameraView(), renderOptions );
+			double ms = 1.0e-3*MicrosecondsSince( start );
+			sumMs[i] += ms;
+			minMs[i] = Min( minMs[i], ms );
+			maxMs[i] = Max( maxMs[i], ms );
+		}
+	}
+
+	fprintf( stdout, "%-8s %14s %10s %10s %10s\n", "Threads", "empty pass us", "mean ms", "min ms", "max ms" );
+	for ( int i=0; i<numModes; i++ ) {
+		fprintf( stdout, "%-8s %14.2lf %10.3lf %10.3lf %10.3lf\n", modeNames[i], emptyPassUs[i],
+					sumMs[i]/options.NumFrames, minMs[i], maxMs[i] );
+	}
+	return 0;
+}
+
+// Writes an .nff scene with numLights point lights, in a square grid one
+//	 unit apart and one unit above a plane.  Spheres, alternately diffuse and
+//	 mirrored, stand on the plane two units apart.  Returns false if the
+//	 file cannot be written.
+static bool WriteLightsScene( const char* fileName, int numLights )
+{
+	FILE* out = fopen( fileName, "w" );
+	if ( out==0 ) {
+		return false;
+	}
+	int gridSize = (int)ceil( sqrt( (double)numLights ) );
+	double halfWidth = 0.5*(double)gridSize;
+	fprintf( out, "b 0.05 0.05 0.1\n" );
+	fprintf( out, "v\nfrom 0 %g %g\nat 0 0 0\nup 0 0 1\nangle 45\nhither 0.01\nresolution 512 512\n",
+				-1.6*halfWidth, 1.2*halfWidth );
+	// Each light has one of several colors, of about the same power
+	for ( int k=0; k<numLights; k++ ) {
+		double x = (double)(k%gridSize) - halfWidth + 0.5;
+		double y = (double)(k/gridSize) - halfWidth + 0.5;
+		int hue = (k*7)%5;
+		fprintf( out, "l %g %g 1 %g %g %g\n", x, y,
+					hue==0 ? 0.6 : 0.3, hue==1 ? 0.6 : 0.3, hue==2 ? 0.6 : 0.3 );
+	}
+	fprintf( out, "f 0.8 0.8 0.8 1 0 1 0 1\n" );
+	fprintf( out, "p 4\n%g %g 0\n%g %g 0\n%g %g 0\n%g %g 0\n", halfWidth+1, halfWidth+1,
+				-halfWidth-1, halfWidth+1, -halfWidth-1, -halfWidth-1, halfWidth+1, -halfWidth-1 );
+	int numSpheres = Max( 1, gridSize/2 );
+	for ( int j=0; j<numSpheres; j++ ) {
+		for ( int i=0; i<numSpheres; i++ ) {
+			if ( (i+j)%2==0 ) {
+				fprintf( out, "f 1 0.75 0.33 0.8 0.2 20 0 1\n" );
+			}
+			else {
+				fprintf( out, "f 0.7 0.8 1 0.3 0.7 100 0 1\n" );
+			}
+			fprintf( out, "s %g %g 0.35 0.35\n", 2.0*i - numSpheres + 1.0, 2.0*j - numSpheres + 1.0 );
+		}
+	}
+	fclose( out );
+	return true;
+}
+
+static int BenchLights( const BenchOptions& options )
+{
+	const int numCutoffs = 5;
+	const double cutoffs[numCutoffs] = { 0.0, 0.001, 0.003, 0.01, 0.03 };
+	PixelArray pixels( options.Width, options.Height );
+	PixelArray culledPixels( options.Width, options.Height );
+	FitCameraToPixels( pixels );
+	myBuildKdTree();
+	AttenuateSceneLights( options.LightAttenuation );
+
+	fprintf( stdout, "Light culling: %s, %d lights, attenuation 1/(1+%g*d*d).  %dx%d, %ld samples per pixel, depth %d.\n",
+				options.SceneFile ? options.SceneFile : "built-in scene", ActiveScene->NumLights(),
+				options.LightAttenuation, options.Width, options.Height,
+				options.Render.SamplesPerPixel, options.Render.TraceDepth );
+	fprintf( stdout, "%-8s %10s %10s %10s %14s %14s\n", "Cutoff", "render ms", "speedup", "lights/pt", "Mrays", "RMS difference" );
+
+	const int numRepeats = 3;
+	long bestMs[numCutoffs];
+	double lightsPerPoint[numCutoffs];
+	double numRays[numCutoffs];
+	double rmsError[numCutoffs];
+	for ( int i=0; i<numCutoffs; i++ ) {
+		bestMs[i] = -1;
+	}
+	// Alternate the cutoffs, so all see the same machine load.
+	for ( int k=0; k<numRepeats; k++ ) {
+		for ( int i=0; i<numCutoffs; i++ ) {
+			RenderOptions renderOptions = options.Render;
+			renderOptions.LightCutoff = cutoffs[i];
+			long ms = RenderFrame( i==0 ? pixels : culledPixels, renderOptions );
+			if ( bestMs[i]<0 || ms<bestMs[i] ) {
+				bestMs[i] = ms;
+			}
+			lightsPerPoint[i] = ( cutoffs[i]>0.0 )
+								? (double)MyStats.GetNumLightsShaded()/(double)Max(MyStats.GetNumShadedPoints(),1L)
+								: (double)ActiveScene->NumLights();
+			numRays[i] = (double)MyStats.GetNumRaysTraced();
+			rmsError[i] = RmsError( culledPixels, pixels );
+		}
+	}
+
+	for ( int i=0; i<numCutoffs; i++ ) {
+		fprintf( stdout, "%-8g %10ld %10.3lf %10.2lf %14.3lf %14.8lf\n", cutoffs[i], bestMs[i],
+					(double)bestMs[0]/(double)Max(bestMs[i],1L), lightsPerPoint[i], numRays[i]*1.0e-6,
+					i==0 ? 0.0 : rmsError[i] );
+	}
+	return 0;
+}
+
+//**********************************************************
+// Main Routine
+//**********************************************************
+int main( int argc, char** argv )
+{
+	BenchOptions options;
+	if ( argc<2 || !ParseOptions( argc, argv, options ) ) {
+		PrintUsage( argv[0] );
+		return 1;
+	}
+	char lightsSceneFile[64];
+	if ( strcmp( argv[1], "lights" )==0 && options.SceneFile==0 ) {
+		sprintf( lightsSceneFile, "lights_%d.nff", options.NumLights );
+		if ( !WriteLightsScene( lightsSceneFile, options.NumLights ) ) {
+			fprintf( stderr, "Unable to write scene file %s.\n", lightsSceneFile );
+			return 1;
+		}
+		fprintf( stdout, "Wrote %s.\n", lightsSceneFile );
+		options.SceneFile = lightsSceneFile;
+	}
+	if ( !LoadActiveScene( options.SceneFile ) ) {
+		fprintf( stderr, "Unable to load scene file %s.\n", options.SceneFile );
+		return 1;
+	}
+
+	if ( strcmp( argv[1], "samplers" )==0 ) {
+		return BenchSamplers( options );
+	}
+	if ( strcmp( argv[1], "raytree" )==0 ) {
+		return BenchRayTree( options );
+	}
+	if ( strcmp( argv[1], "adaptive" )==0 ) {
+		return BenchAdaptive( options );
+	}
+	if ( strcmp( argv[1], "kdlayout" )==0 ) {
+		return BenchKdLayout( options );
+	}
+	if ( strcmp( argv[1], "kdbuild" )==0 ) {
+		return BenchKdBuild( options );
+	}
+	if ( strcmp( argv[1], "accel" )==0 ) {
+		return BenchAccel( options );
+	}
+	if ( strcmp( argv[1], "packets" )==0 ) {
+		return BenchPackets( options );
+	}
+	if ( strcmp( argv[1], "leafbatch" )==0 ) {
+		return BenchLeafBatch( options );
+	}
+	if ( strcmp( argv[1], "wavefront" )==0 ) {
+		return BenchWavefront( options );
+	}
+	if ( strcmp( argv[1], "threads" )==0 ) {
+		return BenchThreads( options );
+	}
+	if ( strcmp( argv[1], "lights" )==0 ) {
+		return BenchLights( options );
+	}
+	PrintUsage( argv[0] );
+	return 1;
+}
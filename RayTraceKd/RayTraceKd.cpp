@@ -23,12 +23,10 @@
 #include <stdio.h>
 
 // C++ STL headers
-#include <random>
-#include <thread>
-#include <mutex>
 #include <chrono>
-#include <vector>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 // If you do not have GLUT installed, you can use the basic GL routines instead.
 //   For this, include windows.h and GL/gl.h, instead of GL/glut.h
@@ -44,7 +42,7 @@
 #include <GL/glut.h>	// GLUT OpenGL includes
 #endif
 
-#include "RayTraceStats.h"
+#include "RayTraceRender.h"
 
 #include "../Graphics/PixelArray.h"
 #include "../Graphics/ViewableBase.h"
@@ -54,7 +52,6 @@
 #include "../VrMath/LinearR4.h"
 #include "../VrMath/MathMisc.h"
 #include "../OpenglRender/GlutRenderer.h"
-#include "../DataStructs/KdTree.h"
 #include "../RaytraceMgr/LoadNffFile.h"
 #include "../RaytraceMgr/LoadObjFile.h"
 #include "../RaytraceMgr/SceneDescription.h"
@@ -63,30 +60,11 @@
 void RenderWithGlut(void);
 
 void RayTraceView(void);
-long SeekIntersection(const VectorR3& startPos, const VectorR3& direction,
-										double *hitDist, VisiblePoint& returnedPoint,
-										long avoidK = -1);
-long SeekIntersectionKd(KdData *data, const VectorR3& startPos, const VectorR3& direction,
-										double *hitDist, VisiblePoint& returnedPoint,
-										long avoidK = -1);
-void RayTrace( int TraceDepth, const VectorR3& pos, const VectorR3 dir, 
-			  VectorR3& returnedColor, double& hitDist, double eta = 1, long avoidK = -1);
-bool ShadowFeeler(const VectorR3& pos, const Light& light, long intersectNum=-1 );
-void CalcAllDirectIllum( KdData *data, const VectorR3& viewPos, const VisiblePoint& visPoint, 
-						VectorR3& returnedColor, long avoidK = -1);
-void TransmitAndReflective(double cos1, double eta1, double eta2, double& transmitRate, double& reflectRate);
 
 static void ResizeWindow(int w, int h);
 
 GlutRenderer* glutDraw = 0;
 
-default_random_engine generator;
-uniform_real_distribution<double> distribution(0.0,1.0);
-
-// ***********************Statistics************
-RayTraceStats MyStats;
-// **********************************************
-
 // Window size and pixel array variables
 bool WindowMinimized = false;
 int WindowWidth;	// Width in pixels
@@ -95,17 +73,26 @@ PixelArray* pixels;		// Array of pixels
 	
 bool RayTraceMode = false;		// Set true for RayTraciing,  false for rendering with OpenGL
 								// Rendering with OpenGL does not support all features, esp., texture mapping
+								// Once ray traced, the view stays ray traced when it or the window changes.
 // Next two variables can be used to keep from re-raytracing a window.
 
 long NumScanLinesRayTraced = -1;
 long WidthRayTraced = -1;
 
-double g_fLength = 350;
-double g_aperture = 0.05;
+RenderOptions g_renderOptions;		// Focal length, aperture, samples, etc.
+
+// The ray tracing runs in a background thread, so the window keeps
+//	 responding.  The thread copies its image to DisplayPixels after each
+//	 progressive pass; a change of the view cancels it (see StopRender()).
+static std::thread RenderThread;
+static RenderCancelToken RenderCancel;
+static std::mutex DisplayMutex;			// Guards DisplayPixels and RenderRunning
+static PixelArray DisplayPixels;		// The image drawn in the window
+static bool RenderRunning = false;
+static int RenderNumber = 0;			// Counts the render threads started
+const int RedrawMilliseconds = 50;		// How often the window is redrawn while rendering
 // const double MAX_DIST = 50;	// Max. view distance
 
-SceneDescription* ActiveScene;
-
 SceneDescription FileScene;			// Scene that is loaded from an .obj or .nff file.
 
 // RenderScene() chooses between using OpenGL or  ray-tracing to render the scene
@@ -123,150 +110,9 @@ static void RenderScene(void)
 	}
 }
 
-// ******************************************************
-//   KdTree definitions and routines for creating the KdTree
-// ******************************************************
-KdTree ObjectKdTree;
-
-void myExtentFunc( long objNum, AABB& retBox )
-{
-	return ActiveScene->GetViewable(objNum).CalcAABB( retBox );
-}
-bool myExtentsInBox( long objNum, const AABB& aabb, AABB& retBox)
+// Draws the last image from the render thread in the window.
+static void DrawPixels(void)
 {
-	return ActiveScene->GetViewable(objNum).CalcExtentsInBox( aabb, retBox );
-}
-
-void myBuildKdTree()
-{
-	ObjectKdTree.SetDoubleRecurseSplitting( true );
-	ObjectKdTree.SetObjectCost(8.0);
-	ObjectKdTree.BuildTree( ActiveScene->NumViewables(), myExtentFunc, myExtentsInBox  );
-	RayTraceStats::PrintKdStats( ObjectKdTree );
-}
-
-// *****************************************************************
-// RayTraceView() is the top level routine that starts the ray tracing.
-//	Current implementation: casts a ray to the center of each pixel.
-//	Calls RayTrace() for each one.
-// *****************************************************************
-
-class PixelWindow{
-public:
-	PixelWindow(int i, int j) :
-	x(0), y(0), width(i), height(j) {}
-
-	bool getNext(int &i, int &j) {
-		lock.lock();
-		bool ret = true;
-		if (x < width) {
-			i = x++;
-			j = y;
-		} else if (y < height - 1) {
-			i = x = 0;
-			j = ++y;
-		} else {
-			ret = false;
-		}
-		// printf("(%d, %d) ", i, j);
-		lock.unlock();
-		return ret;
-	}
-private:
-	int x, y;
-	int width, height;
-	mutex lock;
-};
-
-#define subPixelNum 4
-#define traceDepth 3
-#define THREAD_NUM thread::hardware_concurrency()
-// #define THREAD_NUM 1
-
-/******************************** 
-  TODO: Implement features here
-*********************************/
-
-// Unused for now
-static void tracePixel(PixelWindow *Window, const CameraView *MainView) {
-	VectorR3 PixelDir;
-	VectorR3 curPixelColor, tempPixelColor;
-	int i, j;
-	while (Window->getNext(i, j)) {
-		for( int k = 0; k < subPixelNum; ++k) {
-			for( int l = 0; l < subPixelNum; ++l) {
-				double x = i + (k + distribution(generator))/subPixelNum;
-				double y = j + (l + distribution(generator))/subPixelNum;
-				MainView->CalcPixelDirection(x,y,&PixelDir);
-				double tempHitDist;
-				RayTrace( traceDepth, MainView->GetPosition(), PixelDir, curPixelColor, tempHitDist );
-				tempPixelColor += curPixelColor;
-			}
-		}
-		tempPixelColor /= (subPixelNum*subPixelNum);
-		pixels->SetPixel(i, j, tempPixelColor);
-	}
-}
-
-static void tracePixelDepth(double flength, double aperture, PixelWindow *Window, const CameraView *MainView) {
-	VectorR3 PixelDir;
-	VectorR3 curPixelColor, tempPixelColor;
-	int i, j;
-	while (Window->getNext(i, j)) {
-		for( int k = 0; k < subPixelNum; ++k) {
-			for( int l = 0; l < subPixelNum; ++l) {
-				double x = i + (k + distribution(generator))/subPixelNum;
-				double y = j + (l + distribution(generator))/subPixelNum;
-				// double x = i + distribution(generator);
-				// double y = j + distribution(generator);				
-				MainView->CalcPixelDirection(x,y,&PixelDir);
-				VectorR3 tempPos = MainView->GetPosition() + PixelDir * flength / MainView->GetScreenDistance();
-				VectorR3 dx = MainView->GetPixeldU();
-				VectorR3 dy = MainView->GetPixeldV();
-				dx.Normalize();
-				dy.Normalize();
-				double subPixelOffset = ((double)subPixelNum - 1) / 2;
-				VectorR3 newPos = MainView->GetPosition();
-				newPos += (k - subPixelOffset) * dx * aperture;
-				newPos += (l - subPixelOffset) * dy * aperture;
-				PixelDir = tempPos - newPos;
-				PixelDir.Normalize();
-				double tempHitDist;
-				RayTrace( traceDepth, newPos, PixelDir, curPixelColor, tempHitDist );
-				tempPixelColor += curPixelColor;
-			}
-		}
-		tempPixelColor /= (subPixelNum*subPixelNum);
-		pixels->SetPixel(i, j, tempPixelColor);
-	}
-}
-
-void RayTraceView(void)
-{
-	auto start = chrono::system_clock::now();
-
-	if ( WidthRayTraced!=WindowWidth || NumScanLinesRayTraced!=WindowHeight ) {  
-		// Do the rendering here
-		MyStats.Init();
-		ObjectKdTree.ResetStats();
-
-		vector<thread> threads;
-		threads.resize(THREAD_NUM);
-		PixelWindow Window(WindowWidth, WindowHeight);
-
-		for (thread &t : threads)
-			// t = thread(tracePixel, &Window, &ActiveScene->GetCameraView());
-			t = thread(tracePixelDepth, g_fLength, g_aperture, &Window, &ActiveScene->GetCameraView());
-
-		for (thread &t : threads)
-			t.join();
-
-		WidthRayTraced = WindowWidth;			// Set these values to show scene has been computed.
-		NumScanLinesRayTraced = WindowHeight;
-		MyStats.GetKdRunData( ObjectKdTree );
-		MyStats.PrintStats();
-	}
-			
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
 	gluOrtho2D(0, WindowWidth, 0, WindowHeight);
@@ -275,312 +121,121 @@ void RayTraceView(void)
 	glDisable(GL_LIGHTING);
 	glDisable(GL_DEPTH_TEST);
 
-	pixels->Draw();
+	DisplayMutex.lock();
+	DisplayPixels.Draw();
+	DisplayMutex.unlock();
 
 	// flush the pipeline, swap the buffers
 	glFlush();
 	glutSwapBuffers();
-
-	auto end = chrono::system_clock::now();
-	auto elapsed = chrono::duration_cast<std::chrono::seconds>(end - start);
-	cout << "Raytrace (" << WindowWidth << "x" << WindowHeight
-	     << ") -j" << THREAD_NUM << " Time: " << elapsed.count() << "(s)" << endl;
-
 }
 
-
-
-// Call back function for KdTraversal of view ray or reflection ray
-// It is of type PotentialObjectCallback.
-bool potHitSeekIntersection( KdData *data, long objectNum, double* retStopDistance ) 
+// Copies the render thread's image to DisplayPixels.  PixelArray::Draw()
+//	 clamps the pixels it draws, so it cannot draw the render's own pixels.
+static void ShowProgress( const PixelArray& passPixels, int stride, long samplesPerPixel )
 {
-	double thisHitDistance;
-	bool hitFlag;
-	if ( objectNum == data->kdTraverseAvoid ) {
-		hitFlag = ActiveScene->GetViewable(objectNum).FindIntersection(data->kdStartPosAvoid, data->kdTraverseDir,
-											data->bestHitDistance, &thisHitDistance, data->tempPoint);
-		if ( !hitFlag ) {
-			return false;
+	std::lock_guard<std::mutex> lock( DisplayMutex );
+	int width = (int)passPixels.GetWidth();
+	int height = (int)passPixels.GetHeight();
+	DisplayPixels.SetSize( width, height );
+	for ( int j=0; j<height; j++ ) {
+		for ( int i=0; i<width; i++ ) {
+			DisplayPixels.SetPixel( i, j, passPixels.GetPixel(i,j) );
 		}
-		thisHitDistance += data->isectEpsilon;		// Adjust back to real hit distance
 	}
-	else {
-		hitFlag = ActiveScene->GetViewable(objectNum).FindIntersection(data->kdStartPos, data->kdTraverseDir,
-											data->bestHitDistance, &thisHitDistance, data->tempPoint);
-		if ( !hitFlag ) {
-			return false;
-		}
-	}
-
-	*data->bestHitPoint = data->tempPoint;		// The visible point that was hit
-	data->bestObject = objectNum;				// The object that was hit
-	data->bestHitDistance = thisHitDistance;
-	*retStopDistance = data->bestHitDistance;	// No need to traverse search further than this distance
-	return true;
 }
 
-// Call back function for KdTraversal of shadow feeler
-// It is of type PotentialObjectCallback.
-bool potHitShadowFeeler( KdData *data, long objectNum, double* retStopDistance ) 
+// The body of the render thread.
+static void RenderInBackground(void)
 {
-	double thisHitDistance;
-	bool hitFlag = ActiveScene->GetViewable(objectNum).FindIntersection(data->kdStartPos, data->kdTraverseDir,
-											data->kdShadowDist, &thisHitDistance, data->tempPoint);
-	if  ( hitFlag && !(/*objectNum==kdTraverseAvoid &&*/ thisHitDistance+data->isectEpsilon>=data->kdShadowDist) )
-	{
-		data->kdTraverseFeeler = false;
-		*retStopDistance = -1.0;	// Negative value should abort process quickly
-		return true;
+	auto start = chrono::system_clock::now();
+	bool finished = RayTracePixels( *pixels, ActiveScene->GetCameraView(), g_renderOptions, 0,
+									ShowProgress, &RenderCancel );
+	if ( finished ) {
+		ShowProgress( *pixels, 1, g_renderOptions.SamplesPerPixel );
+		MyStats.PrintStats();
+		RenderTiles.PrintStats();
+		auto end = chrono::system_clock::now();
+		auto elapsed = chrono::duration_cast<std::chrono::milliseconds>(end - start);
+		cout << "Raytrace (" << WindowWidth << "x" << WindowHeight
+			 << ") -j" << g_renderOptions.GetNumThreads() << " Time: " << elapsed.count() << "(ms)" << endl;
 	}
-	else { 
-		return false;
+	else {
+		NumScanLinesRayTraced = WidthRayTraced = -1;	// Render it again when next drawn
 	}
+	std::lock_guard<std::mutex> lock( DisplayMutex );
+	RenderRunning = false;
 }
 
-
-
-// SeekIntersectionKd seeks for an intersection with all viewable objects
-// If it finds one, it returns the index of the viewable object,
-//   and sets the value of hitDist and fills in the returnedPoint values.
-// This "Kd" version uses the Kd-Tree
-long SeekIntersectionKd( KdData *data, const VectorR3& pos, const VectorR3& direction,
-										double *hitDist, VisiblePoint& returnedPoint,
-										long avoidK)
+// Stops the render thread, if it is running.  Must be called before the
+//	 camera, the render options or the pixel array are changed.
+static void StopRender(void)
 {
-	MyStats.AddRayTraced();
-
-	data->kdTraverseAvoid = avoidK;
-	data->kdStartPos = pos;
-	data->kdTraverseDir = direction;
-	data->kdStartPosAvoid = pos;
-	data->kdStartPosAvoid.AddScaled( direction, data->isectEpsilon );
-	data->bestHitPoint = &returnedPoint;
-	data->CallbackFunction = (void*) potHitSeekIntersection;
-	data->UseListCallback = false;
-	
-	ObjectKdTree.Traverse( data, pos, direction );
-
-	if ( data->bestObject>=0 ) {
-		*hitDist = data->bestHitDistance;
-	}
-	return data->bestObject;
-}	
-
-// ShadowFeeler - returns whether the light is visible from the position pos.
-//		Return value is "true" if no shadowing object found.
-//		intersectNum is the index of the visible object being (possibly)
-//		illuminated at pos.
-
-bool ShadowFeelerKd(KdData *data, const VectorR3& pos, const Light& light, long intersectNum ) {
-	MyStats.AddRayTraced();
-	MyStats.AddShadowFeeler();
-
-	data->kdTraverseDir = pos;
-	data->kdTraverseDir -= light.GetPosition();
-	double dist = data->kdTraverseDir.Norm();
-	if ( dist<1.0e-7 ) {
-		return true;		// Extremely close to the light!
+	if ( RenderThread.joinable() ) {
+		RenderCancel.Cancel();
+		RenderThread.join();
+		glutPostRedisplay();
 	}
-	data->kdTraverseDir /= dist;			// Direction from light position towards pos
-	data->kdStartPos = light.GetPosition();
-	data->kdTraverseFeeler = true;		// True indicates no shadowing objects
-	data->kdTraverseAvoid = intersectNum;
-	data->kdShadowDist = dist;
-	data->CallbackFunction = (void*) potHitShadowFeeler;
-	data->UseListCallback = false;
-
-	ObjectKdTree.Traverse( data, light.GetPosition(), data->kdTraverseDir, dist, true );
-
-	return data->kdTraverseFeeler;	// Return whether ray is free of shadowing objects
 }
 
-
-void RayTrace( int TraceDepth, const VectorR3& pos, const VectorR3 dir, 
-			  VectorR3& returnedColor, double& hitDist, double eta, long avoidK ) 
+// Redraws the window while render number renderNumber runs, and once more when it is done.
+static void CheckRender( int renderNumber )
 {
-	// double hitDist;
-	VisiblePoint visPoint;
-
-	KdData data;
-
-	int intersectNum = SeekIntersectionKd(&data, pos, dir,
-								&hitDist, visPoint, avoidK );
-	if ( intersectNum<0 ) {
-		returnedColor = ActiveScene->BackgroundColor();
+	if ( renderNumber!=RenderNumber ) {
+		return;			// That render was stopped
 	}
-	else {
-		CalcAllDirectIllum( &data, pos, visPoint, returnedColor, intersectNum );
-		if ( TraceDepth > 1 ) {
-			VectorR3 nextDir;
-			VectorR3 moreColor;
-			const MaterialBase* thisMat = &(visPoint.GetMaterial());
-
-			double transmitRate = 1.0, reflectRate = 1.0;
-			bool transAndRef = thisMat->IsReflective() && thisMat->IsTransmissive() &&
-					thisMat->CalcRefractDir(visPoint.GetNormal(), dir, eta, nextDir);
-			// if (transAndRef) {
-			// 	TransmitAndReflective(abs(dir^visPoint.GetNormal()), eta, thisMat->GetEta(), transmitRate, reflectRate);
-			// }
-			// Ray trace reflection
-			if ( thisMat->IsReflective() ) {
-				nextDir = visPoint.GetNormal();
-				nextDir *= -2.0*(dir^visPoint.GetNormal());
-				nextDir += dir;
-				nextDir.ReNormalize();	// Just in case...
-				double roughness = thisMat->GetRoughness();
-				if(roughness > 0.0000001) {
-					VectorR3 u = (nextDir.x < nextDir.y) ? VectorR3(1,0,0) : VectorR3(0,1,0);
-					u *= nextDir;
-					u.Normalize();
-					VectorR3 v = u * nextDir;
-					v.Normalize();
-					normal_distribution<double> distribution(0.0,roughness);
-					nextDir += (u * distribution(generator) + v * distribution(generator));
-					nextDir.Normalize();
-				}
-
-				VectorR3 c = thisMat->GetReflectionColor(visPoint, -dir, nextDir);
-				double tempHitDist;
-				RayTrace( TraceDepth-1, visPoint.GetPosition(), nextDir, moreColor, tempHitDist, eta, intersectNum);
-				moreColor.x *= c.x;
-				moreColor.y *= c.y;
-				moreColor.z *= c.z;
-				if (transAndRef) {
-					moreColor.x *= reflectRate;
-					moreColor.y *= reflectRate;
-					moreColor.z *= reflectRate;
-				}
-				returnedColor += moreColor;
-			}
-
-			// Ray Trace Transmission
-			if ( thisMat->IsTransmissive() ) {
-				if ( thisMat->CalcRefractDir(visPoint.GetNormal(), dir, eta, nextDir) ) {
-					double roughness = thisMat->GetRoughness();
-					if(roughness > 0.0000001) {
-						VectorR3 u = (nextDir.x < nextDir.y) ? VectorR3(1,0,0) : VectorR3(0,1,0);
-						u *= nextDir;
-						u.Normalize();
-						VectorR3 v = u * nextDir;
-						v.Normalize();
-						normal_distribution<double> distribution(0.0,thisMat->GetRoughness());
-						nextDir += (u * distribution(generator) + v * distribution(generator));
-						nextDir.Normalize();
-					}
-
-					VectorR3 c = thisMat->GetTransmissionColor(visPoint, -dir, nextDir);
-					double eta = thisMat->GetEta();
-					double tempHitDist;
-					RayTrace( TraceDepth-1, visPoint.GetPosition(), nextDir, moreColor, tempHitDist, eta, intersectNum);
-					double translucent = thisMat->GetTranslucent();
-					if (translucent > 0.0000001) {
-						double rate = exp(-1 * translucent * tempHitDist);
-						moreColor.x *= rate;
-						moreColor.y *= rate;
-						moreColor.z *= rate;
-					}
-					moreColor.x *= c.x;
-					moreColor.y *= c.y;
-					moreColor.z *= c.z;
-					if (transAndRef) {
-						moreColor.x *= transmitRate;
-						moreColor.y *= transmitRate;
-						moreColor.z *= transmitRate;
-					}
-					returnedColor += moreColor;
-				}
-			}
-		}
+	DisplayMutex.lock();
+	bool running = RenderRunning;
+	DisplayMutex.unlock();
+	if ( running ) {
+		glutTimerFunc( RedrawMilliseconds, CheckRender, renderNumber );
 	}
-}
-
-void CalcAllDirectIllum( KdData *data, const VectorR3& viewPos,
-						 const VisiblePoint& visPoint, 
-						 VectorR3& returnedColor, long avoidK )
-{
-	const MaterialBase* thisMat = &(visPoint.GetMaterial());
-	const VectorR3& ambientcolor = thisMat->GetColorAmbient();
-	const VectorR3& ambientlight = ActiveScene->GlobalAmbientLight();
-	const VectorR3& emitted = thisMat->GetColorEmissive();
-	returnedColor.x = ambientcolor.x*ambientlight.x + emitted.x;
-	returnedColor.y = ambientcolor.y*ambientlight.y + emitted.y;
-	returnedColor.z = ambientcolor.z*ambientlight.z + emitted.z;
-
-	VectorR3 thisColor;
-	VectorR3 percentLit;
-	VectorR3 toLight;
-	bool checksides = visPoint.GetMaterial().IsTransmissive();
-	double viewDot;
-	if ( !checksides ) {						// If not transmissive
-		toLight = viewPos;
-		toLight -= visPoint.GetPosition();		// Direction to *viewer*
-		viewDot = toLight^visPoint.GetNormal();
+	else if ( RenderThread.joinable() ) {
+		RenderThread.join();
 	}
-	bool clearpath;
-
-	int numLights = ActiveScene->NumLights();
-	for ( int k=0; k<numLights; k++ ) {
-		const Light& thisLight = ActiveScene->GetLight(k);
-		clearpath = true;
-		// Cast a shadow feeler if (a) transmissive or (b) light and view on the same side
-		if ( !checksides ) {
-			toLight = thisLight.GetPosition();
-			toLight -= visPoint.GetPosition();		// Direction to light
-			if ( !SameSignNonzero( viewDot, (toLight^visPoint.GetNormal()) ) ) {
-				clearpath = false;
-			}
-		}
-		if ( clearpath ) {
-			clearpath = ShadowFeelerKd(data, visPoint.GetPosition(), thisLight, avoidK );
-		}
-		if ( clearpath ) {
-			percentLit.Set(1.0,1.0,1.0);	// Directly lit, with no shadowing
-		}
-		else {
-			percentLit.SetZero();	// Blocked by shadows (still do ambient lighting)
-		}
-		DirectIlluminateViewPos (visPoint, viewPos,  
-						 thisLight, thisColor, percentLit); 
-		returnedColor.x += thisColor.x;
-		returnedColor.y += thisColor.y;
-		returnedColor.z += thisColor.z;
+	if ( RayTraceMode ) {
+		glutPostRedisplay();
 	}
 }
 
-void TransmitAndReflective(double cos1, double eta1, double eta2, double& transmitRate, double& reflectRate)
+// *****************************************************************
+// RayTraceView() is the top level routine that starts the ray tracing.
+//	If the view has changed, starts a render thread, which calls
+//	RayTracePixels() to fill in the pixel array.  Draws the last image
+//	from the render thread: while it runs, the window is redrawn every
+//	RedrawMilliseconds, which shows the passes of a progressive render.
+// *****************************************************************
+
+void RayTraceView(void)
 {
-	double cos2, sin1, sin2;
-	sin1 = sqrt(1 - cos1 * cos1);
-	sin2 = eta1 * sin1 / eta2;
-	cos2 = sqrt(1 - sin2 * sin2);
-	double gamma_v, gamma_h, tau_v, tau_h;
-	gamma_v = (eta2 * cos1 - eta1 * cos2) / (eta2 * cos1 + eta1 * cos2);
-	gamma_h = (eta2 * cos2 - eta1 * cos1) / (eta2 * cos2 + eta1 * cos1);
-	
-	// tau_v   = (2 * eta2 * cos1) / (eta2 * cos1 + eta1 * cos2);
-	// tau_h   = (2 * eta2 * cos1) / (eta2 * cos2 + eta1 * cos1);
-	tau_v   = (2 * eta1 * cos2) / (eta1 * cos2 + eta2 * cos1);
-	tau_h   = (2 * eta1 * cos2) / (eta1 * cos1 + eta2 * cos2);
+	if ( WidthRayTraced!=WindowWidth || NumScanLinesRayTraced!=WindowHeight ) {  
+		StopRender();
+		RenderCancel.Reset();
+		RenderRunning = true;
+		RenderNumber++;
+		RenderThread = std::thread( RenderInBackground );
+		glutTimerFunc( RedrawMilliseconds, CheckRender, RenderNumber );
+
+		WidthRayTraced = WindowWidth;			// Set these values to show scene has been computed.
+		NumScanLinesRayTraced = WindowHeight;
+	}
 
-	transmitRate = sqrt((tau_v * tau_v + tau_h * tau_h) / 2);
-	reflectRate  = sqrt((gamma_v * gamma_v + gamma_h * gamma_h) / 2);
+	DrawPixels();
 }
 
+
+
 // called when the window is resized
 static void ResizeWindow(int w, int h)
 {
 	WindowMinimized = (h==0 || w==0);
 	h = (h==0) ? 1 : h;
 	w = (w==0) ? 1 : w;
-
-	if ( (NumScanLinesRayTraced!=h || WidthRayTraced!=w) && !WindowMinimized ) {
-		RayTraceMode = false;							// Go back to OpenGL mode if size changes.
-	}
+	StopRender();
 
 	WindowHeight = h;
 	WindowWidth = w;
 	if ( pixels->SetSize( WindowWidth, WindowHeight ) ) {	// If pixel data reallocated,
-		RayTraceMode = false;
 		NumScanLinesRayTraced = WidthRayTraced = -1;		// signal pixel data no longer valid
 	}
 
@@ -611,83 +266,85 @@ void myKeyboardFunc( unsigned char key, int x, int y )
 	case 'G':							// 'G' command
 		// Set to be rendering with OpenGL
 		if ( RayTraceMode ) {
+			StopRender();
 			RayTraceMode = false;
 			glutPostRedisplay();
 		}
 		break;
+	case 'p':							// 'p' command
+		// Toggle progressive ray tracing
+		StopRender();
+		g_renderOptions.Progressive = !g_renderOptions.Progressive;
+		cout << "Progressive ray tracing: " << (g_renderOptions.Progressive ? "on" : "off") << endl;
+		break;
+	case 'b':							// 'b' command
+		// Toggle a time budget of one second for refining the image
+		StopRender();
+		g_renderOptions.TimeBudget = ( g_renderOptions.TimeBudget>0.0 ) ? 0.0 : 1.0;
+		cout << "Time budget: " << (g_renderOptions.TimeBudget>0.0 ? "1 second" : "none") << endl;
+		break;
 	}
 }
 
+// Called when the view or the camera settings change: the view must be
+//	 rendered again.  In ray trace mode, this restarts the ray tracing.
+static void ViewChanged(void)
+{
+	NumScanLinesRayTraced = WidthRayTraced = -1;	// Signal view has changed
+	glutPostRedisplay();
+}
+
 // *******************************************************************
 // Handle all "special" key presses.
 // *******************************************************************
 void mySpecialFunc( int key, int x, int y )
 {
+	StopRender();			// Before the camera or the options change
 	switch ( key ) {
 
 	case GLUT_KEY_UP:	
 		ActiveScene->GetCameraView().RotateViewUp( 0.1 );
-		RayTraceMode = false;
-		NumScanLinesRayTraced = WidthRayTraced = -1;	// Signal view has changed		
-		glutPostRedisplay();
+		ViewChanged();
 		break;
 	case GLUT_KEY_DOWN:	
 		ActiveScene->GetCameraView().RotateViewUp( -0.1 );
-		RayTraceMode = false;
-		NumScanLinesRayTraced = WidthRayTraced = -1;	// Signal view has changed		
-		glutPostRedisplay();
+		ViewChanged();
 		break;
 	case GLUT_KEY_RIGHT:	
 		ActiveScene->GetCameraView().RotateViewRight( 0.1 );
-		RayTraceMode = false;
-		NumScanLinesRayTraced = WidthRayTraced = -1;	// Signal view has changed		
-		glutPostRedisplay();
+		ViewChanged();
 		break;
 	case GLUT_KEY_LEFT:	
 		ActiveScene->GetCameraView().RotateViewRight( -0.1 );
-		RayTraceMode = false;
-		NumScanLinesRayTraced = WidthRayTraced = -1;	// Signal view has changed		
-		glutPostRedisplay();
+		ViewChanged();
 		break;
 	case GLUT_KEY_HOME:	
 		ActiveScene->GetCameraView().RescaleDistanceOfViewer( 1.1 );
-		RayTraceMode = false;
-		NumScanLinesRayTraced = WidthRayTraced = -1;	// Signal view has changed		
-		glutPostRedisplay();
+		ViewChanged();
 		break;
 	case GLUT_KEY_END:	
 		ActiveScene->GetCameraView().RescaleDistanceOfViewer( 0.9 );
-		RayTraceMode = false;
-		NumScanLinesRayTraced = WidthRayTraced = -1;	// Signal view has changed		
-		glutPostRedisplay();
+		ViewChanged();
 		break;
 	case GLUT_KEY_F1: 
-		g_fLength *= 1.1;
-		cout << "Focal Length: " << g_fLength << endl;
-		RayTraceMode = false;
-		NumScanLinesRayTraced = WidthRayTraced = -1;	// Signal view has changed		
-		glutPostRedisplay();
+		g_renderOptions.FocalLength *= 1.1;
+		cout << "Focal Length: " << g_renderOptions.FocalLength << endl;
+		ViewChanged();
 		break;
 	case GLUT_KEY_F2: 
-		g_fLength /= 1.1;
-		cout << "Focal Length: " << g_fLength << endl;
-		RayTraceMode = false;
-		NumScanLinesRayTraced = WidthRayTraced = -1;	// Signal view has changed		
-		glutPostRedisplay();
+		g_renderOptions.FocalLength /= 1.1;
+		cout << "Focal Length: " << g_renderOptions.FocalLength << endl;
+		ViewChanged();
 		break;
 	case GLUT_KEY_F3: 
-		g_aperture *= 1.1;
-		cout << "Aperature: " << g_aperture << endl;
-		RayTraceMode = false;
-		NumScanLinesRayTraced = WidthRayTraced = -1;	// Signal view has changed		
-		glutPostRedisplay();
+		g_renderOptions.Aperture *= 1.1;
+		cout << "Aperature: " << g_renderOptions.Aperture << endl;
+		ViewChanged();
 		break;
 	case GLUT_KEY_F4: 
-		g_aperture /= 1.1;
-		cout << "Aperature: " << g_aperture << endl;
-		RayTraceMode = false;
-		NumScanLinesRayTraced = WidthRayTraced = -1;	// Signal view has changed		
-		glutPostRedisplay();
+		g_renderOptions.Aperture /= 1.1;
+		cout << "Aperature: " << g_renderOptions.Aperture << endl;
+		ViewChanged();
 		break;
 	}
 }
@@ -757,7 +414,9 @@ int main( int argc, char** argv )
 	fprintf( stdout, "Press 'F2' to decrease the focal length.\n" );
 	fprintf( stdout, "Press 'F3' to increase the aperture.\n" );
 	fprintf( stdout, "Press 'F4' to decrease the aperture.\n" );
-	fprintf( stdout, "Arrow keys change view direction (and use OpenGL).\n" );
+	fprintf( stdout, "Press 'p' to turn progressive ray tracing on or off (default on).\n" );
+	fprintf( stdout, "Press 'b' to turn a time budget of one second for refining the image on or off.\n" );
+	fprintf( stdout, "Arrow keys change view direction.\n" );
 	fprintf( stdout, "Home/End keys alter view distance --- resizing keeps it same view size.\n");
 
 	glutInit(&argc, argv);
@@ -768,6 +427,7 @@ int main( int argc, char** argv )
 	glutCreateWindow( "Ray Tracing" );
 
 	InitializeSceneGeometry();
+	g_renderOptions.Progressive = true;		// Show a coarse image at once, then refine it
 
 	// set up callback functions
 	glutKeyboardFunc( myKeyboardFunc );
@@ -0,0 +1,1432 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// RayTraceRender.cpp
+//   Ray traces the ActiveScene into a PixelArray.  
+//   See RayTraceRender.h.
+
+#include <math.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+// C++ STL headers
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <memory>
+
+#include "RayTraceRender.h"
+
+#include "../Graphics/PixelArray.h"
+#include "../Graphics/ViewableBase.h"
+#include "../Graphics/DirectLight.h"
+#include "../Graphics/CameraView.h"
+#include "../VrMath/LinearR3.h"
+#include "../VrMath/LinearR4.h"
+#include "../VrMath/MathMisc.h"
+#include "../RaytraceMgr/SceneDescription.h"
+#include "../RaytraceMgr/LoadNffFile.h"
+#include "../RaytraceMgr/LoadObjFile.h"
+#include "RayTraceSetup2.h"
+#include "LeafBatch.h"
+#include "Wavefront.h"
+#include "LightTree.h"
+#include "../Graphics/ViewableSphere.h"
+
+// ***********************Statistics************
+RayTraceStats MyStats;
+thread_local RayTraceStats* ThreadStats = &MyStats;
+// **********************************************
+
+SceneDescription* ActiveScene;
+static SceneDescription LoadedScene;		// Scene loaded by LoadActiveScene() from an .obj or .nff file.
+
+int RenderOptions::GetNumThreads() const
+{
+	if ( NumThreads>0 ) {
+		return NumThreads;
+	}
+	return Max( 1, (int)thread::hardware_concurrency() );
+}
+
+// ******************************************************
+//   Loading the scene and fitting the camera to the image
+// ******************************************************
+
+static bool HasSuffix( const char* name, const char* suffix )
+{
+	size_t n = strlen(name);
+	size_t m = strlen(suffix);
+	return ( n>=m && strcmp( name+(n-m), suffix )==0 );
+}
+
+bool LoadActiveScene( const char* sceneFile )
+{
+	if ( sceneFile==0 ) {
+		SetUpScene2();
+		ActiveScene = &TheScene2;
+	}
+	else if ( HasSuffix( sceneFile, ".obj" ) || HasSuffix( sceneFile, ".OBJ" ) ) {
+		if ( !LoadObjFile( sceneFile, LoadedScene ) ) {
+			return false;
+		}
+		ActiveScene = &LoadedScene;
+		// The next lines specify scene attributes not given in the obj file.
+		ActiveScene->SetBackGroundColor( 0.0, 0.0, 0.0 );
+		ActiveScene->SetGlobalAmbientLight( 0.6, 0.6, 0.2 );
+		CameraView& theCV = ActiveScene->GetCameraView();
+		theCV.SetPosition( 0.0, 0.0, 40.0 );
+		theCV.SetScreenDistance( 40.0 );
+		theCV.SetScreenDimensions( 20.0, 20.0 );
+		SetUpLights( *ActiveScene );
+	}
+	else {
+		if ( !LoadNffFile( sceneFile, LoadedScene ) ) {
+			return false;
+		}
+		ActiveScene = &LoadedScene;
+	}
+	return true;
+}
+
+// Size the camera to the image, as RayTraceKd.cpp does when the window is resized.
+void FitCameraToPixels( const PixelArray& pixels )
+{
+	CameraView& theCV = ActiveScene->GetCameraView();
+	theCV.SetScreenPixelSize( pixels );
+	ActiveScene->RegisterCameraView();
+	ActiveScene->CalcNewScreenDims( (double)pixels.GetWidth() / (double)pixels.GetHeight() );
+	theCV.SetScreenPixelSize( pixels );
+}
+
+void AttenuateSceneLights( double quadratic )
+{
+	for ( int k=0; k<ActiveScene->NumLights(); k++ ) {
+		Light& light = ActiveScene->GetLight(k);
+		if ( light.IsPositional() ) {
+			light.SetAttenuate( 1.0, 0.0, quadratic );
+		}
+	}
+}
+
+// ******************************************************
+//   KdTree definitions and routines for creating the KdTree
+// ******************************************************
+KdTree ObjectKdTree;
+
+// The objects in the trees are the scene's primitives: the triangles of
+//	 a mesh are put in the trees separately.
+void myExtentFunc( long objNum, AABB& retBox )
+{
+	return ActiveScene->CalcPrimitiveAABB( objNum, retBox );
+}
+bool myExtentsInBox( long objNum, const AABB& aabb, AABB& retBox)
+{
+	return ActiveScene->CalcPrimitiveExtentsInBox( objNum, aabb, retBox );
+}
+
+void myBuildKdTree()
+{
+	ObjectKdTree.SetDoubleRecurseSplitting( true );
+	ObjectKdTree.SetObjectCost(8.0);
+	ObjectKdTree.BuildTree( ActiveScene->NumPrimitives(), myExtentFunc, myExtentsInBox  );
+	RayTraceStats::PrintKdStats( ObjectKdTree );
+}
+
+// ******************************************************
+//   The BVH, an alternative to the KdTree
+// ******************************************************
+BvhTree ObjectBvh;
+
+void myBuildBvh()
+{
+	ObjectBvh.BuildTree( ActiveScene->NumPrimitives(), myExtentFunc );
+	RayTraceStats::PrintBvhStats( ObjectBvh );
+}
+
+// The structure used by SeekIntersectionKd() and ShadowFeelerKd().  Set by RayTracePixels().
+static AcceleratorType SceneAccelerator = ACCEL_KDTREE;
+// Whether SeekIntersectionKd() tests the objects of a leaf together (see LeafBatch.h).  Set by RayTracePixels().
+static bool SceneLeafBatch = true;
+// Number of camera rays traced together, one if the packets are not used.  Set by RayTracePixels().
+static int ScenePacketSize = 1;
+// If positive, the lights that light a point by less than this are skipped
+//	 (see RenderOptions::LightCutoff).  Set by RayTracePixels().
+static double SceneLightCutoff = 0.0;
+// The tree over the lights used to find the ones not skipped.  Built by RayTracePixels().
+static LightTree SceneLights;
+
+const char* AcceleratorName( AcceleratorType accel )
+{
+	return ( accel==ACCEL_BVH ) ? "bvh" : "kdtree";
+}
+
+bool ParseAccelerator( const char* name, AcceleratorType* accel )
+{
+	for ( int i=ACCEL_KDTREE; i<=ACCEL_BVH; i++ ) {
+		if ( strcmp( name, AcceleratorName((AcceleratorType)i) )==0 ) {
+			*accel = (AcceleratorType)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// *****************************************************************
+// RayTracePixels() is the top level routine that does the ray tracing.
+//	Runs options.GetNumThreads() threads that take tiles of pixels from
+//	the TileScheduler.  Each thread casts options.SamplesPerPixel rays through
+//	each pixel of its tiles, placed by the options.SamplePattern sampler, and
+//	calls RayTrace() for each one.  With options.WavefrontRays, the rays are
+//	instead traced in batches by a WavefrontTracer (see Wavefront.h).
+//
+//	With options.Adaptive, the image is rendered in two passes.  The first
+//	pass casts options.AdaptiveMinSamples rays through every pixel.  The
+//	second pass keeps adding rays to each pixel, in batches of the same
+//	size, until the standard error of its color is below
+//	options.AdaptiveThreshold or it has options.SamplesPerPixel rays.
+//	Pixels whose first pass color differs from a neighbour's by more than
+//	options.AdaptiveContrast get at least four batches, so that edges
+//	missed by all of the first rays are still refined.
+//
+//	With options.Progressive, the first passes trace one ray through one
+//	pixel in every options.PreviewStride x PreviewStride block, then one in
+//	every block of half the size, and so on down to every pixel.  The
+//	untraced pixels of each block are given the color of its traced pixel.
+//	Later passes multiply the rays per pixel by four, up to
+//	options.SamplesPerPixel (or, if adaptive, to options.AdaptiveMinSamples,
+//	followed by the refinement pass).  Each pass over the whole image has a
+//	cost of its own, so there are few of them.  The rays of the earlier
+//	passes are kept, and each pixel ends with the same rays, added in the
+//	same order, as without options.Progressive, so the final image is the
+//	same.
+//
+//	With options.TimeBudget, the passes that refine an image that already
+//	has a ray in every pixel (the adaptive refinement pass, and the
+//	progressive passes after the first full resolution one) stop taking
+//	tiles once the time is up.  Each pixel keeps the color from the rays
+//	it has, so the image is the best found in the time.  The render is
+//	cancelled in the same way, except that every pass stops.
+// *****************************************************************
+
+TileScheduler RenderTiles;
+RenderThreadPool RenderThreads;
+
+// Running sums of the colors of the rays cast through a pixel.
+//   The error estimate uses the colors clamped to [0,1], as displayed.
+class PixelSamples {
+public:
+	VectorR3 Sum;
+	VectorR3 ClampedSum;
+	VectorR3 ClampedSumSq;
+	long Count;
+	unsigned long long Nanoseconds;	// Time spent on the pixel in all passes, for the statistics
+	long RaysTraced;				// Rays traced for the pixel in all passes, likewise
+
+	void Reset();
+	void AddSample( const VectorR3& color );
+	VectorR3 Mean() const { return Sum/(double)Count; }
+	VectorR3 ClampedMean() const { return ClampedSum/(double)Count; }
+	bool Converged( double threshold ) const;
+};
+
+inline void PixelSamples::Reset()
+{
+	Sum.SetZero();
+	ClampedSum.SetZero();
+	ClampedSumSq.SetZero();
+	Count = 0;
+	Nanoseconds = 0;
+	RaysTraced = 0;
+}
+
+inline void PixelSamples::AddSample( const VectorR3& color )
+{
+	VectorR3 c( ClampRange(color.x, 0.0, 1.0), ClampRange(color.y, 0.0, 1.0), ClampRange(color.z, 0.0, 1.0) );
+	Sum += color;
+	ClampedSum += c;
+	ClampedSumSq += ArrayProd( c, c );
+	Count++;
+}
+
+// True if the standard error of the mean of each color component is at most threshold.
+bool PixelSamples::Converged( double threshold ) const
+{
+	if ( Count<2 ) {
+		return false;
+	}
+	// The squared standard error is variance/Count.  Both sides are scaled by Count*(Count-1).
+	double n = (double)Count;
+	double maxScaledVariance = threshold*threshold*n*n*(n-1.0);
+	VectorR3 scaledVariance = n*ClampedSumSq - ArrayProd( ClampedSum, ClampedSum );
+	return ( scaledVariance.x<=maxScaledVariance
+			 && scaledVariance.y<=maxScaledVariance
+			 && scaledVariance.z<=maxScaledVariance );
+}
+
+// What a pass over the image does to each pixel
+enum RenderPassType {
+	PASS_FIRST,				// Cast the first BatchSize rays
+	PASS_REFINE,			// Adaptive refinement (see refinePixel())
+	PASS_ADD_SAMPLES		// Cast more rays, up to TargetSamples, keeping the earlier ones
+};
+
+// The state shared by the render threads during one pass over the image.
+class RenderPass {
+public:
+	const RenderOptions* Options;
+	const CameraView* MainView;
+	const Sampler* TheSampler;
+	VectorR3 LensU, LensV;			// Unit vectors along the sides of the lens
+	PixelArray* Pixels;
+	PixelArray* SampleMap;			// Null if no map of the samples per pixel is wanted
+	RenderPassType Type;
+	int Stride;						// Only the pixels whose coordinates are multiples of Stride are traced
+	long TargetSamples;				// Rays per pixel at the end of a PASS_ADD_SAMPLES pass
+	long BatchSize;					// Rays per pixel in the first pass, and per refinement step
+	bool Refinement;				// Whether the image already has a ray in every pixel
+	const RenderCancelToken* Cancel;	// Null if the render cannot be cancelled
+	bool UseDeadline;				// Refinement passes stop at Deadline
+	chrono::steady_clock::time_point Deadline;
+
+	bool Cancelled() const { return Cancel && Cancel->IsCancelled(); }
+	// Whether the threads should stop taking tiles
+	bool Stopped() const;
+	PixelSamples* Samples;			// Sums for each pixel, kept between passes.  Null if not adaptive.
+	unsigned char* HighContrast;	// Pixels that differed from a neighbour after the first pass
+	vector<RayTraceStats> Stats;	// The statistics of each thread
+	vector<KdTraverseStats> TraverseStats;	// The traversals of each thread
+};
+
+bool RenderPass::Stopped() const
+{
+	return Cancelled() || ( Refinement && UseDeadline && chrono::steady_clock::now()>=Deadline );
+}
+
+static void traceCameraRays( TraceContext& context, const RenderOptions& options, int numRays,
+							 const VectorR3* pos, const VectorR3* dir, const SampleStream* samples,
+							 VectorR3* returnedColors );
+
+// The camera ray of sample s of pixel (i,j), with a pinhole camera if the
+//	 aperture is zero, and otherwise with a square lens.
+static void cameraRay(const RenderPass *Pass, int i, int j, long s,
+					  VectorR3& pos, VectorR3& dir, SampleStream& samples) {
+	const RenderOptions *Options = Pass->Options;
+	const CameraView *MainView = Pass->MainView;
+	samples = SampleStream(Pass->TheSampler, i, j, s);
+	double x = i + samples.Get(SAMPLE_DIM_PIXEL_X);
+	double y = j + samples.Get(SAMPLE_DIM_PIXEL_Y);
+	if ( !(Options->Aperture>0.0) ) {
+		MainView->CalcPixelDirection(x,y,&dir);
+		pos = MainView->GetPosition();
+		return;
+	}
+	const double flength = Options->FocalLength;
+	const double aperture = Options->Aperture;
+	VectorR3 centerDir;
+	MainView->CalcPixelDirection(x,y,&centerDir);
+	VectorR3 tempPos = MainView->GetPosition() + centerDir * flength / MainView->GetScreenDistance();
+	// Position on the (square) lens
+	pos = MainView->GetPosition();
+	pos += (samples.Get(SAMPLE_DIM_LENS_U) - 0.5) * Pass->LensU * aperture;
+	pos += (samples.Get(SAMPLE_DIM_LENS_V) - 0.5) * Pass->LensV * aperture;
+	dir = tempPos - pos;
+	dir.Normalize();
+}
+
+// Traces samples firstSample,...,lastSample-1 of pixel (i,j): all together in
+//	 wavefront mode, and otherwise in packets of ScenePacketSize rays.
+static void traceSamples(const RenderPass *Pass, TraceContext& context, int i, int j,
+						 long firstSample, long lastSample, PixelSamples& pixelSamples) {
+	if ( context.Wavefront ) {
+		WavefrontTracer& wavefront = *context.Wavefront;
+		VectorR3 pos, dir;
+		SampleStream samples;
+		wavefront.Reset();
+		for ( long s = firstSample; s < lastSample; s++ ) {
+			cameraRay(Pass, i, j, s, pos, dir, samples);
+			wavefront.AddCameraRay( pos, dir, samples );
+		}
+		wavefront.Trace( context, *Pass->Options );
+		for ( long k = 0; k < wavefront.GetNumCameraRays(); k++ ) {
+			pixelSamples.AddSample( wavefront.GetColor(k) );
+		}
+		return;
+	}
+
+	VectorR3 PixelPos[KdTree::MaxPacketRays];
+	VectorR3 PixelDir[KdTree::MaxPacketRays];
+	VectorR3 curPixelColor[KdTree::MaxPacketRays];
+	SampleStream samples[KdTree::MaxPacketRays];
+	int numRays;
+	for( long s = firstSample; s < lastSample; s += numRays) {
+		numRays = (int)Min( (long)ScenePacketSize, lastSample-s );
+		for ( int k=0; k<numRays; k++ ) {
+			cameraRay(Pass, i, j, s+k, PixelPos[k], PixelDir[k], samples[k]);
+		}
+		traceCameraRays( context, *Pass->Options, numRays, PixelPos, PixelDir, samples, curPixelColor );
+		for ( int k=0; k<numRays; k++ ) {
+			pixelSamples.AddSample( curPixelColor[k] );
+		}
+	}
+}
+
+// Second pass of adaptive sampling: add batches of rays until the pixel converges.
+static void refinePixel(const RenderPass *Pass, TraceContext& context, int i, int j,
+						PixelSamples& pixelSamples) {
+	const RenderOptions *Options = Pass->Options;
+	long maxSamples = Options->SamplesPerPixel;
+	long minSamples = Pass->BatchSize;
+	if ( Pass->HighContrast[(long)j*Pass->Pixels->GetWidth() + i] ) {
+		minSamples = Min( 4*Pass->BatchSize, maxSamples );
+	}
+	while ( pixelSamples.Count<maxSamples
+			&& ( pixelSamples.Count<minSamples || !pixelSamples.Converged(Options->AdaptiveThreshold) ) ) {
+		long lastSample = Min( pixelSamples.Count+Pass->BatchSize, maxSamples );
+		traceSamples(Pass, context, i, j, pixelSamples.Count, lastSample, pixelSamples);
+	}
+}
+
+// Also adds the pixel to the thread's statistics if the image has only this
+//	 pass.  Otherwise RayTracePixels() adds it once the passes are done.
+static void setPixel(const RenderPass *Pass, int i, int j, const PixelSamples& pixelSamples) {
+	if ( !Pass->Samples ) {
+		ThreadStats->AddPixel( pixelSamples.Nanoseconds, pixelSamples.RaysTraced );
+	}
+	Pass->Pixels->SetPixel(i, j, pixelSamples.Mean());
+	if ( Pass->SampleMap ) {
+		double fraction = (double)pixelSamples.Count/(double)Pass->Options->SamplesPerPixel;
+		Pass->SampleMap->SetPixel(i, j, VectorR3(fraction, fraction, fraction));
+	}
+}
+
+// First pass in wavefront mode: the camera rays of the pixels of the tile
+//	 are traced in batches of at most options.WavefrontRays rays (but at
+//	 least one pixel).  Returns the number of camera rays.
+//	 The pixels of a batch share its time and rays equally in the statistics.
+static long traceTileWavefront(const RenderPass *Pass, TraceContext& context, const PixelTile& tile,
+							   PixelSamples& localSamples) {
+	WavefrontTracer& wavefront = *context.Wavefront;
+	long width = Pass->Pixels->GetWidth();
+	long tileWidth = tile.MaxX - tile.MinX;
+	long numPixels = tileWidth*(tile.MaxY - tile.MinY);
+	long pixelsPerBatch = Max( 1L, Pass->Options->WavefrontRays/Pass->BatchSize );
+	VectorR3 pos, dir;
+	SampleStream samples;
+	for ( long first = 0; first < numPixels; first += pixelsPerBatch ) {
+		long last = Min( first+pixelsPerBatch, numPixels );
+		auto start = chrono::steady_clock::now();
+		long raysBefore = context.Stats.GetNumRaysTraced();
+		wavefront.Reset();
+		for ( long p = first; p < last; p++ ) {
+			int i = tile.MinX + (int)(p%tileWidth);
+			int j = tile.MinY + (int)(p/tileWidth);
+			for ( long s = 0; s < Pass->BatchSize; s++ ) {
+				cameraRay(Pass, i, j, s, pos, dir, samples);
+				wavefront.AddCameraRay( pos, dir, samples );
+			}
+		}
+		wavefront.Trace( context, *Pass->Options );
+		unsigned long long nanoseconds = chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now() - start ).count();
+		long numRays = context.Stats.GetNumRaysTraced() - raysBefore;
+		long k = 0;
+		for ( long p = first; p < last; p++ ) {
+			int i = tile.MinX + (int)(p%tileWidth);
+			int j = tile.MinY + (int)(p/tileWidth);
+			PixelSamples& pixelSamples = Pass->Samples ? Pass->Samples[j*width + i] : localSamples;
+			pixelSamples.Reset();
+			pixelSamples.Nanoseconds = nanoseconds/(last-first);
+			pixelSamples.RaysTraced = numRays/(last-first);
+			for ( long s = 0; s < Pass->BatchSize; s++ ) {
+				pixelSamples.AddSample( wavefront.GetColor(k++) );
+			}
+			setPixel(Pass, i, j, pixelSamples);
+		}
+	}
+	return numPixels*Pass->BatchSize;
+}
+
+// The work space of a render thread: its TraceContext for RayTrace(), and
+//	 its WavefrontTracer.  A thread keeps its work space until it ends, so the
+//	 threads of RenderThreads allocate it once rather than for every pass.
+//	 It is made again if the trace depth, the trees or the scene change size.
+class RenderWorkSpace {
+public:
+	RenderWorkSpace( int traceDepth );
+	bool Fits( int traceDepth ) const;
+
+	TraceContext Context;
+	WavefrontTracer Wavefront;
+
+private:
+	int TraceDepth;
+	long KdMaxDepth;
+	long BvhStackSize;
+	long NumPrimitives;
+	int NumLights;
+};
+
+RenderWorkSpace::RenderWorkSpace( int traceDepth )
+: Context( traceDepth, ObjectKdTree, ObjectBvh )
+{
+	TraceDepth = traceDepth;
+	KdMaxDepth = ObjectKdTree.GetMaxDepth();
+	BvhStackSize = ObjectBvh.GetStackSize();
+	NumPrimitives = ActiveScene->NumPrimitives();
+	NumLights = ActiveScene->NumLights();
+}
+
+bool RenderWorkSpace::Fits( int traceDepth ) const
+{
+	return ( TraceDepth==traceDepth && KdMaxDepth==ObjectKdTree.GetMaxDepth()
+			 && BvhStackSize==ObjectBvh.GetStackSize()
+			 && NumPrimitives==ActiveScene->NumPrimitives() && NumLights==ActiveScene->NumLights() );
+}
+
+static thread_local unique_ptr<RenderWorkSpace> ThreadWorkSpace;
+
+// The calling thread's work space, ready for a new pass.
+static TraceContext& startPassContext( const RenderOptions& options )
+{
+	if ( !ThreadWorkSpace || !ThreadWorkSpace->Fits( options.TraceDepth ) ) {
+		ThreadWorkSpace.reset();
+		ThreadWorkSpace.reset( new RenderWorkSpace( options.TraceDepth ) );
+	}
+	TraceContext& context = ThreadWorkSpace->Context;
+	context.Stats.Init();
+	context.TraverseStats.Reset();
+	context.Mailbox.ResetNumberSkipped();
+	context.Wavefront = ( options.WavefrontRays>0 ) ? &ThreadWorkSpace->Wavefront : 0;
+	return context;
+}
+
+// Body of each render thread: trace tiles until the scheduler runs out.
+//	 Each thread uses its own work space (see RenderWorkSpace).  The thread
+//	 counts its work in the context's statistics, which runPass() adds up
+//	 once the threads are done.
+static void traceTiles(int threadNum, RenderPass *Pass) {
+	TraceContext& context = startPassContext( *Pass->Options );
+	ThreadStats = &context.Stats;
+	PixelSamples localSamples;
+	PixelTile tile;
+	long width = Pass->Pixels->GetWidth();
+	long numCameraRays = 0;
+	while (!Pass->Stopped() && RenderTiles.GetNextTile(threadNum, tile)) {
+		auto start = chrono::steady_clock::now();
+		if ( context.Wavefront && Pass->Type==PASS_FIRST ) {
+			numCameraRays += traceTileWavefront(Pass, context, tile, localSamples);
+		}
+		else {
+			for (int j = tile.MinY; j < tile.MaxY; ++j) {
+				if ( j%Pass->Stride!=0 ) {
+					continue;
+				}
+				for (int i = tile.MinX; i < tile.MaxX; ++i) {
+					if ( i%Pass->Stride!=0 ) {
+						continue;
+					}
+					PixelSamples& pixelSamples = Pass->Samples ? Pass->Samples[j*width + i] : localSamples;
+					auto pixelStart = chrono::steady_clock::now();
+					long raysBefore = context.Stats.GetNumRaysTraced();
+					if ( Pass->Type==PASS_FIRST ) {
+						pixelSamples.Reset();
+					}
+					long countBefore = pixelSamples.Count;
+					if ( Pass->Type==PASS_FIRST ) {
+						traceSamples(Pass, context, i, j, 0, Pass->BatchSize, pixelSamples);
+					}
+					else if ( Pass->Type==PASS_REFINE ) {
+						refinePixel(Pass, context, i, j, pixelSamples);
+					}
+					else if ( countBefore<Pass->TargetSamples ) {
+						traceSamples(Pass, context, i, j, countBefore, Pass->TargetSamples, pixelSamples);
+					}
+					numCameraRays += pixelSamples.Count - countBefore;
+					pixelSamples.Nanoseconds += chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now() - pixelStart ).count();
+					pixelSamples.RaysTraced += context.Stats.GetNumRaysTraced() - raysBefore;
+					setPixel(Pass, i, j, pixelSamples);
+				}
+			}
+		}
+		chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+		RenderTiles.TileDone(threadNum, tile, elapsed.count());
+	}
+	context.Stats.AddCameraRays( numCameraRays );
+	context.Stats.AddMailboxSkips( context.Mailbox.GetNumberSkipped() );
+	Pass->Stats[threadNum] = context.Stats;
+	Pass->TraverseStats[threadNum] = context.TraverseStats;
+	ThreadStats = &MyStats;
+}
+
+// Flag the pixels whose color differs from one of their eight neighbours by
+//	 more than "contrast" in some component.
+static void markHighContrast( const PixelSamples* samples, int width, int height, double contrast,
+							  unsigned char* highContrast )
+{
+	for ( int j=0; j<height; j++ ) {
+		for ( int i=0; i<width; i++ ) {
+			VectorR3 color = samples[(long)j*width + i].ClampedMean();
+			unsigned char flag = 0;
+			for ( int nj=Max(j-1,0); nj<=Min(j+1,height-1) && !flag; nj++ ) {
+				for ( int ni=Max(i-1,0); ni<=Min(i+1,width-1); ni++ ) {
+					VectorR3 diff = samples[(long)nj*width + ni].ClampedMean() - color;
+					if ( diff.MaxAbs()>contrast ) {
+						flag = 1;
+						break;
+					}
+				}
+			}
+			highContrast[(long)j*width + i] = flag;
+		}
+	}
+}
+
+// Run one pass over the image with numThreads threads: those of
+//	 RenderThreads, or new threads if !options.PersistentThreads.
+static void runPass( RenderPass& pass, int numThreads )
+{
+	const RenderOptions& options = *pass.Options;
+	RenderTiles.Init( pass.Pixels->GetWidth(), pass.Pixels->GetHeight(), options.TileSize, options.TileOrder, numThreads );
+	pass.Stats.assign( numThreads, RayTraceStats() );
+	pass.TraverseStats.assign( numThreads, KdTraverseStats() );
+
+	if ( options.PersistentThreads ) {
+		RenderThreads.Run( numThreads, options.PinThreads, [&pass](int t) { traceTiles(t, &pass); } );
+	}
+	else {
+		vector<thread> threads;
+		threads.resize(numThreads);
+		for (int t = 0; t < numThreads; ++t) {
+			threads[t] = thread(traceTiles, t, &pass);
+		}
+
+		for (thread &t : threads)
+			t.join();
+	}
+
+	// Only the tree being traversed has counts to add
+	for (int t = 0; t < numThreads; ++t) {
+		MyStats.Add( pass.Stats[t] );
+		if ( SceneAccelerator==ACCEL_BVH ) {
+			ObjectBvh.Stats_Add( pass.TraverseStats[t] );
+		}
+		else {
+			ObjectKdTree.Stats_Add( pass.TraverseStats[t] );
+		}
+	}
+}
+
+// Gives each pixel the color of the traced pixel of its Stride x Stride block.
+static void fillPreviewBlocks( const RenderPass& pass )
+{
+	int width = pass.Pixels->GetWidth();
+	int height = pass.Pixels->GetHeight();
+	int stride = pass.Stride;
+	for ( int j=0; j<height; j++ ) {
+		for ( int i=0; i<width; i++ ) {
+			if ( i%stride!=0 || j%stride!=0 ) {
+				const PixelSamples& traced = pass.Samples[(long)(j-j%stride)*width + (i-i%stride)];
+				pass.Pixels->SetPixel( i, j, traced.Mean() );
+			}
+		}
+	}
+}
+
+// The passes of a progressive render, up to the adaptive refinement pass, if any.
+//	 The last of these passes leaves BatchSize rays in every pixel, unless
+//	 the passes are stopped (see RenderPass::Stopped()).
+static void runProgressivePasses( RenderPass& pass, int numThreads, bool adaptive,
+								  RenderProgressCallback* progress )
+{
+	long numPixels = (long)pass.Pixels->GetWidth()*(long)pass.Pixels->GetHeight();
+	for ( long p=0; p<numPixels; p++ ) {
+		pass.Samples[p].Reset();
+	}
+	pass.Type = PASS_ADD_SAMPLES;
+	pass.TargetSamples = 1;
+	for ( pass.Stride = Max( 1, pass.Options->PreviewStride ); ; pass.Stride /= 2 ) {
+		runPass( pass, numThreads );
+		if ( pass.Cancelled() ) {
+			return;
+		}
+		if ( pass.Stride==1 ) {
+			break;
+		}
+		fillPreviewBlocks( pass );
+		if ( progress ) {
+			(*progress)( *pass.Pixels, pass.Stride, 1 );
+		}
+	}
+	pass.Refinement = true;
+	while ( pass.TargetSamples<pass.BatchSize && !pass.Stopped() ) {
+		if ( progress ) {
+			(*progress)( *pass.Pixels, 1, pass.TargetSamples );
+		}
+		pass.TargetSamples = Min( 4*pass.TargetSamples, pass.BatchSize );
+		runPass( pass, numThreads );
+	}
+	if ( pass.Cancelled() ) {
+		return;
+	}
+	if ( progress && adaptive ) {
+		(*progress)( *pass.Pixels, 1, pass.BatchSize );
+	}
+}
+
+bool RayTracePixels( PixelArray& pixels, const CameraView& view, const RenderOptions& options,
+					 PixelArray* sampleMap, RenderProgressCallback* progress,
+					 const RenderCancelToken* cancel )
+{
+	auto start = chrono::steady_clock::now();
+	if ( options.Accelerator==ACCEL_BVH && !ObjectBvh.IsBuilt() ) {
+		myBuildBvh();
+	}
+	SceneAccelerator = options.Accelerator;
+	SceneLeafBatch = options.LeafBatch;
+	// Packets are traversed only in the kd-tree
+	ScenePacketSize = ( options.Accelerator==ACCEL_KDTREE ) ? ClampRange( options.PacketSize, 1, KdTree::MaxPacketRays ) : 1;
+	SceneLightCutoff = options.LightCutoff;
+	if ( SceneLightCutoff>0.0 ) {
+		SceneLights.Build( *ActiveScene );		// Quick, and the lights may have changed
+	}
+	MyStats.Init();
+	ObjectKdTree.ResetStats();
+	ObjectBvh.ResetStats();
+
+	int width = pixels.GetWidth();
+	int height = pixels.GetHeight();
+	int numThreads = options.GetNumThreads();
+	Sampler* sampler = Sampler::New( options.SamplePattern, options.SamplesPerPixel, options.SampleSeed );
+	bool adaptive = options.Adaptive && options.AdaptiveMinSamples<options.SamplesPerPixel;
+
+	RenderPass pass;
+	pass.Options = &options;
+	pass.MainView = &view;
+	pass.TheSampler = sampler;
+	pass.LensU = view.GetPixeldU();
+	pass.LensV = view.GetPixeldV();
+	pass.LensU.Normalize();
+	pass.LensV.Normalize();
+	pass.Pixels = &pixels;
+	pass.SampleMap = sampleMap;
+	pass.Type = PASS_FIRST;
+	pass.Stride = 1;
+	pass.TargetSamples = 0;
+	pass.Refinement = false;
+	pass.Cancel = cancel;
+	pass.UseDeadline = ( options.TimeBudget>0.0 );
+	pass.Deadline = start + chrono::duration_cast<chrono::steady_clock::duration>( chrono::duration<double>( options.TimeBudget ) );
+	pass.BatchSize = adaptive ? Max( 1L, options.AdaptiveMinSamples ) : options.SamplesPerPixel;
+	pass.Samples = 0;
+	pass.HighContrast = 0;
+	if ( adaptive || options.Progressive ) {
+		pass.Samples = new PixelSamples[(long)width*(long)height];
+	}
+	if ( adaptive ) {
+		pass.HighContrast = new unsigned char[(long)width*(long)height];
+	}
+	MyStats.SetNumPixels( (long)width*(long)height );
+
+	if ( options.Progressive ) {
+		runProgressivePasses( pass, numThreads, adaptive, progress );
+	}
+	else {
+		runPass( pass, numThreads );
+	}
+	if ( adaptive && !pass.Stopped() ) {
+		markHighContrast( pass.Samples, width, height, options.AdaptiveContrast, pass.HighContrast );
+		pass.Type = PASS_REFINE;
+		pass.Stride = 1;
+		pass.Refinement = true;
+		runPass( pass, numThreads );
+	}
+	bool finished = !pass.Cancelled();
+	if ( pass.Samples ) {
+		// The time and rays of every pass, including the pixels a stopped
+		//	 render did not finish.
+		for ( long p=0; p<(long)width*(long)height; p++ ) {
+			if ( pass.Samples[p].Count>0 ) {
+				MyStats.AddPixel( pass.Samples[p].Nanoseconds, pass.Samples[p].RaysTraced );
+			}
+		}
+	}
+
+	delete[] pass.Samples;
+	delete[] pass.HighContrast;
+	delete sampler;
+
+	if ( SceneAccelerator==ACCEL_BVH ) {
+		MyStats.GetBvhRunData( ObjectBvh );
+	}
+	else {
+		MyStats.GetKdRunData( ObjectKdTree );
+	}
+	return finished;
+}
+
+TraceContext::TraceContext( int traceDepth, const KdTree& kdTree, const BvhTree& bvh )
+: RayTree( traceDepth+1 ), KdStack( Max( kdTree.GetMaxDepth()+1, bvh.GetStackSize() ) ),
+  PacketStack( kdTree.GetMaxDepth()+1 ), Mailbox( ActiveScene->NumPrimitives() )
+{
+	Wavefront = 0;
+	LightsClear = new unsigned char[KdTree::MaxPacketRays*Max(ActiveScene->NumLights(),1)];
+}
+
+// The mailbox for the rays traced with context.  The BVH puts each object
+//	 in one leaf, so it has no repeated tests to skip.
+KdMailbox* SceneMailbox( TraceContext& context )
+{
+	return ( SceneAccelerator==ACCEL_KDTREE ) ? &context.Mailbox : 0;
+}
+
+// Tests one object for potHitSeekIntersection and potHitSeekIntersectionList.
+static bool SeekHitObject( KdData *data, long objectNum, double* retStopDistance )
+{
+	double thisHitDistance;
+	bool hitFlag;
+	if ( objectNum == data->kdTraverseAvoid ) {
+		hitFlag = ActiveScene->PrimitiveIntersectionDistance(objectNum, data->kdStartPosAvoid, data->kdTraverseDir,
+											data->bestHitDistance, &thisHitDistance);
+		if ( !hitFlag ) {
+			return false;
+		}
+		thisHitDistance += data->isectEpsilon;		// Adjust back to real hit distance
+	}
+	else {
+		hitFlag = ActiveScene->PrimitiveIntersectionDistance(objectNum, data->kdStartPos, data->kdTraverseDir,
+											data->bestHitDistance, &thisHitDistance);
+		if ( !hitFlag ) {
+			return false;
+		}
+	}
+
+	data->bestObject = objectNum;				// The object that was hit
+	data->bestHitDistance = thisHitDistance;
+	*retStopDistance = data->bestHitDistance;	// No need to traverse search further than this distance
+	return true;
+}
+
+// Call back function for KdTraversal of view ray or reflection ray
+// It is of type PotentialObjectCallback.
+//	 An object already tested for this ray is skipped: it missed, or it was
+//	 hit and is still the best hit unless a closer one has been found since.
+//	 Only the hit distance is found here.  SeekIntersectionKd fills in the
+//	 visible point for the closest hit once the traversal is done.
+bool potHitSeekIntersection( KdData *data, long objectNum, double* retStopDistance ) 
+{
+	if ( data->Mailbox && data->Mailbox->AlreadyTested( objectNum ) ) {
+		return false;
+	}
+	return SeekHitObject( data, objectNum, retStopDistance );
+}
+
+// Call back function for KdTraversal of view ray or reflection ray, with all
+//	 the objects of a leaf.  It is of type PotentialObjectsListCallback.
+//	 The triangles of meshes and the spheres are tested in blocks by a
+//	 LeafBatch.  The object the ray starts on, and the other kinds of
+//	 objects, are tested one at a time, as is a leaf with a single object.
+bool potHitSeekIntersectionList( KdData *data, int numObjects, long* objectNums, double* retStopDistance )
+{
+	if ( numObjects==1 ) {
+		return potHitSeekIntersection( data, objectNums[0], retStopDistance );
+	}
+	LeafBatch batch( data->kdStartPos, data->kdTraverseDir, &data->bestHitDistance, &data->bestObject );
+	bool found = false;
+	for ( int i=0; i<numObjects; i++ ) {
+		long objectNum = objectNums[i];
+		if ( data->Mailbox && data->Mailbox->AlreadyTested( objectNum ) ) {
+			continue;
+		}
+		if ( objectNum!=data->kdTraverseAvoid ) {
+			switch ( ActiveScene->GetPrimitiveType( objectNum ) ) {
+			case ViewableBase::Viewable_TriangleMesh:
+				found = batch.AddTriangle( objectNum, *ActiveScene->GetPrimitiveMesh( objectNum ),
+										   ActiveScene->GetPrimitiveTriangle( objectNum ) ) || found;
+				continue;
+			case ViewableBase::Viewable_Sphere:
+				found = batch.AddSphere( objectNum, (const ViewableSphere&)
+										 ActiveScene->GetViewable( ActiveScene->GetPrimitiveViewable( objectNum ) ) ) || found;
+				continue;
+			default:
+				break;
+			}
+		}
+		found = SeekHitObject( data, objectNum, retStopDistance ) || found;
+	}
+	found = batch.Flush() || found;
+	*retStopDistance = data->bestHitDistance;	// No need to traverse search further than this distance
+	return found;
+}
+
+// Call back function for the occlusion traversal of shadow feeler
+// It is of type PotentialOccluderCallback.
+//	 Hits within isectEpsilon of the illuminated point do not count.
+bool potHitShadowFeeler( KdData *data, long objectNum ) 
+{
+	if ( data->Mailbox && data->Mailbox->AlreadyTested( objectNum ) ) {
+		return false;
+	}
+	if ( ActiveScene->PrimitiveIntersectsSegment(objectNum, data->kdStartPos, data->kdTraverseDir,
+											data->kdShadowDist-data->isectEpsilon) )
+	{
+		data->kdTraverseFeeler = false;
+		return true;
+	}
+	return false;
+}
+
+
+
+// Traverses ObjectKdTree or ObjectBvh, as chosen by the render options.
+static inline bool TraverseScene( KdData *data, const VectorR3& pos, const VectorR3& direction,
+								  double seekDistance = 0.0, bool useSeekDistance = false )
+{
+	if ( SceneAccelerator==ACCEL_BVH ) {
+		return ObjectBvh.Traverse( data, pos, direction, seekDistance, useSeekDistance );
+	}
+	return ObjectKdTree.Traverse( data, pos, direction, seekDistance, useSeekDistance );
+}
+
+// Occlusion query on ObjectKdTree or ObjectBvh.  Returns true if the segment is blocked.
+static inline bool TraverseSceneAnyHit( KdData *data, const VectorR3& pos, const VectorR3& direction,
+										double maxDistance )
+{
+	if ( SceneAccelerator==ACCEL_BVH ) {
+		return ObjectBvh.TraverseAnyHit( data, pos, direction, maxDistance );
+	}
+	return ObjectKdTree.TraverseAnyHit( data, pos, direction, maxDistance );
+}
+
+// Sets up data for the traversal of SeekIntersectionKd, or of a packet of rays.
+static void startSeekIntersection( KdData *data, const VectorR3& pos, const VectorR3& direction, long avoidK )
+{
+	ThreadStats->AddRayTraced();
+
+	data->bestObject = -1;			// The KdData may have been used for an earlier ray
+	data->bestHitDistance = DBL_MAX;
+	data->kdTraverseAvoid = avoidK;
+	data->kdStartPos = pos;
+	data->kdTraverseDir = direction;
+	data->kdStartPosAvoid = pos;
+	data->kdStartPosAvoid.AddScaled( direction, data->isectEpsilon );
+	if ( SceneLeafBatch ) {
+		data->CallbackFunction = (void*) potHitSeekIntersectionList;
+		data->UseListCallback = true;
+	}
+	else {
+		data->CallbackFunction = (void*) potHitSeekIntersection;
+		data->UseListCallback = false;
+	}
+}
+
+// After the traversal: the visible point of the closest hit, if any.
+static long finishSeekIntersection( KdData *data, const VectorR3& pos, const VectorR3& direction,
+									double *hitDist, VisiblePoint& returnedPoint, long avoidK )
+{
+	if ( data->bestObject>=0 ) {
+		*hitDist = data->bestHitDistance;
+		// Second phase: the visible point, for the closest hit only
+		const VectorR3& hitStartPos = (data->bestObject==avoidK) ? data->kdStartPosAvoid : pos;
+		if ( !ActiveScene->PrimitiveVisiblePoint( data->bestObject, hitStartPos, direction,
+											data->bestHitDistance, returnedPoint ) )
+		{
+			assert( 0 );		// The first phase found this hit
+		}
+	}
+	return data->bestObject;
+}
+
+// SeekIntersectionKd seeks for an intersection with all viewable objects
+// If it finds one, it returns the index of the viewable object,
+//   and sets the value of hitDist and fills in the returnedPoint values.
+// This "Kd" version uses the Kd-Tree, or the BVH if the render options choose it.
+long SeekIntersectionKd( KdData *data, const VectorR3& pos, const VectorR3& direction,
+										double *hitDist, VisiblePoint& returnedPoint,
+										long avoidK)
+{
+	startSeekIntersection( data, pos, direction, avoidK );
+	if ( data->Mailbox ) {
+		data->Mailbox->NewRay();
+	}
+	
+	TraverseScene( data, pos, direction );
+
+	return finishSeekIntersection( data, pos, direction, hitDist, returnedPoint, avoidK );
+}	
+
+// ShadowFeeler - returns whether the light is visible from the position pos.
+//		Return value is "true" if no shadowing object found.
+//		intersectNum is the index of the visible object being (possibly)
+//		illuminated at pos.
+
+// Sets up data for the shadow feeler of ShadowFeelerKd, or of a packet of feelers.
+//	 Returns false if pos is so close to the light that no feeler is needed.
+static bool startShadowFeeler( KdData *data, const VectorR3& pos, const Light& light, long intersectNum )
+{
+	ThreadStats->AddRayTraced();
+	ThreadStats->AddShadowFeeler();
+
+	data->kdTraverseDir = pos;
+	data->kdTraverseDir -= light.GetPosition();
+	double dist = data->kdTraverseDir.Norm();
+	if ( dist<1.0e-7 ) {
+		return false;		// Extremely close to the light!
+	}
+	data->kdTraverseDir /= dist;			// Direction from light position towards pos
+	data->kdStartPos = light.GetPosition();
+	data->kdTraverseFeeler = true;		// True indicates no shadowing objects
+	data->kdTraverseAvoid = intersectNum;
+	data->kdShadowDist = dist;
+	data->CallbackFunction = (void*) potHitShadowFeeler;
+	return true;
+}
+
+bool ShadowFeelerKd(KdData *data, const VectorR3& pos, const Light& light, long intersectNum ) {
+	if ( !startShadowFeeler( data, pos, light, intersectNum ) ) {
+		return true;
+	}
+	if ( data->Mailbox ) {
+		data->Mailbox->NewRay();
+	}
+
+	TraverseSceneAnyHit( data, light.GetPosition(), data->kdTraverseDir, data->kdShadowDist );
+
+	return data->kdTraverseFeeler;	// Return whether ray is free of shadowing objects
+}
+
+// Whether a shadow feeler is needed for the light at visPoint, seen from viewPos:
+//	 false if the light is on the other side of the surface from the viewer.
+//	 Transmissive surfaces are lit from either side.
+bool FacesLight( const VectorR3& viewPos, const VisiblePoint& visPoint, const Light& light )
+{
+	if ( visPoint.GetMaterial().IsTransmissive() ) {
+		return true;
+	}
+	VectorR3 toView = viewPos;
+	toView -= visPoint.GetPosition();		// Direction to *viewer*
+	VectorR3 toLight = light.GetPosition();
+	toLight -= visPoint.GetPosition();		// Direction to light
+	return SameSignNonzero( toView^visPoint.GetNormal(), toLight^visPoint.GetNormal() );
+}
+
+// Whether the light is skipped at position, since it lights it too little
+//	 (see RenderOptions::LightCutoff).  CalcAllDirectIllum() skips the same lights.
+bool LightCulled( const Light& light, const VectorR3& position )
+{
+	return ( SceneLightCutoff>0.0 && !LightTree::MayLight( light, position, SceneLightCutoff ) );
+}
+
+// Traces the camera rays from pos[k] in direction dir[k], for k<numRays.
+//	 With more than one ray, the first hits of the rays are found by one packet 
+//	 traversal of the kd-tree, and the shadow feelers from each light to the 
+//	 first hits by another.  RayTrace() then traces the rest of each ray tree.
+static void traceCameraRays( TraceContext& context, const RenderOptions& options, int numRays,
+							 const VectorR3* pos, const VectorR3* dir, const SampleStream* samples,
+							 VectorR3* returnedColors )
+{
+	double hitDist;
+	if ( numRays==1 ) {
+		RayTrace( context, options, pos[0], dir[0], returnedColors[0], hitDist, samples[0] );
+		return;
+	}
+
+	KdData rayData[KdTree::MaxPacketRays];
+	KdData* rays[KdTree::MaxPacketRays];
+	CameraHit hits[KdTree::MaxPacketRays];
+	int numLights = ActiveScene->NumLights();
+	for ( int k=0; k<numRays; k++ ) {
+		rayData[k].TraverseStack = &context.KdStack;
+		rayData[k].Mailbox = &context.Mailbox;
+		rayData[k].Stats = &context.TraverseStats;
+		startSeekIntersection( &rayData[k], pos[k], dir[k], -1 );
+		rays[k] = &rayData[k];
+	}
+	ObjectKdTree.TraversePacket( rays, numRays, context.PacketStack );
+	for ( int k=0; k<numRays; k++ ) {
+		hits[k].IntersectNum = finishSeekIntersection( &rayData[k], pos[k], dir[k],
+													   &hits[k].HitDist, hits[k].VisPoint, -1 );
+		hits[k].LightsClear = context.LightsClear + k*numLights;
+	}
+
+	// One packet of shadow feelers for each light
+	for ( int lt=0; lt<numLights; lt++ ) {
+		const Light& thisLight = ActiveScene->GetLight(lt);
+		int numFeelers = 0;
+		int feelerRay[KdTree::MaxPacketRays];			// The camera ray of each feeler
+		double feelerDist[KdTree::MaxPacketRays];
+		for ( int k=0; k<numRays; k++ ) {
+			if ( hits[k].IntersectNum<0 ) {
+				continue;
+			}
+			unsigned char& clear = context.LightsClear[k*numLights+lt];
+			if ( !FacesLight( pos[k], hits[k].VisPoint, thisLight )
+					|| LightCulled( thisLight, hits[k].VisPoint.GetPosition() ) ) {
+				clear = 0;
+			}
+			else if ( !startShadowFeeler( &rayData[k], hits[k].VisPoint.GetPosition(), thisLight, hits[k].IntersectNum ) ) {
+				clear = 1;
+			}
+			else {
+				rays[numFeelers] = &rayData[k];
+				feelerRay[numFeelers] = k;
+				feelerDist[numFeelers] = rayData[k].kdShadowDist;
+				numFeelers++;
+			}
+		}
+		if ( numFeelers>0 ) {
+			ObjectKdTree.TraversePacketAnyHit( rays, numFeelers, feelerDist, context.PacketStack );
+		}
+		for ( int f=0; f<numFeelers; f++ ) {
+			context.LightsClear[feelerRay[f]*numLights+lt] = rayData[feelerRay[f]].kdTraverseFeeler ? 1 : 0;
+		}
+	}
+
+	for ( int k=0; k<numRays; k++ ) {
+		RayTrace( context, options, pos[k], dir[k], returnedColors[k], hitDist, samples[k], 1, -1, &hits[k] );
+	}
+}
+
+
+// Ray traces the tree of rays that starts with the ray from pos in direction dir.
+//	 Rather than recursing, the reflected and transmitted rays are pushed on
+//	 context.RayTree, together with the weight that multiplies their color, and are
+//	 traced in turn.  hitDist is set to the distance to the first hit, or to
+//	 DBL_MAX if the first ray hits nothing.
+//
+//	 With options.StochasticRayTree, a hit that both reflects and transmits
+//	 follows only one of the two rays, chosen with probability proportional to
+//	 its weight, and a ray whose weight is below options.RouletteThreshold is
+//	 continued only with probability weight/RouletteThreshold (Russian roulette).
+//	 The weights of the rays that are followed are divided by the probability
+//	 of following them, so the expected color is the same as for the full tree.
+//
+//	 If cameraHit is not null, it is the first hit of the ray, already found
+//	 with the other camera rays of a packet.
+void RayTrace( TraceContext& context, const RenderOptions& options, const VectorR3& pos, const VectorR3 dir,
+			  VectorR3& returnedColor, double& hitDist, const SampleStream& samples,
+			  double eta, long avoidK, const CameraHit* cameraHit )
+{
+	VisiblePoint visPoint;
+	KdData data;
+	data.TraverseStack = &context.KdStack;
+	data.Mailbox = SceneMailbox( context );
+	data.Stats = &context.TraverseStats;
+	VectorR3 directColor;
+	RayTreeStack& workStack = context.RayTree;
+
+	returnedColor.SetZero();
+	hitDist = DBL_MAX;
+
+	workStack.Reset();
+	PendingRay* root = workStack.Push();
+	root->Pos = pos;
+	root->Dir = dir;
+	root->Weight.Set( 1.0, 1.0, 1.0 );
+	root->Translucent = 0.0;
+	root->Eta = eta;
+	root->AvoidK = avoidK;
+	root->TraceDepth = options.TraceDepth;
+	root->Samples = samples;
+	bool isRoot = true;
+
+	while ( !workStack.IsEmpty() ) {
+		PendingRay ray = workStack.Pop();		// A copy, since pushes reuse its slot
+
+		double rayHitDist;
+		long intersectNum;
+		const CameraHit* hit = isRoot ? cameraHit : 0;
+		if ( hit ) {
+			intersectNum = hit->IntersectNum;
+			rayHitDist = hit->HitDist;
+			visPoint = hit->VisPoint;
+		}
+		else {
+			intersectNum = SeekIntersectionKd(&data, ray.Pos, ray.Dir,
+									&rayHitDist, visPoint, ray.AvoidK );
+		}
+		if ( isRoot ) {
+			if ( intersectNum>=0 ) {
+				hitDist = rayHitDist;
+			}
+			isRoot = false;
+		}
+		if ( intersectNum<0 ) {
+			returnedColor += ArrayProd( ray.Weight, ActiveScene->BackgroundColor() );
+			continue;
+		}
+
+		// Attenuation inside a translucent material.  (A ray that leaves the scene is not attenuated.)
+		if ( ray.Translucent > 0.0000001 ) {
+			ray.Weight *= exp(-1 * ray.Translucent * rayHitDist);
+		}
+		CalcAllDirectIllum( &data, ray.Pos, visPoint, directColor, intersectNum, hit ? hit->LightsClear : 0 );
+		returnedColor += ArrayProd( ray.Weight, directColor );
+		if ( ray.TraceDepth <= 1 ) {
+			continue;
+		}
+
+		PendingRay secondary[2];
+		int numSecondary = SpawnSecondaryRays( options, ray, visPoint, intersectNum, secondary );
+		// Transmission is pushed first, so the reflection ray is traced first.
+		for ( int n=numSecondary-1; n>=0; n-- ) {
+			*workStack.Push() = secondary[n];
+		}
+	}
+}
+
+// The reflected and transmitted rays of ray, which hits object intersectNum
+//	 at visPoint: retRays[0] is the reflected ray, if there is one, and the
+//	 transmitted ray follows it.  Returns the number of rays, at most two.
+//	 Used by RayTrace() and by the wavefront tracer (see Wavefront.h).
+int SpawnSecondaryRays( const RenderOptions& options, const PendingRay& ray, const VisiblePoint& visPoint,
+						long intersectNum, PendingRay* retRays )
+{
+	VectorR3 nextDir;
+	const MaterialBase* thisMat = &(visPoint.GetMaterial());
+	const SampleStream& raySamples = ray.Samples;
+
+	// Objects are not nested, so a ray leaving an object goes back into air.
+	double cosIn = ray.Dir^visPoint.GetNormal();
+	bool entering = ( cosIn<0.0 );
+	double outsideEta = entering ? ray.Eta : 1.0;
+	double insideEta = thisMat->GetEta();
+
+	double transmitRate = 1.0, reflectRate = 1.0;
+	bool transAndRef = thisMat->IsReflective() && thisMat->IsTransmissive() &&
+			thisMat->CalcRefractDir(visPoint.GetNormal(), ray.Dir, outsideEta, nextDir);
+	if ( transAndRef && options.FresnelRates ) {
+		if ( entering ) {
+			TransmitAndReflective(fabs(cosIn), outsideEta, insideEta, transmitRate, reflectRate);
+		}
+		else {
+			TransmitAndReflective(fabs(cosIn), insideEta, outsideEta, transmitRate, reflectRate);
+		}
+	}
+
+	// Reflection
+	bool reflect = false;
+	VectorR3 reflectDir, reflectWeight;
+	if ( thisMat->IsReflective() ) {
+		nextDir = visPoint.GetNormal();
+		nextDir *= -2.0*(ray.Dir^visPoint.GetNormal());
+		nextDir += ray.Dir;
+		nextDir.ReNormalize();	// Just in case...
+		double roughness = thisMat->GetRoughness();
+		if(roughness > 0.0000001) {
+			VectorR3 u = (nextDir.x < nextDir.y) ? VectorR3(1,0,0) : VectorR3(0,1,0);
+			u *= nextDir;
+			u.Normalize();
+			VectorR3 v = u * nextDir;
+			v.Normalize();
+			double du, dv;
+			raySamples.Normal2(SAMPLE_DIM_REFLECT_ROUGH, roughness, &du, &dv);
+			nextDir += (u * du + v * dv);
+			nextDir.Normalize();
+		}
+
+		VectorR3 c = thisMat->GetReflectionColor(visPoint, -ray.Dir, nextDir);
+		reflect = true;
+		reflectDir = nextDir;
+		reflectWeight = ArrayProd( ray.Weight, c );
+		if (transAndRef) {
+			reflectWeight *= reflectRate;
+		}
+	}
+
+	// Transmission
+	bool transmit = false;
+	VectorR3 transmitDir, transmitWeight;
+	if ( thisMat->IsTransmissive() ) {
+		if ( thisMat->CalcRefractDir(visPoint.GetNormal(), ray.Dir, outsideEta, nextDir) ) {
+			double roughness = thisMat->GetRoughness();
+			if(roughness > 0.0000001) {
+				VectorR3 u = (nextDir.x < nextDir.y) ? VectorR3(1,0,0) : VectorR3(0,1,0);
+				u *= nextDir;
+				u.Normalize();
+				VectorR3 v = u * nextDir;
+				v.Normalize();
+				double du, dv;
+				raySamples.Normal2(SAMPLE_DIM_XMIT_ROUGH, roughness, &du, &dv);
+				nextDir += (u * du + v * dv);
+				nextDir.Normalize();
+			}
+
+			VectorR3 c = thisMat->GetTransmissionColor(visPoint, -ray.Dir, nextDir);
+			transmit = true;
+			transmitDir = nextDir;
+			transmitWeight = ArrayProd( ray.Weight, c );
+			if (transAndRef) {
+				transmitWeight *= transmitRate;
+			}
+		}
+	}
+
+	if ( options.StochasticRayTree ) {
+		if ( reflect && transmit ) {
+			// Follow one branch, chosen in proportion to the weights
+			double reflectSum = reflectWeight.x + reflectWeight.y + reflectWeight.z;
+			double transmitSum = transmitWeight.x + transmitWeight.y + transmitWeight.z;
+			double reflectProb = reflectSum/(reflectSum+transmitSum);
+			if ( !(reflectSum+transmitSum>0.0) ) {
+				reflect = transmit = false;
+			}
+			else if ( raySamples.Get(SAMPLE_DIM_BRANCH) < reflectProb ) {
+				reflectWeight /= reflectProb;
+				transmit = false;
+			}
+			else {
+				transmitWeight /= (1.0-reflectProb);
+				reflect = false;
+			}
+		}
+		reflect = reflect && RussianRoulette( reflectWeight, options.RouletteThreshold,
+											  raySamples.Get(SAMPLE_DIM_ROULETTE_REFLECT) );
+		transmit = transmit && RussianRoulette( transmitWeight, options.RouletteThreshold,
+												raySamples.Get(SAMPLE_DIM_ROULETTE_XMIT) );
+	}
+	if ( reflect ) {
+		ThreadStats->AddReflectionRay();
+	}
+	if ( transmit ) {
+		ThreadStats->AddXmitRay();
+	}
+
+	int numRays = 0;
+	if ( reflect ) {
+		PendingRay& refl = retRays[numRays++];
+		refl.Pos = visPoint.GetPosition();
+		refl.Dir = reflectDir;
+		refl.Weight = reflectWeight;
+		refl.Translucent = 0.0;
+		refl.Eta = ray.Eta;
+		refl.AvoidK = intersectNum;
+		refl.TraceDepth = ray.TraceDepth-1;
+		refl.Samples = raySamples.Branch(0);
+	}
+	if ( transmit ) {
+		PendingRay& xmit = retRays[numRays++];
+		xmit.Pos = visPoint.GetPosition();
+		xmit.Dir = transmitDir;
+		xmit.Weight = transmitWeight;
+		xmit.Translucent = thisMat->GetTranslucent();
+		xmit.Eta = entering ? insideEta : outsideEta;
+		xmit.AvoidK = intersectNum;
+		xmit.TraceDepth = ray.TraceDepth-1;
+		xmit.Samples = raySamples.Branch(1);
+	}
+	return numRays;
+}
+
+// Russian roulette.  If the largest component of weight is below threshold,
+//	 the ray survives with probability (largest component)/threshold, and its
+//	 weight is divided by that probability.  u is uniform in [0,1).
+//	 Returns true if the ray survives.
+bool RussianRoulette( VectorR3& weight, double threshold, double u )
+{
+	double maxWeight = weight.MaxAbs();
+	if ( maxWeight>=threshold ) {
+		return true;
+	}
+	double survive = maxWeight/threshold;
+	if ( u>=survive ) {
+		return false;
+	}
+	weight /= survive;
+	return true;
+}
+
+// The lights shaded at a point, with the light culling.  Set by CalcAllDirectIllum().
+static thread_local Array<int> ShadedLights;
+
+// If lightsClear is not null, lightsClear[k] tells whether light k reaches
+//	 visPoint, and no shadow feelers are cast.
+//	 With the light culling, only the lights found by SceneLights are shaded.
+//	 The others are left out, with their ambient light.
+void CalcAllDirectIllum( KdData *data, const VectorR3& viewPos,
+						 const VisiblePoint& visPoint, 
+						 VectorR3& returnedColor, long avoidK, const unsigned char* lightsClear )
+{
+	const MaterialBase* thisMat = &(visPoint.GetMaterial());
+	const VectorR3& ambientcolor = thisMat->GetColorAmbient();
+	const VectorR3& ambientlight = ActiveScene->GlobalAmbientLight();
+	const VectorR3& emitted = thisMat->GetColorEmissive();
+	returnedColor.x = ambientcolor.x*ambientlight.x + emitted.x;
+	returnedColor.y = ambientcolor.y*ambientlight.y + emitted.y;
+	returnedColor.z = ambientcolor.z*ambientlight.z + emitted.z;
+
+	VectorR3 thisColor;
+	VectorR3 percentLit;
+	bool clearpath;
+
+	int numLights = ActiveScene->NumLights();
+	bool culling = ( SceneLightCutoff>0.0 );
+	if ( culling ) {
+		SceneLights.GetLights( visPoint.GetPosition(), SceneLightCutoff, ShadedLights );
+		ThreadStats->AddLightsShaded( ShadedLights.SizeUsed(), numLights-ShadedLights.SizeUsed() );
+		numLights = ShadedLights.SizeUsed();
+	}
+	for ( int i=0; i<numLights; i++ ) {
+		int k = culling ? ShadedLights[i] : i;
+		const Light& thisLight = ActiveScene->GetLight(k);
+		if ( lightsClear ) {
+			clearpath = ( lightsClear[k]!=0 );
+		}
+		else {
+			// Cast a shadow feeler if (a) transmissive or (b) light and view on the same side
+			clearpath = FacesLight( viewPos, visPoint, thisLight )
+						&& ShadowFeelerKd(data, visPoint.GetPosition(), thisLight, avoidK );
+		}
+		if ( clearpath ) {
+			percentLit.Set(1.0,1.0,1.0);	// Directly lit, with no shadowing
+		}
+		else {
+			percentLit.SetZero();	// Blocked by shadows (still do ambient lighting)
+		}
+		DirectIlluminateViewPos (visPoint, viewPos,  
+						 thisLight, thisColor, percentLit); 
+		returnedColor.x += thisColor.x;
+		returnedColor.y += thisColor.y;
+		returnedColor.z += thisColor.z;
+	}
+}
+
+// The fractions of the light reflected and transmitted by the surface between
+//	 media with indices of refraction eta1 and eta2, for light coming from
+//	 the eta1 side at an angle with cosine cos1.  They add up to one.
+void TransmitAndReflective(double cos1, double eta1, double eta2, double& transmitRate, double& reflectRate)
+{
+	double cos2, sin1, sin2;
+	sin1 = sqrt(1 - cos1 * cos1);
+	sin2 = eta1 * sin1 / eta2;
+	if ( sin2 >= 1.0 ) {
+		transmitRate = 0.0;		// Total internal reflection
+		reflectRate = 1.0;
+		return;
+	}
+	cos2 = sqrt(1 - sin2 * sin2);
+	double gamma_v, gamma_h;		// Amplitude reflection coefficients
+	gamma_v = (eta2 * cos1 - eta1 * cos2) / (eta2 * cos1 + eta1 * cos2);
+	gamma_h = (eta2 * cos2 - eta1 * cos1) / (eta2 * cos2 + eta1 * cos1);
+
+	// The fractions of the power, for unpolarized light
+	reflectRate  = (gamma_v * gamma_v + gamma_h * gamma_h) / 2;
+	transmitRate = 1.0 - reflectRate;
+}
@@ -0,0 +1,264 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// RayTraceRender.h
+//   The window-independent part of the ray tracer: the active scene,
+//   its kd-tree and BVH, and the routines that ray trace a view into a PixelArray.
+//   Used by both the GLUT viewer (RayTraceKd.cpp) and the headless
+//   batch renderer (RayTraceBatch.cpp).  Nothing here uses OpenGL.
+
+#ifndef RAYTRACE_RENDER_H
+#define RAYTRACE_RENDER_H
+
+#include <atomic>
+
+#include "Sampler.h"
+#include "RayTraceStats.h"
+#include "TileScheduler.h"
+#include "RenderThreadPool.h"
+#include "../DataStructs/KdTree.h"
+#include "../DataStructs/BvhTree.h"
+#include "../DataStructs/Stack.h"
+#include "../VrMath/LinearR3.h"
+
+class CameraView;
+class Light;
+class PixelArray;
+class SceneDescription;
+class VisiblePoint;
+class WavefrontTracer;
+
+// The structure used to find the objects a ray may hit.  Both are
+//   traversed with the same KdData callbacks.
+enum AcceleratorType {
+	ACCEL_KDTREE = 0,		// ObjectKdTree
+	ACCEL_BVH = 1			// ObjectBvh, built the first time it is used
+};
+
+const char* AcceleratorName( AcceleratorType accel );
+bool ParseAccelerator( const char* name, AcceleratorType* accel );
+
+// *******************************************************************
+// RenderOptions holds the settings for one ray traced frame.
+// *******************************************************************
+
+class RenderOptions {
+public:
+	RenderOptions();
+
+	long SamplesPerPixel;	// Number of rays cast through each pixel.  The maximum, if Adaptive.
+	SamplerType SamplePattern;	// How the rays are spread over the pixel, the lens and the ray tree
+	unsigned long SampleSeed;	// Seed for the sampler's randomization
+	int TraceDepth;			// Maximum depth of the ray tree (1 = no reflection/transmission)
+	double FocalLength;		// Focal length for depth of field
+	double Aperture;		// Width of the lens.  Zero for a pinhole camera.
+	int NumThreads;			// Number of render threads.  Zero means one per hardware thread.
+	bool PersistentThreads;	// Render with the threads of RenderThreads, kept between frames,
+							//   instead of starting new threads for each pass
+	bool PinThreads;		// With PersistentThreads, pin each render thread to its own CPU
+	int TileSize;			// Threads render square tiles of TileSize x TileSize pixels
+	TileOrderType TileOrder;	// Order in which tiles are handed out
+	AcceleratorType Accelerator;	// Kd-tree or BVH
+	bool LeafBatch;			// Test the triangles and spheres of a leaf together, with SIMD (see LeafBatch.h)
+	int PacketSize;			// Camera rays of a pixel traced together through the kd-tree, with their
+							//   shadow feelers (see KdTree::TraversePacket).  1 for one at a time, the default:
+							//   packets pay off only for coherent rays, e.g., with a pinhole camera.
+	long WavefrontRays;		// If positive, the camera rays of a tile are traced in batches of this
+							//   many rays, stage by stage (see Wavefront.h).  Zero to trace each ray in turn.
+	bool SortSecondaryRays;	// In wavefront mode, sort the reflected and transmitted rays by direction
+							//   and origin before they are traced
+
+	// Ray tree (see RayTrace() in RayTraceRender.cpp)
+	bool StochasticRayTree;		// Follow one of reflection and transmission, and use Russian roulette
+	double RouletteThreshold;	// Russian roulette for rays whose weight is below this
+	bool FresnelRates;			// Split light between reflection and transmission by the Fresnel equations
+
+	// Adaptive sampling (see RayTracePixels() in RayTraceRender.cpp)
+	bool Adaptive;				// Cast more rays only through the pixels that need them
+	long AdaptiveMinSamples;	// Rays per pixel in the first pass, and per refinement step
+	double AdaptiveThreshold;	// Refine until the standard error of the pixel color is below this
+	double AdaptiveContrast;	// Pixels differing this much from a neighbour get extra rays
+
+	// Progressive rendering (see RayTracePixels() in RayTraceRender.cpp)
+	bool Progressive;			// Render a coarse image first, then refine it in passes
+	int PreviewStride;			// The first pass traces one pixel in PreviewStride x PreviewStride
+	double TimeBudget;			// If positive, the refinement passes stop this many seconds after
+								//   the render starts (see RayTracePixels() in RayTraceRender.cpp)
+
+	double LightCutoff;			// If positive, each point is shaded only by the lights that may light it
+								//   by at least this much, found with a light tree (see LightTree.h)
+
+	int GetNumThreads() const;
+};
+
+// A ray waiting to be traced by RayTrace(), which evaluates the tree of
+//   reflected and transmitted rays with a stack instead of by recursion.
+class PendingRay {
+public:
+	VectorR3 Pos;			// Start of the ray
+	VectorR3 Dir;			// Direction (unit vector)
+	VectorR3 Weight;		// The color seen by the ray is multiplied by Weight
+	double Translucent;		// If positive, Weight is also multiplied by exp(-Translucent*hitDist)
+	double Eta;				// Index of refraction of the medium the ray travels in
+	long AvoidK;			// Object the ray starts on
+	int TraceDepth;			// Remaining depth of the ray tree
+	SampleStream Samples;
+};
+
+// Holds at most TraceDepth+1 rays at a time.
+typedef Stack<PendingRay> RayTreeStack;
+
+// The first hit of a camera ray, found with the other rays of its packet.
+//   RayTrace() starts from it instead of tracing the camera ray.
+class CameraHit {
+public:
+	long IntersectNum;			// The object hit, or -1 for none
+	double HitDist;
+	VisiblePoint VisPoint;
+	const unsigned char* LightsClear;	// LightsClear[k] is 1 if light k reaches VisPoint
+};
+
+// Work space owned by a single render thread.  It is allocated once,
+//   so that tracing a ray does not allocate memory.
+class TraceContext {
+public:
+	TraceContext( int traceDepth, const KdTree& kdTree, const BvhTree& bvh );
+	~TraceContext() { delete[] LightsClear; }
+
+	RayTreeStack RayTree;		// Rays waiting to be traced by RayTrace()
+	KdTraverseStack KdStack;	// Nodes waiting to be traversed by KdTree::Traverse() or BvhTree::Traverse()
+	KdPacketStack PacketStack;	// Nodes waiting to be traversed by KdTree::TraversePacket()
+	KdMailbox Mailbox;			// Objects already tested against the current ray (kd-tree only)
+	unsigned char* LightsClear;	// Which lights reach the first hits of a packet, for each ray
+	WavefrontTracer* Wavefront;	// Set by the render thread in wavefront mode, otherwise null
+	RayTraceStats Stats;		// The thread's statistics, added to MyStats at the end of each pass
+	KdTraverseStats TraverseStats;	// The thread's kd-tree or BVH traversals, likewise
+
+private:
+	TraceContext( const TraceContext& );			// Not copyable
+	TraceContext& operator=( const TraceContext& );
+};
+
+// Lets another thread stop a render.  RayTracePixels() checks it before
+//   each tile, and once it is set returns without finishing the image.
+class RenderCancelToken {
+public:
+	RenderCancelToken() : Cancelled(false) {}
+
+	void Cancel() { Cancelled.store( true ); }
+	void Reset() { Cancelled.store( false ); }
+	bool IsCancelled() const { return Cancelled.load( std::memory_order_relaxed ); }
+
+private:
+	std::atomic<bool> Cancelled;
+};
+
+// The scene being rendered, its kd-tree and its BVH
+extern SceneDescription* ActiveScene;
+extern KdTree ObjectKdTree;
+extern BvhTree ObjectBvh;
+
+// ***********************Statistics************
+extern RayTraceStats MyStats;
+// The statistics of the calling thread: its TraceContext's Stats in
+//	 a render thread, and MyStats in any other thread.
+extern thread_local RayTraceStats* ThreadStats;
+extern TileScheduler RenderTiles;		// Also reports how the work was spread over threads
+extern RenderThreadPool RenderThreads;	// The render threads, if options.PersistentThreads
+// **********************************************
+
+// Load an .nff or .obj file into ActiveScene.  A null sceneFile loads the
+//   built-in scene of RayTraceSetup2.cpp.  Returns false if the file could not be loaded.
+bool LoadActiveScene( const char* sceneFile );
+// Size the camera of ActiveScene to the pixel array.
+void FitCameraToPixels( const PixelArray& pixels );
+// Give the positional lights of ActiveScene the attenuation 1/(1+quadratic*d*d),
+//   at distance d.  (.nff files cannot give lights attenuation.)
+void AttenuateSceneLights( double quadratic );
+
+// Build ObjectKdTree for the viewables in ActiveScene.
+void myBuildKdTree();
+// Build ObjectBvh for the viewables in ActiveScene.
+void myBuildBvh();
+
+// Ray trace the whole view into the pixel array.
+//   The camera view must already have been sized to match the pixel array.
+//   If sampleMap is not null, it gets the number of rays cast through each pixel,
+//   as a fraction of options.SamplesPerPixel.
+//   With options.Progressive, progress is called after each pass but the last, with
+//   the image so far.  stride is 1 once every pixel has been traced, and
+//   samplesPerPixel is the number of rays cast through each pixel so far
+//   (through the traced pixels, if stride>1).
+//   If cancel is not null, the render stops soon after cancel->Cancel() is called.
+//   Returns false if it was cancelled, and the image is then not finished.
+typedef void RenderProgressCallback( const PixelArray& pixels, int stride, long samplesPerPixel );
+bool RayTracePixels( PixelArray& pixels, const CameraView& view, const RenderOptions& options,
+					 PixelArray* sampleMap = 0, RenderProgressCallback* progress = 0,
+					 const RenderCancelToken* cancel = 0 );
+
+long SeekIntersectionKd(KdData *data, const VectorR3& startPos, const VectorR3& direction,
+										double *hitDist, VisiblePoint& returnedPoint,
+										long avoidK = -1);
+bool ShadowFeelerKd(KdData *data, const VectorR3& pos, const Light& light, long intersectNum=-1 );
+void RayTrace( TraceContext& context, const RenderOptions& options, const VectorR3& pos, const VectorR3 dir,
+			  VectorR3& returnedColor, double& hitDist, const SampleStream& samples,
+			  double eta = 1, long avoidK = -1, const CameraHit* cameraHit = 0 );
+void CalcAllDirectIllum( KdData *data, const VectorR3& viewPos, const VisiblePoint& visPoint,
+						VectorR3& returnedColor, long avoidK = -1, const unsigned char* lightsClear = 0 );
+bool FacesLight( const VectorR3& viewPos, const VisiblePoint& visPoint, const Light& light );
+bool LightCulled( const Light& light, const VectorR3& position );
+int SpawnSecondaryRays( const RenderOptions& options, const PendingRay& ray, const VisiblePoint& visPoint,
+						long intersectNum, PendingRay* retRays );
+KdMailbox* SceneMailbox( TraceContext& context );
+bool RussianRoulette( VectorR3& weight, double threshold, double u );
+void TransmitAndReflective(double cos1, double eta1, double eta2, double& transmitRate, double& reflectRate);
+
+inline RenderOptions::RenderOptions()
+{
+	SamplesPerPixel = 16;
+	SamplePattern = SAMPLER_STRATIFIED;
+	SampleSeed = 0;
+	TraceDepth = 3;
+	FocalLength = 350;
+	Aperture = 0.2;
+	NumThreads = 0;
+	PersistentThreads = true;
+	PinThreads = false;
+	TileSize = 16;
+	TileOrder = TILE_ORDER_HILBERT;
+	Accelerator = ACCEL_KDTREE;
+	LeafBatch = true;
+	PacketSize = 1;
+	WavefrontRays = 0;
+	SortSecondaryRays = false;
+	StochasticRayTree = false;
+	RouletteThreshold = 0.05;
+	FresnelRates = false;
+	Adaptive = false;
+	AdaptiveMinSamples = 4;
+	AdaptiveThreshold = 0.01;
+	AdaptiveContrast = 0.1;
+	Progressive = false;
+	PreviewStride = 8;
+	TimeBudget = 0.0;
+	LightCutoff = 0.0;
+}
+
+#endif // RAYTRACE_RENDER_H
@@ -21,50 +21,188 @@
 // RayTraceStats.cpp
 // Ray Trace Statistics
 
+#include <math.h>
+
 #include "RayTraceStats.h"
 #include "../DataStructs/Stack.h"
 #include "../DataStructs/KdTree.h"
+#include "../DataStructs/BvhTree.h"
 
 void RayTraceStats::Init()
 {
+	NumberPixels = 0;
+	NumberCameraRays = 0;
 	NumberRaysTraced = 0;
 	NumberReflectionRays = 0;
 	NumberXmitRays = 0;
 	NumberShadowFeelers = 0;
 	NumberIsectTests = 0;
 	NumberSuccessIsectTests = 0;
+	NumberShadedPoints = 0;
+	NumberLightsShaded = 0;
+	NumberLightsSkipped = 0;
 
+	RunDataFromBvh = false;
 	NumberKdNodesTraversed = 0;
 	NumberKdLeavesTraversed = 0;
 	NumberKdObjectsInLeaves = 0;
+	NumberKdStackAllocations = 0;
+	NumberMailboxSkips = 0;
+	NumberPacketRays = 0;
+	NumberPacketSteps = 0;
+	NumberPacketRaySteps = 0;
+
+	PixelNanoseconds.Reset();
+	PixelRays.Reset();
+}
+
+void RayTraceStats::Add( const RayTraceStats& other )
+{
+	NumberPixels += other.NumberPixels;
+	NumberCameraRays += other.NumberCameraRays;
+	NumberRaysTraced += other.NumberRaysTraced;
+	NumberReflectionRays += other.NumberReflectionRays;
+	NumberXmitRays += other.NumberXmitRays;
+	NumberShadowFeelers += other.NumberShadowFeelers;
+	NumberIsectTests += other.NumberIsectTests;
+	NumberSuccessIsectTests += other.NumberSuccessIsectTests;
+	NumberShadedPoints += other.NumberShadedPoints;
+	NumberLightsShaded += other.NumberLightsShaded;
+	NumberLightsSkipped += other.NumberLightsSkipped;
+	NumberMailboxSkips += other.NumberMailboxSkips;
+	PixelNanoseconds.Merge( other.PixelNanoseconds );
+	PixelRays.Merge( other.PixelRays );
+}
 
+void StatsHistogram::Reset()
+{
+	for ( int i=0; i<NumBuckets; i++ ) {
+		Buckets[i] = 0;
+	}
+	NumValues = 0;
+	SumValues = 0;
+	MaxValue = 0;
+}
+
+void StatsHistogram::Merge( const StatsHistogram& other )
+{
+	for ( int i=0; i<NumBuckets; i++ ) {
+		Buckets[i] += other.Buckets[i];
+	}
+	NumValues += other.NumValues;
+	SumValues += other.SumValues;
+	if ( other.MaxValue>MaxValue ) {
+		MaxValue = other.MaxValue;
+	}
+}
+
+unsigned long long StatsHistogram::Percentile( double p ) const
+{
+	if ( NumValues==0 ) {
+		return 0;
+	}
+	if ( p>=1.0 ) {
+		return MaxValue;
+	}
+	// The value at place ceil(p*NumValues), counting from 1
+	long long place = (long long)ceil( p*(double)NumValues );
+	if ( place<1 ) {
+		place = 1;
+	}
+	long long numBelow = 0;
+	for ( int i=0; i<NumBuckets; i++ ) {
+		numBelow += Buckets[i];
+		if ( numBelow>=place ) {
+			return BucketMin( i );
+		}
+	}
+	return MaxValue;
+}
+
+// Prints the mean, median, 99th percentile and maximum, times scale.
+void RayTraceStats::PrintHistogram( FILE* out, const char* name, const StatsHistogram& hist, double scale )
+{
+	fprintf( out, "  %s: mean, %0.3lf.  p50, %0.3lf.  p99, %0.3lf.  max, %0.3lf.\n", name,
+				scale*hist.Mean(), scale*(double)hist.Percentile(0.5),
+				scale*(double)hist.Percentile(0.99), scale*(double)hist.Max() );
 }
 
 void RayTraceStats::GetKdRunData( const KdTree& kdTree )
 {
 	kdTree.Stats_GetAll( &NumberKdNodesTraversed, &NumberKdLeavesTraversed, &NumberKdObjectsInLeaves );
+	NumberKdStackAllocations = kdTree.Stats_GetStackAllocations();
+	kdTree.Stats_GetPacketData( &NumberPacketRays, &NumberPacketSteps, &NumberPacketRaySteps );
+	RunDataFromBvh = false;
+}
+
+void RayTraceStats::GetBvhRunData( const BvhTree& bvh )
+{
+	bvh.Stats_GetAll( &NumberKdNodesTraversed, &NumberKdLeavesTraversed, &NumberKdObjectsInLeaves );
+	NumberKdStackAllocations = bvh.Stats_GetStackAllocations();
+	NumberPacketRays = NumberPacketSteps = NumberPacketRaySteps = 0;
+	RunDataFromBvh = true;
 }
 
 void RayTraceStats::PrintStats( FILE* out )
 {
 #if TrackRaysTraced
 	fprintf( out, "Run time statistics:\n");
+	fprintf( out, "  Number of camera rays = %ld.  Per pixel, %0.3lf.\n", NumberCameraRays,
+				NumberPixels>0 ? (double)NumberCameraRays/(double)NumberPixels : 0.0 );
 	fprintf( out, "  Number of rays traced = %ld.\n", NumberRaysTraced );
 #endif
+#if TrackReflectionRays
+	fprintf( out, "  Number of reflection rays = %ld.\n", NumberReflectionRays );
+#endif
+#if TrackXmitRays
+	fprintf( out, "  Number of transmission rays = %ld.\n", NumberXmitRays );
+#endif
 #if TrackShadowFeelers
 	fprintf( out, "  Number of shadow feelers = %ld.\n", NumberShadowFeelers );
 #endif
+#if TrackLightCulling
+	if ( NumberLightsSkipped>0 ) {
+		long numLights = NumberLightsShaded+NumberLightsSkipped;
+		fprintf( out, "  Light culling: lights skipped, %ld (%0.2lf%%).  Lights shaded per point, %0.3lf.\n",
+					NumberLightsSkipped, 100.0*(double)NumberLightsSkipped/(double)numLights,
+					(double)NumberLightsShaded/(double)NumberShadedPoints );
+	}
+#endif
 #if TrackKdTraversal
-	fprintf( out, "  KdTree: Nodes traversed, %ld.  Non-empty leaves traversed, %ld.\n", 
-				NumberKdNodesTraversed, NumberKdLeavesTraversed );
+	const char* treeName = RunDataFromBvh ? "BVH" : "Kd";
+	fprintf( out, "  %s: Nodes traversed, %ld.  Non-empty leaves traversed, %ld.\n", 
+				RunDataFromBvh ? "BVH" : "KdTree", NumberKdNodesTraversed, NumberKdLeavesTraversed );
 	fprintf( out, "          Objects tested, %ld.  Mean number per leaf, %0.6lf.\n", 
 				NumberKdObjectsInLeaves, 
 				(double)NumberKdObjectsInLeaves/(double)NumberKdLeavesTraversed );
 	double numRays = NumberRaysTraced;
-	fprintf( out, "  Kd per ray: Nodes, %0.6lf. Leaves, %0.6lf. Objects, %lf.\n",
-				(double)NumberKdNodesTraversed/numRays, 
+	fprintf( out, "  %s per ray: Nodes, %0.6lf. Leaves, %0.6lf. Objects, %lf.\n",
+				treeName, (double)NumberKdNodesTraversed/numRays, 
 				(double)NumberKdLeavesTraversed/numRays,
 				(double)NumberKdObjectsInLeaves/numRays );
+	fprintf( out, "  %s traversal stack allocations, %ld.  Per ray, %0.6lf.\n",
+				treeName, NumberKdStackAllocations, (double)NumberKdStackAllocations/numRays );
+	if ( NumberPacketRays>0 ) {
+		// A step of a packet replaces one step of each of its active rays.
+		fprintf( out, "  Packets: rays traversed in packets, %ld (%0.2lf%%).  Active rays per step, %0.6lf.\n",
+					NumberPacketRays, 100.0*(double)NumberPacketRays/numRays,
+					(double)NumberPacketRaySteps/(double)NumberPacketSteps );
+		fprintf( out, "          Traversal steps saved, %ld.  Per packet ray, %0.6lf.\n",
+					NumberPacketRaySteps-NumberPacketSteps,
+					(double)(NumberPacketRaySteps-NumberPacketSteps)/(double)NumberPacketRays );
+	}
+#endif
+#if TrackMailboxSkips
+	if ( !RunDataFromBvh ) {
+		fprintf( out, "  Mailbox: repeated object tests skipped, %ld.  Per ray, %0.6lf.\n",
+					NumberMailboxSkips, (double)NumberMailboxSkips/(double)NumberRaysTraced );
+	}
+#endif
+#if TrackPixelHistograms
+	if ( PixelNanoseconds.Count()>0 ) {
+		PrintHistogram( out, "Pixel time (us)", PixelNanoseconds, 1.0e-3 );
+		PrintHistogram( out, "Rays per pixel", PixelRays, 1.0 );
+	}
 #endif
 }
 
@@ -128,6 +266,22 @@ void RayTraceStats::PrintKdStats( const KdTree& kdTree, FILE* out )
 	fprintf( out, "       Depth: %ld.\n", maxDepth);
 	fprintf( out, "       Mean depths: All nodes, %.5lf.  Leaf nodes, %.5lf.\n", 
 					(double)sumNodeDepths/(double)(numNodes), (double)sumLeafDepths/(double)(numLeaves) );
+	fprintf( out, "       Build time: %.3lf(s), %d threads.\n", 
+					kdTree.GetBuildSeconds(), kdTree.GetBuildThreadsUsed() );
 #endif
 
 }
+
+void RayTraceStats::PrintBvhStats( const BvhTree& bvh, FILE* out )
+{
+#if TrackKdProperties
+	fprintf( out, "BVH statistics:\n");
+	fprintf( out, "       Number of objects: %ld.\n", bvh.NumObjects );
+	fprintf( out, "       Number of nodes: %ld, with %d children each.\n", bvh.GetNumNodes(), BvhTree::NodeWidth );
+	fprintf( out, "       Number of leaves: %ld.  Average objects per leaf: %.5lf.\n",
+						bvh.GetNumLeaves(), (double)bvh.GetNumLeafEntries()/(double)Max(bvh.GetNumLeaves(),1L) );
+	fprintf( out, "       Depth: %ld.\n", bvh.GetMaxDepth() );
+	fprintf( out, "       Memory: %ld bytes.  %d bytes per node.\n", bvh.GetMemoryBytes(), (int)sizeof(BvhNode) );
+	fprintf( out, "       Build time: %.3lf(s).\n", bvh.GetBuildSeconds() );
+#endif
+}
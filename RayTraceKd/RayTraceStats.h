@@ -22,9 +22,12 @@
 // RayTraceStats.h
 //  A class for maintaining statistics about ray tracing
 
+#ifndef RAYTRACESTATS_H
+#define RAYTRACESTATS_H
 
 #include <stdio.h>
 class KdTree;
+class BvhTree;
 
 #define TrackRaysTraced 1
 #define TrackReflectionRays 1
@@ -34,7 +37,43 @@ class KdTree;
 #define TrackSuccessIsectTests 1
 #define TrackKdProperties 1
 #define TrackKdTraversal 1
+#define TrackMailboxSkips 1
+#define TrackPixelHistograms 1
+#define TrackLightCulling 1
 
+// A histogram of non-negative values, with buckets of logarithmic width:
+//	 values below 8 have a bucket each, and larger values have four buckets
+//	 for each power of two.  Percentiles are thus found to within 25%.
+class StatsHistogram
+{
+public:
+	StatsHistogram() { Reset(); }
+
+	void Reset();
+	void Add( unsigned long long value );
+	void Merge( const StatsHistogram& other );
+
+	long long Count() const { return NumValues; }
+	unsigned long long Max() const { return MaxValue; }
+	double Mean() const { return NumValues>0 ? (double)SumValues/(double)NumValues : 0.0; }
+	// The smallest value of the bucket holding the p-th fraction of the values,
+	//	 0<=p<=1.  Percentile(1.0) is the maximum.
+	unsigned long long Percentile( double p ) const;
+
+	static const int NumBuckets = 256;
+
+private:
+	long long Buckets[NumBuckets];
+	long long NumValues;
+	unsigned long long SumValues;
+	unsigned long long MaxValue;
+
+	static int BucketOf( unsigned long long value );
+	static unsigned long long BucketMin( int bucket );
+};
+
+// Render threads each keep their own RayTraceStats, with no locking,
+//	 and add them to MyStats with Add() when they are done.
 class RayTraceStats
 {
 public:
@@ -45,6 +84,10 @@ public:
 
 	void PrintStats( FILE* out = stdout );
 
+	long GetNumRaysTraced() const { return NumberRaysTraced; }
+
+	void SetNumPixels( long numPixels ) { NumberPixels = numPixels; }
+	void AddCameraRays( long numRays ) { NumberCameraRays += numRays; }
 	void AddRayTraced();
 	void AddReflectionRay();
 	void AddXmitRay();
@@ -55,26 +98,92 @@ public:
 	void AddKdNodeTraversed();
 	void AddKdLeavesTraversed();
 	void AddKdObjectsInLeavesTraversed( int numObjects = 1 );
+	void AddMailboxSkips( long numSkipped );
+	// The lights shaded at a point, and those skipped by the light culling
+	void AddLightsShaded( long numShaded, long numSkipped );
+	long GetNumShadedPoints() const { return NumberShadedPoints; }
+	long GetNumLightsShaded() const { return NumberLightsShaded; }
+	// The time taken by one pixel over all passes, and the number of rays traced for it
+	void AddPixel( unsigned long long nanoseconds, long numRays );
+
+	// Adds the counts of the other stats, except the kd-tree and BVH data
+	void Add( const RayTraceStats& other );
 
 public:
 	void GetKdRunData( const KdTree& kdTree );
+	void GetBvhRunData( const BvhTree& bvh );
 	static void PrintKdStats( const KdTree& kdTree, FILE* out = stdout );
+	static void PrintBvhStats( const BvhTree& bvh, FILE* out = stdout );
 
 private:
+	long NumberPixels;
+	long NumberCameraRays;
 	long NumberRaysTraced;
 	long NumberReflectionRays;
 	long NumberXmitRays;
 	long NumberShadowFeelers;
 	long NumberIsectTests;
 	long NumberSuccessIsectTests;
+	long NumberShadedPoints;			// Points whose direct illumination was found
+	long NumberLightsShaded;
+	long NumberLightsSkipped;			// Lights skipped by the light culling
 
-	// KdTree operations
+	// KdTree operations, or BVH operations if RunDataFromBvh
+	bool RunDataFromBvh;
 	long NumberKdNodesTraversed;
 	long NumberKdLeavesTraversed;
 	long NumberKdObjectsInLeaves;
+	long NumberKdStackAllocations;		// Traversals that allocated memory for their stack
+	long NumberMailboxSkips;			// Repeated tests of an object against a ray that were skipped
+	long NumberPacketRays;				// Rays traversed in packets (kd-tree only)
+	long NumberPacketSteps;				// Nodes and leaves visited by the packets
+	long NumberPacketRaySteps;			// The same, counted once for each ray of the packet
 
+	StatsHistogram PixelNanoseconds;	// Time taken by each pixel
+	StatsHistogram PixelRays;			// Rays traced for each pixel, including shadow feelers
+
+	static void PrintHistogram( FILE* out, const char* name, const StatsHistogram& hist, double scale );
 };
 
+inline void StatsHistogram::Add( unsigned long long value )
+{
+	Buckets[BucketOf(value)]++;
+	NumValues++;
+	SumValues += value;
+	if ( value>MaxValue ) {
+		MaxValue = value;
+	}
+}
+
+// Bucket 8+4*(e-3)+m holds the values whose highest bit is bit e
+//	 and whose next two bits are m.
+inline int StatsHistogram::BucketOf( unsigned long long value )
+{
+	if ( value<8 ) {
+		return (int)value;
+	}
+	int e = 63 - __builtin_clzll( value );
+	return 8 + 4*(e-3) + (int)((value>>(e-2))&3);
+}
+
+inline unsigned long long StatsHistogram::BucketMin( int bucket )
+{
+	if ( bucket<8 ) {
+		return (unsigned long long)bucket;
+	}
+	int e = 3 + (bucket-8)/4;
+	unsigned long long m = (unsigned long long)((bucket-8)%4);
+	return (4+m) << (e-2);
+}
+
+inline void RayTraceStats::AddPixel( unsigned long long nanoseconds, long numRays )
+{
+#if TrackPixelHistograms
+	PixelNanoseconds.Add( nanoseconds );
+	PixelRays.Add( (unsigned long long)numRays );
+#endif
+}
+
 inline void RayTraceStats::AddRayTraced()
 {
 #if TrackRaysTraced
@@ -117,6 +226,22 @@ inline void RayTraceStats::AddSuccessIsectTest()
 #endif
 }
 
+inline void RayTraceStats::AddMailboxSkips( long numSkipped )
+{
+#if TrackMailboxSkips
+	NumberMailboxSkips += numSkipped;
+#endif
+}
+
+inline void RayTraceStats::AddLightsShaded( long numShaded, long numSkipped )
+{
+#if TrackLightCulling
+	NumberShadedPoints++;
+	NumberLightsShaded += numShaded;
+	NumberLightsSkipped += numSkipped;
+#endif
+}
+
 inline void RayTraceStats::AddKdNodeTraversed()
 {
 #if TrackKdTraversals
@@ -137,3 +262,5 @@ inline void RayTraceStats::AddKdObjectsInLeavesTraversed( int numObjects )
 	NumberKdNodesTraversed += numObjects;
 #endif
 }
+
+#endif // RAYTRACESTATS_H
@@ -0,0 +1,105 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// RayTraceTest.cpp
+//   Checks of the ray tracer's routines that can be tested by themselves.
+//   Prints each failed check, and returns nonzero if any fail.
+
+#include <stdio.h>
+#include <math.h>
+
+#include "RayTraceRender.h"
+#include "TileScheduler.h"
+
+static int NumFailed = 0;
+
+static void Check( bool ok, const char* what )
+{
+	if ( !ok ) {
+		fprintf( stderr, "FAILED: %s\n", what );
+		NumFailed++;
+	}
+}
+
+// TransmitAndReflective() gives the power fractions of the Fresnel equations.
+static void TestFresnel()
+{
+	double transmitRate, reflectRate;
+
+	// Air to glass at normal incidence: ((1.5-1)/(1.5+1))^2 = 0.04
+	TransmitAndReflective( 1.0, 1.0, 1.5, transmitRate, reflectRate );
+	Check( fabs(reflectRate-0.04)<1.0e-12, "air to glass at normal incidence reflects 0.04" );
+	Check( transmitRate+reflectRate==1.0, "air to glass at normal incidence conserves light" );
+
+	// Glass to air at normal incidence reflects the same
+	TransmitAndReflective( 1.0, 1.5, 1.0, transmitRate, reflectRate );
+	Check( fabs(reflectRate-0.04)<1.0e-12, "glass to air at normal incidence reflects 0.04" );
+
+	for ( int i=1; i<=10; i++ ) {
+		double cos1 = 0.1*(double)i;
+		TransmitAndReflective( cos1, 1.0, 1.5, transmitRate, reflectRate );
+		Check( transmitRate+reflectRate==1.0 && 0.0<=reflectRate && reflectRate<=1.0,
+			   "air to glass conserves light at every angle" );
+		TransmitAndReflective( cos1, 1.5, 1.0, transmitRate, reflectRate );
+		Check( transmitRate+reflectRate==1.0 && 0.0<=transmitRate && transmitRate<=1.0,
+			   "glass to air conserves light at every angle" );
+	}
+
+	// Beyond the critical angle, asin(1/1.5), everything is reflected
+	TransmitAndReflective( 0.5, 1.5, 1.0, transmitRate, reflectRate );
+	Check( reflectRate==1.0 && transmitRate==0.0, "glass to air beyond the critical angle is total internal reflection" );
+}
+
+// Once the tile costs of a frame are known, every queue of the next frame
+//	 starts with one of the numThreads most expensive tiles.
+static void TestTileOrder( int width, int height, int tileSize, int numThreads )
+{
+	TileScheduler scheduler;
+	PixelTile tile;
+
+	// A first frame, with made up costs that are all different
+	scheduler.Init( width, height, tileSize, TILE_ORDER_HILBERT, numThreads );
+	long numTiles = scheduler.NumTiles();
+	while ( scheduler.GetNextTile( 0, tile ) ) {
+		scheduler.TileDone( 0, tile, (double)((tile.Index*37)%numTiles) );
+	}
+
+	scheduler.Init( width, height, tileSize, TILE_ORDER_HILBERT, numThreads );
+	for ( int t=0; t<numThreads && t<numTiles; t++ ) {
+		bool gotTile = scheduler.GetNextTile( t, tile );
+		Check( gotTile, "every queue has a tile" );
+		long rank = numTiles-1-(tile.Index*37)%numTiles;	// Zero for the most expensive
+		Check( gotTile && rank<numThreads, "every queue starts with one of the most expensive tiles" );
+	}
+}
+
+int main( int argc, char** argv )
+{
+	TestFresnel();
+	TestTileOrder( 5, 2, 1, 4 );		// 10 tiles, 4 threads
+	TestTileOrder( 12, 8, 1, 64 );		// 96 tiles, 64 threads
+	TestTileOrder( 640, 480, 32, 8 );
+	if ( NumFailed>0 ) {
+		fprintf( stderr, "%d checks failed.\n", NumFailed );
+		return 1;
+	}
+	fprintf( stdout, "All checks passed.\n" );
+	return 0;
+}
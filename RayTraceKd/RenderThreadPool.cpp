@@ -0,0 +1,168 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// RenderThreadPool.cpp
+//   Render threads kept from one frame to the next.  See RenderThreadPool.h.
+
+#include <assert.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "RenderThreadPool.h"
+
+using namespace std;
+
+#ifdef __linux__
+// The CPUs the process could run on when it started, which pinned
+//	 threads are spread over and unpinned threads are returned to.
+static cpu_set_t* ProcessCpus()
+{
+	static cpu_set_t cpus;
+	static bool haveCpus = false;
+	if ( !haveCpus ) {
+		CPU_ZERO( &cpus );
+		if ( sched_getaffinity( 0, sizeof(cpus), &cpus )!=0 ) {
+			CPU_ZERO( &cpus );
+		}
+		haveCpus = true;
+	}
+	return &cpus;
+}
+#endif
+
+RenderThreadPool::RenderThreadPool()
+{
+	Job = 0;
+	JobThreads = 0;
+	PinJob = false;
+	JobNumber = 0;
+	NumRunning = 0;
+	Stopping = false;
+#ifdef __linux__
+	ProcessCpus();			// Before any thread is pinned
+#endif
+}
+
+RenderThreadPool::~RenderThreadPool()
+{
+	{
+		unique_lock<mutex> lock( Lock );
+		Stopping = true;
+	}
+	JobReady.notify_all();
+	for ( thread& t : Threads ) {
+		t.join();
+	}
+}
+
+bool RenderThreadPool::CanPinThreads()
+{
+#ifdef __linux__
+	return CPU_COUNT( ProcessCpus() )>0;
+#else
+	return false;
+#endif
+}
+
+void RenderThreadPool::Start( int numThreads )
+{
+	unique_lock<mutex> lock( Lock );
+	while ( (int)Threads.size()<numThreads ) {
+		int threadNum = (int)Threads.size();
+		ThreadPinned.push_back( false );
+		// The new thread waits for the next job
+		Threads.push_back( thread( &RenderThreadPool::WorkerLoop, this, threadNum, JobNumber ) );
+	}
+}
+
+void RenderThreadPool::Run( int numThreads, bool pinThreads, const function<void(int)>& job )
+{
+	assert( numThreads>0 );
+	Start( numThreads );
+	unique_lock<mutex> lock( Lock );
+	Job = &job;
+	JobThreads = numThreads;
+	PinJob = pinThreads;
+	NumRunning = numThreads;
+	JobNumber++;
+	JobReady.notify_all();
+	JobDone.wait( lock, [this]{ return NumRunning==0; } );
+	Job = 0;
+}
+
+void RenderThreadPool::WorkerLoop( int threadNum, long lastJob )
+{
+	unique_lock<mutex> lock( Lock );
+	while ( true ) {
+		JobReady.wait( lock, [this,lastJob]{ return Stopping || JobNumber!=lastJob; } );
+		if ( Stopping ) {
+			return;
+		}
+		lastJob = JobNumber;
+		if ( threadNum>=JobThreads ) {
+			continue;
+		}
+		const function<void(int)>& job = *Job;
+		bool pin = PinJob;
+		lock.unlock();
+		if ( pin!=(ThreadPinned[threadNum]!=0) ) {
+			SetPinned( threadNum, pin );
+		}
+		job( threadNum );
+		lock.lock();
+		if ( --NumRunning==0 ) {
+			JobDone.notify_one();
+		}
+	}
+}
+
+// Pins the calling thread, number threadNum, to its CPU, or lets it run on any.
+void RenderThreadPool::SetPinned( int threadNum, bool pin )
+{
+#ifdef __linux__
+	cpu_set_t* processCpus = ProcessCpus();
+	int numCpus = CPU_COUNT( processCpus );
+	if ( numCpus==0 ) {
+		return;
+	}
+	cpu_set_t cpus;
+	if ( pin ) {
+		// The (threadNum mod numCpus)-th CPU of the process
+		int n = threadNum%numCpus;
+		int cpu = 0;
+		for ( ; cpu<CPU_SETSIZE; cpu++ ) {
+			if ( CPU_ISSET( cpu, processCpus ) && n--==0 ) {
+				break;
+			}
+		}
+		CPU_ZERO( &cpus );
+		CPU_SET( cpu, &cpus );
+	}
+	else {
+		cpus = *processCpus;
+	}
+	if ( pthread_setaffinity_np( pthread_self(), sizeof(cpus), &cpus )==0 ) {
+		ThreadPinned[threadNum] = pin ? 1 : 0;
+	}
+#endif
+}
@@ -0,0 +1,85 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// RenderThreadPool.h
+//   Render threads that are kept from one frame to the next.
+//	 Run() hands a job to the first numThreads threads of the pool, starting
+//	 more threads if there are too few, and waits until all have finished it.
+//	 Between jobs the threads sleep on a condition variable.
+//
+//	 Keeping the threads saves starting and joining them for every pass
+//	 over the image, which is a visible part of the time of small frames,
+//	 and each thread comes back to the same core with its caches warm.
+//
+//	 With pinning, thread k is held to the k-th CPU that the process may run
+//	 on (wrapping around if there are more threads than CPUs).  A render
+//	 thread allocates its work space (its TraceContext) itself and keeps it
+//	 from one job to the next, so pinned threads keep their work space in
+//	 memory local to their CPU.
+//	 Pinning is only supported on Linux; elsewhere it does nothing.
+
+#ifndef RENDER_THREAD_POOL_H
+#define RENDER_THREAD_POOL_H
+
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+class RenderThreadPool {
+public:
+	RenderThreadPool();
+	~RenderThreadPool();		// Stops and joins the threads
+
+	// Start threads until there are numThreads of them.
+	void Start( int numThreads );
+	// Run job(k) on threads k=0,...,numThreads-1 of the pool, and wait for
+	//	 them to finish.  If pinThreads, each thread is pinned to its CPU first,
+	//	 and otherwise it may run on any CPU.  Not to be called by the pool's threads.
+	void Run( int numThreads, bool pinThreads, const std::function<void(int)>& job );
+
+	int NumThreads() const { return (int)Threads.size(); }
+	long NumJobs() const { return JobNumber; }
+	static bool CanPinThreads();
+
+private:
+	std::vector<std::thread> Threads;
+	std::vector<char> ThreadPinned;		// Whether each thread is pinned now.  Only set by the thread.
+
+	std::mutex Lock;					// Guards the rest
+	std::condition_variable JobReady;
+	std::condition_variable JobDone;
+	const std::function<void(int)>* Job;
+	int JobThreads;						// Number of threads that run the job
+	bool PinJob;
+	long JobNumber;						// Counts the jobs
+	int NumRunning;						// Threads still running the current job
+	bool Stopping;
+
+	void WorkerLoop( int threadNum, long lastJob );
+	void SetPinned( int threadNum, bool pin );
+
+	RenderThreadPool( const RenderThreadPool& );			// Not copyable
+	RenderThreadPool& operator=( const RenderThreadPool& );
+};
+
+#endif // RENDER_THREAD_POOL_H
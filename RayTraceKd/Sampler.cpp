@@ -0,0 +1,315 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// Sampler.cpp
+//   Random, stratified, Halton, Sobol and correlated multi-jittered samplers.
+//	 See Sampler.h.
+
+#include <assert.h>
+#include <string.h>
+
+#include "Sampler.h"
+
+Sampler* Sampler::New( SamplerType type, long samplesPerPixel, unsigned long seed )
+{
+	assert ( samplesPerPixel>0 );
+	switch ( type ) {
+	case SAMPLER_RANDOM:
+		return new RandomSampler( samplesPerPixel, seed );
+	case SAMPLER_HALTON:
+		return new HaltonSampler( samplesPerPixel, seed );
+	case SAMPLER_SOBOL:
+		return new SobolSampler( samplesPerPixel, seed );
+	case SAMPLER_CMJ:
+		return new CmjSampler( samplesPerPixel, seed );
+	case SAMPLER_STRATIFIED:
+	default:
+		return new StratifiedSampler( samplesPerPixel, seed );
+	}
+}
+
+const char* Sampler::TypeName( SamplerType type )
+{
+	switch ( type ) {
+	case SAMPLER_RANDOM:
+		return "random";
+	case SAMPLER_HALTON:
+		return "halton";
+	case SAMPLER_SOBOL:
+		return "sobol";
+	case SAMPLER_CMJ:
+		return "cmj";
+	case SAMPLER_STRATIFIED:
+	default:
+		return "stratified";
+	}
+}
+
+bool Sampler::ParseType( const char* name, SamplerType* type )
+{
+	for ( int i=SAMPLER_RANDOM; i<=SAMPLER_CMJ; i++ ) {
+		if ( strcmp( name, TypeName((SamplerType)i) )==0 ) {
+			*type = (SamplerType)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Pseudo-random permutation of {0,...,l-1}, indexed by p.
+//	 From A. Kensler, "Correlated Multi-Jittered Sampling", Pixar Technical Memo 13-01, 2013.
+unsigned Sampler::Permute( unsigned i, unsigned l, unsigned p )
+{
+	unsigned w = l-1;
+	w |= w>>1;
+	w |= w>>2;
+	w |= w>>4;
+	w |= w>>8;
+	w |= w>>16;
+	do {
+		i ^= p;				i *= 0xe170893d;
+		i ^= p>>16;
+		i ^= (i&w)>>4;
+		i ^= p>>8;			i *= 0x0929eb3f;
+		i ^= p>>23;
+		i ^= (i&w)>>1;		i *= 1|p>>27;
+		i *= 0x6935fa69;
+		i ^= (i&w)>>11;		i *= 0x74dcb303;
+		i ^= (i&w)>>2;		i *= 0x9e501cc3;
+		i ^= (i&w)>>2;		i *= 0xc860a3df;
+		i &= w;
+		i ^= i>>5;
+	} while ( i>=l );
+	return (i+p)%l;
+}
+
+// ************************************************************************************
+// RandomSampler																	  *
+// ************************************************************************************
+
+double RandomSampler::Get( int i, int j, long sample, int dim ) const
+{
+	return RandomValue( i, j, sample, dim );
+}
+
+// ************************************************************************************
+// StratifiedSampler																  *
+//   The first GridSize^2 samples of each pair of dimensions are jittered			  *
+//   in a GridSize x GridSize grid.  Each pair visits the cells in its own		  *
+//   per pixel shuffled order, so the pairs are not correlated and the first		  *
+//   few samples (as used by adaptive sampling) are not bunched together.		  *
+//   Any further samples are random.												  *
+// ************************************************************************************
+
+StratifiedSampler::StratifiedSampler( long samplesPerPixel, unsigned long seed )
+: Sampler( samplesPerPixel, seed )
+{
+	GridSize = (int)sqrt( (double)samplesPerPixel );
+	while ( (long)(GridSize+1)*(long)(GridSize+1)<=samplesPerPixel ) {
+		GridSize++;			// Guard against round off
+	}
+}
+
+double StratifiedSampler::Get( int i, int j, long sample, int dim ) const
+{
+	long numCells = (long)GridSize*(long)GridSize;
+	if ( sample>=numCells ) {
+		return RandomValue( i, j, sample, dim );
+	}
+	int pair = dim>>1;
+	unsigned cell = Permute( (unsigned)sample, (unsigned)numCells, (unsigned)PixelKey( i, j, pair<<1 ) );
+	int stratum = (dim&1)==0 ? (int)(cell/GridSize) : (int)(cell%GridSize);
+	return ( stratum + RandomValue( i, j, sample, dim ) ) / GridSize;
+}
+
+// ************************************************************************************
+// HaltonSampler																	  *
+//   Radical inverses in the first MaxDimensions primes, rotated mod 1 by a			  *
+//   per pixel offset (a Cranley-Patterson rotation).  Random past MaxDimensions.	  *
+// ************************************************************************************
+
+static const int HaltonPrimes[HaltonSampler::MaxDimensions] = {
+	  2,   3,   5,   7,  11,  13,  17,  19,  23,  29,  31,  37,  41,  43,  47,  53,
+	 59,  61,  67,  71,  73,  79,  83,  89,  97, 101, 103, 107, 109, 113, 127, 131,
+	137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+	227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311
+};
+
+double HaltonSampler::Get( int i, int j, long sample, int dim ) const
+{
+	if ( dim>=MaxDimensions ) {
+		return RandomValue( i, j, sample, dim );
+	}
+	int base = HaltonPrimes[dim];
+	double invBase = 1.0/base;
+	double scale = invBase;
+	double u = 0.0;
+	for ( unsigned long n = (unsigned long)sample; n>0; n /= base ) {
+		u += (n%base)*scale;
+		scale *= invBase;
+	}
+	u += ToUnit( PixelKey( i, j, dim ) );
+	if ( u>=1.0 ) {
+		u -= 1.0;
+	}
+	return u;
+}
+
+// ************************************************************************************
+// SobolSampler																		  *
+//   Sobol sequence with the direction numbers of S. Joe and F. Kuo,				  *
+//   "Constructing Sobol sequences with better two-dimensional projections",		  *
+//   SIAM J. Sci. Comput. 30 (2008).  Each pixel XORs the sequence with its own	  *
+//   random bits (a digital shift), which keeps it a (t,s)-sequence.				  *
+//   Random past MaxDimensions.														  *
+// ************************************************************************************
+
+unsigned SobolSampler::DirectionNumbers[SobolSampler::MaxDimensions][32];
+bool SobolSampler::DirectionNumbersSet = false;
+
+// Dimensions 2 through 32: degree s of the primitive polynomial, its coefficients a,
+//	 and the initial direction numbers m_1,...,m_s.
+static const struct {
+	int s;
+	unsigned a;
+	unsigned m[7];
+} JoeKuo[SobolSampler::MaxDimensions-1] = {
+	{ 1,  0, { 1 } },
+	{ 2,  1, { 1, 3 } },
+	{ 3,  1, { 1, 3, 1 } },
+	{ 3,  2, { 1, 1, 1 } },
+	{ 4,  1, { 1, 1, 3, 3 } },
+	{ 4,  4, { 1, 3, 5, 13 } },
+	{ 5,  2, { 1, 1, 5, 5, 17 } },
+	{ 5,  4, { 1, 1, 5, 5, 5 } },
+	{ 5,  7, { 1, 1, 7, 11, 19 } },
+	{ 5, 11, { 1, 1, 5, 1, 1 } },
+	{ 5, 13, { 1, 1, 1, 3, 11 } },
+	{ 5, 14, { 1, 3, 5, 5, 31 } },
+	{ 6,  1, { 1, 3, 3, 9, 7, 49 } },
+	{ 6, 13, { 1, 1, 1, 15, 21, 21 } },
+	{ 6, 16, { 1, 3, 1, 13, 27, 49 } },
+	{ 6, 19, { 1, 1, 1, 15, 7, 5 } },
+	{ 6, 22, { 1, 3, 1, 15, 13, 25 } },
+	{ 6, 25, { 1, 1, 5, 5, 19, 61 } },
+	{ 7,  1, { 1, 3, 7, 11, 23, 15, 103 } },
+	{ 7,  4, { 1, 3, 7, 13, 13, 15, 69 } },
+	{ 7,  7, { 1, 1, 3, 13, 7, 35, 63 } },
+	{ 7,  8, { 1, 3, 5, 9, 1, 25, 53 } },
+	{ 7, 14, { 1, 3, 1, 13, 9, 35, 107 } },
+	{ 7, 19, { 1, 3, 1, 5, 27, 61, 31 } },
+	{ 7, 21, { 1, 1, 5, 11, 19, 41, 61 } },
+	{ 7, 28, { 1, 3, 5, 3, 3, 13, 69 } },
+	{ 7, 31, { 1, 1, 7, 13, 1, 19, 1 } },
+	{ 7, 32, { 1, 3, 7, 5, 13, 19, 59 } },
+	{ 7, 37, { 1, 1, 3, 9, 25, 29, 41 } },
+	{ 7, 41, { 1, 3, 5, 13, 23, 1, 55 } },
+	{ 7, 42, { 1, 3, 7, 3, 13, 59, 17 } },
+};
+
+SobolSampler::SobolSampler( long samplesPerPixel, unsigned long seed )
+: Sampler( samplesPerPixel, seed )
+{
+	SetDirectionNumbers();
+}
+
+// Fills in the direction numbers, scaled by 2^32.  The table is the same
+//	 every time, so it does not matter if several threads set it at once.
+void SobolSampler::SetDirectionNumbers()
+{
+	if ( DirectionNumbersSet ) {
+		return;
+	}
+	for ( int k=0; k<32; k++ ) {
+		DirectionNumbers[0][k] = 1u<<(31-k);		// van der Corput sequence
+	}
+	for ( int d=1; d<MaxDimensions; d++ ) {
+		int s = JoeKuo[d-1].s;
+		unsigned a = JoeKuo[d-1].a;
+		unsigned* v = DirectionNumbers[d];
+		for ( int k=0; k<32; k++ ) {
+			if ( k<s ) {
+				v[k] = JoeKuo[d-1].m[k]<<(31-k);
+			}
+			else {
+				v[k] = v[k-s] ^ (v[k-s]>>s);
+				for ( int l=1; l<s; l++ ) {
+					if ( (a>>(s-1-l))&1 ) {
+						v[k] ^= v[k-l];
+					}
+				}
+			}
+		}
+	}
+	DirectionNumbersSet = true;
+}
+
+double SobolSampler::Get( int i, int j, long sample, int dim ) const
+{
+	if ( dim>=MaxDimensions ) {
+		return RandomValue( i, j, sample, dim );
+	}
+	unsigned x = (unsigned)(PixelKey( i, j, dim )>>32);
+	const unsigned* v = DirectionNumbers[dim];
+	for ( unsigned n = (unsigned)sample; n!=0; n >>= 1, v++ ) {
+		if ( n&1 ) {
+			x ^= *v;
+		}
+	}
+	return x * (1.0/4294967296.0);
+}
+
+// ************************************************************************************
+// CmjSampler																		  *
+//   Correlated multi-jittered sampling: A. Kensler, "Correlated Multi-Jittered	  *
+//   Sampling", Pixar Technical Memo 13-01, 2013.  Each pair of dimensions has		  *
+//   its own pattern and its own order of the samples.  Samples past				  *
+//   SamplesPerPixel are random.													  *
+// ************************************************************************************
+
+CmjSampler::CmjSampler( long samplesPerPixel, unsigned long seed )
+: Sampler( samplesPerPixel, seed )
+{
+	NumCols = (int)sqrt( (double)samplesPerPixel );
+	while ( (long)(NumCols+1)*(long)(NumCols+1)<=samplesPerPixel ) {
+		NumCols++;			// Guard against round off
+	}
+	NumRows = (int)((samplesPerPixel+NumCols-1)/NumCols);
+}
+
+double CmjSampler::Get( int i, int j, long sample, int dim ) const
+{
+	if ( sample>=SamplesPerPixel ) {
+		return RandomValue( i, j, sample, dim );
+	}
+	int pair = dim>>1;
+	unsigned p = (unsigned)PixelKey( i, j, pair<<1 );
+	unsigned s = Permute( (unsigned)sample, (unsigned)SamplesPerPixel, p*0x51633e2d );
+	unsigned col = s%NumCols;
+	unsigned row = s/NumCols;
+	if ( (dim&1)==0 ) {
+		unsigned sy = Permute( row, NumRows, p*0x63d83595 );
+		return ( col + (sy + RandomValue( i, j, s, pair<<1 ))/NumRows ) / NumCols;
+	}
+	else {
+		unsigned sx = Permute( col, NumCols, p*0xa511e9b3 );
+		return ( row + (sx + RandomValue( i, j, s, (pair<<1)+1 ))/NumCols ) / NumRows;
+	}
+}
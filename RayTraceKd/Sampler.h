@@ -0,0 +1,252 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// Sampler.h
+//   Sample values for ray tracing.
+//
+//	 A Sampler gives the value in [0,1) of dimension "dim" of sample number
+//	 "sample" of pixel (i,j).  Samplers are stateless: a value depends only
+//	 on those arguments (and the seed), so a single Sampler is shared by all
+//	 render threads, and images do not depend on the number of threads.
+//
+//	 A SampleStream is the view of a sampler seen by one ray of the ray tree.
+//	 It maps the dimensions used at each hit (see the SAMPLE_DIM values) to
+//	 distinct sampler dimensions for each depth of the tree.
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <math.h>
+
+enum SamplerType {
+	SAMPLER_RANDOM = 0,			// Independent random values
+	SAMPLER_STRATIFIED = 1,		// Jittered sqrt(spp) x sqrt(spp) grids, shuffled between pairs of dimensions
+	SAMPLER_HALTON = 2,			// Halton sequence, Cranley-Patterson rotated per pixel
+	SAMPLER_SOBOL = 3,			// Sobol sequence, digitally shifted per pixel
+	SAMPLER_CMJ = 4				// Correlated multi-jittered (Kensler 2013)
+};
+
+// Dimensions used by the camera ray
+enum {
+	SAMPLE_DIM_PIXEL_X = 0,		// Position within the pixel
+	SAMPLE_DIM_PIXEL_Y = 1,
+	SAMPLE_DIM_LENS_U = 2,		// Position on the lens
+	SAMPLE_DIM_LENS_V = 3,
+};
+// Dimensions used at each hit in the ray tree
+enum {
+	SAMPLE_DIM_REFLECT_ROUGH = 4,	// Two dimensions: perturbation of a glossy reflection
+	SAMPLE_DIM_XMIT_ROUGH = 6,		// Two dimensions: perturbation of a rough transmission
+	SAMPLE_DIM_BRANCH = 8,			// Choice between reflection and transmission
+	SAMPLE_DIM_ROULETTE_REFLECT = 9,	// Russian roulette for the reflected ray
+	SAMPLE_DIM_ROULETTE_XMIT = 10,	// Russian roulette for the transmitted ray
+	SAMPLE_DIMS_PER_BOUNCE = 7		// Sampler dimensions added for each level of the ray tree
+};
+
+// ************************************************************************************
+// Sampler																			  *
+// ************************************************************************************
+class Sampler {
+public:
+	Sampler( long samplesPerPixel, unsigned long seed );
+	virtual ~Sampler() {}
+
+	// Value in [0,1) of dimension dim of sample number "sample" of pixel (i,j)
+	virtual double Get( int i, int j, long sample, int dim ) const = 0;
+	virtual SamplerType GetType() const = 0;
+
+	long GetSamplesPerPixel() const { return SamplesPerPixel; }
+
+	// Creates a new sampler (delete it when done).  The sample counts of
+	//	 the stratified and multi-jittered samplers are fixed at samplesPerPixel.
+	static Sampler* New( SamplerType type, long samplesPerPixel, unsigned long seed = 0 );
+
+	static const char* TypeName( SamplerType type );
+	static bool ParseType( const char* name, SamplerType* type );
+
+	// Hashing tools used by the samplers
+	static unsigned long long Mix( unsigned long long x );
+	static double ToUnit( unsigned long long h );
+	static unsigned Permute( unsigned i, unsigned l, unsigned p );
+
+protected:
+	long SamplesPerPixel;
+	unsigned long Seed;
+
+	unsigned long long PixelKey( int i, int j, int dim ) const;		// Hash of pixel, dimension and seed
+	double RandomValue( int i, int j, long sample, int dim ) const;	// Independent random value
+};
+
+class RandomSampler : public Sampler {
+public:
+	RandomSampler( long samplesPerPixel, unsigned long seed ) : Sampler( samplesPerPixel, seed ) {}
+	double Get( int i, int j, long sample, int dim ) const;
+	SamplerType GetType() const { return SAMPLER_RANDOM; }
+};
+
+class StratifiedSampler : public Sampler {
+public:
+	StratifiedSampler( long samplesPerPixel, unsigned long seed );
+	double Get( int i, int j, long sample, int dim ) const;
+	SamplerType GetType() const { return SAMPLER_STRATIFIED; }
+private:
+	int GridSize;		// Samples form a GridSize x GridSize grid in each pair of dimensions
+};
+
+class HaltonSampler : public Sampler {
+public:
+	HaltonSampler( long samplesPerPixel, unsigned long seed ) : Sampler( samplesPerPixel, seed ) {}
+	double Get( int i, int j, long sample, int dim ) const;
+	SamplerType GetType() const { return SAMPLER_HALTON; }
+	static const int MaxDimensions = 64;
+};
+
+class SobolSampler : public Sampler {
+public:
+	SobolSampler( long samplesPerPixel, unsigned long seed );
+	double Get( int i, int j, long sample, int dim ) const;
+	SamplerType GetType() const { return SAMPLER_SOBOL; }
+	static const int MaxDimensions = 32;
+private:
+	static unsigned DirectionNumbers[MaxDimensions][32];
+	static bool DirectionNumbersSet;
+	static void SetDirectionNumbers();
+};
+
+class CmjSampler : public Sampler {
+public:
+	CmjSampler( long samplesPerPixel, unsigned long seed );
+	double Get( int i, int j, long sample, int dim ) const;
+	SamplerType GetType() const { return SAMPLER_CMJ; }
+private:
+	int NumCols, NumRows;	// Layout of the samples in each pair of dimensions
+};
+
+// ************************************************************************************
+// SampleStream																		  *
+// ************************************************************************************
+class SampleStream {
+public:
+	// Stream for the camera ray of the given sample of pixel (i,j).
+	SampleStream( const Sampler* sampler, int i, int j, long sample );
+
+	// Stream for the child ray spawned by reflection (branch 0) or transmission (branch 1).
+	SampleStream Branch( int branch ) const;
+
+	// Value in [0,1) for one of the SAMPLE_DIM dimensions at this ray's depth
+	double Get( int dim ) const;
+	// Pair of independent normally distributed values, mean zero, standard deviation sigma.
+	//   Uses dimensions dim and dim+1.
+	void Normal2( int dim, double sigma, double* n1, double* n2 ) const;
+
+	int GetPixelI() const { return PixelI; }
+	int GetPixelJ() const { return PixelJ; }
+	long GetSampleNumber() const { return SampleNumber; }
+	int GetDepth() const { return Depth; }
+
+	SampleStream() {}		// Uninitialized, for arrays of streams
+
+private:
+	const Sampler* TheSampler;
+	int PixelI, PixelJ;
+	long SampleNumber;
+	int Depth;						// Depth in the ray tree.  Zero for the camera ray.
+	unsigned long long PathKey;		// Hash of the branches taken from the camera ray
+};
+
+inline Sampler::Sampler( long samplesPerPixel, unsigned long seed )
+{
+	SamplesPerPixel = samplesPerPixel;
+	Seed = seed;
+}
+
+// 64 bit finalizer from SplitMix64
+inline unsigned long long Sampler::Mix( unsigned long long x )
+{
+	x ^= x>>30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x>>27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x>>31;
+	return x;
+}
+
+// Uses the top 53 bits
+inline double Sampler::ToUnit( unsigned long long h )
+{
+	return (double)(h>>11) * (1.0/9007199254740992.0);
+}
+
+inline unsigned long long Sampler::PixelKey( int i, int j, int dim ) const
+{
+	unsigned long long key = ((unsigned long long)(unsigned int)i<<32) | (unsigned long long)(unsigned int)j;
+	return Mix( Mix( key ^ ((unsigned long long)Seed<<20) ) ^ (0xd1b54a32d192ed03ULL*(unsigned long long)(dim+1)) );
+}
+
+inline double Sampler::RandomValue( int i, int j, long sample, int dim ) const
+{
+	return ToUnit( Mix( PixelKey( i, j, dim ) + 0x9e3779b97f4a7c15ULL*(unsigned long long)(sample+1) ) );
+}
+
+inline SampleStream::SampleStream( const Sampler* sampler, int i, int j, long sample )
+{
+	TheSampler = sampler;
+	PixelI = i;
+	PixelJ = j;
+	SampleNumber = sample;
+	Depth = 0;
+	PathKey = 0;
+}
+
+inline SampleStream SampleStream::Branch( int branch ) const
+{
+	SampleStream child = *this;
+	child.Depth = Depth+1;
+	child.PathKey = Sampler::Mix( PathKey + 0x9e3779b97f4a7c15ULL*(unsigned long long)(branch+1) );
+	return child;
+}
+
+// Below the camera ray, the values are rotated (mod 1) by an amount that
+//	 depends on the path through the ray tree.  This keeps the reflected and
+//	 transmitted sub-trees from using identical values, while keeping the
+//	 stratification of each dimension over the samples of the pixel.
+inline double SampleStream::Get( int dim ) const
+{
+	int samplerDim = dim + SAMPLE_DIMS_PER_BOUNCE*Depth;
+	double u = TheSampler->Get( PixelI, PixelJ, SampleNumber, samplerDim );
+	if ( Depth>0 ) {
+		u += Sampler::ToUnit( Sampler::Mix( PathKey ^ (unsigned long long)samplerDim ) );
+		if ( u>=1.0 ) {
+			u -= 1.0;
+		}
+	}
+	return u;
+}
+
+// Box-Muller transform
+inline void SampleStream::Normal2( int dim, double sigma, double* n1, double* n2 ) const
+{
+	double r = sigma*sqrt( -2.0*log( 1.0-Get(dim) ) );
+	double theta = 6.283185307179586*Get(dim+1);
+	*n1 = r*cos(theta);
+	*n2 = r*sin(theta);
+}
+
+#endif // SAMPLER_H
@@ -0,0 +1,313 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// TileScheduler.cpp
+//   Work-stealing tile scheduler.  See TileScheduler.h.
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#include "TileScheduler.h"
+
+TileScheduler::TileScheduler()
+{
+	Width = Height = 0;
+	TileSize = 0;
+	Order = TILE_ORDER_SCANLINE;
+	NumThreads = 0;
+	HaveTileCosts = false;
+	Queues = 0;
+}
+
+TileScheduler::~TileScheduler()
+{
+	delete[] Queues;
+}
+
+void TileScheduler::Init( int width, int height, int tileSize, TileOrderType order, int numThreads )
+{
+	assert ( width>0 && height>0 && tileSize>0 && numThreads>0 );
+
+	// Costs from the last frame are only useful if the tiles are the same.
+	bool sameTiling = ( width==Width && height==Height && tileSize==TileSize );
+	HaveTileCosts = HaveTileCosts && sameTiling;
+
+	Width = width;
+	Height = height;
+	TileSize = tileSize;
+	Order = order;
+	if ( numThreads!=NumThreads ) {
+		delete[] Queues;
+		Queues = new TileQueue[numThreads];
+		NumThreads = numThreads;
+	}
+
+	// Make the tiles
+	int tilesX = (Width+TileSize-1)/TileSize;
+	int tilesY = (Height+TileSize-1)/TileSize;
+	long numTiles = (long)tilesX*(long)tilesY;
+	if ( !sameTiling ) {
+		Tiles.resize( numTiles );
+		TileCosts.assign( numTiles, 0.0 );
+		for ( int ty=0; ty<tilesY; ty++ ) {
+			for ( int tx=0; tx<tilesX; tx++ ) {
+				PixelTile& tile = Tiles[(long)ty*tilesX+tx];
+				tile.MinX = tx*TileSize;
+				tile.MinY = ty*TileSize;
+				tile.MaxX = std::min( tile.MinX+TileSize, Width );
+				tile.MaxY = std::min( tile.MinY+TileSize, Height );
+				tile.Index = (long)ty*tilesX+tx;
+			}
+		}
+	}
+
+	// Lay the tiles out along the space filling curve.
+	int curveSize = 1;
+	while ( curveSize<tilesX || curveSize<tilesY ) {
+		curveSize <<= 1;
+	}
+	std::vector<unsigned long> keys( numTiles );
+	std::vector<long> sorted( numTiles );
+	for ( long i=0; i<numTiles; i++ ) {
+		keys[i] = CurveKey( Order, (int)(i%tilesX), (int)(i/tilesX), curveSize );
+		sorted[i] = i;
+	}
+	std::sort( sorted.begin(), sorted.end(),
+			   [&keys]( long a, long b ) { return keys[a]<keys[b]; } );
+
+	QueueTiles.resize( numTiles );
+	if ( HaveTileCosts ) {
+		// Most expensive tiles first, dealt round robin so every queue starts
+		//   with one of the NumThreads most expensive tiles.  Ties keep the
+		//   curve order.  Queue t gets sorted[t], sorted[t+NumThreads], ...
+		const std::vector<double>& costs = TileCosts;
+		std::stable_sort( sorted.begin(), sorted.end(),
+						  [&costs]( long a, long b ) { return costs[a]>costs[b]; } );
+		long k = 0;
+		for ( int t=0; t<NumThreads; t++ ) {
+			for ( long i=t; i<numTiles; i+=NumThreads ) {
+				QueueTiles[k++] = sorted[i];
+			}
+		}
+	}
+	else {
+		// Each queue gets a contiguous stretch of the curve.
+		QueueTiles = sorted;
+	}
+
+	long begin = 0;
+	for ( int t=0; t<NumThreads; t++ ) {
+		long end;
+		if ( HaveTileCosts ) {
+			end = begin + (numTiles-t+NumThreads-1)/NumThreads;	// Size of the round robin share
+		}
+		else {
+			end = (numTiles*(t+1))/NumThreads;
+		}
+		TileQueue& queue = Queues[t];
+		queue.Begin = begin;
+		queue.HeadTail.store( (unsigned long long)(end-begin) );	// Head is zero
+		queue.NumTiles = 0;
+		queue.NumPixels = 0;
+		queue.NumSteals = 0;
+		queue.BusySeconds = 0.0;
+		begin = end;
+	}
+
+	// The costs measured during this frame are used to order the next frame.
+	HaveTileCosts = true;
+}
+
+bool TileScheduler::GetNextTile( int threadNum, PixelTile& tile )
+{
+	long tileIdx;
+	if ( !PopFront( Queues[threadNum], &tileIdx ) ) {
+		// Own queue is empty: steal from the others, starting with the next thread.
+		int victim = threadNum;
+		while ( true ) {
+			victim = (victim+1)%NumThreads;
+			if ( victim==threadNum ) {
+				return false;
+			}
+			if ( PopBack( Queues[victim], &tileIdx ) ) {
+				Queues[threadNum].NumSteals++;
+				break;
+			}
+		}
+	}
+	tile = Tiles[tileIdx];
+	return true;
+}
+
+void TileScheduler::TileDone( int threadNum, const PixelTile& tile, double seconds )
+{
+	TileQueue& queue = Queues[threadNum];
+	queue.NumTiles++;
+	queue.NumPixels += tile.NumPixels();
+	queue.BusySeconds += seconds;
+	TileCosts[tile.Index] = seconds;
+}
+
+// Take the tile at the head of the queue.  Used by the owning thread.
+bool TileScheduler::PopFront( TileQueue& queue, long* tileIdx )
+{
+	unsigned long long headTail = queue.HeadTail.load();
+	while ( true ) {
+		unsigned long head = (unsigned long)(headTail>>32);
+		unsigned long tail = (unsigned long)(headTail&0xffffffff);
+		if ( head>=tail ) {
+			return false;
+		}
+		unsigned long long newHeadTail = (((unsigned long long)(head+1))<<32) | tail;
+		if ( queue.HeadTail.compare_exchange_weak( headTail, newHeadTail ) ) {
+			*tileIdx = QueueTiles[queue.Begin+head];
+			return true;
+		}
+	}
+}
+
+// Take the tile at the tail of the queue.  Used by stealing threads.
+bool TileScheduler::PopBack( TileQueue& queue, long* tileIdx )
+{
+	unsigned long long headTail = queue.HeadTail.load();
+	while ( true ) {
+		unsigned long head = (unsigned long)(headTail>>32);
+		unsigned long tail = (unsigned long)(headTail&0xffffffff);
+		if ( head>=tail ) {
+			return false;
+		}
+		unsigned long long newHeadTail = (((unsigned long long)head)<<32) | (tail-1);
+		if ( queue.HeadTail.compare_exchange_weak( headTail, newHeadTail ) ) {
+			*tileIdx = QueueTiles[queue.Begin+tail-1];
+			return true;
+		}
+	}
+}
+
+long TileScheduler::NumSteals() const
+{
+	long steals = 0;
+	for ( int t=0; t<NumThreads; t++ ) {
+		steals += Queues[t].NumSteals;
+	}
+	return steals;
+}
+
+double TileScheduler::LoadImbalance() const
+{
+	double maxBusy = 0.0;
+	double sumBusy = 0.0;
+	for ( int t=0; t<NumThreads; t++ ) {
+		maxBusy = std::max( maxBusy, Queues[t].BusySeconds );
+		sumBusy += Queues[t].BusySeconds;
+	}
+	if ( sumBusy<=0.0 ) {
+		return 1.0;
+	}
+	return maxBusy*NumThreads/sumBusy;
+}
+
+void TileScheduler::PrintStats( FILE* out ) const
+{
+	if ( NumThreads==0 ) {
+		return;
+	}
+	double minBusy = Queues[0].BusySeconds;
+	double maxBusy = Queues[0].BusySeconds;
+	long minTiles = Queues[0].NumTiles;
+	long maxTiles = Queues[0].NumTiles;
+	for ( int t=1; t<NumThreads; t++ ) {
+		minBusy = std::min( minBusy, Queues[t].BusySeconds );
+		maxBusy = std::max( maxBusy, Queues[t].BusySeconds );
+		minTiles = std::min( minTiles, Queues[t].NumTiles );
+		maxTiles = std::max( maxTiles, Queues[t].NumTiles );
+	}
+	fprintf( out, "Tile scheduler: %ld tiles of %dx%d, %s order, %d threads.\n",
+				NumTiles(), TileSize, TileSize, OrderName(Order), NumThreads );
+	fprintf( out, "  Tiles per thread: min %ld, max %ld.  Steals, %ld.\n",
+				minTiles, maxTiles, NumSteals() );
+	fprintf( out, "  Busy time per thread: min %.3lf(s), max %.3lf(s).  Imbalance (max/mean), %.4lf.\n",
+				minBusy, maxBusy, LoadImbalance() );
+}
+
+const char* TileScheduler::OrderName( TileOrderType order )
+{
+	switch ( order ) {
+	case TILE_ORDER_MORTON:
+		return "morton";
+	case TILE_ORDER_HILBERT:
+		return "hilbert";
+	case TILE_ORDER_SCANLINE:
+	default:
+		return "scanline";
+	}
+}
+
+bool TileScheduler::ParseOrder( const char* name, TileOrderType* order )
+{
+	for ( int i=TILE_ORDER_SCANLINE; i<=TILE_ORDER_HILBERT; i++ ) {
+		if ( strcmp( name, OrderName((TileOrderType)i) )==0 ) {
+			*order = (TileOrderType)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Position of tile (x,y) along the curve.
+//   curveSize is a power of two at least as large as the number of tiles in each direction.
+unsigned long TileScheduler::CurveKey( TileOrderType order, int x, int y, int curveSize )
+{
+	switch ( order ) {
+	case TILE_ORDER_MORTON:
+		{
+			unsigned long key = 0;
+			for ( int bit=0; (1<<bit)<curveSize; bit++ ) {
+				key |= (unsigned long)((x>>bit)&1) << (2*bit);
+				key |= (unsigned long)((y>>bit)&1) << (2*bit+1);
+			}
+			return key;
+		}
+	case TILE_ORDER_HILBERT:
+		{
+			unsigned long key = 0;
+			for ( int s=curveSize/2; s>0; s/=2 ) {
+				int rx = (x & s) ? 1 : 0;
+				int ry = (y & s) ? 1 : 0;
+				key += (unsigned long)s * (unsigned long)s * (unsigned long)((3*rx)^ry);
+				// Rotate the quadrant
+				if ( ry==0 ) {
+					if ( rx==1 ) {
+						x = curveSize-1-x;
+						y = curveSize-1-y;
+					}
+					int t = x;
+					x = y;
+					y = t;
+				}
+			}
+			return key;
+		}
+	case TILE_ORDER_SCANLINE:
+	default:
+		return (unsigned long)y*(unsigned long)curveSize + (unsigned long)x;
+	}
+}
@@ -0,0 +1,106 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// TileScheduler.h
+//   Hands out rectangular tiles of the image to the render threads.
+//	 Each thread has its own queue of tiles.  A thread whose queue is
+//	 empty steals tiles from the back of another thread's queue.
+//	 Queues are lock-free: the head and tail of each queue are packed
+//	 into a single atomic word.
+
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+
+// Order in which tiles are laid out along the queues.
+enum TileOrderType {
+	TILE_ORDER_SCANLINE = 0,
+	TILE_ORDER_MORTON = 1,
+	TILE_ORDER_HILBERT = 2
+};
+
+class PixelTile {
+public:
+	int MinX, MinY;			// Lower left pixel of the tile
+	int MaxX, MaxY;			// One past the upper right pixel
+	long Index;				// Index of the tile in the scheduler
+
+	long NumPixels() const { return (long)(MaxX-MinX)*(long)(MaxY-MinY); }
+};
+
+class TileScheduler {
+public:
+	TileScheduler();
+	~TileScheduler();
+
+	// Split a width x height image into tiles and deal them out to numThreads queues.
+	//	 If the tiling is the same as for the previous frame, the tiles that took
+	//	 the longest in the previous frame are dealt out first.
+	void Init( int width, int height, int tileSize, TileOrderType order, int numThreads );
+
+	// Get the next tile for thread threadNum.  Returns false when no work is left.
+	bool GetNextTile( int threadNum, PixelTile& tile );
+	// Report that thread threadNum has finished a tile, which took "seconds" to render.
+	void TileDone( int threadNum, const PixelTile& tile, double seconds );
+
+	long NumTiles() const { return (long)Tiles.size(); }
+	long NumSteals() const;
+	double LoadImbalance() const;		// Max busy time of a thread divided by the mean busy time
+
+	void PrintStats( FILE* out = stdout ) const;
+
+	static const char* OrderName( TileOrderType order );
+	static bool ParseOrder( const char* name, TileOrderType* order );
+
+private:
+	// A queue of tiles for a single thread, plus the thread's statistics.
+	//   Padded so that different threads do not share cache lines.
+	class TileQueue {
+	public:
+		std::atomic<unsigned long long> HeadTail;	// Head in high 32 bits, tail in low 32 bits
+		char PadHeadTail[64];
+		long Begin;							// Start of the queue in QueueTiles
+		long NumTiles;						// Tiles rendered by this thread
+		long NumPixels;						// Pixels rendered by this thread
+		long NumSteals;						// Tiles this thread stole from others
+		double BusySeconds;					// Total time spent rendering tiles
+		char Pad[64];
+	};
+
+	int Width, Height;
+	int TileSize;
+	TileOrderType Order;
+	int NumThreads;
+
+	std::vector<PixelTile> Tiles;
+	std::vector<double> TileCosts;		// Seconds spent on each tile in the last frame
+	bool HaveTileCosts;					// True if TileCosts are from the same tiling
+	std::vector<long> QueueTiles;		// Tile indices, queue by queue
+	TileQueue* Queues;
+
+	bool PopFront( TileQueue& queue, long* tileIdx );
+	bool PopBack( TileQueue& queue, long* tileIdx );
+	static unsigned long CurveKey( TileOrderType order, int x, int y, int curveSize );
+};
+
+#endif // TILE_SCHEDULER_H
@@ -0,0 +1,256 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+#include <math.h>
+#include <algorithm>
+
+#include "Wavefront.h"
+#include "../Graphics/Light.h"
+#include "../RaytraceMgr/SceneDescription.h"
+
+// Makes the array hold n entries, whose values are not set.
+template<class T> static inline void SetNumEntries( Array<T>& a, long n )
+{
+	a.Reset();
+	if ( n>0 ) {
+		a.Touch( n-1 );
+	}
+}
+
+WavefrontTracer::WavefrontTracer()
+{
+	NumCameraRays = 0;
+	NumGenerations = 0;
+	LightsClear = 0;
+	LightsClearSize = 0;
+}
+
+void WavefrontTracer::Reset()
+{
+	Queue[0].Reset();
+	Queue[1].Reset();
+	NodeTerm.Reset();
+	NodeChild.Reset();
+	NumCameraRays = 0;
+}
+
+// The rest of the camera ray is set as by RayTrace(), except its depth,
+//	 which is set by Trace().
+long WavefrontTracer::AddCameraRay( const VectorR3& pos, const VectorR3& dir, const SampleStream& samples )
+{
+	PendingRay ray;
+	ray.Pos = pos;
+	ray.Dir = dir;
+	ray.Weight.Set( 1.0, 1.0, 1.0 );
+	ray.Translucent = 0.0;
+	ray.Eta = 1.0;
+	ray.AvoidK = -1;
+	ray.TraceDepth = 0;
+	ray.Samples = samples;
+	long node = AddNode();
+	assert( node==NumCameraRays );
+	Queue[0].Add( ray, node );
+	return NumCameraRays++;
+}
+
+void WavefrontTracer::Trace( TraceContext& context, const RenderOptions& options )
+{
+	RayQueue* rays = &Queue[0];
+	RayQueue* nextRays = &Queue[1];
+	assert( rays->Size()==NumCameraRays );
+	for ( long k=0; k<NumCameraRays; k++ ) {
+		rays->TraceDepth[k] = options.TraceDepth;
+	}
+
+	NumGenerations = 0;
+	while ( rays->Size()>0 ) {
+		if ( NumGenerations>0 && options.SortSecondaryRays ) {
+			nextRays->Reset();
+			SortRays( *rays, *nextRays );
+			RayQueue* temp = rays;
+			rays = nextRays;
+			nextRays = temp;
+		}
+		Extend( context, *rays );
+		Shadow( context, *rays );
+		nextRays->Reset();
+		Shade( options, *rays, *nextRays );
+		RayQueue* temp = rays;
+		rays = nextRays;
+		nextRays = temp;
+		NumGenerations++;
+	}
+	SumTerms();
+}
+
+// Bits 0,...,9 of v, moved to bits 0, 3, ..., 27.
+static inline unsigned long long SpreadBits3( unsigned long v )
+{
+	unsigned long long spread = 0;
+	for ( int bit=0; bit<10; bit++ ) {
+		spread |= (unsigned long long)((v>>bit)&1) << (3*bit);
+	}
+	return spread;
+}
+
+// Puts the rays in sortedRays, sorted by the octant of their direction, then
+//	 along a Morton curve through the box holding their origins.  Each ray
+//	 keeps its node, so its color term still goes to its camera ray.
+void WavefrontTracer::SortRays( const RayQueue& rays, RayQueue& sortedRays )
+{
+	long numRays = rays.Size();
+	assert( numRays < (1L<<31) );
+	VectorR3 boxMin = rays.Pos[0];
+	VectorR3 boxMax = rays.Pos[0];
+	for ( long k=1; k<numRays; k++ ) {
+		const VectorR3& pos = rays.Pos[k];
+		boxMin.Set( Min(boxMin.x,pos.x), Min(boxMin.y,pos.y), Min(boxMin.z,pos.z) );
+		boxMax.Set( Max(boxMax.x,pos.x), Max(boxMax.y,pos.y), Max(boxMax.z,pos.z) );
+	}
+	// Each coordinate of the origin is scaled to 0,...,1023
+	VectorR3 scale = boxMax-boxMin;
+	scale.x = (scale.x>0.0) ? 1023.0/scale.x : 0.0;
+	scale.y = (scale.y>0.0) ? 1023.0/scale.y : 0.0;
+	scale.z = (scale.z>0.0) ? 1023.0/scale.z : 0.0;
+
+	// The key is 3 bits of octant and 30 bits of Morton code, above 31 bits of the ray's place
+	SortKeys.Reset();
+	for ( long k=0; k<numRays; k++ ) {
+		const VectorR3& pos = rays.Pos[k];
+		const VectorR3& dir = rays.Dir[k];
+		unsigned long long octant = (dir.x<0.0 ? 1 : 0) | (dir.y<0.0 ? 2 : 0) | (dir.z<0.0 ? 4 : 0);
+		unsigned long long morton = SpreadBits3( (unsigned long)((pos.x-boxMin.x)*scale.x) )
+									| (SpreadBits3( (unsigned long)((pos.y-boxMin.y)*scale.y) ) << 1)
+									| (SpreadBits3( (unsigned long)((pos.z-boxMin.z)*scale.z) ) << 2);
+		SortKeys.Push( (((octant<<30) | morton) << 31) | (unsigned long long)k );
+	}
+	std::sort( SortKeys.GetFirstEntryPtr(), SortKeys.GetFirstEntryPtr()+numRays );
+
+	PendingRay ray;
+	for ( long k=0; k<numRays; k++ ) {
+		long from = (long)( SortKeys[k] & 0x7FFFFFFF );
+		rays.GetRay( from, ray );
+		sortedRays.Add( ray, rays.Node[from] );
+	}
+}
+
+// The closest hit of each ray, as found by RayTrace().
+void WavefrontTracer::Extend( TraceContext& context, const RayQueue& rays )
+{
+	KdData data;
+	data.TraverseStack = &context.KdStack;
+	data.Mailbox = SceneMailbox( context );
+	data.Stats = &context.TraverseStats;
+	long numRays = rays.Size();
+	SetNumEntries( HitObject, numRays );
+	SetNumEntries( HitDist, numRays );
+	SetNumEntries( HitPoint, numRays );
+	for ( long k=0; k<numRays; k++ ) {
+		HitObject[k] = SeekIntersectionKd( &data, rays.Pos[k], rays.Dir[k], &HitDist[k], HitPoint[k], rays.AvoidK[k] );
+	}
+}
+
+// The shadow feelers of CalcAllDirectIllum(), cast for one light at a time.
+void WavefrontTracer::Shadow( TraceContext& context, const RayQueue& rays )
+{
+	KdData data;
+	data.TraverseStack = &context.KdStack;
+	data.Mailbox = SceneMailbox( context );
+	data.Stats = &context.TraverseStats;
+	long numRays = rays.Size();
+	int numLights = ActiveScene->NumLights();
+	if ( numRays*numLights>LightsClearSize ) {
+		delete[] LightsClear;
+		LightsClearSize = Max( 2*LightsClearSize, numRays*numLights );
+		LightsClear = new unsigned char[LightsClearSize];
+	}
+	for ( int lt=0; lt<numLights; lt++ ) {
+		const Light& thisLight = ActiveScene->GetLight(lt);
+		for ( long k=0; k<numRays; k++ ) {
+			if ( HitObject[k]<0 ) {
+				continue;
+			}
+			const VisiblePoint& visPoint = HitPoint[k];
+			bool clearpath = FacesLight( rays.Pos[k], visPoint, thisLight )
+							 && !LightCulled( thisLight, visPoint.GetPosition() )
+							 && ShadowFeelerKd( &data, visPoint.GetPosition(), thisLight, HitObject[k] );
+			LightsClear[k*numLights+lt] = clearpath ? 1 : 0;
+		}
+	}
+}
+
+// The term of each ray in the color of its camera ray, as added by RayTrace(),
+//	 and the rays of the next generation.
+void WavefrontTracer::Shade( const RenderOptions& options, const RayQueue& rays, RayQueue& nextRays )
+{
+	long numRays = rays.Size();
+	int numLights = ActiveScene->NumLights();
+	PendingRay ray;
+	PendingRay secondary[2];
+	VectorR3 directColor;
+	for ( long k=0; k<numRays; k++ ) {
+		long node = rays.Node[k];
+		if ( HitObject[k]<0 ) {
+			NodeTerm[node] = ArrayProd( rays.Weight[k], ActiveScene->BackgroundColor() );
+			continue;
+		}
+		rays.GetRay( k, ray );
+
+		// Attenuation inside a translucent material.
+		if ( ray.Translucent > 0.0000001 ) {
+			ray.Weight *= exp(-1 * ray.Translucent * HitDist[k]);
+		}
+		CalcAllDirectIllum( 0, ray.Pos, HitPoint[k], directColor, HitObject[k],
+							LightsClear+k*numLights );
+		NodeTerm[node] = ArrayProd( ray.Weight, directColor );
+		if ( ray.TraceDepth <= 1 ) {
+			continue;
+		}
+
+		int numSecondary = SpawnSecondaryRays( options, ray, HitPoint[k], HitObject[k], secondary );
+		for ( int n=0; n<numSecondary; n++ ) {
+			long child = AddNode();
+			NodeChild[2*node+n] = child;
+			nextRays.Add( secondary[n], child );
+		}
+	}
+}
+
+// Adds the terms of each ray tree in the order of RayTrace(): a ray's term,
+//	 then those of its reflected ray's tree, then those of its transmitted ray's tree.
+void WavefrontTracer::SumTerms()
+{
+	SetNumEntries( Colors, NumCameraRays );
+	for ( long k=0; k<NumCameraRays; k++ ) {
+		VectorR3& color = Colors[k];
+		color.SetZero();
+		SumStack.Reset();
+		SumStack.Push( k );
+		while ( SumStack.SizeUsed()>0 ) {
+			long node = SumStack.Pop();
+			color += NodeTerm[node];
+			for ( int n=1; n>=0; n-- ) {
+				if ( NodeChild[2*node+n]>=0 ) {
+					SumStack.Push( NodeChild[2*node+n] );
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,168 @@
+/*
+ *
+ * RayTrace Software Package, release 3.2.  May 3, 2007.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.  Please acknowledge
+ *   all use of the software in any publications or products based on it.
+ *
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ */
+
+// Wavefront.h
+//   Traces a batch of camera rays stage by stage, instead of tracing the
+//	 tree of rays of one camera ray to completion before starting the next.
+//
+//	 The rays are traced in generations: the camera rays, then the rays
+//	 they reflect and transmit, and so on.  Each generation goes through
+//	 the stages in turn, each stage running over all of its rays:
+//		Extend:  the closest hit of each ray, with its visible point.
+//		Shadow:  the shadow feelers from the hits, one light at a time.
+//		Shade:   the direct illumination of each hit, and the reflected and
+//				 transmitted rays (see SpawnSecondaryRays()), which form
+//				 the next generation.
+//	 The rays and the hits are kept with one array for each value.
+//
+//	 With options.SortSecondaryRays, the reflected and transmitted rays of
+//	 each generation are sorted before they are traced: by the octant of
+//	 their direction, and then by their origin, along a Morton curve through
+//	 the box holding the origins.  Rays that start close together and go the
+//	 same way are then traced one after another, and so visit mostly the same
+//	 kd-tree nodes and objects.
+//
+//	 The color of a camera ray is the sum of one term for each ray of its
+//	 tree.  The terms are added once the last generation is done, in the
+//	 order RayTrace() adds them, so the colors are exactly those of RayTrace().
+
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "RayTraceRender.h"
+#include "../DataStructs/Array.h"
+#include "../Graphics/VisiblePoint.h"
+
+class WavefrontTracer {
+public:
+	WavefrontTracer();
+	~WavefrontTracer() { delete[] LightsClear; }
+
+	// Start a new batch of camera rays
+	void Reset();
+	// Add a camera ray to the batch.  Returns its number in the batch.
+	long AddCameraRay( const VectorR3& pos, const VectorR3& dir, const SampleStream& samples );
+	long GetNumCameraRays() const { return NumCameraRays; }
+
+	// Trace the rays of the batch.  Then GetColor(k) is the color that
+	//	 RayTrace() returns for camera ray number k.
+	void Trace( TraceContext& context, const RenderOptions& options );
+	const VectorR3& GetColor( long k ) const { return Colors[k]; }
+
+	long GetNumGenerations() const { return NumGenerations; }
+
+private:
+	// The rays of one generation, with one array for each value of PendingRay.
+	//	 Node is the ray's node in the ray trees.
+	class RayQueue {
+	public:
+		Array<VectorR3> Pos;
+		Array<VectorR3> Dir;
+		Array<VectorR3> Weight;
+		Array<double> Translucent;
+		Array<double> Eta;
+		Array<long> AvoidK;
+		Array<int> TraceDepth;
+		Array<SampleStream> Samples;
+		Array<long> Node;
+
+		void Reset();
+		long Size() const { return Node.SizeUsed(); }
+		void Add( const PendingRay& ray, long node );
+		void GetRay( long k, PendingRay& ray ) const;
+	};
+
+	RayQueue Queue[2];			// The current generation and the next
+	Array<unsigned long long> SortKeys;		// The sort key of each ray, then its place in the queue
+	long NumCameraRays;
+	long NumGenerations;
+
+	// The hits of the current generation, one for each ray
+	Array<long> HitObject;				// -1 if the ray hits nothing
+	Array<double> HitDist;
+	Array<VisiblePoint> HitPoint;
+	unsigned char* LightsClear;			// One for each light, for each hit
+	long LightsClearSize;				// Number of entries allocated for LightsClear
+
+	// The ray trees.  The camera rays are nodes 0,...,NumCameraRays-1.
+	Array<VectorR3> NodeTerm;			// The ray's term in the color of its camera ray
+	Array<long> NodeChild;				// Two for each node: the reflected and
+										//   transmitted rays, in the order traced by RayTrace()
+	Array<long> SumStack;				// Used when adding the terms
+	Array<VectorR3> Colors;
+
+	long AddNode();
+	void SortRays( const RayQueue& rays, RayQueue& sortedRays );
+	void Extend( TraceContext& context, const RayQueue& rays );
+	void Shadow( TraceContext& context, const RayQueue& rays );
+	void Shade( const RenderOptions& options, const RayQueue& rays, RayQueue& nextRays );
+	void SumTerms();
+
+	WavefrontTracer( const WavefrontTracer& );			// Not copyable
+	WavefrontTracer& operator=( const WavefrontTracer& );
+};
+
+inline void WavefrontTracer::RayQueue::Reset()
+{
+	Pos.Reset();
+	Dir.Reset();
+	Weight.Reset();
+	Translucent.Reset();
+	Eta.Reset();
+	AvoidK.Reset();
+	TraceDepth.Reset();
+	Samples.Reset();
+	Node.Reset();
+}
+
+inline void WavefrontTracer::RayQueue::Add( const PendingRay& ray, long node )
+{
+	Pos.Push( ray.Pos );
+	Dir.Push( ray.Dir );
+	Weight.Push( ray.Weight );
+	Translucent.Push( ray.Translucent );
+	Eta.Push( ray.Eta );
+	AvoidK.Push( ray.AvoidK );
+	TraceDepth.Push( ray.TraceDepth );
+	Samples.Push( ray.Samples );
+	Node.Push( node );
+}
+
+inline void WavefrontTracer::RayQueue::GetRay( long k, PendingRay& ray ) const
+{
+	ray.Pos = Pos[k];
+	ray.Dir = Dir[k];
+	ray.Weight = Weight[k];
+	ray.Translucent = Translucent[k];
+	ray.Eta = Eta[k];
+	ray.AvoidK = AvoidK[k];
+	ray.TraceDepth = TraceDepth[k];
+	ray.Samples = Samples[k];
+}
+
+inline long WavefrontTracer::AddNode()
+{
+	NodeTerm.Push()->SetZero();
+	NodeChild.Push( -1 );
+	NodeChild.Push( -1 );
+	return NodeTerm.SizeUsed()-1;
+}
+
+#endif // WAVEFRONT_H
@@ -32,6 +32,7 @@
 #include "../Graphics/ViewableCylinder.h"
 #include "../Graphics/ViewableSphere.h"
 #include "../Graphics/ViewableTriangle.h"
+#include "../Graphics/ViewableTriangleMesh.h"
 
 const int numCommands = 14;
 const char* nffCommandList[numCommands] = 
@@ -94,6 +95,7 @@ bool NffFileLoader::Load( const char* filename, SceneDescription& theScene )
 						screenWidth, screenHeight, hither );
 			}
 			fclose( infile );
+			AddMeshes();
 			PrintCmdNotSupportedErrors(stderr);
 			return true;
 		}
@@ -316,11 +318,24 @@ bool NffFileLoader::ProcessFaceNFF( int numVerts, const Material* mat, FILE* inf
 	if ( !ReadVertexR3(prevVert, infile) ) {
 		return false;
 	}
+	ViewableTriangleMesh* mesh = 0;
+	long firstIdx = 0, prevIdx = 0;
+	if ( UseTriangleMeshes ) {
+		mesh = GetMesh( mat );
+		firstIdx = mesh->AddVertex( firstVert );
+		prevIdx = mesh->AddVertex( prevVert );
+	}
 	int i;
 	for ( i=2; i<numVerts; i++ ) {
 		if ( !ReadVertexR3(thisVert, infile) ) {
 			return false;
 		}
+		if ( mesh ) {
+			long thisIdx = mesh->AddVertex( thisVert );
+			mesh->AddTriangle( firstIdx, prevIdx, thisIdx );	// Adds nothing if the triangle has zero area.
+			prevIdx = thisIdx;
+			continue;
+		}
 		ViewableTriangle* vt = new ViewableTriangle();
 		vt->Init( firstVert, prevVert, thisVert );
 		if ( vt->IsWellFormed() ) {
@@ -439,12 +454,49 @@ int NffFileLoader::GetCommandNumber( char *cmd ) {
 }
 
 
+// The mesh for the triangles with material mat.  Usually the material
+//	 is the most recent one, so the search starts from the end.
+ViewableTriangleMesh* NffFileLoader::GetMesh( const Material* mat )
+{
+	for ( long i=Meshes.SizeUsed()-1; i>=0; i-- ) {
+		if ( MeshMaterials[i]==mat ) {
+			return Meshes[i];
+		}
+	}
+	ViewableTriangleMesh* mesh = new ViewableTriangleMesh();
+	mesh->SetMaterial( mat );
+	Meshes.Push( mesh );
+	MeshMaterials.Push( mat );
+	return mesh;
+}
+
+// Adds the meshes to the scene.  Called at the end of the file.
+void NffFileLoader::AddMeshes()
+{
+	for ( long i=0; i<Meshes.SizeUsed(); i++ ) {
+		Meshes[i]->FinishMesh();
+		if ( Meshes[i]->GetNumTriangles()>0 ) {
+			ScenePtr->AddViewable( Meshes[i] );
+		}
+		else {
+			delete Meshes[i];
+		}
+	}
+	Meshes.Reset();
+	MeshMaterials.Reset();
+}
+
 void NffFileLoader::Reset()
 {
 	for ( long i=0; i<UnsupportedCmds.SizeUsed(); i++ ) {
 		delete UnsupportedCmds[i];
 	}
 	UnsupportedCmds.Reset();
+	for ( long i=0; i<Meshes.SizeUsed(); i++ ) {
+		delete Meshes[i];
+	}
+	Meshes.Reset();
+	MeshMaterials.Reset();
 }
 
 void NffFileLoader::UnsupportedTooManyVerts( int maxVerts)
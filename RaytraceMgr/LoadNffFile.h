@@ -30,6 +30,7 @@
 class SceneDescription;
 class ObjFileLoader;
 class CameraView;
+class ViewableTriangleMesh;
 
 // This is the preferred method for loading from nff (neutral file format) files.
 //    Filename should usually end with ".nff".
@@ -55,6 +56,11 @@ public:
 	//		loaded into the Scene Description
 	bool IgnoreResolution;  
 
+	// If true (the default), the polygons are triangulated into one
+	//	 ViewableTriangleMesh for each material.  Otherwise, each triangle
+	//	 is a ViewableTriangle.
+	bool UseTriangleMeshes;
+
 private:
 	bool ReportUnsupportedFeatures;
 	bool UnsupFlagTooManyVerts;
@@ -97,11 +103,17 @@ private:
 
 	Array<char*> UnsupportedCmds;
 
+	Array<ViewableTriangleMesh*> Meshes;	// The meshes, if UseTriangleMeshes
+	Array<const Material*> MeshMaterials;	// The material of each mesh
+	ViewableTriangleMesh* GetMesh( const Material* mat );
+	void AddMeshes();
+
 };
 
 inline NffFileLoader::NffFileLoader()
 {
 	IgnoreResolution = true;		// By default, ignore the view resolution specification
+	UseTriangleMeshes = true;
 
 	ReportUnsupportedFeatures = true;
 	UnsupFlagTooManyVerts = false;
@@ -28,6 +28,7 @@
 
 #include "../Graphics/ViewableParallelogram.h"
 #include "../Graphics/ViewableTriangle.h"
+#include "../Graphics/ViewableTriangleMesh.h"
 
 const int numCommands = 4;
 const char* commandList[numCommands] = 
@@ -62,6 +63,7 @@ bool ObjFileLoader::Load( const char* filename, SceneDescription& theScene )
 	while ( true ) {
 		if ( !fgets( inbuffer, 1026, infile ) ) {
 			fclose( infile );
+			AddMesh();
 			PrintCmdNotSupportedErrors(stderr);
 			return true;
 		}
@@ -73,6 +75,7 @@ bool ObjFileLoader::Load( const char* filename, SceneDescription& theScene )
 		}
 
 		char theCommand[17];
+		sscanf( findStart, "%16s", theCommand );
 		int cmdNum = GetCommandNumber( theCommand );		
 		if ( cmdNum==-1 ) {
 			AddUnsupportedCmd( theCommand );
@@ -85,6 +88,7 @@ bool ObjFileLoader::Load( const char* filename, SceneDescription& theScene )
 			{
 				VectorR4* vertData = Vertices.Push();
 				ReadVectorR4Hg ( args, vertData );
+				MeshVertexNums.Push( -1 );
 			}
 			break;
 		case 1:   // "vt" command
@@ -318,12 +322,20 @@ bool ObjFileLoader::ProcessFace( char* inbuf)
 			return false;
 		}
 		else {
-			vA.SetFromHg( Vertices[i1] );
-			vB.SetFromHg( Vertices[i2] );
-			vC.SetFromHg( Vertices[i3] );
 			startIdx = idx3;
 			assert ( 0 <= idx2 && idx2 < numVertsInFace );
 			assert ( 0 <= idx3 && idx3 < numVertsInFace );
+			if ( UseTriangleMeshes ) {
+				if ( !Mesh ) {
+					Mesh = new ViewableTriangleMesh();
+				}
+				// Adds nothing if the triangle has zero area.
+				Mesh->AddTriangle( GetMeshVertex(i1), GetMeshVertex(i2), GetMeshVertex(i3) );
+				continue;
+			}
+			vA.SetFromHg( Vertices[i1] );
+			vB.SetFromHg( Vertices[i2] );
+			vC.SetFromHg( Vertices[i3] );
 			ViewableTriangle* vt = new ViewableTriangle();
 			vt->Init( vA, vB, vC );
 			if ( vt->IsWellFormed() ) {
@@ -374,6 +386,34 @@ bool ObjFileLoader::ProcessFace( char* inbuf)
 	return true;
 }
 
+// The mesh index of vertex vertNum (counting from zero).  The mesh gets
+//	 only the vertices used by its triangles.
+long ObjFileLoader::GetMeshVertex( long vertNum )
+{
+	long& meshNum = MeshVertexNums[vertNum];
+	if ( meshNum<0 ) {
+		VectorR3 v;
+		v.SetFromHg( Vertices[vertNum] );
+		meshNum = Mesh->AddVertex( v );
+	}
+	return meshNum;
+}
+
+// Adds the mesh, if any, to the scene.  Called at the end of the file.
+void ObjFileLoader::AddMesh()
+{
+	if ( Mesh ) {
+		Mesh->FinishMesh();
+		if ( Mesh->GetNumTriangles()>0 ) {
+			ScenePtr->AddViewable( Mesh );
+		}
+		else {
+			delete Mesh;
+		}
+		Mesh = 0;
+	}
+}
+
 int ObjFileLoader::NextTriVertIdx( int start, int* step, int totalNum )
 {
 	int retIdx = start + (*step);
@@ -388,6 +428,9 @@ void ObjFileLoader::Reset()
 {
 	Vertices.Reset();
 	TextureCoords.Reset();
+	MeshVertexNums.Reset();
+	delete Mesh;
+	Mesh = 0;
 	// VertexNormals.Reset();
 	for ( long i=0; i<UnsupportedCmds.SizeUsed(); i++ ) {
 		delete UnsupportedCmds[i];
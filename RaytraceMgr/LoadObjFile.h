@@ -29,6 +29,7 @@
 
 class SceneDescription;
 class ObjFileLoader;
+class ViewableTriangleMesh;
 
 // This is the preferred method for loading from obj files.
 //    Filename should end with ".obj".
@@ -50,6 +51,10 @@ public:
 	//  items, they are left unchanged.)
 	bool Load( const char* filename, SceneDescription& theScene );
 
+	// If true (the default), the triangles are put in one ViewableTriangleMesh
+	//	 that shares the file's vertices.  Otherwise, each is a ViewableTriangle.
+	bool UseTriangleMeshes;
+
 private:
 	bool ReportUnsupportedFeatures;
 	bool UnsupFlagTextureDepth;
@@ -82,6 +87,11 @@ private:
 	Array<VectorR2> TextureCoords;		// Texture coordinates not supported yet
 	Array<VectorR3> VertexNormals;		// Vertex normals not supported yet
 
+	ViewableTriangleMesh* Mesh;			// The triangles, if UseTriangleMeshes.  Null until the first triangle.
+	Array<long> MeshVertexNums;			// For each vertex: its index in Mesh, or -1 if not yet used
+	long GetMeshVertex( long vertNum );
+	void AddMesh();
+
 	Array<char*> UnsupportedCmds;
 
 };
@@ -92,6 +102,8 @@ inline ObjFileLoader::ObjFileLoader()
 	UnsupFlagTextureDepth = false;
 	UnsupFlagTooManyVerts = false;
 	UnsupFlagLines = false;
+	UseTriangleMeshes = true;
+	Mesh = 0;
 }
 
 
@@ -78,6 +78,10 @@ void SceneDescription::DeleteAllViewables()
 	for ( i=NumViewables(); i>0; i-- ) {
 		delete ViewableArray.Pop();
 	}
+	ViewableTypes.Reset();
+	ViewableMesh.Reset();
+	FirstPrimitive.Reset();
+	PrimitiveViewable.Reset();
 }
 
 
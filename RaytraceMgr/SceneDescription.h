@@ -37,6 +37,7 @@
 #include "../Graphics/TextureSequence.h"
 #include "../Graphics/BumpMapFunction.h"
 #include "../Graphics/ViewableBase.h"
+#include "../Graphics/ViewableTriangleMesh.h"
 
 class SceneDescription
 {
@@ -128,6 +129,24 @@ public:
 	Array<ViewableBase*>& GetViewableArray() { return ViewableArray; }
 	const Array<ViewableBase*>& GetViewableArray() const { return ViewableArray; }
 
+	// Primitives are the objects held by the kd-tree or BVH.  Each viewable
+	//	 is one primitive, except that each triangle of a ViewableTriangleMesh
+	//	 is a separate primitive.  A mesh must be finished before it is added.
+	long NumPrimitives() const { return PrimitiveViewable.SizeUsed(); }
+	int GetPrimitiveViewable( long prim ) const { return PrimitiveViewable[prim]; }
+	ViewableBase::ViewableType GetPrimitiveType( long prim ) const { return ViewableTypes[PrimitiveViewable[prim]]; }
+	const ViewableTriangleMesh* GetPrimitiveMesh( long prim ) const { return ViewableMesh[PrimitiveViewable[prim]]; }
+	long GetPrimitiveTriangle( long prim ) const;	// Triangle number in the mesh, -1 if not a mesh
+	// Same as the ViewableBase routines, for a single primitive
+	bool PrimitiveIntersectionDistance( long prim, const VectorR3& viewPos, const VectorR3& viewDir,
+										double maxDistance, double *intersectDistance ) const;
+	bool PrimitiveIntersectsSegment( long prim, const VectorR3& viewPos, const VectorR3& viewDir,
+									 double maxDistance ) const;
+	bool PrimitiveVisiblePoint( long prim, const VectorR3& viewPos, const VectorR3& viewDir,
+								double hitDistance, VisiblePoint& returnedPoint ) const;
+	void CalcPrimitiveAABB( long prim, AABB& retAABB ) const;
+	bool CalcPrimitiveExtentsInBox( long prim, const AABB& boundingAABB, AABB& retAABB ) const;
+
 	void DeleteAllLights();
 	void DeleteAllTextures();
 	void DeleteAllMaterials();
@@ -152,6 +171,11 @@ private:
 
 	Array<ViewableBase*> ViewableArray;
 
+	Array<ViewableBase::ViewableType> ViewableTypes;	// For each viewable: its type
+	Array<const ViewableTriangleMesh*> ViewableMesh;	// For each viewable: the mesh, or null if not a mesh
+	Array<long> FirstPrimitive;							// For each viewable: its first primitive
+	Array<int> PrimitiveViewable;						// For each primitive: its viewable
+
 };
 
 inline SceneDescription::SceneDescription()
@@ -202,9 +226,89 @@ inline int SceneDescription::AddViewable( ViewableBase* newViewable )
 { 
 	int index = (int)ViewableArray.SizeUsed();
 	ViewableArray.Push( newViewable );
+	const ViewableTriangleMesh* mesh = 0;
+	long numPrimitives = 1;
+	ViewableTypes.Push( newViewable->GetViewableType() );
+	if ( newViewable->GetViewableType()==ViewableBase::Viewable_TriangleMesh ) {
+		mesh = (const ViewableTriangleMesh*)newViewable;
+		assert( mesh->IsFinished() );
+		numPrimitives = mesh->GetNumTriangles();
+	}
+	ViewableMesh.Push( mesh );
+	FirstPrimitive.Push( NumPrimitives() );
+	for ( long i=0; i<numPrimitives; i++ ) {
+		PrimitiveViewable.Push( index );
+	}
 	return index;
 }
 
+inline long SceneDescription::GetPrimitiveTriangle( long prim ) const
+{
+	int viewableNum = PrimitiveViewable[prim];
+	return ( ViewableMesh[viewableNum] ? prim-FirstPrimitive[viewableNum] : -1 );
+}
+
+inline bool SceneDescription::PrimitiveIntersectionDistance( long prim, const VectorR3& viewPos, const VectorR3& viewDir,
+															 double maxDistance, double *intersectDistance ) const
+{
+	int viewableNum = PrimitiveViewable[prim];
+	const ViewableTriangleMesh* mesh = ViewableMesh[viewableNum];
+	if ( mesh ) {
+		return mesh->FindTriangleIntersectionDistance( prim-FirstPrimitive[viewableNum], viewPos, viewDir,
+													   maxDistance, intersectDistance );
+	}
+	return ViewableArray[viewableNum]->FindIntersectionDistance( viewPos, viewDir, maxDistance, intersectDistance );
+}
+
+inline bool SceneDescription::PrimitiveIntersectsSegment( long prim, const VectorR3& viewPos, const VectorR3& viewDir,
+														  double maxDistance ) const
+{
+	int viewableNum = PrimitiveViewable[prim];
+	const ViewableTriangleMesh* mesh = ViewableMesh[viewableNum];
+	if ( mesh ) {
+		double hitDistance;
+		return mesh->FindTriangleIntersectionDistance( prim-FirstPrimitive[viewableNum], viewPos, viewDir,
+													   maxDistance, &hitDistance );
+	}
+	return ViewableArray[viewableNum]->IntersectsSegment( viewPos, viewDir, maxDistance );
+}
+
+// As in ViewableBase::CalcVisiblePoint, the hit is found again with maxDistance just beyond it.
+inline bool SceneDescription::PrimitiveVisiblePoint( long prim, const VectorR3& viewPos, const VectorR3& viewDir,
+													 double hitDistance, VisiblePoint& returnedPoint ) const
+{
+	int viewableNum = PrimitiveViewable[prim];
+	const ViewableTriangleMesh* mesh = ViewableMesh[viewableNum];
+	if ( mesh ) {
+		double intersectDistance;
+		return mesh->FindTriangleIntersection( prim-FirstPrimitive[viewableNum], viewPos, viewDir,
+											   hitDistance+1.0e-9*(1.0+hitDistance), &intersectDistance, returnedPoint );
+	}
+	return ViewableArray[viewableNum]->CalcVisiblePoint( viewPos, viewDir, hitDistance, returnedPoint );
+}
+
+inline void SceneDescription::CalcPrimitiveAABB( long prim, AABB& retAABB ) const
+{
+	int viewableNum = PrimitiveViewable[prim];
+	const ViewableTriangleMesh* mesh = ViewableMesh[viewableNum];
+	if ( mesh ) {
+		mesh->CalcTriangleAABB( prim-FirstPrimitive[viewableNum], retAABB );
+	}
+	else {
+		ViewableArray[viewableNum]->CalcAABB( retAABB );
+	}
+}
+
+inline bool SceneDescription::CalcPrimitiveExtentsInBox( long prim, const AABB& boundingAABB, AABB& retAABB ) const
+{
+	int viewableNum = PrimitiveViewable[prim];
+	const ViewableTriangleMesh* mesh = ViewableMesh[viewableNum];
+	if ( mesh ) {
+		return mesh->CalcTriangleExtentsInBox( prim-FirstPrimitive[viewableNum], boundingAABB, retAABB );
+	}
+	return ViewableArray[viewableNum]->CalcExtentsInBox( boundingAABB, retAABB );
+}
+
 inline TextureAffineXform* SceneDescription::NewTextureAffineXform() 
 { 
 	TextureAffineXform* newTex = new TextureAffineXform();